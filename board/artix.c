@@ -32,11 +32,16 @@
 #include "../util.h"
 #include "../stim.h"
 #include "../profile.h"
+#include "../subvec.h"
+#include "../resident.h"
+#include "../perf.h"
 #include "artix.h"
 #include "helper.h"
 #include "dma.h"
+#include "dev.h"
 #include "subcore.h"
 #include "driver.h"
+#include "../lib/uthash/uthash.h"
 
 
 static void subcore_prep_dma_write(enum artix_selects artix_select, uint32_t num_bursts){
@@ -65,6 +70,8 @@ static void subcore_prep_dma_write(enum artix_selects artix_select, uint32_t num
 void artix_mem_write(enum artix_selects artix_select,
         uint64_t addr, uint64_t *write_data, size_t write_size){
     uint64_t *dma_buf;
+    uint64_t start_ns = perf_now_ns();
+    uint64_t duration_ns = 0;
 
     // address can't be greater than artix memory capacity
     // and you need to send at least one burst (1024 bytes)
@@ -78,6 +85,7 @@ void artix_mem_write(enum artix_selects artix_select,
             "the max size we can allocate %zu.", write_size, (size_t)MAX_CHUNK_SIZE);
     }
 
+    gcore_dev_lock();
     // each burst is 1024 bytes
     uint32_t num_bursts = (write_size / BURST_BYTES);
 
@@ -126,10 +134,10 @@ void artix_mem_write(enum artix_selects artix_select,
 
         uint32_t num_chunks = (write_size/DMA_SIZE);
 
-        // send chunks of max buffer size
+        // send chunks of max buffer size, each slice overwrites the
+        // whole buffer so the dma config is reused
         for(int i=0; i<num_chunks; i++){
             slog_debug("writing %i bytes...", DMA_SIZE);
-            memset(dma_buf, 0, DMA_SIZE);
             memcpy(dma_buf, ((uint8_t*)write_data)+(i*DMA_SIZE), DMA_SIZE);
             gcore_dma_prep(dma_buf, DMA_SIZE, NULL, 0);
             gcore_dma_start(GCORE_WAIT_TX);
@@ -181,20 +189,20 @@ void artix_mem_write(enum artix_selects artix_select,
         }
     }
 
-//#ifdef GEM_DEBUG
-//    for(int i=0; i<32;i++){
-//        slog_debug("dma_buf %02i: 0x%016" PRIX64 "", i, write_data[i]);
-//    }
-//#endif
-
     // subcore must be idle
     subcore_idle();
 
     // reset burst count
     helper_gvpu_load(artix_select, TEST_CLEANUP);
 
+    duration_ns = perf_now_ns() - start_ns;
+    gcore_dev_add_mem_xfer(true, write_size, duration_ns);
+    slog_debug("wrote %zu bytes in %" PRIu64 " us (%.2f MB/s)", write_size,
+        duration_ns/1000, gcore_dev_calc_mbps(write_size, duration_ns));
+
     // debug status
     helper_print_agent_status(artix_select);
+    gcore_dev_unlock();
     return;
 }
 
@@ -237,6 +245,8 @@ static void subcore_prep_dma_read(enum artix_selects artix_select, uint32_t num_
 void artix_mem_read(enum artix_selects artix_select, uint64_t addr,
         uint64_t *read_data, size_t read_size){
     uint64_t *dma_buf;
+    uint64_t start_ns = perf_now_ns();
+    uint64_t duration_ns = 0;
 
     // 
     if(read_size > MAX_CHUNK_SIZE){
@@ -252,6 +262,7 @@ void artix_mem_read(enum artix_selects artix_select, uint64_t addr,
         num_bursts = num_bursts + 1;
     }
 
+    gcore_dev_lock();
     // setup memcore with start_addr and num_bursts will read
     helper_burst_setup(artix_select, addr, num_bursts);
 
@@ -286,7 +297,6 @@ void artix_mem_read(enum artix_selects artix_select, uint64_t addr,
         // receive chunks of DMA_SIZE
         for(int i=0; i<num_chunks;i++){
             slog_debug("reading %i bytes...", DMA_SIZE);
-            memset(dma_buf, 0, DMA_SIZE);
             gcore_dma_prep(NULL, 0, dma_buf, DMA_SIZE);
             subcore_prep_dma_read(artix_select, DMA_SIZE/BURST_BYTES);
             gcore_dma_start(GCORE_WAIT_RX);
@@ -345,19 +355,90 @@ void artix_mem_read(enum artix_selects artix_select, uint64_t addr,
         
     }
 
-//#ifdef GEM_DEBUG
-//    for(int i=0; i<32;i++){
-//        slog_debug("dma_buf %02i: 0x%016" PRIX64 "", i, read_data[i]);
-//    }
-//#endif
-
     // wait for idle state
     subcore_idle();
 
     // reset burst count
     helper_gvpu_load(artix_select, TEST_CLEANUP);
 
+    duration_ns = perf_now_ns() - start_ns;
+    gcore_dev_add_mem_xfer(false, read_size, duration_ns);
+    slog_debug("read %zu bytes in %" PRIu64 " us (%.2f MB/s)", read_size,
+        duration_ns/1000, gcore_dev_calc_mbps(read_size, duration_ns));
+
     helper_print_agent_status(artix_select);
+    gcore_dev_unlock();
+    return;
+}
+
+/*
+ * Copies size bytes within one unit's memory from src_addr to dst_addr
+ * through a host bounce buffer, since the units can't copy on their 
+ * own. Copies front to back, so overlapping ranges are only safe when
+ * dst_addr is below src_addr. Addrs and size must be burst aligned.
+ *
+ */
+void artix_mem_copy(enum artix_selects artix_select, uint64_t dst_addr, 
+        uint64_t src_addr, uint64_t size){
+    uint64_t *copy_buf = NULL;
+    uint64_t copy_size = 0;
+    uint64_t offset = 0;
+
+    if(artix_select != ARTIX_SELECT_A1 && artix_select != ARTIX_SELECT_A2){
+        die("invalid artix unit selected");
+    }
+    if(dst_addr % BURST_BYTES != 0 || src_addr % BURST_BYTES != 0 
+            || size % BURST_BYTES != 0){
+        die("artix mem copy must be burst aligned");
+    }
+    if(dst_addr > src_addr && dst_addr < src_addr+size){
+        die("artix mem copy can't move up over itself");
+    }
+    if(dst_addr == src_addr || size == 0){
+        return;
+    }
+
+    if((copy_buf = (uint64_t*)malloc(ARTIX_MEM_COPY_SIZE)) == NULL){
+        die("error: malloc failed");
+    }
+
+    gcore_dev_lock();
+    slog_info("copying %" PRIu64 " bytes from 0x%016" PRIX64 " to 0x%016" PRIX64 "...", 
+        size, src_addr, dst_addr);
+
+    while(offset < size){
+        copy_size = size-offset;
+        if(copy_size > ARTIX_MEM_COPY_SIZE){
+            copy_size = ARTIX_MEM_COPY_SIZE;
+        }
+        artix_mem_read(artix_select, src_addr+offset, copy_buf, (size_t)copy_size);
+        artix_mem_write(artix_select, dst_addr+offset, copy_buf, (size_t)copy_size);
+        offset += copy_size;
+    }
+
+    free(copy_buf);
+    gcore_dev_unlock();
+    return;
+}
+
+/*
+ * Last enable pins burst written to each unit with TEST_SETUP. It mirrors
+ * the gvpu rather than any one prgm, so it's shared by every prgm. Dropped
+ * by anything that resets or reuses the gvpu: configuring, the mem test
+ * and bench, and a subcore reset (caught through the reset count).
+ *
+ */
+static uint8_t artix_last_enable_pins[2][BURST_BYTES];
+static bool artix_has_last_enable_pins[2] = {false, false};
+static uint64_t artix_last_enable_pins_resets[2] = {0, 0};
+
+static void artix_drop_enable_pins(enum artix_selects artix_select){
+    if(artix_select == ARTIX_SELECT_A1 || artix_select == ARTIX_SELECT_BOTH){
+        artix_has_last_enable_pins[0] = false;
+    }
+    if(artix_select == ARTIX_SELECT_A2 || artix_select == ARTIX_SELECT_BOTH){
+        artix_has_last_enable_pins[1] = false;
+    }
     return;
 }
 
@@ -530,11 +611,9 @@ void static artix_load_mem_test_data(enum artix_selects artix_select, bool run_c
         }
         start_burst += num_bursts;
 
-#ifdef GEM_DEBUG
-        if(i == 0){
+        if(i == 0 && GCORE_LOG_DEBUG_ENABLED()){
             debug_print_dma_burst(run_crc, chunk, chunk_size);
         }
-#endif
 
         slog_info("writing mem data chunk %" PRId64 " of %" PRId64 " to rank:0x%X addr:0x%08X...", 
             i+1, num_chunks, GET_START_RANK(addr), GET_START_ADDR(addr));
@@ -580,9 +659,9 @@ struct mem_test_check static artix_check_mem_test_data(enum artix_selects artix_
     for(uint32_t i=0; i<num_chunks; i++){
         artix_mem_read(artix_select, addr, read_data, chunk_size);
 
-#ifdef GEM_DEBUG
-        debug_print_dma_burst(run_crc, read_data, chunk_size);
-#endif
+        if(GCORE_LOG_DEBUG_ENABLED()){
+            debug_print_dma_burst(run_crc, read_data, chunk_size);
+        }
 
         // re-generate write data with results not cleared out so 
         // it will match read_data
@@ -646,7 +725,7 @@ bool artix_mem_test(enum artix_selects artix_select, bool run_crc, bool full_tes
     uint64_t num_chunks = 0;
     uint64_t start_addr = 0x0000000000000000;
     uint64_t num_bursts = 0;
-    struct gcore_registers *regs = NULL;
+    struct gcore_registers regs;
     enum gvpu_states gvpu_state = GVPU_IDLE;
     time_t test_start_time;
     time_t test_end_time;
@@ -655,8 +734,13 @@ bool artix_mem_test(enum artix_selects artix_select, bool run_crc, bool full_tes
     double diff_time_secs = 0;
     bool did_test_pass = false;
 
+    gcore_dev_lock();
     slog_info("mem test starting...");
 
+    // the test overwrites tester memory and reuses the gvpu
+    resident_evict_all();
+    artix_drop_enable_pins(artix_select);
+
 #ifdef VERILATOR
     chunk_size = 1024*5; 
 #else
@@ -704,8 +788,8 @@ bool artix_mem_test(enum artix_selects artix_select, bool run_crc, bool full_tes
         time(&test_start_time);
         time(&check_start_time);
         while(1){
-            regs = subcore_get_regs();
-            gvpu_state = get_gvpu_state(artix_select, regs);
+            subcore_read_regs(&regs);
+            gvpu_state = get_gvpu_state(artix_select, &regs);
             if(gvpu_state == GVPU_IDLE){
                 time(&test_end_time);
                 break;
@@ -798,9 +882,123 @@ bool artix_mem_test(enum artix_selects artix_select, bool run_crc, bool full_tes
     slog_info("mem test done.");
     
 
+    gcore_dev_unlock();
     return did_test_pass;
 }
 
+static uint64_t artix_count_ioctls(struct gcore_dev_stats *stats){
+    uint64_t num_ioctls = 0;
+    for(uint32_t i=0; i<GCORE_DEV_NUM_IOCTLS; i++){
+        num_ioctls += stats->ioctls[i].count;
+    }
+    return num_ioctls;
+}
+
+/*
+ * Writes and reads back tester memory at addr 0 with transfer sizes 
+ * doubling from 1KB to MAX_CHUNK_SIZE, num_repeats times each, and 
+ * logs the MB/s and ioctls per transfer for each size. Small sizes 
+ * show the fixed cost of a transfer, large sizes the dma throughput.
+ * Sizes past ARTIX_MEM_BENCH_CHUNK_SIZE are sent as back to back chunks
+ * of it, so the host buffer never grows past one chunk.
+ *
+ * Overwrites tester memory, so it dies if a prgm has stims loaded and
+ * evicts the rest.
+ *
+ */
+void artix_mem_bench(enum artix_selects artix_select, uint32_t num_repeats){
+    struct gcore_dev_stats before;
+    struct gcore_dev_stats after;
+    uint64_t *data = NULL;
+    uint64_t max_size = 0;
+    uint64_t chunk_size = 0;
+    uint64_t xfer_size = 0;
+    uint64_t num_chunks = 0;
+    uint64_t start_ns = 0;
+    uint64_t write_ns = 0;
+    uint64_t read_ns = 0;
+    uint64_t num_write_ioctls = 0;
+    uint64_t num_read_ioctls = 0;
+
+    if(artix_select != ARTIX_SELECT_A1 && artix_select != ARTIX_SELECT_A2){
+        die("mem bench runs on one unit at a time");
+    }
+    if(num_repeats == 0){
+        num_repeats = 1;
+    }
+
+    gcore_dev_lock();
+    if(resident_get_num_in_use() > 0){
+        die("can't run mem bench with %u stims loaded", resident_get_num_in_use());
+    }
+
+    // the bench overwrites tester memory and reuses the gvpu
+    resident_evict_all();
+    artix_drop_enable_pins(artix_select);
+
+#ifdef VERILATOR
+    max_size = 1024*64;
+#else
+    max_size = MAX_CHUNK_SIZE;
+#endif
+
+    chunk_size = max_size;
+    if(chunk_size > ARTIX_MEM_BENCH_CHUNK_SIZE){
+        chunk_size = ARTIX_MEM_BENCH_CHUNK_SIZE;
+    }
+
+    if((data = (uint64_t *)calloc(chunk_size, sizeof(uint8_t))) == NULL){
+        die("failed to calloc mem bench data");
+    }
+    for(uint64_t i=0; i<chunk_size/sizeof(uint64_t); i++){
+        data[i] = i;
+    }
+
+    slog_info("mem bench starting...");
+    for(uint64_t size=BURST_BYTES; size<=max_size; size*=2){
+        xfer_size = size;
+        num_chunks = 1;
+        if(size > chunk_size){
+            xfer_size = chunk_size;
+            num_chunks = size/chunk_size;
+        }
+
+        gcore_dev_get_stats(&before);
+        start_ns = perf_now_ns();
+        for(uint32_t i=0; i<num_repeats; i++){
+            for(uint64_t c=0; c<num_chunks; c++){
+                artix_mem_write(artix_select, c*xfer_size, data, xfer_size);
+            }
+        }
+        write_ns = perf_now_ns() - start_ns;
+        gcore_dev_get_stats(&after);
+        num_write_ioctls = artix_count_ioctls(&after) - artix_count_ioctls(&before);
+
+        before = after;
+        start_ns = perf_now_ns();
+        for(uint32_t i=0; i<num_repeats; i++){
+            for(uint64_t c=0; c<num_chunks; c++){
+                artix_mem_read(artix_select, c*xfer_size, data, xfer_size);
+            }
+        }
+        read_ns = perf_now_ns() - start_ns;
+        gcore_dev_get_stats(&after);
+        num_read_ioctls = artix_count_ioctls(&after) - artix_count_ioctls(&before);
+
+        slog_info("mem bench %10" PRIu64 " bytes: write %8.2f MB/s (%" PRIu64 
+            " ioctls), read %8.2f MB/s (%" PRIu64 " ioctls)", size,
+            gcore_dev_calc_mbps(size*num_repeats, write_ns), 
+            num_write_ioctls/num_repeats,
+            gcore_dev_calc_mbps(size*num_repeats, read_ns), 
+            num_read_ioctls/num_repeats);
+    }
+    slog_info("mem bench done.");
+
+    free(data);
+    gcore_dev_unlock();
+    return;
+}
+
 /*
  * Given a stim and an artix select, check to see if the
  * pin's dut_io_ids are within range for given artix unit.
@@ -850,10 +1048,8 @@ uint64_t artix_load_stim(struct stim *stim, uint64_t a1_load_addr, uint64_t a2_l
     if(stim == NULL){
         die("pointer is null");
     }
-    // 2**33 = 8589934592 or 8GB of mem
-    // 8GB / 8 = 0x40000000
-    // 0x40000000-1 because addr starts at zero
-    if(a1_load_addr > (0x40000000-1)){
+    // 2**33 = 8589934592 or 8GB of mem, each addr is one byte
+    if(a1_load_addr > (ARTIX_MEM_ADDR_LIMIT-1)){
         bye("failed to load stim at addr 0x%016" PRIX64 " because out of tester memory range", a1_load_addr);
     }
 
@@ -861,7 +1057,7 @@ uint64_t artix_load_stim(struct stim *stim, uint64_t a1_load_addr, uint64_t a2_l
         bye("failed to load stim at addr 0x%016" PRIX64 " because it is not memory aligned to 1024 bytes", a1_load_addr);
     }
 
-    if(a2_load_addr > (0x40000000-1)){
+    if(a2_load_addr > (ARTIX_MEM_ADDR_LIMIT-1)){
         bye("failed to load stim at addr 0x%016" PRIX64 " because out of tester memory range", a2_load_addr);
     }
 
@@ -870,6 +1066,7 @@ uint64_t artix_load_stim(struct stim *stim, uint64_t a1_load_addr, uint64_t a2_l
     }
 
 
+    gcore_dev_lock();
     for(int i=0; i<2; i++){
         if(stim_get_mode(stim) == STIM_MODE_DUAL){
             if(i == 0){
@@ -918,27 +1115,138 @@ uint64_t artix_load_stim(struct stim *stim, uint64_t a1_load_addr, uint64_t a2_l
         helper_gvpu_load(artix_select, TEST_CLEANUP);
     }
 
+    gcore_dev_unlock();
+
     // number of loaded bytes is same if loading dual so just return last
     return num_loaded_bytes;
 }
 
+/*
+ * Builds the TEST_INIT params and enable pins bursts for a stim loaded
+ * at the given addrs so repeat runs don't have to.
+ *
+ */
+struct artix_stim_setup *artix_create_stim_setup(struct stim *stim, 
+        uint64_t a1_addr, uint64_t a2_addr){
+    return artix_create_stim_site_setup(stim, a1_addr, a2_addr, -1);
+}
+
+/*
+ * Same as artix_create_stim_setup but only enables the pins wired to 
+ * dut_id, so the loaded stim can be run for one site at a time. Only 
+ * the units with pins on the dut are used. Returns NULL if the stim has
+ * no pins on the dut.
+ *
+ */
+struct artix_stim_setup *artix_create_stim_site_setup(struct stim *stim, 
+        uint64_t a1_addr, uint64_t a2_addr, int32_t dut_id){
+    struct artix_stim_setup *setup = NULL;
+    enum stim_modes stim_mode = STIM_MODE_NONE;
+    uint32_t num_a1_pins = 0;
+    uint32_t num_a2_pins = 0;
+
+    if(stim == NULL){
+        die("pointer is NULL");
+    }
+
+    if((setup = (struct artix_stim_setup*)calloc(1, sizeof(struct artix_stim_setup))) == NULL){
+        die("error: calloc failed");
+    }
+
+    setup->stim = stim;
+    setup->dut_id = dut_id;
+    setup->a1_addr = a1_addr;
+    setup->a2_addr = a2_addr;
+    setup->num_vecs = (stim->num_vecs+stim->num_padding_vecs);
+    setup->a1_enable_pins = NULL;
+    setup->a2_enable_pins = NULL;
+
+    stim_mode = stim_get_mode(stim);
+    if(stim_mode == STIM_MODE_DUAL || stim_mode == STIM_MODE_A1){
+        if((setup->a1_enable_pins = stim_get_dut_enable_pins_data(stim, 
+                ARTIX_SELECT_A1, dut_id, &num_a1_pins)) == NULL){
+            die("failed to alloc enable_pins");
+        }
+    }
+    if(stim_mode == STIM_MODE_DUAL || stim_mode == STIM_MODE_A2){
+        if((setup->a2_enable_pins = stim_get_dut_enable_pins_data(stim, 
+                ARTIX_SELECT_A2, dut_id, &num_a2_pins)) == NULL){
+            die("failed to alloc enable_pins");
+        }
+    }
+
+    // a site only runs on the units its pins are on
+    if(dut_id >= 0){
+        if(setup->a1_enable_pins != NULL && num_a1_pins == 0){
+            free(setup->a1_enable_pins);
+            setup->a1_enable_pins = NULL;
+        }
+        if(setup->a2_enable_pins != NULL && num_a2_pins == 0){
+            free(setup->a2_enable_pins);
+            setup->a2_enable_pins = NULL;
+        }
+        if(setup->a1_enable_pins == NULL && setup->a2_enable_pins == NULL){
+            free(setup);
+            return NULL;
+        }
+    }
+
+    return setup;
+}
+
+void artix_free_stim_setup(struct artix_stim_setup *setup){
+    if(setup == NULL){
+        return;
+    }
+    if(setup->a1_enable_pins != NULL){
+        free(setup->a1_enable_pins);
+    }
+    if(setup->a2_enable_pins != NULL){
+        free(setup->a2_enable_pins);
+    }
+    free(setup);
+    return;
+}
+
 /*
  * Preps the gvpu to execute a stim dut test. Must be called before every dut test.
  *  + sets the test start addr
  *  + sets total num vecs to execute
  *  + sets which pins are enabled for test
  *
+ * The enable pins burst is only sent if it differs from the last one
+ * written to the unit.
+ *
  */
-static void artix_setup_stim(struct stim *stim, enum artix_selects artix_select, 
-        uint64_t start_addr){
+static void artix_setup_stim(struct artix_stim_setup *setup, 
+        enum artix_selects artix_select){
     struct gcore_ctrl_packet packet;
     uint64_t *dma_buf;
     uint32_t num_bursts;
+    uint64_t start_addr = 0;
+    uint8_t *enable_pins = NULL;
+    uint32_t unit = 0;
 
-    if(stim == NULL){
+    if(setup == NULL){
         die("pointer is NULL");
     }
 
+    if(artix_select == ARTIX_SELECT_A1){
+        unit = 0;
+        start_addr = setup->a1_addr;
+        enable_pins = setup->a1_enable_pins;
+    }else if(artix_select == ARTIX_SELECT_A2){
+        unit = 1;
+        start_addr = setup->a2_addr;
+        enable_pins = setup->a2_enable_pins;
+    }else{
+        die("invalid artix unit selected");
+    }
+
+    if(enable_pins == NULL){
+        die("no enable pins setup for stim");
+    }
+
     // check if dut_io_id is within range for given artix
     //assert_dut_io_range(stim, artix_select);
 
@@ -946,9 +1254,18 @@ static void artix_setup_stim(struct stim *stim, enum artix_selects artix_select,
     helper_gvpu_load(artix_select, TEST_INIT);
     packet.rank_select = GET_START_RANK(start_addr);
     packet.addr = GET_START_ADDR(start_addr);
-    packet.data = (stim->num_vecs+stim->num_padding_vecs);
+    packet.data = setup->num_vecs;
     helper_gvpu_packet_write(artix_select, &packet);
 
+    // enable pins haven't changed since the last test
+    if(artix_has_last_enable_pins[unit] 
+            && artix_last_enable_pins_resets[unit] == subcore_get_num_resets()
+            && memcmp(artix_last_enable_pins[unit], enable_pins, BURST_BYTES) == 0){
+        slog_debug("enable pins unchanged, skipping test setup");
+        helper_gvpu_load(artix_select, TEST_CLEANUP);
+        return;
+    }
+
     // perform test setup by writing enable_pins burst
     helper_gvpu_load(artix_select, TEST_SETUP);
     helper_agent_load(artix_select, GVPU_WRITE);
@@ -963,11 +1280,6 @@ static void artix_setup_stim(struct stim *stim, enum artix_selects artix_select,
     size_t burst_size = num_bursts*BURST_BYTES;
     slog_debug("sending setup burst (%i bytes)...", burst_size);
 
-    uint8_t *enable_pins = NULL;
-    if((enable_pins = stim_get_enable_pins_data(stim, artix_select)) == NULL){
-        die("failed to alloc enable_pins");
-    }
-
     // Note: no need to swap the endianess of enable_pins because of the
     // way 64 bit words are packed in agent, gvpu and memcore
 
@@ -976,14 +1288,17 @@ static void artix_setup_stim(struct stim *stim, enum artix_selects artix_select,
     memset(dma_buf, 0xffffffff, burst_size);
     memcpy(dma_buf, enable_pins, burst_size);
 
-#ifdef GEM_DEBUG
-    for(int i=0; i<32;i++){
-        slog_debug("pin_enable %02i: 0x%016" PRIX64 "", i, dma_buf[i]);
+    if(GCORE_LOG_DEBUG_ENABLED()){
+        for(int i=0; i<32;i++){
+            slog_debug("pin_enable %02i: 0x%016" PRIX64 "", i, dma_buf[i]);
+        }
     }
-#endif
 
     gcore_dma_prep_start(GCORE_WAIT_TX, dma_buf, burst_size, NULL, 0);
-    free(enable_pins);
+
+    memcpy(artix_last_enable_pins[unit], enable_pins, BURST_BYTES);
+    artix_has_last_enable_pins[unit] = true;
+    artix_last_enable_pins_resets[unit] = subcore_get_num_resets();
 
     // reset cycle count and failed flag
     helper_gvpu_load(artix_select, TEST_CLEANUP);
@@ -992,43 +1307,37 @@ static void artix_setup_stim(struct stim *stim, enum artix_selects artix_select,
 }
 
 /*
- * Queries both A1 and A2 for fail pins. Returns an array with len 400.
- * If stim is solo pattern check A1 or A2. If stim is dual check entire array.
+ * Reads the fail pins of the selected units into fail_pins, indexed by
+ * dut_io_id. Units not selected aren't touched on the board, so one can
+ * still be running while the other is read.
  *
  */
-void artix_get_stim_fail_pins(uint8_t **fail_pins, uint32_t *num_fail_pins){
+static void artix_read_fail_pins(enum artix_selects artix_select, uint8_t *fail_pins){
     uint64_t *dma_buf = NULL;
     uint32_t num_bursts = 1;
     size_t burst_size = num_bursts*BURST_BYTES;
-    enum artix_selects artix_select = ARTIX_SELECT_NONE;
-
-    // grab a1 and a2 fail pins
-    (*fail_pins) = NULL;
-    (*num_fail_pins) = 400;
-    if(((*fail_pins) = (uint8_t*)calloc((*num_fail_pins), sizeof(uint8_t))) == NULL){
-        die("error: calloc failed");
-    }
-    for(int i=0; i<(*num_fail_pins); i++){
-        (*fail_pins)[i] = 0x00;
-    }
+    enum artix_selects unit_select = ARTIX_SELECT_NONE;
 
     for(int select=0; select<2; select++){
         if(select == 0){
-            artix_select = ARTIX_SELECT_A1;
+            unit_select = ARTIX_SELECT_A1;
         }else if(select == 1){
-            artix_select = ARTIX_SELECT_A2;
+            unit_select = ARTIX_SELECT_A2;
         }else{
             continue;
         }
+        if(artix_select != unit_select && artix_select != ARTIX_SELECT_BOTH){
+            continue;
+        }
 
-        helper_gvpu_load(artix_select, TEST_FAIL_PINS);
-        helper_agent_load(artix_select, GVPU_READ);
+        helper_gvpu_load(unit_select, TEST_FAIL_PINS);
+        helper_agent_load(unit_select, GVPU_READ);
 
         // reset dma buffer
         gcore_dma_alloc_reset();
 
         // send one burst of data (1024 bytes)
-        subcore_prep_dma_read(artix_select, num_bursts);
+        subcore_prep_dma_read(unit_select, num_bursts);
 
         slog_debug("sending setup burst (%i bytes)...", burst_size);
 
@@ -1037,36 +1346,41 @@ void artix_get_stim_fail_pins(uint8_t **fail_pins, uint32_t *num_fail_pins){
         memset(dma_buf, 0xffffffff, burst_size);
 
         gcore_dma_prep(NULL, 0, dma_buf, burst_size);
-        //subcore_prep_dma_read(artix_select, burst_size);
         gcore_dma_start(GCORE_WAIT_RX);
-        if(select == 0){
-            for(int i=0; i<200; i++){
-                if(((uint8_t *)dma_buf)[i]){
-                    (*fail_pins)[i] = 1;
-                }else{
-                    (*fail_pins)[i] = 0;
-                }
-            }
-        }else if(select == 1){
-            for(int i=0; i<200; i++){
-                if(((uint8_t *)dma_buf)[i]){
-                    (*fail_pins)[i+200] = 1;
-                }else{
-                    (*fail_pins)[i+200] = 0;
-                }
-            }
+        for(int i=0; i<DUT_NUM_PINS; i++){
+            fail_pins[i+(select*DUT_NUM_PINS)] = ((uint8_t *)dma_buf)[i] ? 1 : 0;
         }
 
-#ifdef GEM_DEBUG
-        for(int i=0; i<32;i++){
-            slog_debug("fail_pin %02i: 0x%016" PRIX64 "", i, dma_buf[i]);
+        if(GCORE_LOG_DEBUG_ENABLED()){
+            for(int i=0; i<32;i++){
+                slog_debug("fail_pin %02i: 0x%016" PRIX64 "", i, dma_buf[i]);
+            }
         }
-#endif
     }
 
     return;
 }
 
+/*
+ * Queries both A1 and A2 for fail pins. Returns an array with len 400.
+ * If stim is solo pattern check A1 or A2. If stim is dual check entire array.
+ *
+ */
+void artix_get_stim_fail_pins(uint8_t **fail_pins, uint32_t *num_fail_pins){
+    // grab a1 and a2 fail pins
+    (*fail_pins) = NULL;
+    (*num_fail_pins) = DUT_TOTAL_NUM_PINS;
+    if(((*fail_pins) = (uint8_t*)calloc((*num_fail_pins), sizeof(uint8_t))) == NULL){
+        die("error: calloc failed");
+    }
+
+    gcore_dev_lock();
+    artix_read_fail_pins(ARTIX_SELECT_BOTH, (*fail_pins));
+    gcore_dev_unlock();
+
+    return;
+}
+
 void artix_print_stim_fail_pins(struct stim *stim, uint8_t *fail_pins, uint32_t num_fail_pins){
     struct profile_pin *pin = NULL;
 
@@ -1101,112 +1415,303 @@ void artix_print_stim_fail_pins(struct stim *stim, uint8_t *fail_pins, uint32_t
 }
 
 
-//
-// Execute the stim in tester memory at the addresses given.
-//
-// returns -1 if pass or failing cycle number (zero indexed)
-//
-//
-bool artix_run_stim(struct stim *stim, uint64_t *test_cycle, 
-        uint64_t a1_start_addr, uint64_t a2_start_addr){
-    struct gcore_ctrl_packet master_packet;
-    struct gcore_ctrl_packet slave_packet;
-    bool master_test_failed = false;
-    bool slave_test_failed = false;
-    uint64_t master_test_cycle = 0;
-    uint64_t slave_test_cycle = 0;
-    enum artix_selects artix_select = ARTIX_SELECT_NONE;
-    uint64_t total_unrolled_vecs = 0;
+static uint64_t artix_get_time_us(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec*1000000)+((uint64_t)ts.tv_nsec/1000);
+}
 
-    if(test_cycle != NULL){
-        (*test_cycle) = 0;
-    }
+static void artix_sleep_us(uint64_t usecs){
+    struct timespec ts;
+    ts.tv_sec = (time_t)(usecs/1000000);
+    ts.tv_nsec = (long)((usecs%1000000)*1000);
+    while(nanosleep(&ts, &ts) == -1 && errno == EINTR);
+    return;
+}
 
-    if(stim == NULL){
-        die("pointer is NULL");
+/*
+ * Polls the agent status over ctrl with backoff until the gvpu isn't in
+ * TEST_RUN. Returns false if it still is at deadline_us. Always reads
+ * at least once.
+ *
+ */
+static bool artix_wait_agent_done(enum artix_selects artix_select, 
+        uint64_t deadline_us){
+    struct gcore_ctrl_packet packet;
+    uint64_t poll_us = ARTIX_RUN_POLL_MIN_US;
+
+    while(1){
+        helper_get_agent_status(artix_select, &packet);
+        if((packet.data & GCORE_AGENT_GVPU_STATE_MASK) != (TEST_RUN << 4)){
+            return true;
+        }
+        if(artix_get_time_us() >= deadline_us){
+            return false;
+        }
+        artix_sleep_us(poll_us);
+        poll_us = poll_us*2;
+        if(poll_us > ARTIX_RUN_POLL_MAX_US){
+            poll_us = ARTIX_RUN_POLL_MAX_US;
+        }
     }
 
-    if(stim->profile == NULL){
-        die("no profile set for stim");
+    return false;
+}
+
+/*
+ * Waits for the gvpu to leave TEST_RUN. The driver has no completion
+ * interrupt so the runtime is estimated from the number of vectors and
+ * the vector period. Sleep through most of the estimate from num_vecs,
+ * then poll the unit's status register with backoff so short stims 
+ * return right away. A register read is one ioctl where an agent status
+ * ctrl read is several subcore round trips.
+ *
+ * driver.h lays the a1/a2 status registers out like the agent status
+ * and get_gvpu_state reads the gvpu state from them, but nothing here
+ * guarantees they track TEST_RUN exactly. So once the register says
+ * the run is done (or the deadline passes) one agent status read 
+ * confirms it, and if they disagree the wait falls back to agent 
+ * status polls.
+ *
+ * The deadline comes from max_num_vecs, the most vecs the run can
+ * take, so a low num_vecs only costs polls, never a false timeout.
+ * Returns false if the gvpu is still running after the deadline.
+ *
+ */
+static bool artix_wait_stim_done(enum artix_selects artix_select, 
+        uint64_t num_vecs, uint64_t max_num_vecs, uint64_t start_us){
+    uint64_t estimate_us = 0;
+    uint64_t deadline_us = 0;
+    uint64_t now_us = 0;
+    bool is_reg_done = false;
+    bool is_done = false;
+
+    estimate_us = (num_vecs*ARTIX_VEC_PERIOD_NS)/1000;
+    deadline_us = start_us+(((max_num_vecs*ARTIX_VEC_PERIOD_NS)/1000)*2)+ARTIX_RUN_TIMEOUT_US;
+
+    // sleep until 3/4 of the estimate has passed since the test started
+    now_us = artix_get_time_us();
+    if(estimate_us > ARTIX_RUN_POLL_MIN_US && now_us < start_us+((estimate_us/4)*3)){
+        artix_sleep_us(start_us+((estimate_us/4)*3)-now_us);
     }
 
-    if(!stim->num_a1_vec_chunks && !stim->num_a2_vec_chunks){
-        die("stim has neither a1 nor a2 chunks");
+    now_us = artix_get_time_us();
+    is_reg_done = subcore_wait_for_state_change(artix_select, 
+        GCORE_AGENT_GVPU_STATE_MASK, (TEST_RUN << 4), 
+        (deadline_us > now_us) ? (deadline_us-now_us) : 0);
+
+    // a deadline of 0 is a single read
+    is_done = artix_wait_agent_done(artix_select, 0);
+    if(is_done != is_reg_done){
+        slog_warn("unit status reg says the run is %s but the agent status "
+            "says %s", is_reg_done ? "done" : "running", 
+            is_done ? "done" : "running");
+        if(!is_done){
+            is_done = artix_wait_agent_done(artix_select, deadline_us);
+        }
     }
+    return is_done;
+}
 
-    total_unrolled_vecs = (stim->num_unrolled_vecs+(uint64_t)(stim->num_padding_vecs));
+/*
+ * Units a setup runs on.
+ *
+ */
+static enum artix_selects artix_get_setup_select(struct artix_stim_setup *setup){
+    if(setup->a1_enable_pins != NULL && setup->a2_enable_pins != NULL){
+        return ARTIX_SELECT_BOTH;
+    }else if(setup->a1_enable_pins != NULL){
+        return ARTIX_SELECT_A1;
+    }else if(setup->a2_enable_pins != NULL){
+        return ARTIX_SELECT_A2;
+    }
+    return ARTIX_SELECT_NONE;
+}
 
-    slog_info("setup test...");
-    bool dual_mode = false;
+/*
+ * Units the stim runs on. Dual stims run on both.
+ *
+ */
+static enum artix_selects artix_get_stim_select(struct stim *stim){
     enum stim_modes stim_mode = stim_get_mode(stim);
-    if(stim_mode == STIM_MODE_DUAL){
-        dual_mode = true;
-        artix_setup_stim(stim, ARTIX_SELECT_A1, a1_start_addr);
-        artix_setup_stim(stim, ARTIX_SELECT_A2, a2_start_addr);
 
-        // a1 is always the master in dual_mode
-        artix_select = ARTIX_SELECT_A1;
+    if(stim_mode == STIM_MODE_DUAL){
+        return ARTIX_SELECT_BOTH;
     }else if(stim_mode == STIM_MODE_A1){
-        artix_setup_stim(stim, ARTIX_SELECT_A1, a1_start_addr);
-        artix_select = ARTIX_SELECT_A1;
+        return ARTIX_SELECT_A1;
     }else if(stim_mode == STIM_MODE_A2){
-        artix_setup_stim(stim, ARTIX_SELECT_A2, a2_start_addr);
-        artix_select = ARTIX_SELECT_A2;
-    }else{
-        bye("failed to execute stim with no vectors");
+        return ARTIX_SELECT_A2;
     }
+    return ARTIX_SELECT_NONE;
+}
 
-    // setup a1 and a2 for dual mode
-    if(dual_mode){
-        subcore_artix_sync(true);
-    }else{
-        subcore_artix_sync(false);
+/*
+ * Units the run uses. A site setup may use fewer units than the stim.
+ *
+ */
+static enum artix_selects artix_get_run_select(struct artix_stim_run *run){
+    if(run->setup != NULL){
+        return artix_get_setup_select(run->setup);
     }
+    return artix_get_stim_select(run->stim);
+}
 
-    helper_print_agent_status(artix_select);
+static void artix_check_stim_run(struct artix_stim_run *run){
+    if(run == NULL){
+        die("pointer is NULL");
+    }
 
-    // run the test
-    if(dual_mode){
-        slog_info("running test (dual mode)...");
-        helper_gvpu_load(ARTIX_SELECT_A1, TEST_RUN);
-        helper_gvpu_load(ARTIX_SELECT_A2, TEST_RUN);
-    }else{
-        slog_info("running test...");
-        helper_gvpu_load(artix_select, TEST_RUN);
-        helper_print_agent_status(artix_select);
+    if(run->stim == NULL){
+        die("pointer is NULL");
     }
 
-    uint32_t counter = 0;
-    while(1){
-        helper_get_agent_status(artix_select, &master_packet);
-        if((master_packet.data & 0x000000f0) != (TEST_RUN << 4)){
-            if(dual_mode){
-                helper_print_agent_status(ARTIX_SELECT_A1);
-                helper_print_agent_status(ARTIX_SELECT_A2);
-            }else{
-                helper_print_agent_status(artix_select);
-            }
-            break;
-        }else{
-            if(counter >= 0x000fffff){
-                master_test_cycle = helper_get_agent_gvpu_status(artix_select,
-                        GVPU_STATUS_SELECT_DUT_TEST,
-                        GVPU_STATUS_CMD_GET_CYCLE);
-                if(dual_mode){
-                    helper_print_agent_status(ARTIX_SELECT_A1);
-                    helper_print_agent_status(ARTIX_SELECT_A2);
-                }else{
-                    helper_print_agent_status(artix_select);
-                }
-                counter = 0;
-                break;
-            }else{
-                counter = counter + 1;
+    if(run->stim->profile == NULL){
+        die("no profile set for stim");
+    }
+
+    if(!run->stim->num_a1_vec_chunks && !run->stim->num_a2_vec_chunks){
+        die("stim has neither a1 nor a2 chunks");
+    }
+
+    if(artix_get_stim_select(run->stim) == ARTIX_SELECT_NONE){
+        bye("failed to execute stim with no vectors");
+    }
+
+    if(run->run_with_next && artix_get_run_select(run) == ARTIX_SELECT_BOTH){
+        die("dual stims can't run with another stim");
+    }
+
+    if(run->setup != NULL){
+        if(run->setup->stim != run->stim || run->setup->a1_addr != run->a1_addr 
+                || run->setup->a2_addr != run->a2_addr){
+            die("stim setup doesn't match the run");
+        }
+    }
+
+    return;
+}
+
+/*
+ * Setup the units used by the run.
+ *
+ */
+static void artix_setup_stim_run(struct artix_stim_run *run){
+    enum artix_selects artix_select = artix_get_setup_select(run->_setup);
+
+    if(artix_select == ARTIX_SELECT_A1 || artix_select == ARTIX_SELECT_BOTH){
+        artix_setup_stim(run->_setup, ARTIX_SELECT_A1);
+    }
+    if(artix_select == ARTIX_SELECT_A2 || artix_select == ARTIX_SELECT_BOTH){
+        artix_setup_stim(run->_setup, ARTIX_SELECT_A2);
+    }
+
+    return;
+}
+
+/*
+ * Starts the gvpu(s) of the run. The run must already be setup and the
+ * sync line set for its group by artix_run_stims.
+ *
+ */
+static void artix_start_stim_run(struct artix_stim_run *run){
+    enum artix_selects artix_select = artix_get_setup_select(run->_setup);
+
+    if(artix_select == ARTIX_SELECT_BOTH){
+        // a1 is always the master in dual mode
+        helper_print_agent_status(ARTIX_SELECT_A1);
+
+        slog_info("running test (dual mode)...");
+        helper_gvpu_load(ARTIX_SELECT_A1, TEST_RUN);
+        helper_gvpu_load(ARTIX_SELECT_A2, TEST_RUN);
+    }else{
+        helper_print_agent_status(artix_select);
+
+        slog_info("running test...");
+        helper_gvpu_load(artix_select, TEST_RUN);
+        helper_print_agent_status(artix_select);
+    }
+    run->_start_us = artix_get_time_us();
+
+    return;
+}
+
+/*
+ * Fills run->fail_pins, indexed by dut_io_id, with the failing pins that
+ * were enabled for the run.
+ *
+ */
+static void artix_copy_run_fail_pins(struct artix_stim_run *run, 
+        enum artix_selects artix_select){
+    uint8_t fail_pins[DUT_TOTAL_NUM_PINS];
+
+    memset(run->fail_pins, 0, DUT_TOTAL_NUM_PINS*sizeof(uint8_t));
+
+    if(!run->did_fail){
+        return;
+    }
+
+    // only this run's units, the other may still be running its pair
+    memset(fail_pins, 0, DUT_TOTAL_NUM_PINS*sizeof(uint8_t));
+    artix_read_fail_pins(artix_select, fail_pins);
+
+    for(uint32_t i=0; i<DUT_NUM_PINS; i++){
+        if(artix_select == ARTIX_SELECT_A1 || artix_select == ARTIX_SELECT_BOTH){
+            if(run->_setup->a1_enable_pins[i] == 0x00){
+                run->fail_pins[i] = fail_pins[i];
+            }
+        }
+        if(artix_select == ARTIX_SELECT_A2 || artix_select == ARTIX_SELECT_BOTH){
+            if(run->_setup->a2_enable_pins[i] == 0x00){
+                run->fail_pins[i+DUT_NUM_PINS] = fail_pins[i+DUT_NUM_PINS];
             }
         }
     }
 
-    sleep(2);
+    return;
+}
+
+/*
+ * Waits for a started run to finish and grabs the fail flag and test
+ * cycle from its unit(s).
+ *
+ */
+static void artix_finish_stim_run(struct artix_stim_run *run){
+    struct gcore_ctrl_packet master_packet;
+    struct gcore_ctrl_packet slave_packet;
+    bool master_test_failed = false;
+    bool slave_test_failed = false;
+    uint64_t master_test_cycle = 0;
+    uint64_t slave_test_cycle = 0;
+    enum artix_selects artix_select = artix_get_setup_select(run->_setup);
+    enum artix_selects run_select = artix_select;
+    uint64_t total_unrolled_vecs = 0;
+    uint64_t num_wait_vecs = 0;
+    bool dual_mode = false;
+
+    total_unrolled_vecs = (run->stim->num_unrolled_vecs+(uint64_t)(run->stim->num_padding_vecs));
+
+    // a prefix's unrolled length isn't known, but every vec it runs takes
+    // at least one cycle, so its vec count never oversleeps
+    num_wait_vecs = total_unrolled_vecs;
+    if(run->_is_prefix && run->_setup->num_vecs < num_wait_vecs){
+        num_wait_vecs = run->_setup->num_vecs;
+    }
+
+    if(artix_select == ARTIX_SELECT_BOTH){
+        dual_mode = true;
+        artix_select = ARTIX_SELECT_A1;
+    }
+
+    if(!artix_wait_stim_done(artix_select, num_wait_vecs, 
+            total_unrolled_vecs, run->_start_us)){
+        slog_error("timed out waiting for test to finish");
+    }
+    if(dual_mode){
+        helper_print_agent_status(ARTIX_SELECT_A1);
+        helper_print_agent_status(ARTIX_SELECT_A2);
+    }else{
+        helper_print_agent_status(artix_select);
+    }
 
     master_test_cycle = helper_get_agent_gvpu_status(artix_select,
             GVPU_STATUS_SELECT_DUT_TEST,
@@ -1237,14 +1742,12 @@ bool artix_run_stim(struct stim *stim, uint64_t *test_cycle,
             slog_warn("warning: a2 read fifo stalled during test");
         }
 
-        if(test_cycle != NULL){
-            if(master_test_cycle == slave_test_cycle){
-                (*test_cycle) = master_test_cycle;
-            }else if(master_test_cycle < slave_test_cycle){
-                (*test_cycle) = master_test_cycle;
-            }else if(slave_test_cycle < master_test_cycle){
-                (*test_cycle) = slave_test_cycle;
-            }
+        if(master_test_cycle == slave_test_cycle){
+            run->test_cycle = master_test_cycle;
+        }else if(master_test_cycle < slave_test_cycle){
+            run->test_cycle = master_test_cycle;
+        }else if(slave_test_cycle < master_test_cycle){
+            run->test_cycle = slave_test_cycle;
         }
 
         if(master_test_failed || slave_test_failed){
@@ -1260,11 +1763,11 @@ bool artix_run_stim(struct stim *stim, uint64_t *test_cycle,
                 slog_error("test failed in a2 at vector %llu out of %llu :(", slave_test_cycle, total_unrolled_vecs);
             }
         }else{
-            if(master_test_cycle < total_unrolled_vecs || master_test_cycle > total_unrolled_vecs){
+            if(!run->_is_prefix && (master_test_cycle < total_unrolled_vecs || master_test_cycle > total_unrolled_vecs)){
                 slog_error("a1 test failed (executed %llu of %llu vectors) (fail flag didn't assert)!", master_test_cycle, total_unrolled_vecs);
                 master_test_failed = true;
             }
-            if(slave_test_cycle < total_unrolled_vecs || slave_test_cycle > total_unrolled_vecs){
+            if(!run->_is_prefix && (slave_test_cycle < total_unrolled_vecs || slave_test_cycle > total_unrolled_vecs)){
                 slog_error("a2 test failed (executed %llu of %llu vectors) (fail flag didn't assert)!", slave_test_cycle, total_unrolled_vecs);
                 slave_test_failed = true;
             }
@@ -1278,24 +1781,17 @@ bool artix_run_stim(struct stim *stim, uint64_t *test_cycle,
         }
     }else{
 
-        master_test_cycle = helper_get_agent_gvpu_status(artix_select,
-            GVPU_STATUS_SELECT_DUT_TEST,
-            GVPU_STATUS_CMD_GET_CYCLE);
-
-
         // msb byte is 0:did_stall:status_switch
         if((master_packet.addr & 0xf0000000) >> 30){
             slog_warn("warning: read fifo stalled during test");
         }
 
-        if(test_cycle != NULL){
-            (*test_cycle) = master_test_cycle;
-        }
+        run->test_cycle = master_test_cycle;
 
         if(master_test_failed){
             slog_error("test failed at vector %llu out of %llu :(", master_test_cycle, total_unrolled_vecs);
         }else{
-            if(master_test_cycle < total_unrolled_vecs || master_test_cycle > total_unrolled_vecs){
+            if(!run->_is_prefix && (master_test_cycle < total_unrolled_vecs || master_test_cycle > total_unrolled_vecs)){
                 slog_error("test failed (executed %llu of %llu vectors) (fail flag didn't assert)!", master_test_cycle, total_unrolled_vecs);
                 master_test_failed = true;
             }else{
@@ -1304,7 +1800,658 @@ bool artix_run_stim(struct stim *stim, uint64_t *test_cycle,
         }
     }
 
-    return (master_test_failed || slave_test_failed);
+    run->did_run = true;
+    run->did_fail = (master_test_failed || slave_test_failed);
+
+    if(run->fail_pins != NULL){
+        artix_copy_run_fail_pins(run, run_select);
+    }
+
+    return;
+}
+
+/*
+ * Setups built for runs in a batch that didn't bring their own, one 
+ * entry per stim and addr pair.
+ *
+ */
+struct artix_setup_key {
+    struct stim *stim;
+    uint64_t a1_addr;
+    uint64_t a2_addr;
+};
+
+struct artix_setup_entry {
+    struct artix_setup_key key;
+    struct artix_stim_setup *setup;
+    UT_hash_handle hh;
+};
+
+static struct artix_stim_setup *artix_get_run_setup(
+        struct artix_setup_entry **cache, struct artix_stim_run *run){
+    struct artix_setup_entry *entry = NULL;
+    struct artix_setup_key key;
+
+    if(run->setup != NULL){
+        return run->setup;
+    }
+
+    // zero the padding since the whole key is hashed
+    memset(&key, 0, sizeof(struct artix_setup_key));
+    key.stim = run->stim;
+    key.a1_addr = run->a1_addr;
+    key.a2_addr = run->a2_addr;
+
+    HASH_FIND(hh, (*cache), &key, sizeof(struct artix_setup_key), entry);
+    if(entry != NULL){
+        return entry->setup;
+    }
+
+    if((entry = (struct artix_setup_entry*)calloc(1, sizeof(struct artix_setup_entry))) == NULL){
+        die("error: calloc failed");
+    }
+    entry->key = key;
+    entry->setup = artix_create_stim_setup(run->stim, run->a1_addr, run->a2_addr);
+    HASH_ADD(hh, (*cache), key, sizeof(struct artix_setup_key), entry);
+
+    return entry->setup;
+}
+
+/*
+ * Runs a batch of stims already loaded in tester memory back to back.
+ *
+ * Runs without a setup get one built once per stim and addr pair for
+ * the whole batch. A gvpu can't be setup while it's in TEST_RUN, so the
+ * next run is only setup early when it uses the unit that's idle during
+ * the current run.
+ *
+ * A solo run with run_with_next set is started together with the next 
+ * run, which must be a solo run on the other unit. The units aren't 
+ * synced so each one finishes on its own and gets its own result.
+ *
+ * Stops after the first failing run unless run_continue is true. Runs
+ * that didn't execute have did_run false. Returns the number of runs 
+ * executed.
+ *
+ * The board lock is held for the whole batch, so start_cb and done_cb 
+ * run with it held.
+ *
+ */
+uint32_t artix_run_stims(struct artix_stim_run *runs, uint32_t num_runs, 
+        bool run_continue){
+    struct artix_setup_entry *cache = NULL;
+    struct artix_setup_entry *entry = NULL;
+    struct artix_setup_entry *tmp = NULL;
+    struct artix_stim_run *next_run = NULL;
+    uint32_t num_runs_ran = 0;
+    uint32_t num_group_runs = 0;
+    uint32_t group_select = ARTIX_SELECT_NONE;
+    bool is_next_setup = false;
+    bool did_group_fail = false;
+    uint64_t perf_start = perf_begin();
+
+    if(runs == NULL){
+        die("pointer is NULL");
+    }
+
+    gcore_dev_lock();
+    for(uint32_t i=0; i<num_runs; i++){
+        artix_check_stim_run(&runs[i]);
+        runs[i]._setup = artix_get_run_setup(&cache, &runs[i]);
+    }
+
+    for(uint32_t i=0; i<num_runs; i++){
+        if(runs[i].run_with_next){
+            if(i+1 >= num_runs || runs[i+1].run_with_next){
+                die("run_with_next must be followed by one solo run");
+            }
+            if((artix_get_setup_select(runs[i]._setup) 
+                    & artix_get_setup_select(runs[i+1]._setup)) != 0){
+                die("runs started together must use different units");
+            }
+        }
+        runs[i].did_run = false;
+        runs[i].did_fail = false;
+        runs[i].test_cycle = 0;
+    }
+
+    slog_info("setup test...");
+    for(uint32_t i=0; i<num_runs; i+=num_group_runs){
+        num_group_runs = runs[i].run_with_next ? 2 : 1;
+        group_select = ARTIX_SELECT_NONE;
+
+        for(uint32_t j=i; j<i+num_group_runs; j++){
+            if(!(is_next_setup && j == i)){
+                artix_setup_stim_run(&runs[j]);
+            }
+            group_select |= artix_get_setup_select(runs[j]._setup);
+        }
+        is_next_setup = false;
+
+        if(num_group_runs > 1){
+            slog_info("running a1 and a2 solo tests together...");
+        }
+
+        // set the sync line once per group while both units are idle, 
+        // nothing says a gvpu in TEST_RUN ignores a change to it
+        subcore_artix_sync(num_group_runs == 1 
+            && artix_get_setup_select(runs[i]._setup) == ARTIX_SELECT_BOTH);
+        for(uint32_t j=i; j<i+num_group_runs; j++){
+            if(runs[j].start_cb != NULL){
+                runs[j].start_cb(&runs[j], runs[j].cb_data);
+            }
+            artix_start_stim_run(&runs[j]);
+        }
+
+        // overlap the next setup with this run if it only uses the idle unit
+        next_run = (i+num_group_runs < num_runs) ? &runs[i+num_group_runs] : NULL;
+        if(next_run != NULL && !next_run->run_with_next 
+                && (group_select & artix_get_setup_select(next_run->_setup)) == 0){
+            artix_setup_stim_run(next_run);
+            is_next_setup = true;
+        }
+
+        did_group_fail = false;
+        for(uint32_t j=i; j<i+num_group_runs; j++){
+            artix_finish_stim_run(&runs[j]);
+            num_runs_ran += 1;
+            if(runs[j].done_cb != NULL){
+                runs[j].done_cb(&runs[j], runs[j].cb_data);
+            }
+            if(runs[j].did_fail){
+                did_group_fail = true;
+            }
+        }
+
+        if(did_group_fail && run_continue == false){
+            break;
+        }
+    }
+
+    for(uint32_t i=0; i<num_runs; i++){
+        runs[i]._setup = NULL;
+    }
+
+    HASH_ITER(hh, cache, entry, tmp){
+        HASH_DEL(cache, entry);
+        artix_free_stim_setup(entry->setup);
+        free(entry);
+    }
+
+    perf_end(PERF_TEST_RUN, perf_start);
+    gcore_dev_unlock();
+    return num_runs_ran;
+}
+
+/*
+ * Runs an a1 solo stim and an a2 solo stim at the same time without 
+ * syncing the units. Results are filled in for each run. Returns true 
+ * if either failed.
+ *
+ */
+bool artix_run_solo_stims(struct artix_stim_run *a1_run, 
+        struct artix_stim_run *a2_run){
+    struct artix_stim_run runs[2];
+
+    if(a1_run == NULL || a2_run == NULL){
+        die("pointer is NULL");
+    }
+
+    if(artix_get_run_select(a1_run) != ARTIX_SELECT_A1){
+        die("a1 run must be an a1 solo stim");
+    }
+    if(artix_get_run_select(a2_run) != ARTIX_SELECT_A2){
+        die("a2 run must be an a2 solo stim");
+    }
+
+    runs[0] = (*a1_run);
+    runs[1] = (*a2_run);
+    runs[0].run_with_next = true;
+    runs[1].run_with_next = false;
+
+    gcore_dev_lock();
+    artix_run_stims(runs, 2, true);
+
+    a1_run->did_run = runs[0].did_run;
+    a1_run->did_fail = runs[0].did_fail;
+    a1_run->test_cycle = runs[0].test_cycle;
+    a2_run->did_run = runs[1].did_run;
+    a2_run->did_fail = runs[1].did_fail;
+    a2_run->test_cycle = runs[1].test_cycle;
+
+    gcore_dev_unlock();
+    return (a1_run->did_fail || a2_run->did_fail);
+}
+
+//
+// Execute the stim in tester memory at the addresses given.
+//
+// returns true if the test failed and sets test_cycle to the failing 
+// cycle or number of executed cycles if it passed
+//
+bool artix_run_stim(struct stim *stim, uint64_t *test_cycle, 
+        uint64_t a1_start_addr, uint64_t a2_start_addr){
+    struct artix_stim_run run;
+
+    if(test_cycle != NULL){
+        (*test_cycle) = 0;
+    }
+
+    memset(&run, 0, sizeof(struct artix_stim_run));
+    run.stim = stim;
+    run.a1_addr = a1_start_addr;
+    run.a2_addr = a2_start_addr;
+
+    artix_run_stims(&run, 1, true);
+
+    if(test_cycle != NULL){
+        (*test_cycle) = run.test_cycle;
+    }
+
+    return run.did_fail;
+}
+
+/*
+ * Runs the first num_vecs vecs of the stim in run->setup, which the
+ * caller owns. If num_vecs doesn't end on a burst, the burst it ends in 
+ * is swapped in tester memory for a copy with the vecs past the end
+ * turned into nops, then put back after the run. If last_repeat isn't
+ * 0 it overrides the repeat of the last vec.
+ *
+ */
+static void artix_run_stim_prefix(struct artix_stim_run *run, 
+        uint64_t num_vecs, uint64_t last_repeat){
+    enum artix_selects artix_select = artix_get_setup_select(run->setup);
+    uint8_t burst[2][BURST_BYTES];
+    uint8_t patched_burst[BURST_BYTES];
+    uint64_t burst_addr[2] = {0, 0};
+    uint8_t *vec = NULL;
+    uint64_t repeat = 0;
+    enum subvec_opcode opcode = DUT_OPCODE_NOP;
+    uint32_t last_vec_id = 0;
+    bool is_patched = false;
+
+    if(num_vecs == 0 || num_vecs > run->stim->num_vecs+run->stim->num_padding_vecs){
+        die("invalid number of vecs %llu to run", num_vecs);
+    }
+
+    last_vec_id = (uint32_t)((num_vecs-1) % STIM_NUM_VECS_PER_BURST);
+    is_patched = ((num_vecs % STIM_NUM_VECS_PER_BURST) != 0 || last_repeat != 0);
+
+    for(uint32_t unit=0; unit<2 && is_patched; unit++){
+        if(!(artix_select & (unit == 0 ? ARTIX_SELECT_A1 : ARTIX_SELECT_A2))){
+            continue;
+        }
+        burst_addr[unit] = (unit == 0 ? run->a1_addr : run->a2_addr);
+        burst_addr[unit] += ((num_vecs-1)/STIM_NUM_VECS_PER_BURST)*BURST_BYTES;
+
+        artix_mem_read((unit == 0 ? ARTIX_SELECT_A1 : ARTIX_SELECT_A2), 
+            burst_addr[unit], (uint64_t*)burst[unit], BURST_BYTES);
+        memcpy(patched_burst, burst[unit], BURST_BYTES);
+
+        if(last_repeat != 0){
+            vec = &patched_burst[last_vec_id*STIM_VEC_SIZE];
+            opcode = get_opcode_and_operand_by_subvecs(vec, &repeat);
+            pack_subvecs_with_opcode_and_operand(vec, opcode, last_repeat);
+        }
+        for(uint32_t i=last_vec_id+1; i<STIM_NUM_VECS_PER_BURST; i++){
+            vec = &patched_burst[i*STIM_VEC_SIZE];
+            memset(vec, (DUT_SUBVEC_X << 4) | DUT_SUBVEC_X, DUT_NUM_PINS/2);
+            pack_subvecs_with_opcode_and_operand(vec, DUT_OPCODE_NOP, 1);
+        }
+
+        artix_mem_write((unit == 0 ? ARTIX_SELECT_A1 : ARTIX_SELECT_A2), 
+            burst_addr[unit], (uint64_t*)patched_burst, BURST_BYTES);
+    }
+
+    // padding nops fill out the last burst so the gvpu runs whole bursts
+    run->setup->num_vecs = num_vecs + calc_num_padding_vecs((uint32_t)num_vecs);
+    run->_is_prefix = true;
+    artix_run_stims(run, 1, true);
+
+    for(uint32_t unit=0; unit<2 && is_patched; unit++){
+        if(!(artix_select & (unit == 0 ? ARTIX_SELECT_A1 : ARTIX_SELECT_A2))){
+            continue;
+        }
+        artix_mem_write((unit == 0 ? ARTIX_SELECT_A1 : ARTIX_SELECT_A2), 
+            burst_addr[unit], (uint64_t*)burst[unit], BURST_BYTES);
+    }
+
+    return;
+}
+
+/*
+ * Locates the first failing vec of a stim already loaded in tester 
+ * memory without trusting the fail cycle the gvpu reports.
+ *
+ * Bisects on how many vecs of the stim run, using the loaded vecs in
+ * place. A cut inside a burst only rewrites that one burst. A failing
+ * VECLOOP or VECCLK vec is then bisected on its repeat, so repeats 
+ * count as unrolled vecs. The test cycle is taken from the cycle count
+ * of the longest passing run.
+ *
+ * The run gets the results of the full run. Returns true if the stim
+ * failed, in which case first_fail holds the vec, the unrolled cycle
+ * and the pins that failed there. If the shortest failing run passes
+ * when rerun for its fail pins, the fail isn't repeatable and nothing
+ * located can be trusted, so is_flaky is set and it returns false.
+ *
+ */
+bool artix_locate_stim_first_fail(struct artix_stim_run *run, 
+        struct artix_first_fail *first_fail){
+    struct artix_stim_setup *setup = NULL;
+    struct artix_stim_run locate_run;
+    enum artix_selects artix_select = ARTIX_SELECT_NONE;
+    enum subvec_opcode opcode = DUT_OPCODE_NOP;
+    uint8_t burst[BURST_BYTES];
+    uint64_t vec_addr = 0;
+    uint64_t repeat = 0;
+    uint64_t num_vecs = 0;
+    uint64_t pass_num_vecs = 0;
+    uint64_t fail_num_vecs = 0;
+    uint64_t pass_test_cycle = 0;
+    uint64_t pass_repeat = 0;
+    uint64_t fail_repeat = 0;
+    uint64_t mid = 0;
+    uint64_t offset = 0;
+    int32_t dut_id = -1;
+
+    artix_check_stim_run(run);
+
+    if(first_fail == NULL){
+        die("pointer is NULL");
+    }
+
+    if(run->run_with_next){
+        die("first fail locate can't run with another stim");
+    }
+
+    memset(first_fail, 0, sizeof(struct artix_first_fail));
+
+    // own setup since num_vecs changes between runs
+    if(run->setup != NULL){
+        dut_id = run->setup->dut_id;
+    }
+    if((setup = artix_create_stim_site_setup(run->stim, 
+            run->a1_addr, run->a2_addr, dut_id)) == NULL){
+        die("stim has no pins on dut %i", dut_id);
+    }
+    num_vecs = setup->num_vecs;
+
+    memset(&locate_run, 0, sizeof(struct artix_stim_run));
+    locate_run.stim = run->stim;
+    locate_run.a1_addr = run->a1_addr;
+    locate_run.a2_addr = run->a2_addr;
+    locate_run.setup = setup;
+    locate_run.fail_pins = first_fail->fail_pins;
+
+    // no other thread's runs between the bisect runs
+    gcore_dev_lock();
+    artix_run_stims(&locate_run, 1, true);
+    first_fail->num_runs += 1;
+
+    run->did_run = locate_run.did_run;
+    run->did_fail = locate_run.did_fail;
+    run->test_cycle = locate_run.test_cycle;
+    if(run->fail_pins != NULL){
+        memcpy(run->fail_pins, first_fail->fail_pins, DUT_TOTAL_NUM_PINS*sizeof(uint8_t));
+    }
+
+    if(!locate_run.did_fail){
+        gcore_dev_unlock();
+        artix_free_stim_setup(setup);
+        return false;
+    }
+
+    // running no vecs passes and running them all fails
+    pass_num_vecs = 0;
+    fail_num_vecs = num_vecs;
+    while(fail_num_vecs-pass_num_vecs > 1){
+        mid = pass_num_vecs+((fail_num_vecs-pass_num_vecs)/2);
+        artix_run_stim_prefix(&locate_run, mid, 0);
+        first_fail->num_runs += 1;
+        if(locate_run.did_fail){
+            fail_num_vecs = mid;
+        }else{
+            pass_num_vecs = mid;
+            pass_test_cycle = locate_run.test_cycle-calc_num_padding_vecs((uint32_t)mid);
+        }
+    }
+    first_fail->vec_id = fail_num_vecs-1;
+
+    // read back the failing vec to see if it repeats
+    artix_select = artix_get_setup_select(setup);
+    if(artix_select == ARTIX_SELECT_BOTH){
+        artix_select = ARTIX_SELECT_A1;
+    }
+    vec_addr = (artix_select == ARTIX_SELECT_A1 ? run->a1_addr : run->a2_addr);
+    vec_addr += (first_fail->vec_id/STIM_NUM_VECS_PER_BURST)*BURST_BYTES;
+    artix_mem_read(artix_select, vec_addr, (uint64_t*)burst, BURST_BYTES);
+    opcode = get_opcode_and_operand_by_subvecs(
+        &burst[(first_fail->vec_id % STIM_NUM_VECS_PER_BURST)*STIM_VEC_SIZE], &repeat);
+
+    fail_repeat = 0;
+    if((opcode == DUT_OPCODE_VECLOOP || opcode == DUT_OPCODE_VECCLK) && repeat > 1){
+        pass_repeat = 0;
+        fail_repeat = repeat;
+        while(fail_repeat-pass_repeat > 1){
+            mid = pass_repeat+((fail_repeat-pass_repeat)/2);
+            artix_run_stim_prefix(&locate_run, fail_num_vecs, mid);
+            first_fail->num_runs += 1;
+            if(locate_run.did_fail){
+                fail_repeat = mid;
+            }else{
+                pass_repeat = mid;
+            }
+        }
+        // a clocked vec takes two cycles per repeat
+        offset = (opcode == DUT_OPCODE_VECCLK) ? 2*(fail_repeat-1) : (fail_repeat-1);
+    }
+
+    // the last run may have passed so rerun the shortest failing one for
+    // its fail pins
+    artix_run_stim_prefix(&locate_run, fail_num_vecs, fail_repeat);
+    first_fail->num_runs += 1;
+
+    if(!locate_run.did_fail){
+        slog_warn("stim passed a rerun of its first %llu vecs that failed before, "
+            "fail isn't repeatable", fail_num_vecs);
+        first_fail->is_flaky = true;
+        gcore_dev_unlock();
+        artix_free_stim_setup(setup);
+        return false;
+    }
+
+    first_fail->did_fail = true;
+    first_fail->test_cycle = pass_test_cycle+offset;
+
+    slog_info("located first fail at vec %llu cycle %llu (gvpu reported %llu) in %u runs", 
+        first_fail->vec_id, first_fail->test_cycle, run->test_cycle, first_fail->num_runs);
+
+    gcore_dev_unlock();
+    artix_free_stim_setup(setup);
+    return true;
+}
+
+/*
+ * Returns the enable pin byte for a dut_io_id in the setup, or NULL if
+ * the unit it's on isn't used.
+ *
+ */
+static uint8_t *artix_get_setup_enable_pin(struct artix_stim_setup *setup, 
+        uint32_t dut_io_id){
+    if(dut_io_id < DUT_NUM_PINS){
+        if(setup->a1_enable_pins == NULL){
+            return NULL;
+        }
+        return &setup->a1_enable_pins[dut_io_id];
+    }else if(dut_io_id < DUT_TOTAL_NUM_PINS){
+        if(setup->a2_enable_pins == NULL){
+            return NULL;
+        }
+        return &setup->a2_enable_pins[dut_io_id-DUT_NUM_PINS];
+    }
+    return NULL;
+}
+
+/*
+ * Captures a fail log for a stim already loaded in tester memory.
+ *
+ * The gvpu stops on the first failing cycle and only keeps one sticky
+ * fail pins burst, so the stim is rerun with the pins that failed 
+ * masked off until it passes, no enabled pins are left or max_records
+ * is hit. Each record is the first failing cycle of the pins in it,
+ * so a pin that fails again later in the stim isn't logged again. The
+ * vectors stay loaded, only the enable pins burst changes between runs.
+ *
+ * Every record costs a rerun from cycle zero to its fail, plus one run
+ * to find that the rest pass. With no limit that's up to one run per
+ * enabled pin (400 for a dual stim), so pass a max_records when only the
+ * earliest fails matter.
+ *
+ * A run with a site setup only captures that site's pins. The run gets
+ * the results of the first capture run. Set max_records to 0 for no 
+ * limit. Free the log with artix_free_fail_log.
+ *
+ */
+struct artix_fail_log *artix_capture_stim_fails(struct artix_stim_run *run, 
+        uint32_t max_records){
+    struct artix_fail_log *fail_log = NULL;
+    struct artix_fail_record *record = NULL;
+    struct artix_stim_setup *setup = NULL;
+    struct artix_stim_run capture_run;
+    uint8_t fail_pins[DUT_TOTAL_NUM_PINS];
+    uint8_t *enable_pin = NULL;
+    uint32_t num_enabled_pins = 0;
+    int32_t dut_id = -1;
+
+    gcore_dev_lock();
+    artix_check_stim_run(run);
+
+    if(run->run_with_next){
+        die("fail capture can't run with another stim");
+    }
+
+    if(max_records == 0 || max_records > ARTIX_MAX_FAIL_RECORDS){
+        max_records = ARTIX_MAX_FAIL_RECORDS;
+    }
+
+    // own setup since its enable pins get masked as pins fail
+    if(run->setup != NULL){
+        dut_id = run->setup->dut_id;
+    }
+    if((setup = artix_create_stim_site_setup(run->stim, 
+            run->a1_addr, run->a2_addr, dut_id)) == NULL){
+        die("stim has no pins on dut %i", dut_id);
+    }
+
+    if((fail_log = (struct artix_fail_log*)calloc(1, sizeof(struct artix_fail_log))) == NULL){
+        die("error: calloc failed");
+    }
+    if((fail_log->records = (struct artix_fail_record*)calloc(max_records, sizeof(struct artix_fail_record))) == NULL){
+        die("error: calloc failed");
+    }
+
+    while(true){
+        memset(&capture_run, 0, sizeof(struct artix_stim_run));
+        capture_run.stim = run->stim;
+        capture_run.a1_addr = run->a1_addr;
+        capture_run.a2_addr = run->a2_addr;
+        capture_run.setup = setup;
+        capture_run.fail_pins = fail_pins;
+
+        artix_run_stims(&capture_run, 1, true);
+        fail_log->num_runs += 1;
+
+        if(fail_log->num_runs == 1){
+            run->did_run = capture_run.did_run;
+            run->did_fail = capture_run.did_fail;
+            run->test_cycle = capture_run.test_cycle;
+            if(run->fail_pins != NULL){
+                memcpy(run->fail_pins, fail_pins, DUT_TOTAL_NUM_PINS*sizeof(uint8_t));
+            }
+        }
+
+        if(!capture_run.did_fail){
+            fail_log->is_complete = true;
+            break;
+        }
+        fail_log->did_fail = true;
+
+        record = &fail_log->records[fail_log->num_records];
+        fail_log->num_records += 1;
+        record->test_cycle = capture_run.test_cycle;
+
+        for(uint32_t i=0; i<DUT_TOTAL_NUM_PINS; i++){
+            if(fail_pins[i]){
+                record->num_pins += 1;
+            }
+        }
+
+        // failed without a failing pin, masking can't get past it
+        if(record->num_pins == 0){
+            slog_warn("fail capture stopped at cycle %llu with no failing pins", 
+                capture_run.test_cycle);
+            break;
+        }
+
+        if((record->dut_io_ids = (uint16_t*)calloc(record->num_pins, sizeof(uint16_t))) == NULL){
+            die("error: calloc failed");
+        }
+
+        record->num_pins = 0;
+        for(uint32_t i=0; i<DUT_TOTAL_NUM_PINS; i++){
+            if(!fail_pins[i]){
+                continue;
+            }
+            record->dut_io_ids[record->num_pins] = (uint16_t)i;
+            record->num_pins += 1;
+            if((enable_pin = artix_get_setup_enable_pin(setup, i)) != NULL){
+                (*enable_pin) = 0xff;
+            }
+        }
+
+        num_enabled_pins = 0;
+        for(uint32_t i=0; i<DUT_TOTAL_NUM_PINS; i++){
+            enable_pin = artix_get_setup_enable_pin(setup, i);
+            if(enable_pin != NULL && (*enable_pin) == 0x00){
+                num_enabled_pins += 1;
+            }
+        }
+
+        if(num_enabled_pins == 0){
+            fail_log->is_complete = true;
+            break;
+        }
+
+        if(fail_log->num_records >= max_records){
+            slog_warn("fail capture stopped after %u records", max_records);
+            break;
+        }
+    }
+
+    slog_info("captured %u fail records in %u runs", 
+        fail_log->num_records, fail_log->num_runs);
+
+    artix_free_stim_setup(setup);
+    gcore_dev_unlock();
+    return fail_log;
+}
+
+void artix_free_fail_log(struct artix_fail_log *fail_log){
+    if(fail_log == NULL){
+        return;
+    }
+    for(uint32_t i=0; i<fail_log->num_records; i++){
+        if(fail_log->records[i].dut_io_ids != NULL){
+            free(fail_log->records[i].dut_io_ids);
+        }
+    }
+    if(fail_log->records != NULL){
+        free(fail_log->records);
+    }
+    free(fail_log);
+    return;
 }
 
 /*
@@ -1317,10 +2464,17 @@ void artix_config(enum artix_selects artix_select, const char *bit_path){
     int fd;
     FILE *fp = NULL;
     off_t file_size;
-    struct gcore_registers *regs;
+    struct gcore_registers regs;
     uint64_t *dma_buf;
     uint32_t mode_state;
 
+    gcore_dev_lock();
+    // a fresh bitstream has no enable pins set
+    artix_drop_enable_pins(artix_select);
+
+    // nothing resident survives reconfiguring
+    resident_evict_all();
+
     if(get_stim_type_by_path(bit_path) != STIM_TYPE_BIN){
         die("error: artix config only takes bin files (flipped): %s", bit_path);
     }
@@ -1341,13 +2495,10 @@ void artix_config(enum artix_selects artix_select, const char *bit_path){
     helper_subcore_load(artix_select, CONFIG_SETUP);
 
     //check for any init errors
-    regs = subcore_get_regs();
-    if(regs != NULL){
-        if((regs->status & GCORE_STATUS_INIT_ERROR_MASK) == GCORE_STATUS_INIT_ERROR_MASK){
-            die("error: failed to configure artix, init_error is high.");
-        }
+    subcore_read_regs(&regs);
+    if((regs.status & GCORE_STATUS_INIT_ERROR_MASK) == GCORE_STATUS_INIT_ERROR_MASK){
+        die("error: failed to configure artix, init_error is high.");
     }
-    regs = subcore_free_regs(regs);
 
     // dma over the data from start of dma buffer sending file_size bytes
     
@@ -1364,36 +2515,33 @@ void artix_config(enum artix_selects artix_select, const char *bit_path){
     // doing subcore_state ioctl will write
     // config_num_bytes in the addr reg
     subcore_mode_state(&mode_state);
-    regs = subcore_get_regs();
+    subcore_read_regs(&regs);
 
-    //if(regs->addr != file_size){
-    //    slog_error("config: only %d bytes of %ld bytes sent.", regs->addr, file_size);
+    //if(regs.addr != file_size){
+    //    slog_error("config: only %d bytes of %ld bytes sent.", regs.addr, file_size);
     //}
 
     subcore_idle();
 
     // check done
-    if(regs != NULL){
-        if((regs->status & GCORE_STATUS_DONE_ERROR_MASK) == GCORE_STATUS_DONE_ERROR_MASK){
-            slog_error("error: failed to configure, done error is high.");
-        }else{
-            if(artix_select == ARTIX_SELECT_A1){
-                if((regs->a1_status & GCORE_AGENT_DONE_MASK) != GCORE_AGENT_DONE_MASK){
-                    slog_error("no done error, but a1 done pin did NOT go high.");
-                }else{
-                    slog_info("a1 configuration done!");
-                }
-            }else if (artix_select == ARTIX_SELECT_A2){
-                if((regs->a2_status & GCORE_AGENT_DONE_MASK) != GCORE_AGENT_DONE_MASK){
-                    slog_error("no done error, but a2 done pin did NOT go high.");
-                }else{
-                    slog_info("a2 configuration done!");
-                }
+    if((regs.status & GCORE_STATUS_DONE_ERROR_MASK) == GCORE_STATUS_DONE_ERROR_MASK){
+        slog_error("error: failed to configure, done error is high.");
+    }else{
+        if(artix_select == ARTIX_SELECT_A1){
+            if((regs.a1_status & GCORE_AGENT_DONE_MASK) != GCORE_AGENT_DONE_MASK){
+                slog_error("no done error, but a1 done pin did NOT go high.");
+            }else{
+                slog_info("a1 configuration done!");
+            }
+        }else if (artix_select == ARTIX_SELECT_A2){
+            if((regs.a2_status & GCORE_AGENT_DONE_MASK) != GCORE_AGENT_DONE_MASK){
+                slog_error("no done error, but a2 done pin did NOT go high.");
+            }else{
+                slog_info("a2 configuration done!");
             }
         }
     }
 
-    regs = subcore_free_regs(regs);
-
+    gcore_dev_unlock();
     return;
 }
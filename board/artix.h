@@ -19,17 +19,166 @@ extern "C" {
 #include "driver.h"
 #include "../stim.h"
 
+// stims must be loaded below this addr in each unit. Unit memory is byte
+// addressed across all 8GiB, the same range artix_mem_write takes.
+#define ARTIX_MEM_ADDR_LIMIT (ARTIX_MEM_BYTES)
+
+// bounce buffer size used to copy within a unit's memory
+#define ARTIX_MEM_COPY_SIZE (DMA_SIZE)
+
+// largest single transfer the mem bench buffers on the host (64MiB)
+#define ARTIX_MEM_BENCH_CHUNK_SIZE (67108864)
+
+// dut test vector period used to estimate how long a stim runs
+#ifndef ARTIX_VEC_PERIOD_NS
+#define ARTIX_VEC_PERIOD_NS (20)
+#endif
+
+// runs estimated shorter than this are polled right away
+#define ARTIX_RUN_POLL_MIN_US (50)
+
+// backoff cap when polling the agent status over ctrl
+#define ARTIX_RUN_POLL_MAX_US (1000)
+
+// give up waiting this long past the estimated runtime
+#define ARTIX_RUN_TIMEOUT_US (5000000)
+
+/*
+ * TEST_INIT params and enable pins bursts for a stim loaded at a1_addr
+ * and a2_addr. Build it once when the stim is loaded and pass it to 
+ * every run of the stim. A site setup (dut_id >= 0) only enables the 
+ * pins of that dut and has NULL enable pins for units it doesn't use.
+ *
+ */
+struct artix_stim_setup {
+    struct stim *stim;
+    int32_t dut_id;
+    uint64_t a1_addr;
+    uint64_t a2_addr;
+    uint64_t num_vecs;
+    uint8_t *a1_enable_pins;
+    uint8_t *a2_enable_pins;
+};
+
+struct artix_stim_run;
+
+// called right before a run starts and right after its results are set
+typedef void (*artix_stim_run_cb)(struct artix_stim_run *run, void *data);
+
+/*
+ * One stim of a batch run. Set stim, the start addrs and optionally a
+ * setup made for them, the rest is filled in when it runs. Set 
+ * run_with_next to start a solo stim together with the next run, which
+ * must be a solo stim on the other unit. Point fail_pins at 
+ * DUT_TOTAL_NUM_PINS bytes to get the run's failing pins by dut_io_id.
+ * Set start_cb and done_cb to follow the batch as it runs.
+ *
+ */
+struct artix_stim_run {
+    // public
+    struct stim *stim;
+    uint64_t a1_addr;
+    uint64_t a2_addr;
+    struct artix_stim_setup *setup;
+    bool run_with_next;
+    uint8_t *fail_pins;
+    artix_stim_run_cb start_cb;
+    artix_stim_run_cb done_cb;
+    void *cb_data;
+    bool did_run;
+    bool did_fail;
+    uint64_t test_cycle;
+
+    // private
+    struct artix_stim_setup *_setup;
+    uint64_t _start_us;
+
+    // private, set when only the first setup->num_vecs of the stim run
+    // so the executed vecs aren't checked against the whole stim
+    bool _is_prefix;
+};
+
+/*
+ * Result of artix_locate_stim_first_fail. vec_id is the first failing
+ * vec in tester memory and test_cycle the first failing unrolled vec.
+ * A failing clocked vec is located to its first cycle. is_flaky is set
+ * if the shortest failing run passed when rerun.
+ *
+ */
+struct artix_first_fail {
+    bool did_fail;
+    bool is_flaky;
+    uint64_t vec_id;
+    uint64_t test_cycle;
+    uint32_t num_runs;
+    uint8_t fail_pins[DUT_TOTAL_NUM_PINS];
+};
+
+// a fail capture masks at least one pin per record so it can't log more
+#define ARTIX_MAX_FAIL_RECORDS (DUT_TOTAL_NUM_PINS)
+
+/*
+ * One entry of a fail log, the cycle a capture run failed at and the
+ * dut_io_ids of the pins that failed there.
+ *
+ */
+struct artix_fail_record {
+    uint64_t test_cycle;
+    uint32_t num_pins;
+    uint16_t *dut_io_ids;
+};
+
+/*
+ * Fail log from artix_capture_stim_fails. It holds the first failing
+ * cycle of each pin, not every failing cycle: once a pin fails it's 
+ * masked for the rest of the capture. Records are in run order so test
+ * cycles never decrease. is_complete is set if every enabled pin was 
+ * checked to the end of the stim.
+ *
+ */
+struct artix_fail_log {
+    bool did_fail;
+    bool is_complete;
+    uint32_t num_runs;
+    uint32_t num_records;
+    struct artix_fail_record *records;
+};
+
 void artix_mem_write(enum artix_selects artix_select,
     uint64_t addr, uint64_t *write_data, size_t write_size);
 void artix_mem_read(enum artix_selects artix_select, uint64_t addr,
     uint64_t *read_data, size_t read_size);
+void artix_mem_copy(enum artix_selects artix_select, uint64_t dst_addr, 
+    uint64_t src_addr, uint64_t size);
 // if full test true, will run full 8GiB test. Returns true if pass.
 bool artix_mem_test(enum artix_selects artix_select, bool run_crc, bool full_test);
+// logs write/read MB/s for transfer sizes from 1KB to MAX_CHUNK_SIZE
+void artix_mem_bench(enum artix_selects artix_select, uint32_t num_repeats);
 // note: if stim is solo pattern, will use the appropriate artix addr. Just
 // give the same addr for both if unsure.
 uint64_t artix_load_stim(struct stim *stim, uint64_t a1_load_addr, uint64_t a2_load_addr);
+struct artix_stim_setup *artix_create_stim_setup(struct stim *stim, 
+    uint64_t a1_addr, uint64_t a2_addr);
+struct artix_stim_setup *artix_create_stim_site_setup(struct stim *stim, 
+    uint64_t a1_addr, uint64_t a2_addr, int32_t dut_id);
+void artix_free_stim_setup(struct artix_stim_setup *setup);
 bool artix_run_stim(struct stim *stim, uint64_t *test_cycle, 
     uint64_t a1_start_addr, uint64_t a2_start_addr);
+// runs back to back and fills in did_run, did_fail and test_cycle for
+// each run. Returns number of runs executed.
+uint32_t artix_run_stims(struct artix_stim_run *runs, uint32_t num_runs, 
+    bool run_continue);
+// runs an a1 solo and an a2 solo stim at the same time, unsynced
+bool artix_run_solo_stims(struct artix_stim_run *a1_run, 
+    struct artix_stim_run *a2_run);
+// bisects truncated runs to find the first failing vec and cycle
+bool artix_locate_stim_first_fail(struct artix_stim_run *run, 
+    struct artix_first_fail *first_fail);
+// reruns the stim masking pins as they fail and logs each pin's first
+// failing cycle, one full run per record
+struct artix_fail_log *artix_capture_stim_fails(struct artix_stim_run *run, 
+    uint32_t max_records);
+void artix_free_fail_log(struct artix_fail_log *fail_log);
 void artix_get_stim_fail_pins(uint8_t **fail_pins, uint32_t *num_fail_pins);
 void artix_print_stim_fail_pins(struct stim *stim, uint8_t *fail_pins, 
     uint32_t num_fail_pins);
@@ -15,14 +15,46 @@
 #include <sys/ioctl.h>
 #include <errno.h>
 #include <string.h>
+#include <inttypes.h>
+#include <pthread.h>
 
 #include "../common.h"
+#include "../perf.h"
 #include "dev.h"
 #include "driver.h"
 
+// the ioctl number is the low byte of the request on linux and bsd
+#ifndef _IOC_NR
+#define _IOC_NR(request) ((request) & 0xff)
+#endif
+
 static int gcore_fd = -1;
 static uint8_t *gcore_map = NULL;
 
+// updated with relaxed atomics, see gcore_dev_get_stats
+static struct gcore_dev_stats gcore_stats;
+
+// board lock, see gcore_dev_lock
+static pthread_mutex_t gcore_board_lock;
+static pthread_once_t gcore_board_lock_once = PTHREAD_ONCE_INIT;
+
+static const char *gcore_ioctl_names[GCORE_DEV_NUM_IOCTLS] = {
+    "regs_read",
+    "userdevs_read",
+    "subcore_load",
+    "subcore_run",
+    "subcore_idle",
+    "subcore_state",
+    "subcore_reset",
+    "artix_sync",
+    "ctrl_write",
+    "ctrl_read",
+    "dma_config",
+    "dma_prep",
+    "dma_start",
+    "dma_stop"
+};
+
 __attribute__((constructor))
 static void gcore_dev_init() {
 
@@ -75,4 +107,165 @@ uint8_t *gcore_dev_get_map(){
     return gcore_map;
 }
 
+static void gcore_dev_init_lock(void){
+    pthread_mutexattr_t attr;
+
+    if(pthread_mutexattr_init(&attr) != 0){
+        die("gcorelib: failed to init board lock attr");
+    }
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    if(pthread_mutex_init(&gcore_board_lock, &attr) != 0){
+        die("gcorelib: failed to init board lock");
+    }
+    pthread_mutexattr_destroy(&attr);
+    return;
+}
+
+/*
+ * Board lock. The artix, subcore and dma entry points hold it for the
+ * whole call, so threads driving the board, e.g. a prgm each, take turns
+ * instead of mixing their ioctls. It's recursive since entry points call
+ * each other. Hold it over several calls to keep other threads off the
+ * board in between. Take it before the resident lock, never after.
+ *
+ * Initialized on first use, the dma constructor may run before ours.
+ *
+ */
+void gcore_dev_lock(void){
+    pthread_once(&gcore_board_lock_once, gcore_dev_init_lock);
+    pthread_mutex_lock(&gcore_board_lock);
+    return;
+}
+
+void gcore_dev_unlock(void){
+    pthread_mutex_unlock(&gcore_board_lock);
+    return;
+}
+
+/*
+ * ioctl on the gcore device that counts the call and its latency by
+ * ioctl nr. The clock is read twice per call, which is noise next to
+ * the syscall, so the counters are always on.
+ *
+ */
+int gcore_dev_ioctl(int fd, unsigned long request, void *arg){
+    struct gcore_dev_ioctl_stats *ioctl_stats = NULL;
+    uint64_t start_ns = 0;
+    uint64_t duration_ns = 0;
+    uint64_t cur = 0;
+    uint32_t nr = 0;
+    int ret = 0;
+
+    start_ns = perf_now_ns();
+    ret = ioctl(fd, request, arg);
+    duration_ns = perf_now_ns() - start_ns;
+
+    if((nr = _IOC_NR(request)) >= GCORE_DEV_NUM_IOCTLS){
+        return ret;
+    }
+    ioctl_stats = &gcore_stats.ioctls[nr];
+    __atomic_fetch_add(&ioctl_stats->count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&ioctl_stats->total_ns, duration_ns, __ATOMIC_RELAXED);
+    cur = __atomic_load_n(&ioctl_stats->max_ns, __ATOMIC_RELAXED);
+    while(duration_ns > cur &&
+            !__atomic_compare_exchange_n(&ioctl_stats->max_ns, &cur, 
+                duration_ns, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    return ret;
+}
+
+void gcore_dev_add_dma_bytes(size_t tx_bytes, size_t rx_bytes){
+    __atomic_fetch_add(&gcore_stats.tx_bytes, tx_bytes, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&gcore_stats.rx_bytes, rx_bytes, __ATOMIC_RELAXED);
+    return;
+}
+
+void gcore_dev_add_mem_xfer(bool is_write, size_t bytes, uint64_t duration_ns){
+    struct gcore_dev_xfer_stats *xfer = NULL;
 
+    xfer = is_write ? &gcore_stats.mem_writes : &gcore_stats.mem_reads;
+    __atomic_fetch_add(&xfer->count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&xfer->bytes, bytes, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&xfer->total_ns, duration_ns, __ATOMIC_RELAXED);
+    __atomic_store_n(&xfer->last_bytes, bytes, __ATOMIC_RELAXED);
+    __atomic_store_n(&xfer->last_ns, duration_ns, __ATOMIC_RELAXED);
+    return;
+}
+
+/*
+ * Copies the counters into stats. Fields are read one by one, so a
+ * snapshot taken during a transfer can be a call apart between fields.
+ *
+ */
+void gcore_dev_get_stats(struct gcore_dev_stats *stats){
+    uint64_t *src = (uint64_t *)&gcore_stats;
+    uint64_t *dst = NULL;
+
+    if(stats == NULL){
+        die("pointer is NULL");
+    }
+
+    // every field is a uint64_t
+    dst = (uint64_t *)stats;
+    for(size_t i=0; i<sizeof(struct gcore_dev_stats)/sizeof(uint64_t); i++){
+        dst[i] = __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+    }
+    return;
+}
+
+void gcore_dev_reset_stats(void){
+    uint64_t *dst = (uint64_t *)&gcore_stats;
+
+    for(size_t i=0; i<sizeof(struct gcore_dev_stats)/sizeof(uint64_t); i++){
+        __atomic_store_n(&dst[i], 0, __ATOMIC_RELAXED);
+    }
+    return;
+}
+
+const char *gcore_dev_get_ioctl_name(uint32_t nr){
+    if(nr >= GCORE_DEV_NUM_IOCTLS){
+        die("invalid gcore ioctl nr %u", nr);
+    }
+    return gcore_ioctl_names[nr];
+}
+
+double gcore_dev_calc_mbps(uint64_t bytes, uint64_t duration_ns){
+    if(duration_ns == 0){
+        return 0.0;
+    }
+    // bytes per us is MB/s
+    return ((double)bytes * 1000.0) / (double)duration_ns;
+}
+
+void gcore_dev_print_stats(FILE *fp){
+    struct gcore_dev_stats stats;
+    struct gcore_dev_ioctl_stats *ioctl_stats = NULL;
+
+    if(fp == NULL){
+        die("pointer is NULL");
+    }
+
+    gcore_dev_get_stats(&stats);
+
+    fprintf(fp, "%-14s %10s %12s %10s %10s\n", "ioctl", "count", 
+        "total_us", "mean_us", "max_us");
+    for(uint32_t i=0; i<GCORE_DEV_NUM_IOCTLS; i++){
+        ioctl_stats = &stats.ioctls[i];
+        if(ioctl_stats->count == 0){
+            continue;
+        }
+        fprintf(fp, "%-14s %10" PRIu64 " %12" PRIu64 " %10" PRIu64 " %10" PRIu64 "\n",
+            gcore_ioctl_names[i], ioctl_stats->count, ioctl_stats->total_ns/1000,
+            (ioctl_stats->total_ns/ioctl_stats->count)/1000, ioctl_stats->max_ns/1000);
+    }
+    fprintf(fp, "dma tx %" PRIu64 " bytes, rx %" PRIu64 " bytes\n", 
+        stats.tx_bytes, stats.rx_bytes);
+    fprintf(fp, "mem writes %" PRIu64 " (%" PRIu64 " bytes, %.2f MB/s, last %.2f MB/s)\n",
+        stats.mem_writes.count, stats.mem_writes.bytes,
+        gcore_dev_calc_mbps(stats.mem_writes.bytes, stats.mem_writes.total_ns),
+        gcore_dev_calc_mbps(stats.mem_writes.last_bytes, stats.mem_writes.last_ns));
+    fprintf(fp, "mem reads %" PRIu64 " (%" PRIu64 " bytes, %.2f MB/s, last %.2f MB/s)\n",
+        stats.mem_reads.count, stats.mem_reads.bytes,
+        gcore_dev_calc_mbps(stats.mem_reads.bytes, stats.mem_reads.total_ns),
+        gcore_dev_calc_mbps(stats.mem_reads.last_bytes, stats.mem_reads.last_ns));
+    return;
+}
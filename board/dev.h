@@ -12,16 +12,72 @@
 extern "C" {
 #endif
 
+#include <stdio.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 
 #include "driver.h"
 
+// ioctls are counted by nr, GCORE_REGS_READ (0) to GCORE_DMA_STOP (13)
+#define GCORE_DEV_NUM_IOCTLS 14
+
+/*
+ * Calls and latency of one gcore ioctl, times in ns.
+ *
+ */
+struct gcore_dev_ioctl_stats {
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t max_ns;
+};
+
+/*
+ * Tester memory transfers done by artix_mem_write or artix_mem_read.
+ * last_bytes and last_ns are from the latest call, for its MB/s.
+ *
+ */
+struct gcore_dev_xfer_stats {
+    uint64_t count;
+    uint64_t bytes;
+    uint64_t total_ns;
+    uint64_t last_bytes;
+    uint64_t last_ns;
+};
+
+/*
+ * Snapshot of the traffic through /dev/gcore since the last reset.
+ *
+ * ioctls     : Per ioctl nr calls and latency.
+ * tx_bytes   : Bytes dma'd to the subcore.
+ * rx_bytes   : Bytes dma'd from the subcore.
+ * mem_writes : Whole artix_mem_write calls, including the setup ioctls.
+ * mem_reads  : Whole artix_mem_read calls, including the setup ioctls.
+ *
+ */
+struct gcore_dev_stats {
+    struct gcore_dev_ioctl_stats ioctls[GCORE_DEV_NUM_IOCTLS];
+    uint64_t tx_bytes;
+    uint64_t rx_bytes;
+    struct gcore_dev_xfer_stats mem_writes;
+    struct gcore_dev_xfer_stats mem_reads;
+};
 
 uint8_t gcore_dev_get_fd();
 uint8_t *gcore_dev_get_map();
 
+void gcore_dev_lock(void);
+void gcore_dev_unlock(void);
+
+int gcore_dev_ioctl(int fd, unsigned long request, void *arg);
+void gcore_dev_add_dma_bytes(size_t tx_bytes, size_t rx_bytes);
+void gcore_dev_add_mem_xfer(bool is_write, size_t bytes, uint64_t duration_ns);
+void gcore_dev_get_stats(struct gcore_dev_stats *stats);
+void gcore_dev_reset_stats(void);
+const char *gcore_dev_get_ioctl_name(uint32_t nr);
+double gcore_dev_calc_mbps(uint64_t bytes, uint64_t duration_ns);
+void gcore_dev_print_stats(FILE *fp);
+
 #ifdef __cplusplus
 }
 #endif
@@ -17,6 +17,7 @@
 #include <string.h>
 
 #include "../common.h"
+#include "../perf.h"
 #include "dev.h"
 #include "dma.h"
 #include "driver.h"
@@ -47,6 +48,18 @@ static bool is_dma_reg_mmap_init = false;
 static bool is_rx_prepared = false;
 static bool is_tx_prepared = false;
 
+/*
+ * The channel ids and completions in userdev don't change once the
+ * driver is open, so they're read on the first prep. tx_config and 
+ * rx_config hold what each channel was last configured with, which 
+ * lets a prep of the same buffer and size skip the config ioctl.
+ * Same sized slices from the dma buffer then cost a prep and a start.
+ *
+ */
+static bool is_userdev_read = false;
+static bool is_tx_configured = false;
+static bool is_rx_configured = false;
+
 
 __attribute__((constructor))
 static void gcore_dma_init() {
@@ -85,17 +98,51 @@ static void gcore_dma_destroy() {
     return;
 }
 
+#ifndef VERILATOR
+/*
+ * Configures a channel unless it's already configured with the same
+ * buffer, size and direction.
+ *
+ */
+static void gcore_dma_config_chan(int gcore_fd, struct gcore_chan_cfg *config,
+        bool *is_configured, u32 chan, u32 buf_offset, u32 buf_size, 
+        enum gcore_direction dir){
+    if(*is_configured && config->chan == chan && config->buf_offset == buf_offset
+            && config->buf_size == buf_size && config->dir == dir){
+        return;
+    }
+
+    config->chan = chan;
+    config->buf_offset = buf_offset;
+    config->buf_size = buf_size;
+    config->dir = dir;
+    if(gcore_dev_ioctl(gcore_fd, GCORE_DMA_CONFIG, config) < 0){
+        *is_configured = false;
+        if(dir == GCORE_MEM_TO_DEV){
+            die("gcorelib: error config dma tx chan");
+        }
+        die("gcorelib: error config dma rx chan");
+    }
+    *is_configured = true;
+    return;
+}
+#endif
+
 /* Perform DMA transaction
  *
  * To perform a one-way transaction set the unused directions pointer to NULL
- * or length to zero.
+ * or length to zero. Preps of the same buffer and size as the last one
+ * on a channel reuse its config, so refill the buffer in place when 
+ * sending a run of same sized slices.
  */
 void gcore_dma_prep( uint64_t *tx_ptr, size_t tx_size,
     uint64_t *rx_ptr, size_t rx_size)
 {
     const bool tx_used = ((tx_ptr != NULL) && (tx_size != 0));
     const bool rx_used = ((rx_ptr != NULL) && (rx_size != 0));
-    
+    uint64_t perf_start = perf_begin();
+
+    gcore_dev_lock();
 #ifdef VERILATOR
     if(tx_used){
         sim_tx_trans.dma_buf = tx_ptr;
@@ -113,45 +160,40 @@ void gcore_dma_prep( uint64_t *tx_ptr, size_t tx_size,
         die("failed to get gcore fd");
     }
 
-    userdev.tx_chan = (u32) 0;
-    userdev.tx_cmp = (u32) 0;
-    userdev.rx_chan = (u32) 0;
-    userdev.rx_cmp = (u32) 0;
+    if(!is_userdev_read){
+        userdev.tx_chan = (u32) 0;
+        userdev.tx_cmp = (u32) 0;
+        userdev.rx_chan = (u32) 0;
+        userdev.rx_cmp = (u32) 0;
 
-    if(ioctl(gcore_fd, GCORE_USERDEVS_READ, &userdev) < 0){
-        die("gcorelib: error userdevs_read failed");
+        if(gcore_dev_ioctl(gcore_fd, GCORE_USERDEVS_READ, &userdev) < 0){
+            die("gcorelib: error userdevs_read failed");
+        }
+        is_userdev_read = true;
     }
 
     if(tx_used){
-        tx_config.chan = userdev.tx_chan;
-        tx_config.buf_offset = (u32) gcore_dma_calc_offset(tx_ptr);
-        tx_config.buf_size = (u32) tx_size;
-        tx_config.dir = GCORE_MEM_TO_DEV;
-        if(ioctl(gcore_fd, GCORE_DMA_CONFIG, &tx_config) < 0){
-            die("gcorelib: error config dma tx chan");
-        }
+        gcore_dma_config_chan(gcore_fd, &tx_config, &is_tx_configured,
+            userdev.tx_chan, (u32) gcore_dma_calc_offset(tx_ptr), 
+            (u32) tx_size, GCORE_MEM_TO_DEV);
     }
 
     if(rx_used){
-        rx_config.chan = userdev.rx_chan;
-        rx_config.buf_offset = (u32) gcore_dma_calc_offset(rx_ptr);
-        rx_config.buf_size = (u32) rx_size;
-        rx_config.dir = GCORE_DEV_TO_MEM;
-        if(ioctl(gcore_fd, GCORE_DMA_CONFIG, &rx_config) < 0){
-            die("gcorelib: error config dma rx chan");
-        }
+        gcore_dma_config_chan(gcore_fd, &rx_config, &is_rx_configured,
+            userdev.rx_chan, (u32) gcore_dma_calc_offset(rx_ptr), 
+            (u32) rx_size, GCORE_DEV_TO_MEM);
     }
 
     if(tx_used){
         tx_config.completion = userdev.tx_cmp;
-        if(ioctl(gcore_fd, GCORE_DMA_PREP, &tx_config)){
+        if(gcore_dev_ioctl(gcore_fd, GCORE_DMA_PREP, &tx_config)){
             die("gcorelib: error prep dma tx buf");
         }
     }
 
     if(rx_used){
         rx_config.completion = userdev.rx_cmp;
-        if(ioctl(gcore_fd, GCORE_DMA_PREP, &rx_config)){
+        if(gcore_dev_ioctl(gcore_fd, GCORE_DMA_PREP, &rx_config)){
             die("gcorelib: error prep dma rx buf");
         }
     }
@@ -169,6 +211,8 @@ void gcore_dma_prep( uint64_t *tx_ptr, size_t tx_size,
         is_rx_prepared = false;
     }
 
+    gcore_dev_unlock();
+    perf_end(PERF_DMA_PREP, perf_start);
     return;
 }
 
@@ -181,7 +225,9 @@ void gcore_dma_start(enum gcore_wait wait)
 {   
     struct gcore_transfer rx_trans;
     struct gcore_transfer tx_trans;
+    uint64_t perf_start = perf_begin();
 
+    gcore_dev_lock();
     if(!(is_tx_prepared || is_rx_prepared)){
         die("gcorelib: error starting dma, not prepared yet");
     }
@@ -190,11 +236,13 @@ void gcore_dma_start(enum gcore_wait wait)
     struct chip *chip = get_chip_instance();
     if(is_tx_prepared){
         sim_ioctl_subcore_dma_write(chip, sim_tx_trans.dma_buf, sim_tx_trans.dma_size);
+        gcore_dev_add_dma_bytes(sim_tx_trans.dma_size, 0);
         is_tx_prepared = false;
     }
 
     if(is_rx_prepared){
         sim_ioctl_subcore_dma_read(chip, sim_rx_trans.dma_buf, sim_rx_trans.dma_size);
+        gcore_dev_add_dma_bytes(0, sim_rx_trans.dma_size);
         is_rx_prepared = false;
     }
 
@@ -214,9 +262,10 @@ void gcore_dma_start(enum gcore_wait wait)
         tx_trans.buf_size = tx_config.buf_size;
         
         
-        if(ioctl(gcore_fd, GCORE_DMA_START, &tx_trans)){
+        if(gcore_dev_ioctl(gcore_fd, GCORE_DMA_START, &tx_trans)){
             die("gcorelib: error starting dma tx transaction");
         }
+        gcore_dev_add_dma_bytes(tx_trans.buf_size, 0);
 
         // reset flag
         is_tx_prepared = false;
@@ -230,15 +279,18 @@ void gcore_dma_start(enum gcore_wait wait)
         rx_trans.cookie = rx_config.cookie;
         rx_trans.buf_size = rx_config.buf_size;
 
-        if(ioctl(gcore_fd, GCORE_DMA_START, &rx_trans)){
+        if(gcore_dev_ioctl(gcore_fd, GCORE_DMA_START, &rx_trans)){
             die("gcorelib: error starting dma rx transaction");
         }
+        gcore_dev_add_dma_bytes(0, rx_trans.buf_size);
         
         // reset flag
         is_rx_prepared = false;
     }
 #endif
 
+    gcore_dev_unlock();
+    perf_end(PERF_DMA_START, perf_start);
     return;
 }
 
@@ -251,6 +303,7 @@ void gcore_dma_stop()
     struct gcore_transfer rx_trans;
     struct gcore_transfer tx_trans;
 
+    gcore_dev_lock();
     if(!(is_tx_prepared || is_rx_prepared)){
         die("gcorelib: error failed to stop dma, nothing is running");
     }
@@ -269,21 +322,24 @@ void gcore_dma_stop()
     if(is_tx_prepared){
         tx_trans.chan = userdev.tx_chan;
         
-        if(ioctl(gcore_fd, GCORE_DMA_STOP, &(tx_trans.chan))){
+        if(gcore_dev_ioctl(gcore_fd, GCORE_DMA_STOP, &(tx_trans.chan))){
             die("gcorelib: error stopping dma tx trans");
         }
         is_tx_prepared = false;
+        is_tx_configured = false;
     }
 
     if(is_rx_prepared){
         rx_trans.chan = userdev.rx_chan;
         
-        if(ioctl(gcore_fd, GCORE_DMA_STOP, &(rx_trans.chan))){
+        if(gcore_dev_ioctl(gcore_fd, GCORE_DMA_STOP, &(rx_trans.chan))){
             die("gcorelib: error stopping dma rx trans");
         }
         is_rx_prepared = false;
+        is_rx_configured = false;
     }
 #endif
+    gcore_dev_unlock();
     return;
 }
 
@@ -311,13 +367,17 @@ void *gcore_dma_alloc(int length, int byte_num){
     if((gcore_map = gcore_dev_get_map()) == NULL){
         die("failed to get gcore dev map");
     }
+    gcore_dev_lock();
     void *array = &gcore_map[alloc_offset];
     alloc_offset += gcore_dma_calc_size(length, byte_num);
+    gcore_dev_unlock();
     return array;
 }
 
 void gcore_dma_alloc_reset(void){
+    gcore_dev_lock();
     alloc_offset = 0;
+    gcore_dev_unlock();
 }
 
 /*
@@ -326,8 +386,10 @@ void gcore_dma_alloc_reset(void){
 void gcore_dma_prep_start(enum gcore_wait wait,
     uint64_t *tx_ptr, size_t tx_size,
     uint64_t *rx_ptr, size_t rx_size){
+    gcore_dev_lock();
     gcore_dma_prep(tx_ptr, tx_size, rx_ptr, rx_size);
     gcore_dma_start(wait);
+    gcore_dev_unlock();
     return;
 }
 
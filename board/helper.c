@@ -18,6 +18,7 @@
 
 #include "../common.h"
 #include "../util.h"
+#include "../perf.h"
 #include "helper.h"
 #include "subcore.h"
 #include "driver.h"
@@ -156,7 +157,7 @@ void helper_agent_load(enum artix_selects artix_select,
     enum agent_states agent_state){
     struct gcore_ctrl_packet packet;
     enum subcore_states subcore_state;
-    struct gcore_registers *regs = NULL;
+    struct gcore_registers regs;
     bool agent_did_startup = false;
 
     packet.rank_select = 0;
@@ -170,19 +171,11 @@ void helper_agent_load(enum artix_selects artix_select,
     }
 
     // Need to check for error
-    regs = subcore_get_regs();
-    if(regs != NULL){
-        if(artix_select == ARTIX_SELECT_A1){
-            if((regs->a1_status & GCORE_AGENT_STARTUP_DONE_MASK) == GCORE_AGENT_STARTUP_DONE_MASK){
-                agent_did_startup = true;
-            }
-        } else if (artix_select == ARTIX_SELECT_A2) {
-            if((regs->a2_status & GCORE_AGENT_STARTUP_DONE_MASK) == GCORE_AGENT_STARTUP_DONE_MASK){
-                agent_did_startup = true;
-            }
-        }
+    subcore_read_regs(&regs);
+    if((subcore_get_status_reg(&regs, artix_select) & GCORE_AGENT_STARTUP_DONE_MASK) 
+            == GCORE_AGENT_STARTUP_DONE_MASK){
+        agent_did_startup = true;
     }
-    regs = subcore_free_regs(regs);
 
     /*
      * Only run state once. Each time it runs it asserts artix_reset_b and
@@ -210,15 +203,12 @@ void helper_agent_load(enum artix_selects artix_select,
         print_packet(&packet, "agent startup: ");
 
         // Need to check for error
-        regs = subcore_get_regs();
-        if(regs != NULL){
-            if((regs->status & GCORE_STATUS_INIT_ERROR_MASK) == GCORE_STATUS_INIT_ERROR_MASK){
-                print_regs(regs);
-                slog_error("Agent startup init error.");
-                exit(1);
-            }
+        subcore_read_regs(&regs);
+        if((regs.status & GCORE_STATUS_INIT_ERROR_MASK) == GCORE_STATUS_INIT_ERROR_MASK){
+            print_regs(&regs);
+            slog_error("Agent startup init error.");
+            exit(1);
         }
-        regs = subcore_free_regs(regs);
     }
     
     // fill packet
@@ -404,8 +394,8 @@ uint64_t helper_get_agent_gvpu_status(enum artix_selects artix_select,
         enum gvpu_status_selects select, enum gvpu_status_cmds cmd){
     struct gcore_ctrl_packet packet;
     uint64_t status = 0;
+    uint64_t perf_start = perf_begin();
 
-    
     helper_agent_load(artix_select, GVPU_STATUS);
     helper_subcore_load(artix_select, CTRL_WRITE);
 
@@ -430,6 +420,7 @@ uint64_t helper_get_agent_gvpu_status(enum artix_selects artix_select,
     status = status | (((uint64_t)(packet.addr)) << 32);
     status = status | (((uint64_t)(packet.data)) << 0);
 
+    perf_end(PERF_AGENT_POLL, perf_start);
     return status;
 }
 
@@ -442,6 +433,7 @@ uint64_t helper_get_agent_gvpu_status(enum artix_selects artix_select,
  */
 void helper_get_agent_status(enum artix_selects artix_select, 
         struct gcore_ctrl_packet *packet){
+    uint64_t perf_start = perf_begin();
 
     if(packet == NULL){
         die("pointer is NULL");
@@ -464,6 +456,7 @@ void helper_get_agent_status(enum artix_selects artix_select,
     
     // wait for subcore idle state
     subcore_idle();
+    perf_end(PERF_AGENT_POLL, perf_start);
     return;
 }
 
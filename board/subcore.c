@@ -18,9 +18,11 @@
 #include <stdbool.h>
 #include <fcntl.h>
 #include <inttypes.h>
+#include <time.h>
 
 #include "../common.h"
 #include "../util.h"
+#include "../perf.h"
 #include "dev.h"
 #include "subcore.h"
 #include "driver.h"
@@ -29,10 +31,40 @@
 #include "../../sim/chip_top/chip.h"
 #endif
 
+static void subcore_read_driver_regs(struct gcore_registers *regs, void *data);
+
+static struct subcore_regs_backend subcore_driver_backend = {
+    .read_regs = subcore_read_driver_regs,
+    .data = NULL
+};
+
+/*
+ * Register snapshots come from regs_backend. If regs_coalesce_ns is set,
+ * a read within that many ns of the last one returns the last snapshot
+ * instead of going to the driver. Anything that changes subcore state
+ * drops the snapshot so a read after it is always fresh. Like the dma
+ * state, this is only touched with the board lock held.
+ *
+ */
+static struct subcore_regs_backend *regs_backend = &subcore_driver_backend;
+static uint64_t regs_coalesce_ns = 0;
+static struct gcore_registers last_regs;
+static uint64_t last_regs_ns = 0;
+static bool is_last_regs_valid = false;
+static uint64_t num_subcore_resets = 0;
+
+static void subcore_drop_regs(void){
+    is_last_regs_valid = false;
+    return;
+}
+
 /*
  * Configure subcore with an FSM state and artix unit.
  */
 void subcore_load(struct gcore_cfg *gcfg){
+    gcore_dev_lock();
+    subcore_drop_regs();
+    uint64_t perf_start = perf_begin();
 #ifdef VERILATOR
     struct chip *chip = get_chip_instance();
     sim_ioctl_subcore_load(chip, gcfg->artix_select, gcfg->subcore_state);
@@ -41,10 +73,12 @@ void subcore_load(struct gcore_cfg *gcfg){
     if((gcore_fd = gcore_dev_get_fd()) == -1){
         die("failed to get gcore fd");
     }
-    if(ioctl(gcore_fd, GCORE_SUBCORE_LOAD, gcfg) < 0){
+    if(gcore_dev_ioctl(gcore_fd, GCORE_SUBCORE_LOAD, gcfg) < 0){
         die("gcorelib: error subcore_load failed");
     }
 #endif
+    perf_end(PERF_SUBCORE_STATE, perf_start);
+    gcore_dev_unlock();
     return;
 }
 
@@ -52,6 +86,9 @@ void subcore_load(struct gcore_cfg *gcfg){
  * Run loaded state.
  */
 void subcore_run(){
+    gcore_dev_lock();
+    subcore_drop_regs();
+    uint64_t perf_start = perf_begin();
 #ifdef VERILATOR
     struct chip *chip = get_chip_instance();
     sim_ioctl_subcore_run(chip);
@@ -60,10 +97,12 @@ void subcore_run(){
     if((gcore_fd = gcore_dev_get_fd()) == -1){
         die("failed to get gcore fd");
     }
-    if(ioctl(gcore_fd, GCORE_SUBCORE_RUN) < 0){
+    if(gcore_dev_ioctl(gcore_fd, GCORE_SUBCORE_RUN, NULL) < 0){
         die("gcorelib: error subcore_run failed");
     }
 #endif
+    perf_end(PERF_SUBCORE_STATE, perf_start);
+    gcore_dev_unlock();
     return;
 }
 
@@ -71,6 +110,9 @@ void subcore_run(){
  * Waits for subcore to go back to IDLE state.
  */
 void subcore_idle(){
+    gcore_dev_lock();
+    subcore_drop_regs();
+    uint64_t perf_start = perf_begin();
 #ifdef VERILATOR
     struct chip *chip = get_chip_instance();
     sim_ioctl_subcore_idle(chip);
@@ -80,10 +122,12 @@ void subcore_idle(){
         die("failed to get gcore fd");
     }
     // wait for done to go high
-    if(ioctl(gcore_fd, GCORE_SUBCORE_IDLE) < 0){
+    if(gcore_dev_ioctl(gcore_fd, GCORE_SUBCORE_IDLE, NULL) < 0){
         die("gcorelib: error subcore_idle failed");
     }
 #endif
+    perf_end(PERF_SUBCORE_STATE, perf_start);
+    gcore_dev_unlock();
     return;
 }
 
@@ -92,7 +136,10 @@ void subcore_idle(){
  *
  */
 void subcore_mode_state(uint32_t *mode_state){
-    struct gcore_registers *regs;
+    struct gcore_registers regs;
+
+    gcore_dev_lock();
+    subcore_drop_regs();
 #ifdef VERILATOR
     struct chip *chip = get_chip_instance();
     sim_ioctl_subcore_state(chip);
@@ -101,13 +148,13 @@ void subcore_mode_state(uint32_t *mode_state){
     if((gcore_fd = gcore_dev_get_fd()) == -1){
         die("failed to get gcore fd");
     }
-    if(ioctl(gcore_fd, GCORE_SUBCORE_STATE) < 0){
+    if(gcore_dev_ioctl(gcore_fd, GCORE_SUBCORE_STATE, NULL) < 0){
         die("gcorelib: error subcore_state failed");
     }
 #endif
-    regs = subcore_get_regs();
-    (*mode_state) = (uint32_t)regs->data;
-    regs = subcore_free_regs(regs);
+    subcore_read_regs(&regs);
+    (*mode_state) = (uint32_t)regs.data;
+    gcore_dev_unlock();
     return;
 }
 
@@ -115,6 +162,9 @@ void subcore_mode_state(uint32_t *mode_state){
  * Peform a subcore soft reset.
  */
 void subcore_reset(){
+    gcore_dev_lock();
+    subcore_drop_regs();
+    num_subcore_resets++;
 #ifdef VERILATOR
     struct chip *chip = get_chip_instance();
     sim_ioctl_subcore_reset(chip);
@@ -123,13 +173,28 @@ void subcore_reset(){
     if((gcore_fd = gcore_dev_get_fd()) == -1){
         die("failed to get gcore fd");
     }
-    if(ioctl(gcore_fd, GCORE_SUBCORE_RESET) < 0){
+    if(gcore_dev_ioctl(gcore_fd, GCORE_SUBCORE_RESET, NULL) < 0){
         die("gcorelib: error subcore_reset failed");
     }
 #endif
+    gcore_dev_unlock();
     return;
 }
 
+/*
+ * Number of soft resets so far. Lets callers caching gvpu state notice
+ * a reset they didn't issue.
+ *
+ */
+uint64_t subcore_get_num_resets(){
+    uint64_t num_resets = 0;
+
+    gcore_dev_lock();
+    num_resets = num_subcore_resets;
+    gcore_dev_unlock();
+    return num_resets;
+}
+
 /* ==========================================================================
  * CTRL
  * ==========================================================================
@@ -141,6 +206,8 @@ void subcore_reset(){
  * and data regs.
  */
 void subcore_write_packet(struct gcore_ctrl_packet *packet){
+    gcore_dev_lock();
+    subcore_drop_regs();
 #ifdef VERILATOR
     struct chip *chip = get_chip_instance();
     sim_ioctl_subcore_ctrl_write(chip, packet);
@@ -149,10 +216,11 @@ void subcore_write_packet(struct gcore_ctrl_packet *packet){
     if((gcore_fd = gcore_dev_get_fd()) == -1){
         die("failed to get gcore fd");
     }
-    if(ioctl(gcore_fd, GCORE_CTRL_WRITE, packet) < 0){
+    if(gcore_dev_ioctl(gcore_fd, GCORE_CTRL_WRITE, packet) < 0){
         die("gcorelib: error ctrl_write failed");
     }
 #endif
+    gcore_dev_unlock();
     return;
 }
 
@@ -161,6 +229,8 @@ void subcore_write_packet(struct gcore_ctrl_packet *packet){
  * will read from subcore into the rank_sel, addr, data.
  */
 void subcore_read_packet(struct gcore_ctrl_packet *packet){
+    gcore_dev_lock();
+    subcore_drop_regs();
 #ifdef VERILATOR
     struct chip *chip = get_chip_instance();
     sim_ioctl_subcore_ctrl_read(chip, packet);
@@ -169,10 +239,11 @@ void subcore_read_packet(struct gcore_ctrl_packet *packet){
     if((gcore_fd = gcore_dev_get_fd()) == -1){
         die("failed to get gcore fd");
     }
-    if(ioctl(gcore_fd, GCORE_CTRL_READ, packet) < 0){
+    if(gcore_dev_ioctl(gcore_fd, GCORE_CTRL_READ, packet) < 0){
         die("gcorelib: error ctrl_read failed");
     }
 #endif
+    gcore_dev_unlock();
     return;
 }
 
@@ -186,6 +257,9 @@ void subcore_artix_sync(bool sync){
     int gcore_fd = -1;
     struct gcore_ctrl_packet packet;
 
+    gcore_dev_lock();
+    subcore_drop_regs();
+
     packet.rank_select = 0;
     packet.addr = 0x00000000;
     if(sync){
@@ -200,21 +274,19 @@ void subcore_artix_sync(bool sync){
     if((gcore_fd = gcore_dev_get_fd()) == -1){
         die("failed to get gcore fd");
     }
-    if(ioctl(gcore_fd, GCORE_ARTIX_SYNC, &packet) < 0){
+    if(gcore_dev_ioctl(gcore_fd, GCORE_ARTIX_SYNC, &packet) < 0){
         die("gcorelib: error artix_sync failed");
     }
 #endif
+    gcore_dev_unlock();
     return;
 }
 
 /*
- * Gets all values of the registers.
+ * Reads the registers through the driver. Default register backend.
+ *
  */
-struct gcore_registers* subcore_get_regs(){
-    struct gcore_registers *regs = NULL;
-    if((regs = (struct gcore_registers *) malloc(sizeof(struct gcore_registers))) == NULL){
-        die("error: malloc failed");
-    }
+static void subcore_read_driver_regs(struct gcore_registers *regs, void *data){
     regs->control = (u32) 0;
     regs->status = (u32) 0;
     regs->addr = (u32) 0;
@@ -231,10 +303,180 @@ struct gcore_registers* subcore_get_regs(){
         die("failed to get gcore fd");
     }
     
-    if(ioctl(gcore_fd, GCORE_REGS_READ, regs) < 0){
+    if(gcore_dev_ioctl(gcore_fd, GCORE_REGS_READ, regs) < 0){
         die("gcorelib: error regs_read failed");
     }
 #endif
+    return;
+}
+
+/*
+ * Sets where register snapshots are read from. NULL goes back to the
+ * driver.
+ *
+ */
+void subcore_set_regs_backend(struct subcore_regs_backend *backend){
+    if(backend != NULL && backend->read_regs == NULL){
+        die("register backend has no read_regs");
+    }
+    gcore_dev_lock();
+    regs_backend = (backend != NULL) ? backend : &subcore_driver_backend;
+    subcore_drop_regs();
+    gcore_dev_unlock();
+    return;
+}
+
+/*
+ * Reads within window_ns of the last read return the same snapshot.
+ * 0, the default, reads the registers every time.
+ *
+ */
+void subcore_set_regs_coalesce_ns(uint64_t window_ns){
+    gcore_dev_lock();
+    regs_coalesce_ns = window_ns;
+    subcore_drop_regs();
+    gcore_dev_unlock();
+    return;
+}
+
+static void subcore_read_fresh_regs(struct gcore_registers *regs){
+    regs_backend->read_regs(regs, regs_backend->data);
+    if(regs_coalesce_ns > 0){
+        last_regs = *regs;
+        last_regs_ns = perf_now_ns();
+        is_last_regs_valid = true;
+    }
+    return;
+}
+
+/*
+ * Fills regs with a snapshot of the registers. Use this over 
+ * subcore_get_regs, it doesn't allocate.
+ *
+ */
+void subcore_read_regs(struct gcore_registers *regs){
+    if(regs == NULL){
+        die("pointer is NULL");
+    }
+
+    gcore_dev_lock();
+    if(is_last_regs_valid && regs_coalesce_ns > 0 
+            && perf_now_ns()-last_regs_ns < regs_coalesce_ns){
+        *regs = last_regs;
+    }else{
+        subcore_read_fresh_regs(regs);
+    }
+    gcore_dev_unlock();
+    return;
+}
+
+/*
+ * Status register of a unit, or the subcore status for ARTIX_SELECT_NONE.
+ *
+ */
+uint32_t subcore_get_status_reg(struct gcore_registers *regs, 
+        enum artix_selects artix_select){
+    if(regs == NULL){
+        die("pointer is NULL");
+    }
+
+    switch(artix_select){
+        case ARTIX_SELECT_NONE:
+            return regs->status;
+        case ARTIX_SELECT_A1:
+            return regs->a1_status;
+        case ARTIX_SELECT_A2:
+            return regs->a2_status;
+        default:
+            die("can't get the status of both units in one reg");
+    }
+    return 0;
+}
+
+static void subcore_sleep_us(uint64_t usecs){
+    struct timespec ts;
+    ts.tv_sec = (time_t)(usecs/1000000);
+    ts.tv_nsec = (long)((usecs%1000000)*1000);
+    while(nanosleep(&ts, &ts) == -1 && errno == EINTR);
+    return;
+}
+
+/*
+ * Polls the status register until (status & mask) == value matches
+ * is_equal. Spins SUBCORE_WAIT_NUM_SPINS reads first, since most state
+ * changes land within a few reads, then sleeps between reads doubling
+ * from SUBCORE_WAIT_MIN_SLEEP_US up to SUBCORE_WAIT_MAX_SLEEP_US.
+ *
+ */
+static bool subcore_poll_state(enum artix_selects artix_select, uint32_t mask,
+        uint32_t value, bool is_equal, uint64_t timeout_us){
+    struct gcore_registers regs;
+    uint64_t deadline_ns = perf_now_ns()+(timeout_us*1000);
+    uint64_t sleep_us = SUBCORE_WAIT_MIN_SLEEP_US;
+    uint32_t num_spins = 0;
+
+    while(1){
+        // polls always read the registers, never a coalesced snapshot
+        subcore_read_fresh_regs(&regs);
+        if(((subcore_get_status_reg(&regs, artix_select) & mask) == value) == is_equal){
+            return true;
+        }
+        if(perf_now_ns() >= deadline_ns){
+            return false;
+        }
+        if(num_spins < SUBCORE_WAIT_NUM_SPINS){
+            num_spins++;
+            continue;
+        }
+        subcore_sleep_us(sleep_us);
+        sleep_us = sleep_us*2;
+        if(sleep_us > SUBCORE_WAIT_MAX_SLEEP_US){
+            sleep_us = SUBCORE_WAIT_MAX_SLEEP_US;
+        }
+    }
+    return false;
+}
+
+/*
+ * Waits until the masked status register of the unit equals value.
+ * Returns false if it doesn't by timeout_us.
+ *
+ */
+bool subcore_wait_for_state(enum artix_selects artix_select, uint32_t mask, 
+        uint32_t value, uint64_t timeout_us){
+    bool is_state = false;
+
+    gcore_dev_lock();
+    is_state = subcore_poll_state(artix_select, mask, value, true, timeout_us);
+    gcore_dev_unlock();
+    return is_state;
+}
+
+/*
+ * Waits until the masked status register of the unit stops equaling
+ * value. Returns false if it still does at timeout_us.
+ *
+ */
+bool subcore_wait_for_state_change(enum artix_selects artix_select, 
+        uint32_t mask, uint32_t value, uint64_t timeout_us){
+    bool is_changed = false;
+
+    gcore_dev_lock();
+    is_changed = subcore_poll_state(artix_select, mask, value, false, timeout_us);
+    gcore_dev_unlock();
+    return is_changed;
+}
+
+/*
+ * Gets all values of the registers. The snapshot is malloced, free it
+ * with subcore_free_regs.
+ */
+struct gcore_registers* subcore_get_regs(){
+    struct gcore_registers *regs = NULL;
+    if((regs = (struct gcore_registers *) malloc(sizeof(struct gcore_registers))) == NULL){
+        die("error: malloc failed");
+    }
+    subcore_read_regs(regs);
     return regs;
 }
 
@@ -25,6 +25,7 @@ void subcore_run(void);
 void subcore_idle(void);
 void subcore_mode_state(uint32_t *mode_state);
 void subcore_reset(void);
+uint64_t subcore_get_num_resets(void);
 
 /*
  * Crtl Axi
@@ -42,6 +43,33 @@ void subcore_artix_sync(bool sync);
  * Registers
  *
  */
+
+// polls spin this many times before sleeping between reads
+#define SUBCORE_WAIT_NUM_SPINS (64)
+#define SUBCORE_WAIT_MIN_SLEEP_US (10)
+#define SUBCORE_WAIT_MAX_SLEEP_US (1000)
+
+/*
+ * Where register snapshots come from. The default backend reads them
+ * through the gcore driver, or the simulator under verilator. Set a 
+ * fake backend to run the register logic without a board.
+ *
+ */
+struct subcore_regs_backend {
+    void (*read_regs)(struct gcore_registers *regs, void *data);
+    void *data;
+};
+
+void subcore_set_regs_backend(struct subcore_regs_backend *backend);
+void subcore_set_regs_coalesce_ns(uint64_t window_ns);
+void subcore_read_regs(struct gcore_registers *regs);
+uint32_t subcore_get_status_reg(struct gcore_registers *regs, 
+    enum artix_selects artix_select);
+bool subcore_wait_for_state(enum artix_selects artix_select, uint32_t mask, 
+    uint32_t value, uint64_t timeout_us);
+bool subcore_wait_for_state_change(enum artix_selects artix_select, 
+    uint32_t mask, uint32_t value, uint64_t timeout_us);
+
 struct gcore_registers* subcore_get_regs(void);
 struct gcore_registers* subcore_free_regs(struct gcore_registers *regs);
 
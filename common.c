@@ -11,6 +11,7 @@
 #include <unistd.h>
 
 #include "common.h"
+#include "perf.h"
 
 static bool did_init = false;
 
@@ -51,6 +52,8 @@ void gcore_init(){
         slgCfg.nToScreen = 1;
         slgCfg.nToFile = 1;
         slgCfg.nFlush = 1;
+        // file lines are written by the slog writer thread
+        slgCfg.nAsync = 1;
         slog_config_set(&slgCfg);
         did_init = true;
     }
@@ -58,6 +61,7 @@ void gcore_init(){
 }
 
 static void _gcore_destroy(){
+    perf_stop_dump();
     slog_destroy();
     return;
 }
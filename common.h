@@ -20,10 +20,39 @@ extern "C" {
 #include <stdint.h>
 #include <stdbool.h>
 
-#ifdef VERILATOR
-#define GEM_DEBUG
+// log levels ordered by verbosity
+#define GCORE_LOG_LEVEL_TRACE (0)
+#define GCORE_LOG_LEVEL_DEBUG (1)
+#define GCORE_LOG_LEVEL_INFO (2)
+#define GCORE_LOG_LEVEL_WARN (3)
+#define GCORE_LOG_LEVEL_ERROR (4)
+
+// slog calls below the min level are compiled out. The arm release build
+// sets it to info.
+#ifndef GCORE_LOG_MIN_LEVEL
+#define GCORE_LOG_MIN_LEVEL GCORE_LOG_LEVEL_TRACE
+#endif
+
+// if(0) keeps the arguments type checked without evaluating them
+#if GCORE_LOG_MIN_LEVEL > GCORE_LOG_LEVEL_TRACE
+#undef slog_trace
+#define slog_trace(...) do{ if(0){ slog_display(SLOG_TRACE, 1, __VA_ARGS__); } }while(0)
+#endif
+#if GCORE_LOG_MIN_LEVEL > GCORE_LOG_LEVEL_DEBUG
+#undef slog_debug
+#define slog_debug(...) do{ if(0){ slog_display(SLOG_DEBUG, 1, __VA_ARGS__); } }while(0)
+#endif
+#if GCORE_LOG_MIN_LEVEL > GCORE_LOG_LEVEL_INFO
+#undef slog_info
+#define slog_info(...) do{ if(0){ slog_display(SLOG_INFO, 1, __VA_ARGS__); } }while(0)
+#endif
+
+// Gate for loops and helpers that only exist to log debug lines. False
+// at compile time if debug is compiled out, otherwise checks the level.
+#if GCORE_LOG_MIN_LEVEL > GCORE_LOG_LEVEL_DEBUG
+#define GCORE_LOG_DEBUG_ENABLED() (false)
 #else
-#define GEM_DEBUG
+#define GCORE_LOG_DEBUG_ENABLED() (slog_is_enabled(SLOG_DEBUG))
 #endif
 
 // can't include kernel headers so add defines here
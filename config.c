@@ -209,18 +209,17 @@ struct profile_pin **get_config_profile_pins(struct profile *profile, int32_t du
     for(int i=0; i<num_tags; i++){
         num_pins = 0;
         pins = NULL;
-        if((pins = get_profile_pins_by_tag(profile, dut_id, config_tags[i], &num_pins)) == NULL){
+        if((pins = find_profile_pins_by_tag(profile, dut_id, config_tags[i], &num_pins)) == NULL){
             die("error: pointer is NULL");
         }
         for(int j=0; j<num_pins; j++){
             if((*found_num_pins) < num_config_pins){
-                config_pins[(*found_num_pins)++] = create_profile_pin_from_pin(pins[j]);
+                config_pins[(*found_num_pins)++] = retain_profile_pin(pins[j]);
             }else{
                 die("error: failed to get config pins, length exceeded.");
             }
         }
         num_found_pins += num_pins;
-        pins = free_profile_pins(pins, num_pins);
     }
 
     if(num_found_pins != num_config_pins){
@@ -272,6 +271,7 @@ struct config *create_config(struct profile *profile, enum config_types type, ui
         die("error: failed to get profile config pins");
     }
     config->dots = create_dots((num_loop_vecs*num_dots_vecs), pins, num_pins);
+    pins = free_profile_pins(pins, num_pins);
 
     // save order of config pins, so stim can iterate through correct
     // order when accessing it's pins
@@ -15,6 +15,8 @@
 #include <stdbool.h>
 #include <fcntl.h>
 #include <inttypes.h>
+#include <pthread.h>
+#include <time.h>
 
 #include "sqlite3.h"
 #include "lib/uthash/utstring.h"
@@ -24,6 +26,7 @@
 #include "util.h"
 #include "sql.h"
 #include "db.h"
+#include "perf.h"
 
 
 #ifndef STRDUP
@@ -62,6 +65,22 @@ struct db *db_create(){
     db->path = NULL;
     db->_db = NULL;
     db->is_open = false;
+    db->is_readonly = false;
+    db->in_snapshot = false;
+
+    db->_num_readers = 0;
+    db->_readers = NULL;
+    pthread_mutex_init(&db->_pool_lock, NULL);
+    pthread_cond_init(&db->_pool_cond, NULL);
+
+    db->_pool = NULL;
+    db->_is_checked_out = false;
+    db->_num_checkouts = 0;
+
+    db->_event_seq = 0;
+    db->_events_dirty = false;
+    pthread_mutex_init(&db->_event_lock, NULL);
+    pthread_cond_init(&db->_event_cond, NULL);
 
     return db;
 }
@@ -73,10 +92,78 @@ void db_free(struct db *db){
     if(db->is_open){
         die("failed to free db because db connection is still open.");
     }
+    for(uint32_t i=0; i<db->_num_readers; i++){
+        db_free(db->_readers[i]);
+    }
+    free(db->_readers);
+    pthread_mutex_destroy(&db->_pool_lock);
+    pthread_cond_destroy(&db->_pool_cond);
+    pthread_mutex_destroy(&db->_event_lock);
+    pthread_cond_destroy(&db->_event_cond);
     free(db);
     return;
 }
 
+/*
+ * Called for every row written through the writer connection, including
+ * rows inserted by the event triggers. The transaction isn't committed
+ * yet so only mark it; waiters are woken from the wal hook.
+ *
+ */
+static void db_update_hook(void *data, int op, 
+        const char *db_name, const char *table_name, sqlite3_int64 row_id){
+    struct db *db = (struct db*)data;
+    if(op == SQLITE_INSERT && strcmp(table_name, "events") == 0){
+        db->_events_dirty = true;
+    }
+    return;
+}
+
+/*
+ * Called after each commit in WAL mode. Replaces the default auto
+ * checkpoint hook, so checkpoint at the same 1000 page threshold.
+ *
+ */
+static int db_wal_hook(void *data, sqlite3 *conn, const char *db_name, int num_pages){
+    struct db *db = (struct db*)data;
+
+    if(db->_events_dirty){
+        pthread_mutex_lock(&db->_event_lock);
+        db->_events_dirty = false;
+        db->_event_seq++;
+        pthread_cond_broadcast(&db->_event_cond);
+        pthread_mutex_unlock(&db->_event_lock);
+    }
+
+    if(num_pages >= 1000){
+        sqlite3_wal_checkpoint_v2(conn, db_name, SQLITE_CHECKPOINT_PASSIVE, NULL, NULL);
+    }
+    return SQLITE_OK;
+}
+
+/*
+ * Dbs created before a column was added don't get it from the create
+ * table sql, so add it here.
+ *
+ */
+static void db_add_missing_columns(struct db *db){
+    sqlite3_stmt *res = NULL;
+    char *err_msg = NULL;
+
+    if(sqlite3_prepare_v2(db->_db, DB_SQL_STIMS_SITE_CHECK, -1, &res, 0) == SQLITE_OK){
+        sqlite3_finalize(res);
+        return;
+    }
+    sqlite3_finalize(res);
+
+    if(sqlite3_exec(db->_db, DB_SQL_STIMS_SITE_ADD, 0, 0, &err_msg) != SQLITE_OK){
+        slog_error("failed to add site column to stims: %s", err_msg);
+        sqlite3_free(err_msg);
+    }
+
+    return;
+}
+
 void db_open(struct db *db, const char *path){
     char *err_msg = NULL;
 
@@ -99,8 +186,11 @@ void db_open(struct db *db, const char *path){
     }
 
     if (rc != SQLITE_OK) {
+        // the message belongs to the connection, copy it before closing
+        char err_msg[256];
+        snprintf(err_msg, sizeof(err_msg), "%s", sqlite3_errmsg(db->_db));
         sqlite3_close(db->_db);
-        bye("cannot open database: %s\n", sqlite3_errmsg(db->_db));
+        bye("cannot open database: %s\n", err_msg);
     }
 
     sqlite3_busy_timeout(db->_db, 5000);
@@ -116,6 +206,11 @@ void db_open(struct db *db, const char *path){
         exit(EXIT_FAILURE);
     }
 
+    db_add_missing_columns(db);
+
+    sqlite3_update_hook(db->_db, db_update_hook, db);
+    sqlite3_wal_hook(db->_db, db_wal_hook, db);
+
     return;
 }
 
@@ -126,11 +221,259 @@ void db_close(struct db *db){
     if(db->is_open == false){
         return;
     }
+    pthread_mutex_lock(&db->_pool_lock);
+    for(uint32_t i=0; i<db->_num_readers; i++){
+        if(db->_readers[i]->_is_checked_out){
+            slog_warn("closing db reader %i while still checked out", i);
+        }
+        db_close(db->_readers[i]);
+    }
+    pthread_mutex_unlock(&db->_pool_lock);
     sqlite3_close(db->_db);
     db->is_open = false;
     return;
 }
 
+/*
+ * Opens a read-only connection to an existing database. The writer
+ * must already be open so the schema and WAL journal mode are set.
+ *
+ */
+static struct db *db_open_reader(struct db *pool, const char *path){
+    struct db *reader = NULL;
+
+    reader = db_create();
+    reader->is_readonly = true;
+    reader->_pool = pool;
+
+    int rc = sqlite3_open_v2(path, &reader->_db,
+        SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, NULL);
+
+    if(reader->_db == NULL){
+        bye("failed to open database reader");
+    }
+
+    if(rc != SQLITE_OK){
+        // the message belongs to the connection, copy it before closing
+        char err_msg[256];
+        snprintf(err_msg, sizeof(err_msg), "%s", sqlite3_errmsg(reader->_db));
+        sqlite3_close(reader->_db);
+        bye("cannot open database reader: %s\n", err_msg);
+    }
+
+    // readers only wait on WAL recovery, never on the writer
+    sqlite3_busy_timeout(reader->_db, 5000);
+
+    reader->is_open = true;
+
+    return reader;
+}
+
+/*
+ * Opens the read-write connection and num_readers read-only
+ * connections to the same database. Monitoring clients should
+ * checkout a reader instead of opening their own handle, so
+ * polling never contends with result writes.
+ *
+ */
+void db_open_pool(struct db *db, const char *path, uint32_t num_readers){
+    if(db == NULL){
+        die("pointer is null");
+    }
+
+    if(path == NULL){
+        die("pointer is null");
+    }
+
+    if(db->is_readonly){
+        die("cannot open a reader pool on a reader");
+    }
+
+    if(db->is_open == true){
+        return;
+    }
+
+    db_open(db, path);
+
+    if(num_readers == 0){
+        return;
+    }
+
+    // readers from a previous open are re-used
+    if(db->_num_readers != num_readers){
+        for(uint32_t i=0; i<db->_num_readers; i++){
+            db_free(db->_readers[i]);
+        }
+        free(db->_readers);
+        if((db->_readers = (struct db**)calloc(num_readers, sizeof(struct db*))) == NULL){
+            die("malloc failed");
+        }
+        db->_num_readers = num_readers;
+    }
+
+    for(uint32_t i=0; i<db->_num_readers; i++){
+        if(db->_readers[i] != NULL){
+            db_free(db->_readers[i]);
+        }
+        db->_readers[i] = db_open_reader(db, path);
+    }
+
+    return;
+}
+
+/*
+ * Blocks until a reader is free and returns it. A thread that already
+ * holds a reader gets the same one back, so nested checkouts from one
+ * thread never deadlock. Every checkout needs a matching checkin.
+ *
+ */
+struct db *db_checkout_reader(struct db *db){
+    struct db *reader = NULL;
+    pthread_t self = pthread_self();
+
+    if(db == NULL){
+        die("pointer is null");
+    }
+
+    if(db->is_open == false){
+        die("failed to checkout reader; db is not open");
+    }
+
+    if(db->_num_readers == 0){
+        die("failed to checkout reader; db has no reader pool");
+    }
+
+    pthread_mutex_lock(&db->_pool_lock);
+
+    for(uint32_t i=0; i<db->_num_readers; i++){
+        if(db->_readers[i]->_is_checked_out &&
+                pthread_equal(db->_readers[i]->_owner, self)){
+            reader = db->_readers[i];
+            break;
+        }
+    }
+
+    while(reader == NULL){
+        for(uint32_t i=0; i<db->_num_readers; i++){
+            if(db->_readers[i]->_is_checked_out == false){
+                reader = db->_readers[i];
+                reader->_is_checked_out = true;
+                reader->_owner = self;
+                break;
+            }
+        }
+        if(reader == NULL){
+            pthread_cond_wait(&db->_pool_cond, &db->_pool_lock);
+        }
+    }
+
+    reader->_num_checkouts++;
+
+    pthread_mutex_unlock(&db->_pool_lock);
+
+    return reader;
+}
+
+/*
+ * Returns a reader to its pool. An open snapshot is ended on the
+ * last checkin so the reader never pins an old WAL frame.
+ *
+ */
+void db_checkin_reader(struct db *reader){
+    struct db *pool = NULL;
+
+    if(reader == NULL){
+        die("pointer is null");
+    }
+
+    if((pool = reader->_pool) == NULL){
+        die("failed to checkin reader; db is not a pool reader");
+    }
+
+    pthread_mutex_lock(&pool->_pool_lock);
+
+    if(reader->_is_checked_out == false || reader->_num_checkouts == 0){
+        pthread_mutex_unlock(&pool->_pool_lock);
+        die("failed to checkin reader; reader is not checked out");
+    }
+
+    reader->_num_checkouts--;
+
+    if(reader->_num_checkouts == 0){
+        if(reader->in_snapshot){
+            db_snapshot_end(reader);
+        }
+        reader->_is_checked_out = false;
+        pthread_cond_signal(&pool->_pool_cond);
+    }
+
+    pthread_mutex_unlock(&pool->_pool_lock);
+
+    return;
+}
+
+/*
+ * Starts a read transaction and touches the schema so sqlite pins the
+ * current WAL snapshot. All reads until db_snapshot_end see the same
+ * consistent view while the writer keeps committing.
+ *
+ */
+void db_snapshot_begin(struct db *db){
+    char *err_msg = NULL;
+    int rc = 0;
+
+    if(db == NULL){
+        die("pointer is null");
+    }
+
+    if(db->is_open == false){
+        die("failed to begin snapshot; db is not open");
+    }
+
+    if(db->in_snapshot){
+        die("failed to begin snapshot; snapshot already open");
+    }
+
+    rc = sqlite3_exec(db->_db,
+        "BEGIN DEFERRED; SELECT count(*) FROM sqlite_master;", 0, 0, &err_msg);
+    if(rc != SQLITE_OK){
+        slog_error("failed to begin snapshot: %s", err_msg);
+        sqlite3_free(err_msg);
+        if(sqlite3_get_autocommit(db->_db) == 0){
+            sqlite3_exec(db->_db, "ROLLBACK;", 0, 0, NULL);
+        }
+        die("failed to begin snapshot");
+    }
+
+    db->in_snapshot = true;
+
+    return;
+}
+
+void db_snapshot_end(struct db *db){
+    char *err_msg = NULL;
+    int rc = 0;
+
+    if(db == NULL){
+        die("pointer is null");
+    }
+
+    if(db->in_snapshot == false){
+        return;
+    }
+
+    rc = sqlite3_exec(db->_db, "COMMIT;", 0, 0, &err_msg);
+    if(rc != SQLITE_OK){
+        slog_error("failed to end snapshot: %s", err_msg);
+        sqlite3_free(err_msg);
+        sqlite3_exec(db->_db, "ROLLBACK;", 0, 0, NULL);
+    }
+
+    db->in_snapshot = false;
+
+    return;
+}
+
 static struct db_user* db_make_user(sqlite3_stmt *res){
     struct db_user *user = NULL;
     if(res == NULL){
@@ -251,6 +594,7 @@ static struct db_stim* db_make_stim(sqlite3_stmt *res){
     stim->did_fail = sqlite3_column_int(res, 4);
     stim->failing_vec = sqlite3_column_int64(res, 5);
     stim->state = (enum db_stim_states)sqlite3_column_int(res, 6);
+    stim->site = sqlite3_column_int(res, 7);
     return stim;
 }
 
@@ -269,6 +613,21 @@ static struct db_fail_pin* db_make_fail_pin(sqlite3_stmt *res){
     return fail_pin;
 }
 
+static struct db_fail_log* db_make_fail_log(sqlite3_stmt *res){
+    struct db_fail_log *fail_log = NULL;
+    if(res == NULL){
+        die("pointer is null");
+    }
+    if((fail_log = (struct db_fail_log*)calloc(1, sizeof(struct db_fail_log))) == NULL){
+        die("malloc failed");
+    }
+    fail_log->id = sqlite3_column_int64(res, 0);
+    fail_log->stim_id = sqlite3_column_int64(res, 1);
+    fail_log->test_cycle = sqlite3_column_int64(res, 2);
+    fail_log->dut_io_id = sqlite3_column_int64(res, 3);
+    return fail_log;
+}
+
 static struct db_mount* db_make_mount(sqlite3_stmt *res){
     struct db_mount *mount = NULL;
     if(res == NULL){
@@ -366,6 +725,31 @@ void db_free_fail_pin(struct db_fail_pin *fail_pin){
     return;
 }
 
+void db_free_fail_log(struct db_fail_log *fail_log){
+    if(fail_log == NULL){
+        die("pointer is null");
+    }
+    free(fail_log);
+    return;
+}
+
+static struct db_event* db_make_event(sqlite3_stmt *res){
+    struct db_event *event = NULL;
+    if(res == NULL){
+        die("pointer is null");
+    }
+    if((event = (struct db_event*)calloc(1, sizeof(struct db_event))) == NULL){
+        die("malloc failed");
+    }
+    event->id = sqlite3_column_int64(res, 0);
+    event->date_created = util_dt_to_epoch(STRDUP((const char *)sqlite3_column_text(res, 1)));
+    event->table_name = STRDUP((const char *)sqlite3_column_text(res, 2));
+    event->row_id = sqlite3_column_int64(res, 3);
+    event->old_state = sqlite3_column_int(res, 4);
+    event->new_state = sqlite3_column_int(res, 5);
+    return event;
+}
+
 void db_free_mount(struct db_mount *mount){
     if(mount == NULL){
         die("pointer is null");
@@ -1082,6 +1466,7 @@ int64_t db_insert_prgm(struct db *db,
 }
 
 int64_t db_update_prgm(struct db *db, struct db_prgm *prgm){
+    uint64_t perf_start = perf_begin();
     sqlite3_stmt *res = NULL;
     int rc = 0;
 
@@ -1129,6 +1514,7 @@ int64_t db_update_prgm(struct db *db, struct db_prgm *prgm){
     free((char *)date_start);
     free((char *)date_end);
 
+    perf_end(PERF_DB_WRITE, perf_start);
     return prgm->id;
 }
 
@@ -1395,6 +1781,7 @@ struct db_prgm_log* db_get_prgm_log_by_id(struct db *db, int64_t prgm_log_id){
 
 int64_t db_insert_prgm_log(struct db *db, 
         int64_t prgm_id, const char *line){
+    uint64_t perf_start = perf_begin();
     sqlite3_stmt *res = NULL;
     int rc = 0;
 
@@ -1425,6 +1812,7 @@ int64_t db_insert_prgm_log(struct db *db,
     }
 
     sqlite3_finalize(res);
+    perf_end(PERF_DB_WRITE, perf_start);
     return sqlite3_last_insert_rowid(db->_db);
 }
 
@@ -1459,8 +1847,9 @@ struct db_stim* db_get_stim_by_id(struct db *db, int64_t stim_id){
 }
 
 int64_t db_insert_stim(struct db *db, 
-        int64_t prgm_id, const char *path, int32_t did_fail, 
+        int64_t prgm_id, const char *path, int32_t site, int32_t did_fail, 
         int64_t failing_vec, enum db_stim_states state){
+    uint64_t perf_start = perf_begin();
     sqlite3_stmt *res = NULL;
     int rc = 0;
 
@@ -1472,8 +1861,8 @@ int64_t db_insert_stim(struct db *db,
         path = strdup("");
     }
 
-    const char *sql = "INSERT INTO stims(prgm_id, date_created, path, did_fail, failing_vec, state)"
-        "VALUES(?, datetime('now'), ?, ?, ?, ?)";
+    const char *sql = "INSERT INTO stims(prgm_id, date_created, path, did_fail, failing_vec, state, site)"
+        "VALUES(?, datetime('now'), ?, ?, ?, ?, ?)";
 
     rc = sqlite3_prepare_v2(db->_db, sql, -1, &res, 0);
 
@@ -1483,6 +1872,7 @@ int64_t db_insert_stim(struct db *db,
         sqlite3_bind_int(res, 3, did_fail);
         sqlite3_bind_int64(res, 4, failing_vec);
         sqlite3_bind_int(res, 5, (int32_t)state);
+        sqlite3_bind_int(res, 6, site);
     }else{
         die("Failed to execute statement: %s\n", sqlite3_errmsg(db->_db));
     }
@@ -1494,10 +1884,12 @@ int64_t db_insert_stim(struct db *db,
     }
 
     sqlite3_finalize(res);
+    perf_end(PERF_DB_WRITE, perf_start);
     return sqlite3_last_insert_rowid(db->_db);
 }
 
 int64_t db_update_stim(struct db *db, struct db_stim *stim){
+    uint64_t perf_start = perf_begin();
     sqlite3_stmt *res = NULL;
     int rc = 0;
 
@@ -1509,7 +1901,7 @@ int64_t db_update_stim(struct db *db, struct db_stim *stim){
         die("pointer is null");
     }
 
-    const char *sql = "UPDATE stims SET prgm_id=?, path=?, did_fail=?, failing_vec=?, state=? WHERE id=?";
+    const char *sql = "UPDATE stims SET prgm_id=?, path=?, did_fail=?, failing_vec=?, state=?, site=? WHERE id=?";
 
     rc = sqlite3_prepare_v2(db->_db, sql, -1, &res, 0);
 
@@ -1519,7 +1911,8 @@ int64_t db_update_stim(struct db *db, struct db_stim *stim){
         sqlite3_bind_int(res, 3, stim->did_fail);
         sqlite3_bind_int64(res, 4, stim->failing_vec);
         sqlite3_bind_int(res, 5, stim->state);
-        sqlite3_bind_int64(res, 6, stim->id);
+        sqlite3_bind_int(res, 6, stim->site);
+        sqlite3_bind_int64(res, 7, stim->id);
     } else {
         die("Failed to execute statement: %s\n", sqlite3_errmsg(db->_db));
     }
@@ -1532,6 +1925,7 @@ int64_t db_update_stim(struct db *db, struct db_stim *stim){
 
     sqlite3_finalize(res);
 
+    perf_end(PERF_DB_WRITE, perf_start);
     return stim->id;
 }
 
@@ -1567,6 +1961,7 @@ struct db_fail_pin* db_get_fail_pin_by_id(struct db *db, int64_t fail_pin_id){
 
 int64_t db_insert_fail_pin(struct db *db, 
     int64_t stim_id, int64_t dut_io_id, int32_t did_fail){
+    uint64_t perf_start = perf_begin();
     sqlite3_stmt *res = NULL;
     int rc = 0;
 
@@ -1593,10 +1988,74 @@ int64_t db_insert_fail_pin(struct db *db,
     }
 
     sqlite3_finalize(res);
+    perf_end(PERF_DB_WRITE, perf_start);
     return sqlite3_last_insert_rowid(db->_db);
 }
 
 
+struct db_fail_log* db_get_fail_log_by_id(struct db *db, int64_t fail_log_id){
+    struct db_fail_log *fail_log = NULL;
+    sqlite3_stmt *res = NULL;
+    int rc = 0;
+    int step = 0;
+
+    if(db == NULL){
+        die("pointer is null");
+    }
+
+    const char *sql = "SELECT * FROM fail_logs WHERE id=? LIMIT 1";
+
+    rc = sqlite3_prepare_v2(db->_db, sql, -1, &res, 0);
+
+    if(rc == SQLITE_OK){
+        sqlite3_bind_int64(res, 1, fail_log_id);
+    } else {
+        fprintf(stderr, "Failed to execute statement: %s\n", sqlite3_errmsg(db->_db));
+    }
+
+    step = sqlite3_step(res);
+
+    if (step == SQLITE_ROW) {
+        fail_log = db_make_fail_log(res);
+    }
+
+    sqlite3_finalize(res);
+    return fail_log;
+}
+
+int64_t db_insert_fail_log(struct db *db, 
+    int64_t stim_id, int64_t test_cycle, int64_t dut_io_id){
+    uint64_t perf_start = perf_begin();
+    sqlite3_stmt *res = NULL;
+    int rc = 0;
+
+    if(db == NULL){
+        die("pointer is null");
+    }
+
+    const char *sql = "INSERT INTO fail_logs(stim_id, test_cycle, dut_io_id) VALUES(?, ?, ?)";
+
+    rc = sqlite3_prepare_v2(db->_db, sql, -1, &res, 0);
+
+    if(rc == SQLITE_OK){
+        sqlite3_bind_int64(res, 1, stim_id);
+        sqlite3_bind_int64(res, 2, test_cycle);
+        sqlite3_bind_int64(res, 3, dut_io_id);
+    }else{
+        die("Failed to execute statement: %s\n", sqlite3_errmsg(db->_db));
+    }
+
+    int step = sqlite3_step(res);
+
+    if(step != SQLITE_DONE){
+        die("failed to exec sql '%s' with code %d", sql, step);
+    }
+
+    sqlite3_finalize(res);
+    perf_end(PERF_DB_WRITE, perf_start);
+    return sqlite3_last_insert_rowid(db->_db);
+}
+
 struct db_mount* db_get_mount_by_id(struct db *db, int64_t mount_id){
     struct db_mount *mount = NULL;
     sqlite3_stmt *res = NULL;
@@ -2010,3 +2469,196 @@ struct db_mount** db_get_mounts(struct db *db,
     sqlite3_finalize(res);
     return mounts;
 }
+
+void db_free_event(struct db_event *event){
+    if(event == NULL){
+        die("pointer is null");
+    }
+    free((char *)event->table_name);
+    free(event);
+    return;
+}
+
+/*
+ * Returns the id of the newest event or zero if there are none. Use
+ * it as the starting cursor to only see events from now on.
+ *
+ */
+int64_t db_get_last_event_id(struct db *db){
+    sqlite3_stmt *res = NULL;
+    int64_t last_id = 0;
+    int rc = 0;
+
+    if(db == NULL){
+        die("pointer is null");
+    }
+
+    const char *sql = "SELECT IFNULL(MAX(id), 0) FROM events";
+
+    rc = sqlite3_prepare_v2(db->_db, sql, -1, &res, 0);
+
+    if(rc != SQLITE_OK){
+        die("Failed to execute statement: %s\n", sqlite3_errmsg(db->_db));
+    }
+
+    if(sqlite3_step(res) == SQLITE_ROW){
+        last_id = sqlite3_column_int64(res, 0);
+    }
+
+    sqlite3_finalize(res);
+    return last_id;
+}
+
+/*
+ * Returns up to max_events events with an id greater than cursor, in
+ * id order. The last event id returned is the next cursor.
+ *
+ */
+struct db_event** db_get_events(struct db *db, int64_t cursor, 
+        uint32_t max_events, uint32_t *num_events){
+    struct db_event **events = NULL;
+    sqlite3_stmt *res = NULL;
+    int rc = 0;
+
+    if(db == NULL){
+        die("pointer is null");
+    }
+
+    if(num_events == NULL){
+        die("pointer is null");
+    }
+
+    if(max_events == 0){
+        die("max_events must be > 0");
+    }
+
+    (*num_events) = 0;
+
+    const char *sql = "SELECT id, date_created, table_name, row_id, old_state, new_state "
+                      "FROM events WHERE id > ? ORDER BY id LIMIT ?";
+
+    rc = sqlite3_prepare_v2(db->_db, sql, -1, &res, 0);
+
+    if(rc == SQLITE_OK){
+        sqlite3_bind_int64(res, 1, cursor);
+        sqlite3_bind_int64(res, 2, max_events);
+    }else{
+        die("Failed to execute statement: %s\n", sqlite3_errmsg(db->_db));
+    }
+
+    while(sqlite3_step(res) == SQLITE_ROW){
+        if(events == NULL){
+            if((events = (struct db_event**)calloc(max_events, sizeof(struct db_event*))) == NULL){
+                die("malloc failed");
+            }
+        }
+        events[(*num_events)++] = db_make_event(res);
+    }
+
+    sqlite3_finalize(res);
+    return events;
+}
+
+/*
+ * Blocks until events newer than cursor exist or timeout_ms passes,
+ * then returns them like db_get_events. Commits through this db's
+ * writer wake waiters right away. Writes from other processes aren't
+ * seen by the hook, so they're picked up when the timeout expires.
+ * Reads go through the reader pool when one is open.
+ *
+ */
+struct db_event** db_wait_events(struct db *db, int64_t cursor, 
+        uint32_t max_events, uint32_t timeout_ms, uint32_t *num_events){
+    struct db_event **events = NULL;
+    struct db *reader = NULL;
+    struct timespec deadline;
+    uint64_t seq = 0;
+    bool timed_out = false;
+
+    if(db == NULL){
+        die("pointer is null");
+    }
+
+    if(num_events == NULL){
+        die("pointer is null");
+    }
+
+    if(db->is_readonly){
+        die("failed to wait for events; db is a reader, use the pool writer");
+    }
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+    if(deadline.tv_nsec >= 1000000000L){
+        deadline.tv_sec += 1;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    while(true){
+        // read the seq before querying so a commit in between still wakes us
+        pthread_mutex_lock(&db->_event_lock);
+        seq = db->_event_seq;
+        pthread_mutex_unlock(&db->_event_lock);
+
+        reader = (db->_num_readers > 0) ? db_checkout_reader(db) : db;
+        events = db_get_events(reader, cursor, max_events, num_events);
+        if(reader != db){
+            db_checkin_reader(reader);
+        }
+
+        if((*num_events) > 0 || timed_out){
+            break;
+        }
+
+        pthread_mutex_lock(&db->_event_lock);
+        while(db->_event_seq == seq && !timed_out){
+            if(pthread_cond_timedwait(&db->_event_cond, &db->_event_lock, &deadline) == ETIMEDOUT){
+                timed_out = true;
+            }
+        }
+        pthread_mutex_unlock(&db->_event_lock);
+    }
+
+    return events;
+}
+
+/*
+ * Deletes the events with an id up to and including cursor, the last
+ * id every consumer has seen. With more than one consumer pass the
+ * lowest of their cursors. Event ids are never reused, so cursors stay
+ * valid. Returns the number of events deleted.
+ *
+ */
+uint64_t db_prune_events(struct db *db, int64_t cursor){
+    sqlite3_stmt *res = NULL;
+    int rc = 0;
+
+    if(db == NULL){
+        die("pointer is null");
+    }
+
+    if(db->is_readonly){
+        die("failed to prune events; db is a reader, use the pool writer");
+    }
+
+    const char *sql = "DELETE FROM events WHERE id <= ?";
+
+    rc = sqlite3_prepare_v2(db->_db, sql, -1, &res, 0);
+
+    if(rc == SQLITE_OK){
+        sqlite3_bind_int64(res, 1, cursor);
+    }else{
+        die("Failed to execute statement: %s\n", sqlite3_errmsg(db->_db));
+    }
+
+    int step = sqlite3_step(res);
+
+    if(step != SQLITE_DONE){
+        die("failed to exec sql '%s' with code %d", sql, step);
+    }
+
+    sqlite3_finalize(res);
+
+    return (uint64_t)sqlite3_changes(db->_db);
+}
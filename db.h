@@ -11,6 +11,11 @@
 extern "C" {
 #endif
 
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+
 #include "sqlite3.h"
 
 #define PASS_SALT ("1DE4CFC74A5F9AC2CC834E029E5D95D1")
@@ -119,6 +124,7 @@ struct db_prgm_log {
     const char *line;
 };
 
+// site is the dut_id the stim ran on, or -1 if it ran on all duts
 struct db_stim {
     int64_t id;
     int64_t prgm_id;
@@ -126,6 +132,7 @@ struct db_stim {
     int32_t did_fail;
     int64_t failing_vec;
     enum db_stim_states state;
+    int32_t site;
 };
 
 struct db_fail_pin {
@@ -135,6 +142,14 @@ struct db_fail_pin {
     int32_t did_fail;
 };
 
+// one row per pin of a fail capture record
+struct db_fail_log {
+    int64_t id;
+    int64_t stim_id;
+    int64_t test_cycle;
+    int64_t dut_io_id;
+};
+
 struct db_mount {
     int64_t id;
     const char *name;
@@ -145,6 +160,27 @@ struct db_mount {
     enum db_mount_states state;
 };
 
+/*
+ * Rows in the events table are appended by triggers whenever a
+ * job, prgm or stim is inserted or changes state. Nothing removes
+ * them but db_prune_events.
+ *
+ */
+struct db_event {
+    int64_t id;
+    time_t date_created;
+    const char *table_name;
+    int64_t row_id;
+    int32_t old_state;
+    int32_t new_state;
+};
+
+/*
+ * A db opened with db_open_pool holds one read-write connection plus
+ * a pool of read-only connections. Readers are themselves struct db
+ * objects with is_readonly set, so every db_get_* func works on them.
+ *
+ */
 struct db {
 
     /*
@@ -152,12 +188,32 @@ struct db {
      */
     char *path;
     bool is_open;
+    bool is_readonly;
+    bool in_snapshot;
 
     /*
      * private
      */
     sqlite3 *_db;
 
+    // reader pool, only set on the writer
+    uint32_t _num_readers;
+    struct db **_readers;
+    pthread_mutex_t _pool_lock;
+    pthread_cond_t _pool_cond;
+
+    // checkout state, only set on a reader
+    struct db *_pool;
+    bool _is_checked_out;
+    pthread_t _owner;
+    uint32_t _num_checkouts;
+
+    // change feed, bumped after each commit that wrote events
+    uint64_t _event_seq;
+    bool _events_dirty;
+    pthread_mutex_t _event_lock;
+    pthread_cond_t _event_cond;
+
 };
 
 
@@ -169,6 +225,15 @@ void db_open(struct db *db, const char *path);
 void db_close(struct db *db);
 void db_free(struct db *db);
 
+/*
+ * reader pool and snapshot funcs
+ */
+void db_open_pool(struct db *db, const char *path, uint32_t num_readers);
+struct db *db_checkout_reader(struct db *db);
+void db_checkin_reader(struct db *reader);
+void db_snapshot_begin(struct db *db);
+void db_snapshot_end(struct db *db);
+
 /*
  * Use these to free structs returned from
  * funcs below.
@@ -182,7 +247,9 @@ void db_free_prgm(struct db_prgm *prgm);
 void db_free_prgm_log(struct db_prgm_log *prgm_log);
 void db_free_stim(struct db_stim *stim);
 void db_free_fail_pin(struct db_fail_pin *fail_pin);
+void db_free_fail_log(struct db_fail_log *fail_log);
 void db_free_mount(struct db_mount *mount);
+void db_free_event(struct db_event *event);
 
 /*
  * use these to insert, update or get rows from db
@@ -229,12 +296,15 @@ int64_t db_insert_prgm_log(struct db *db,
         int64_t prgm_id, const char *line);
 struct db_stim* db_get_stim_by_id(struct db *db, int64_t stim_id);
 int64_t db_insert_stim(struct db *db, 
-        int64_t prgm_id, const char *path, int32_t did_fail, 
+        int64_t prgm_id, const char *path, int32_t site, int32_t did_fail, 
         int64_t failing_vec, enum db_stim_states state);
 int64_t db_update_stim(struct db *db, struct db_stim *stim);
 struct db_fail_pin* db_get_fail_pin_by_id(struct db *db, int64_t fail_pin_id);
 int64_t db_insert_fail_pin(struct db *db, 
     int64_t stim_id, int64_t dut_io_id, int32_t did_fail);
+struct db_fail_log* db_get_fail_log_by_id(struct db *db, int64_t fail_log_id);
+int64_t db_insert_fail_log(struct db *db, 
+    int64_t stim_id, int64_t test_cycle, int64_t dut_io_id);
 struct db_mount* db_get_mount_by_id(struct db *db, int64_t mount_id);
 int64_t db_insert_mount(struct db *db, 
         const char *name, const char *ip_addr, const char *path, 
@@ -246,6 +316,12 @@ uint64_t db_get_num_mounts(struct db *db,
 struct db_mount** db_get_mounts(struct db *db, 
         const char *name, const char *ip_addr, const char *remote_path,
         const char *local_point, const char *message, int32_t states);
+int64_t db_get_last_event_id(struct db *db);
+struct db_event** db_get_events(struct db *db, int64_t cursor, 
+        uint32_t max_events, uint32_t *num_events);
+struct db_event** db_wait_events(struct db *db, int64_t cursor, 
+        uint32_t max_events, uint32_t timeout_ms, uint32_t *num_events);
+uint64_t db_prune_events(struct db *db, int64_t cursor);
 
 #ifdef __cplusplus
 }
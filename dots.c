@@ -9,6 +9,7 @@
 #include "util.h"
 #include "profile.h"
 #include "stim.h"
+#include "perf.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -36,6 +37,7 @@ struct dots *parse_dots(struct profile *profile, char *dots_path){
     uint32_t num_pins = 0;
     uint32_t num_vecs = 0;
     char *real_path = NULL;
+    uint64_t perf_start = perf_begin();
 
     if(util_fopen(dots_path, &fd, &fp, &file_size)){
         bye("error: failed to open file '%s'\n", dots_path);
@@ -80,9 +82,9 @@ struct dots *parse_dots(struct profile *profile, char *dots_path){
     profile_pins = create_profile_pins(num_pins);
     for(int i=0; i<num_pins; i++){
         char *name = pin_names[i];
-        if((profile_pins[i] = get_profile_pin_by_dest_pin_name(profile, -1, name)) == NULL){
-            if((profile_pins[i] = get_profile_pin_by_net_alias(profile, -1, name)) == NULL){
-                if((profile_pins[i] = get_profile_pin_by_net_name(profile, name)) == NULL){
+        if((profile_pins[i] = find_profile_pin_by_dest_pin_name(profile, -1, name)) == NULL){
+            if((profile_pins[i] = find_profile_pin_by_net_alias(profile, -1, name)) == NULL){
+                if((profile_pins[i] = find_profile_pin_by_net_name(profile, name)) == NULL){
                     bye("failed to get profile pin by name '%s'\n", name);
                 }
             }
@@ -93,6 +95,9 @@ struct dots *parse_dots(struct profile *profile, char *dots_path){
         bye("failed to create dots\n");
     }
 
+    // pins are borrowed from the profile, only free the array
+    free(profile_pins);
+
     fseek(fp, 0, SEEK_SET);
 
     while((read = getline(&file_line, &len, fp)) != -1){
@@ -125,6 +130,7 @@ struct dots *parse_dots(struct profile *profile, char *dots_path){
     fclose(fp);
     close(fd);
 
+    perf_end(PERF_DOTS_PARSE, perf_start);
     return dots;
 }
 
@@ -431,7 +437,7 @@ struct dots *create_dots(uint32_t num_dots_vecs, struct profile_pin **pins,
     }
 
     for(uint32_t i=0; i<dots->num_pins; i++){
-        dots->pins[i] = create_profile_pin_from_pin(pins[i]);
+        dots->pins[i] = retain_profile_pin(pins[i]);
     }
 
     // when chunk is reading vecs from the dots, 
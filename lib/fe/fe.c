@@ -22,6 +22,7 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <errno.h>
 #include "fe.h"
 
 #define unused(x)     ( (void) (x) )
@@ -32,6 +33,9 @@
 #define type(x)       ( tag(x) & 0x1 ? tag(x) >> 2 : FE_TPAIR )
 #define settype(x,t)  ( tag(x) = (t) << 2 | 1 )
 #define number(x)     ( (x)->cdr.n )
+#define integer(x)    ( (x)->cdr.i )
+#define isnum(x)      ( type(x) == FE_TNUMBER || type(x) == FE_TINTEGER )
+#define numval(x)     ( type(x) == FE_TINTEGER ? (fe_Number) integer(x) : number(x) )
 #define prim(x)       ( (x)->cdr.c )
 #define cfunc(x)      ( (x)->cdr.f )
 #define strbuf(x)     ( &(x)->car.c + 1 )
@@ -39,6 +43,7 @@
 #define STRBUFSIZE    ( (int) sizeof(fe_Object*) - 1 )
 #define GCMARKBIT     ( 0x2 )
 #define GCSTACKSIZE   ( 256 )
+#define SYMTABSIZE    ( 1024 ) /* must be a power of two */
 
 
 enum {
@@ -55,10 +60,10 @@ static const char *primnames[] = {
 
 static const char *typenames[] = {
   "pair", "free", "nil", "number", "symbol", "string",
-  "func", "macro", "prim", "cfunc", "ptr"
+  "func", "macro", "prim", "cfunc", "ptr", "integer"
 };
 
-typedef union { fe_Object *o; fe_CFunc f; fe_Number n; char c; } Value;
+typedef union { fe_Object *o; fe_CFunc f; fe_Number n; fe_Integer i; char c; } Value;
 
 struct fe_Object { Value car, cdr; };
 
@@ -70,9 +75,11 @@ struct fe_Context {
   int object_count;
   fe_Object *calllist;
   fe_Object *freelist;
-  fe_Object *symlist;
+  fe_Object *symtab[SYMTABSIZE];
+  fe_Object *globals;
   fe_Object *t;
   int nextchr;
+  void *udata;
 };
 
 static fe_Object nil = {{ (fe_Object *) (FE_TNIL << 2 | 1) }, { NULL }};
@@ -83,6 +90,16 @@ fe_Handlers* fe_handlers(fe_Context *ctx) {
 }
 
 
+void fe_setudata(fe_Context *ctx, void *udata) {
+  ctx->udata = udata;
+}
+
+
+void* fe_getudata(fe_Context *ctx) {
+  return ctx->udata;
+}
+
+
 void fe_error(fe_Context *ctx, const char *msg) {
   fe_Object *cl = ctx->calllist;
   /* reset context state */
@@ -154,7 +171,8 @@ int fe_savegc(fe_Context *ctx) {
 void fe_mark(fe_Context *ctx, fe_Object *obj) {
   fe_Object *car;
 begin:
-  if (tag(obj) & GCMARKBIT) { return; }
+  /* nil is shared by every context and never swept; don't write to it */
+  if (isnil(obj) || tag(obj) & GCMARKBIT) { return; }
   car = car(obj); /* store car before modifying it with GCMARKBIT */
   tag(obj) |= GCMARKBIT;
 
@@ -179,7 +197,10 @@ static void collectgarbage(fe_Context *ctx) {
   for (i = 0; i < ctx->gcstack_idx; i++) {
     fe_mark(ctx, ctx->gcstack[i]);
   }
-  fe_mark(ctx, ctx->symlist);
+  for (i = 0; i < SYMTABSIZE; i++) {
+    fe_mark(ctx, ctx->symtab[i]);
+  }
+  fe_mark(ctx, ctx->globals);
   /* sweep and unmark */
   for (i = 0; i < ctx->object_count; i++) {
     fe_Object *obj = &ctx->objects[i];
@@ -200,8 +221,13 @@ static void collectgarbage(fe_Context *ctx) {
 
 static int equal(fe_Object *a, fe_Object *b) {
   if (a == b) { return 1; }
+  if (type(a) == FE_TINTEGER && type(b) == FE_TINTEGER) {
+    return integer(a) == integer(b);
+  }
+  if (isnum(a) && isnum(b)) {
+    return numval(a) == numval(b);
+  }
   if (type(a) != type(b)) { return 0; }
-  if (type(a) == FE_TNUMBER) { return number(a) == number(b); }
   if (type(a) == FE_TSTRING) {
     for (; !isnil(a); a = cdr(a), b = cdr(b)) {
       if (car(a) != car(b)) { return 0; }
@@ -261,6 +287,14 @@ fe_Object* fe_number(fe_Context *ctx, fe_Number n) {
 }
 
 
+fe_Object* fe_integer(fe_Context *ctx, fe_Integer n) {
+  fe_Object *obj = object(ctx);
+  settype(obj, FE_TINTEGER);
+  integer(obj) = n;
+  return obj;
+}
+
+
 static fe_Object* buildstring(fe_Context *ctx, fe_Object *tail, int chr) {
   if (!tail || strbuf(tail)[STRBUFSIZE - 1] != '\0') {
     fe_Object *obj = fe_cons(ctx, NULL, &nil);
@@ -286,19 +320,30 @@ fe_Object* fe_string(fe_Context *ctx, const char *str) {
 }
 
 
+static unsigned symhash(const char *name) {
+  /* fnv-1a */
+  unsigned h = 2166136261u;
+  for (; *name; name++) {
+    h = (h ^ (unsigned char) *name) * 16777619u;
+  }
+  return h & (SYMTABSIZE - 1);
+}
+
+
 fe_Object* fe_symbol(fe_Context *ctx, const char *name) {
   fe_Object *obj;
-  /* try to find in symlist */
-  for (obj = ctx->symlist; !isnil(obj); obj = cdr(obj)) {
+  fe_Object **bucket = &ctx->symtab[symhash(name)];
+  /* try to find in the symbol's bucket */
+  for (obj = *bucket; !isnil(obj); obj = cdr(obj)) {
     if (streq(car(cdr(car(obj))), name)) {
       return car(obj);
     }
   }
-  /* create new object, push to symlist and return */
+  /* create new object, push to bucket and return */
   obj = object(ctx);
   settype(obj, FE_TSYMBOL);
   cdr(obj) = fe_cons(ctx, fe_string(ctx, name), &nil);
-  ctx->symlist = fe_cons(ctx, obj, ctx->symlist);
+  *bucket = fe_cons(ctx, obj, *bucket);
   return obj;
 }
 
@@ -357,6 +402,11 @@ void fe_write(fe_Context *ctx, fe_Object *obj, fe_WriteFn fn, void *udata, int q
       writestr(ctx, fn, udata, buf);
       break;
 
+    case FE_TINTEGER:
+      sprintf(buf, "%lld", (long long) integer(obj));
+      writestr(ctx, fn, udata, buf);
+      break;
+
     case FE_TPAIR:
       fn(ctx, udata, '(');
       for (;;) {
@@ -426,10 +476,27 @@ int fe_tostring(fe_Context *ctx, fe_Object *obj, char *dst, int size) {
 
 
 fe_Number fe_tonumber(fe_Context *ctx, fe_Object *obj) {
+  if (type(obj) == FE_TINTEGER) { return (fe_Number) integer(obj); }
   return number(checktype(ctx, obj, FE_TNUMBER));
 }
 
 
+fe_Integer fe_tointeger(fe_Context *ctx, fe_Object *obj) {
+  if (type(obj) == FE_TNUMBER) {
+    fe_Number n = number(obj);
+    /* written so nan fails too; casting outside the range is undefined */
+    if (!(n >= -9223372036854775808.0 && n < 9223372036854775808.0)) {
+      fe_error(ctx, "number out of integer range");
+    }
+    if (n != (fe_Number) (fe_Integer) n) {
+      fe_error(ctx, "number is not an integer");
+    }
+    return (fe_Integer) n;
+  }
+  return integer(checktype(ctx, obj, FE_TINTEGER));
+}
+
+
 void* fe_toptr(fe_Context *ctx, fe_Object *obj) {
   return cdr(checktype(ctx, obj, FE_TPTR));
 }
@@ -452,12 +519,48 @@ void fe_set(fe_Context *ctx, fe_Object *sym, fe_Object *v) {
 }
 
 
+void fe_saveglobals(fe_Context *ctx) {
+  int i, gc = fe_savegc(ctx);
+  fe_Object *obj, *globals = &nil;
+  /* store a (sym . value) pair for every bound global */
+  for (i = 0; i < SYMTABSIZE; i++) {
+    for (obj = ctx->symtab[i]; !isnil(obj); obj = cdr(obj)) {
+      fe_Object *sym = car(obj);
+      if (isnil(cdr(cdr(sym)))) { continue; }
+      globals = fe_cons(ctx, fe_cons(ctx, sym, cdr(cdr(sym))), globals);
+      fe_restoregc(ctx, gc);
+      fe_pushgc(ctx, globals);
+    }
+  }
+  ctx->globals = globals;
+  fe_restoregc(ctx, gc);
+}
+
+
+void fe_restoreglobals(fe_Context *ctx) {
+  int i;
+  fe_Object *obj;
+  /* unbind every global then rebind the saved ones; values that were
+  ** changed in place with setcar/setcdr stay changed */
+  for (i = 0; i < SYMTABSIZE; i++) {
+    for (obj = ctx->symtab[i]; !isnil(obj); obj = cdr(obj)) {
+      cdr(cdr(car(obj))) = &nil;
+    }
+  }
+  for (obj = ctx->globals; !isnil(obj); obj = cdr(obj)) {
+    cdr(cdr(car(car(obj)))) = cdr(car(obj));
+  }
+}
+
+
 static fe_Object rparen;
 
 static fe_Object* read_(fe_Context *ctx, fe_ReadFn fn, void *udata) {
   const char *delimiter = " \n\t\r();";
   fe_Object *v, *res, **tail;
   fe_Number n;
+  fe_Integer i;
+  const char *s;
   int chr, gc;
   char buf[64], *p;
 
@@ -530,6 +633,12 @@ static fe_Object* read_(fe_Context *ctx, fe_ReadFn fn, void *udata) {
       } while (chr && !strchr(delimiter, chr));
       *p = '\0';
       ctx->nextchr = chr;
+      s = buf + (*buf == '-' || *buf == '+');
+      errno = 0;  /* try to read as integer, decimal or 0x hex */
+      i = strtoll(buf, &p, s[0] == '0' && (s[1] == 'x' || s[1] == 'X') ? 16 : 10);
+      if (p != buf && strchr(delimiter, *p) && errno != ERANGE) {
+        return fe_integer(ctx, i);
+      }
       n = strtod(buf, &p);  /* try to read as number */
       if (p != buf && strchr(delimiter, *p)) { return fe_number(ctx, n); }
       if (!strcmp(buf, "nil")) { return &nil; }
@@ -598,19 +707,58 @@ static fe_Object* argstoenv(fe_Context *ctx, fe_Object *prm, fe_Object *arg, fe_
 
 #define evalarg() eval(ctx, fe_nextarg(ctx, &arg), env, NULL)
 
-#define arithop(op) {                             \
-    fe_Number x = fe_tonumber(ctx, evalarg());    \
-    while (!isnil(arg)) {                         \
-      x = x op fe_tonumber(ctx, evalarg());       \
-    }                                             \
-    res = fe_number(ctx, x);                      \
+#define numcmpop(op) {                            \
+    va = evalarg();                               \
+    vb = evalarg();                               \
+    res = fe_bool(ctx, numcmp(ctx, va, vb) op 0); \
   }
 
-#define numcmpop(op) {                            \
-    va = checktype(ctx, evalarg(), FE_TNUMBER);   \
-    vb = checktype(ctx, evalarg(), FE_TNUMBER);   \
-    res = fe_bool(ctx, number(va) op number(vb)); \
+
+static int numcmp(fe_Context *ctx, fe_Object *a, fe_Object *b) {
+  fe_Number x, y;
+  if (type(a) == FE_TINTEGER && type(b) == FE_TINTEGER) {
+    return (integer(a) > integer(b)) - (integer(a) < integer(b));
+  }
+  x = fe_tonumber(ctx, a);
+  y = fe_tonumber(ctx, b);
+  if (x != x || y != y) { return 2; } /* nan is neither < nor <= */
+  return (x > y) - (x < y);
+}
+
+
+static fe_Object* arith(fe_Context *ctx, int op, fe_Object *arg, fe_Object *env) {
+  fe_Object *v = evalarg();
+  int isint = type(v) == FE_TINTEGER;
+  fe_Integer x = isint ? integer(v) : 0, y, r;
+  fe_Number xn = isint ? 0 : fe_tonumber(ctx, v), yn;
+  while (!isnil(arg)) {
+    v = evalarg();
+    if (isint && type(v) == FE_TINTEGER) {
+      /* stay an integer until it overflows or divides unevenly */
+      int ok;
+      y = integer(v);
+      switch (op) {
+        case P_ADD: ok = !__builtin_add_overflow(x, y, &r); break;
+        case P_SUB: ok = !__builtin_sub_overflow(x, y, &r); break;
+        case P_MUL: ok = !__builtin_mul_overflow(x, y, &r); break;
+        default:
+          ok = y != 0 && !(x == INT64_MIN && y == -1) && x % y == 0;
+          if (ok) { r = x / y; }
+          break;
+      }
+      if (ok) { x = r; continue; }
+    }
+    if (isint) { xn = (fe_Number) x; isint = 0; }
+    yn = fe_tonumber(ctx, v);
+    switch (op) {
+      case P_ADD: xn = xn + yn; break;
+      case P_SUB: xn = xn - yn; break;
+      case P_MUL: xn = xn * yn; break;
+      default:    xn = xn / yn; break;
+    }
   }
+  return isint ? fe_integer(ctx, x) : fe_number(ctx, xn);
+}
 
 
 static fe_Object* eval(fe_Context *ctx, fe_Object *obj, fe_Object *env, fe_Object **newenv) {
@@ -739,10 +887,9 @@ static fe_Object* eval(fe_Context *ctx, fe_Object *obj, fe_Object *env, fe_Objec
 
         case P_LT: numcmpop(<); break;
         case P_LTE: numcmpop(<=); break;
-        case P_ADD: arithop(+); break;
-        case P_SUB: arithop(-); break;
-        case P_MUL: arithop(*); break;
-        case P_DIV: arithop(/); break;
+        case P_ADD: case P_SUB: case P_MUL: case P_DIV:
+          res = arith(ctx, prim(fn), arg, env);
+          break;
       }
       break;
 
@@ -799,7 +946,10 @@ fe_Context* fe_open(void *ptr, int size) {
   /* init lists */
   ctx->calllist = &nil;
   ctx->freelist = &nil;
-  ctx->symlist = &nil;
+  ctx->globals = &nil;
+  for (i = 0; i < SYMTABSIZE; i++) {
+    ctx->symtab[i] = &nil;
+  }
 
   /* populate freelist */
   for (i = 0; i < ctx->object_count; i++) {
@@ -828,9 +978,13 @@ fe_Context* fe_open(void *ptr, int size) {
 
 
 void fe_close(fe_Context *ctx) {
-  /* clear gcstack and symlist; makes all objects unreachable */
+  int i;
+  /* clear gcstack, symtab and globals; makes all objects unreachable */
   ctx->gcstack_idx = 0;
-  ctx->symlist = &nil;
+  ctx->globals = &nil;
+  for (i = 0; i < SYMTABSIZE; i++) {
+    ctx->symtab[i] = &nil;
+  }
   collectgarbage(ctx);
 }
 
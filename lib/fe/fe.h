@@ -14,10 +14,12 @@ extern "C" {
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
 
 #define FE_VERSION "1.0"
 
 typedef double fe_Number;
+typedef int64_t fe_Integer;
 typedef struct fe_Object fe_Object;
 typedef struct fe_Context fe_Context;
 typedef fe_Object* (*fe_CFunc)(fe_Context *ctx, fe_Object *args);
@@ -28,12 +30,14 @@ typedef struct { fe_ErrorFn error; fe_CFunc mark, gc; } fe_Handlers;
 
 enum {
   FE_TPAIR, FE_TFREE, FE_TNIL, FE_TNUMBER, FE_TSYMBOL, FE_TSTRING,
-  FE_TFUNC, FE_TMACRO, FE_TPRIM, FE_TCFUNC, FE_TPTR
+  FE_TFUNC, FE_TMACRO, FE_TPRIM, FE_TCFUNC, FE_TPTR, FE_TINTEGER
 };
 
 fe_Context* fe_open(void *ptr, int size);
 void fe_close(fe_Context *ctx);
 fe_Handlers* fe_handlers(fe_Context *ctx);
+void fe_setudata(fe_Context *ctx, void *udata);
+void* fe_getudata(fe_Context *ctx);
 void fe_error(fe_Context *ctx, const char *msg);
 fe_Object* fe_nextarg(fe_Context *ctx, fe_Object **arg);
 int fe_type(fe_Context *ctx, fe_Object *obj);
@@ -45,6 +49,7 @@ void fe_mark(fe_Context *ctx, fe_Object *obj);
 fe_Object* fe_cons(fe_Context *ctx, fe_Object *car, fe_Object *cdr);
 fe_Object* fe_bool(fe_Context *ctx, int b);
 fe_Object* fe_number(fe_Context *ctx, fe_Number n);
+fe_Object* fe_integer(fe_Context *ctx, fe_Integer n);
 fe_Object* fe_string(fe_Context *ctx, const char *str);
 fe_Object* fe_symbol(fe_Context *ctx, const char *name);
 fe_Object* fe_cfunc(fe_Context *ctx, fe_CFunc fn);
@@ -56,8 +61,11 @@ void fe_write(fe_Context *ctx, fe_Object *obj, fe_WriteFn fn, void *udata, int q
 void fe_writefp(fe_Context *ctx, fe_Object *obj, FILE *fp);
 int fe_tostring(fe_Context *ctx, fe_Object *obj, char *dst, int size);
 fe_Number fe_tonumber(fe_Context *ctx, fe_Object *obj);
+fe_Integer fe_tointeger(fe_Context *ctx, fe_Object *obj);
 void* fe_toptr(fe_Context *ctx, fe_Object *obj);
 void fe_set(fe_Context *ctx, fe_Object *sym, fe_Object *v);
+void fe_saveglobals(fe_Context *ctx);
+void fe_restoreglobals(fe_Context *ctx);
 fe_Object* fe_read(fe_Context *ctx, fe_ReadFn fn, void *udata);
 fe_Object* fe_readfp(fe_Context *ctx, FILE *fp);
 fe_Object* fe_eval(fe_Context *ctx, fe_Object *obj);
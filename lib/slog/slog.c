@@ -35,6 +35,8 @@
 #include <limits.h>
 #include <errno.h>
 #include <time.h>
+#include <inttypes.h>
+#include <sys/types.h>
 #include "slog.h"
 
 #if !defined(__APPLE__) && !defined(DARWIN) && !defined(WIN32)
@@ -66,6 +68,56 @@ typedef struct XLogCtx {
 
 static slog_t g_slog;
 
+/* File record queued for the async writer */
+typedef struct SLogRecord {
+    size_t nSeq;
+    size_t nLength;
+    char *pHeap;
+    uint16_t nYear;
+    uint8_t nMonth;
+    uint8_t nDay;
+    char sRecord[SLOG_RECORD_MAX];
+} slog_record_t;
+
+/* 
+ * Bounded multi-producer ring of preformatted file records and the one
+ * writer thread that drains it. Claiming and publishing a slot takes no
+ * lock, each slot's nSeq says whether it's free for the producer at that
+ * position or holds a record for the writer. This only keeps file I/O
+ * off the caller: with nTdSafe set, slog_display still holds g_slog.mutex
+ * while it formats, prints to screen and pushes, so callers serialize 
+ * there. slog_flush waits on flushCond, which the writer broadcasts 
+ * after each drained batch.
+ */
+typedef struct SLogAsync {
+    slog_record_t *pRing;
+    size_t nHead;
+    size_t nTail;
+    size_t nWritten;
+    uint64_t nDropped;
+    uint64_t nReported;
+    uint32_t nPathGen;
+    uint8_t nRunning;
+    uint8_t nStop;
+    uint8_t nIdle;
+    pid_t nPid;
+    pthread_t thread;
+    uint8_t nForkReady;
+    pthread_mutex_t waitMutex;
+    pthread_cond_t waitCond;
+    pthread_cond_t flushCond;
+    pthread_mutex_t pathMutex;
+    char sFilePath[SLOG_PATH_MAX];
+    char sFileName[SLOG_NAME_MAX];
+} slog_async_t;
+
+static slog_async_t g_async = {
+    .waitMutex = PTHREAD_MUTEX_INITIALIZER,
+    .waitCond = PTHREAD_COND_INITIALIZER,
+    .flushCond = PTHREAD_COND_INITIALIZER,
+    .pathMutex = PTHREAD_MUTEX_INITIALIZER
+};
+
 static void slog_sync_init(slog_t *pSlog)
 {
     if (!pSlog->nTdSafe) return;
@@ -195,6 +247,259 @@ static void slog_create_tid(char *pOut, int nSize, uint8_t nTraceTid)
     else snprintf(pOut, nSize, "(%u) ", slog_get_tid());
 }
 
+static uint8_t slog_async_is_empty(slog_async_t *pAsync)
+{
+    size_t nHead = __atomic_load_n(&pAsync->nHead, __ATOMIC_RELAXED);
+    slog_record_t *pRec = &pAsync->pRing[nHead & (SLOG_RING_SIZE - 1)];
+    return __atomic_load_n(&pRec->nSeq, __ATOMIC_ACQUIRE) != nHead + 1;
+}
+
+static void slog_async_set_path(slog_async_t *pAsync, const slog_config_t *pCfg)
+{
+    pthread_mutex_lock(&pAsync->pathMutex);
+    if (strcmp(pAsync->sFilePath, pCfg->sFilePath) || strcmp(pAsync->sFileName, pCfg->sFileName))
+    {
+        snprintf(pAsync->sFilePath, sizeof(pAsync->sFilePath), "%s", pCfg->sFilePath);
+        snprintf(pAsync->sFileName, sizeof(pAsync->sFileName), "%s", pCfg->sFileName);
+        __atomic_add_fetch(&pAsync->nPathGen, 1, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&pAsync->pathMutex);
+}
+
+static FILE *slog_async_open(slog_async_t *pAsync, const slog_record_t *pRec)
+{
+    char sFilePath[SLOG_PATH_MAX + SLOG_NAME_MAX + SLOG_DATE_MAX];
+
+    pthread_mutex_lock(&pAsync->pathMutex);
+    snprintf(sFilePath, sizeof(sFilePath), "%s/%s-%04d-%02d-%02d.log", 
+        pAsync->sFilePath, pAsync->sFileName, pRec->nYear, pRec->nMonth, pRec->nDay);
+    pthread_mutex_unlock(&pAsync->pathMutex);
+
+    FILE *pFile = fopen(sFilePath, "a");
+    if (pFile != NULL) setvbuf(pFile, NULL, _IOFBF, SLOG_WRITE_BUFFER);
+    return pFile;
+}
+
+static void slog_async_wait(slog_async_t *pAsync)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_nsec += (long)SLOG_WRITER_WAIT_MS * 1000000L;
+    ts.tv_sec += ts.tv_nsec / 1000000000L;
+    ts.tv_nsec %= 1000000000L;
+
+    pthread_mutex_lock(&pAsync->waitMutex);
+    __atomic_store_n(&pAsync->nIdle, 1, __ATOMIC_SEQ_CST);
+
+    /* A producer may have pushed before it could see nIdle */
+    if (slog_async_is_empty(pAsync) && !__atomic_load_n(&pAsync->nStop, __ATOMIC_ACQUIRE))
+        pthread_cond_timedwait(&pAsync->waitCond, &pAsync->waitMutex, &ts);
+
+    __atomic_store_n(&pAsync->nIdle, 0, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&pAsync->waitMutex);
+}
+
+static void *slog_async_writer(void *pArg)
+{
+    slog_async_t *pAsync = (slog_async_t*)pArg;
+    FILE *pFile = NULL;
+    uint32_t nFileDate = 0;
+    uint32_t nFileGen = 0;
+
+    while (1)
+    {
+        uint8_t nStop = __atomic_load_n(&pAsync->nStop, __ATOMIC_ACQUIRE);
+        size_t nHead = __atomic_load_n(&pAsync->nHead, __ATOMIC_RELAXED);
+        slog_record_t *pRec = &pAsync->pRing[nHead & (SLOG_RING_SIZE - 1)];
+
+        if (__atomic_load_n(&pRec->nSeq, __ATOMIC_ACQUIRE) != nHead + 1)
+        {
+            /* Drained, so write out the batch */
+            uint64_t nDropped = __atomic_load_n(&pAsync->nDropped, __ATOMIC_RELAXED);
+            if (pFile != NULL && nDropped != pAsync->nReported)
+            {
+                fprintf(pFile, "<warn> slog dropped %" PRIu64 " records%s", 
+                    nDropped - pAsync->nReported, SLOG_NEWLINE);
+                pAsync->nReported = nDropped;
+            }
+            if (pFile != NULL) fflush(pFile);
+
+            pthread_mutex_lock(&pAsync->waitMutex);
+            __atomic_store_n(&pAsync->nWritten, nHead, __ATOMIC_RELEASE);
+            pthread_cond_broadcast(&pAsync->flushCond);
+            pthread_mutex_unlock(&pAsync->waitMutex);
+
+            if (nStop) break;
+            slog_async_wait(pAsync);
+            continue;
+        }
+
+        uint32_t nDate = (uint32_t)pRec->nYear * 10000 + pRec->nMonth * 100 + pRec->nDay;
+        uint32_t nGen = __atomic_load_n(&pAsync->nPathGen, __ATOMIC_ACQUIRE);
+
+        /* Keep the file open, rotating it daily or if the path changed */
+        if (pFile == NULL || nDate != nFileDate || nGen != nFileGen)
+        {
+            if (pFile != NULL) fclose(pFile);
+            pFile = slog_async_open(pAsync, pRec);
+            nFileDate = nDate;
+            nFileGen = nGen;
+        }
+
+        const char *pData = pRec->pHeap != NULL ? pRec->pHeap : pRec->sRecord;
+        if (pFile != NULL) fwrite(pData, 1, pRec->nLength, pFile);
+
+        if (pRec->pHeap != NULL)
+        {
+            free(pRec->pHeap);
+            pRec->pHeap = NULL;
+        }
+
+        __atomic_store_n(&pRec->nSeq, nHead + SLOG_RING_SIZE, __ATOMIC_RELEASE);
+        __atomic_store_n(&pAsync->nHead, nHead + 1, __ATOMIC_RELEASE);
+    }
+
+    if (pFile != NULL) fclose(pFile);
+    return NULL;
+}
+
+/* Holds every slog lock across fork so the child doesn't inherit one mid use */
+static void slog_async_prefork(void)
+{
+    slog_lock(&g_slog);
+    pthread_mutex_lock(&g_async.pathMutex);
+    pthread_mutex_lock(&g_async.waitMutex);
+}
+
+static void slog_async_postfork_parent(void)
+{
+    pthread_mutex_unlock(&g_async.waitMutex);
+    pthread_mutex_unlock(&g_async.pathMutex);
+    slog_unlock(&g_slog);
+}
+
+/* 
+ * The writer thread doesn't exist in the child. Records still queued 
+ * are the parent's to write, so the child empties the ring and starts
+ * its own writer on first use.
+ */
+static void slog_async_postfork_child(void)
+{
+    slog_async_t *pAsync = &g_async;
+
+    if (pAsync->pRing != NULL)
+    {
+        /* Overlong records may leak, the writer could have been freeing one */
+        size_t i;
+        for (i = 0; i < SLOG_RING_SIZE; i++)
+        {
+            pAsync->pRing[i].pHeap = NULL;
+            pAsync->pRing[i].nSeq = i;
+        }
+        pAsync->nHead = pAsync->nTail = pAsync->nWritten = 0;
+    }
+
+    pAsync->nRunning = 0;
+    pAsync->nIdle = 0;
+    pAsync->nStop = 0;
+    pthread_cond_init(&pAsync->waitCond, NULL);
+    pthread_cond_init(&pAsync->flushCond, NULL);
+
+    /* The child's thread id differs, so an owner unlock can fail, reinit instead */
+    pthread_mutex_init(&pAsync->waitMutex, NULL);
+    pthread_mutex_init(&pAsync->pathMutex, NULL);
+    slog_sync_init(&g_slog);
+}
+
+/* Starts the writer, again in a forked child since threads don't survive fork */
+static int slog_async_start(slog_async_t *pAsync, const slog_config_t *pCfg)
+{
+    if (pAsync->nRunning && pAsync->nPid == getpid()) return 1;
+
+    if (!pAsync->nForkReady)
+    {
+        if (pthread_atfork(slog_async_prefork, slog_async_postfork_parent, 
+            slog_async_postfork_child)) return 0;
+        pAsync->nForkReady = 1;
+    }
+
+    if (pAsync->pRing == NULL)
+    {
+        pAsync->pRing = (slog_record_t*)calloc(SLOG_RING_SIZE, sizeof(slog_record_t));
+        if (pAsync->pRing == NULL) return 0;
+
+        size_t i;
+        for (i = 0; i < SLOG_RING_SIZE; i++) pAsync->pRing[i].nSeq = i;
+        pAsync->nHead = pAsync->nTail = pAsync->nWritten = 0;
+    }
+
+    slog_async_set_path(pAsync, pCfg);
+    pAsync->nStop = 0;
+    pAsync->nIdle = 0;
+
+    if (pthread_create(&pAsync->thread, NULL, slog_async_writer, pAsync)) return 0;
+    pAsync->nRunning = 1;
+    pAsync->nPid = getpid();
+    return 1;
+}
+
+static void slog_async_push(slog_async_t *pAsync, const slog_context_t *pCtx, 
+    const char *pInfo, const char *pMessage, const char *pReset, const char *pNewLine)
+{
+    uint32_t nHighWater = g_slog.config.nHighWater;
+    if (!nHighWater || nHighWater > SLOG_RING_SIZE) nHighWater = SLOG_RING_SIZE;
+
+    size_t nPos = __atomic_load_n(&pAsync->nTail, __ATOMIC_RELAXED);
+    slog_record_t *pRec = NULL;
+
+    while (1)
+    {
+        size_t nHead = __atomic_load_n(&pAsync->nHead, __ATOMIC_ACQUIRE);
+        if (nPos - nHead >= nHighWater)
+        {
+            __atomic_add_fetch(&pAsync->nDropped, 1, __ATOMIC_RELAXED);
+            return;
+        }
+
+        pRec = &pAsync->pRing[nPos & (SLOG_RING_SIZE - 1)];
+        size_t nSeq = __atomic_load_n(&pRec->nSeq, __ATOMIC_ACQUIRE);
+        intptr_t nDiff = (intptr_t)nSeq - (intptr_t)nPos;
+
+        if (nDiff == 0)
+        {
+            if (__atomic_compare_exchange_n(&pAsync->nTail, &nPos, nPos + 1, 1, 
+                __ATOMIC_RELAXED, __ATOMIC_RELAXED)) break;
+        }
+        else if (nDiff < 0)
+        {
+            __atomic_add_fetch(&pAsync->nDropped, 1, __ATOMIC_RELAXED);
+            return;
+        }
+        else nPos = __atomic_load_n(&pAsync->nTail, __ATOMIC_RELAXED);
+    }
+
+    int nLength = snprintf(pRec->sRecord, sizeof(pRec->sRecord), "%s%s%s%s", 
+        pInfo, pMessage, pReset, pNewLine);
+    if (nLength < 0) nLength = 0;
+
+    pRec->pHeap = NULL;
+    if ((size_t)nLength >= sizeof(pRec->sRecord) && 
+        asprintf(&pRec->pHeap, "%s%s%s%s", pInfo, pMessage, pReset, pNewLine) < 0)
+    {
+        pRec->pHeap = NULL;
+        nLength = sizeof(pRec->sRecord) - 1;
+    }
+
+    pRec->nLength = (size_t)nLength;
+    pRec->nYear = pCtx->date.nYear;
+    pRec->nMonth = pCtx->date.nMonth;
+    pRec->nDay = pCtx->date.nDay;
+    __atomic_store_n(&pRec->nSeq, nPos + 1, __ATOMIC_RELEASE);
+
+    if (__atomic_load_n(&pAsync->nIdle, __ATOMIC_SEQ_CST))
+        pthread_cond_signal(&pAsync->waitCond);
+}
+
 static void slog_display_message(const slog_context_t *pCtx, const char *pInfo, const char *pInput)
 {
     const char *pReset = pCtx->nFullColor ? SLOG_COLOR_RESET : SLOG_EMPTY;
@@ -226,6 +531,15 @@ static void slog_display_message(const slog_context_t *pCtx, const char *pInfo,
     if (!pCfg->nToFile || nCbVal < 0) return;
     const slog_date_t *pDate = &pCtx->date;
 
+    if (pCfg->nAsync && slog_async_start(&g_async, pCfg))
+    {
+        slog_async_push(&g_async, pCtx, pInfo, pMessage, pReset, pNewLine);
+
+        /* The process is about to exit, so get it on disk */
+        if (pCtx->eFlag == SLOG_FATAL) slog_flush();
+        return;
+    }
+
     char sFilePath[SLOG_PATH_MAX + SLOG_NAME_MAX + SLOG_DATE_MAX];
     snprintf(sFilePath, sizeof(sFilePath), "%s/%s-%04d-%02d-%02d.log", 
         pCfg->sFilePath, pCfg->sFileName, pDate->nYear, pDate->nMonth, pDate->nDay);
@@ -304,6 +618,14 @@ static void slog_display_stack(const slog_context_t *pCtx, va_list args)
     slog_display_message(pCtx, sLogInfo, sMessage);
 }
 
+uint8_t slog_is_enabled(slog_flag_t eFlag)
+{
+    /* Unlocked, slog_display checks again under the lock */
+    slog_config_t *pCfg = &g_slog.config;
+    uint16_t nFlags = __atomic_load_n(&pCfg->nFlags, __ATOMIC_RELAXED);
+    return SLOG_FLAGS_CHECK(nFlags, eFlag) && (pCfg->nToScreen || pCfg->nToFile);
+}
+
 void slog_display(slog_flag_t eFlag, uint8_t nNewLine, const char *pFormat, ...)
 {
     slog_lock(&g_slog);
@@ -358,9 +680,29 @@ void slog_config_set(slog_config_t *pCfg)
 {
     slog_lock(&g_slog);
     g_slog.config = *pCfg;
+    if (g_async.nRunning) slog_async_set_path(&g_async, pCfg);
     slog_unlock(&g_slog);
 }
 
+void slog_flush()
+{
+    slog_async_t *pAsync = &g_async;
+    if (!pAsync->nRunning || pAsync->nPid != getpid()) return;
+
+    size_t nTarget = __atomic_load_n(&pAsync->nTail, __ATOMIC_ACQUIRE);
+
+    pthread_mutex_lock(&pAsync->waitMutex);
+    pthread_cond_signal(&pAsync->waitCond);
+    while ((intptr_t)(nTarget - __atomic_load_n(&pAsync->nWritten, __ATOMIC_ACQUIRE)) > 0)
+        pthread_cond_wait(&pAsync->flushCond, &pAsync->waitMutex);
+    pthread_mutex_unlock(&pAsync->waitMutex);
+}
+
+uint64_t slog_get_dropped()
+{
+    return __atomic_load_n(&g_async.nDropped, __ATOMIC_RELAXED);
+}
+
 void slog_enable(slog_flag_t eFlag)
 {
     slog_lock(&g_slog);
@@ -425,7 +767,9 @@ void slog_init(const char* pName, uint16_t nFlags, uint8_t nTdSafe)
     pCfg->nUseHeap = 0;
     pCfg->nToFile = 0;
     pCfg->nFlush = 0;
+    pCfg->nAsync = 0;
     pCfg->nFlags = nFlags;
+    pCfg->nHighWater = SLOG_RING_SIZE;
 
     const char *pFileName = (pName != NULL) ? pName : SLOG_NAME_DEFAULT;
     snprintf(pCfg->sFileName, sizeof(pCfg->sFileName), "%s", pFileName);
@@ -449,6 +793,26 @@ void slog_destroy()
     g_slog.config.pCallbackCtx = NULL;
     g_slog.config.logCallback = NULL;
 
+    /* Writer drains the ring before it exits */
+    if (g_async.nRunning && g_async.nPid == getpid())
+    {
+        __atomic_store_n(&g_async.nStop, 1, __ATOMIC_RELEASE);
+        pthread_cond_signal(&g_async.waitCond);
+        pthread_join(g_async.thread, NULL);
+    }
+    g_async.nRunning = 0;
+    g_slog.config.nAsync = 0;
+
+    /* Writer is gone, free what's left in the ring, slog_async_start reallocates */
+    if (g_async.pRing != NULL)
+    {
+        size_t i;
+        for (i = 0; i < SLOG_RING_SIZE; i++) free(g_async.pRing[i].pHeap);
+        free(g_async.pRing);
+        g_async.pRing = NULL;
+        g_async.nHead = g_async.nTail = g_async.nWritten = 0;
+    }
+
     if (g_slog.nTdSafe)
     {
         pthread_mutex_destroy(&g_slog.mutex);
@@ -63,6 +63,12 @@ extern "C" {
 #define SLOG_TAG_MAX            32
 #define SLOG_COLOR_MAX          16
 
+/* Async file writer ring, SLOG_RING_SIZE must be a power of two */
+#define SLOG_RING_SIZE          2048
+#define SLOG_RECORD_MAX         512
+#define SLOG_WRITE_BUFFER       65536
+#define SLOG_WRITER_WAIT_MS     100
+
 #define SLOG_FLAGS_CHECK(c, f) (((c) & (f)) == (f))
 #define SLOG_FLAGS_ALL          255
 
@@ -114,32 +120,37 @@ typedef enum
     SLOG_DATE_FULL
 } slog_date_ctrl_t;
 
+/* Level is checked before the arguments are evaluated or formatted */
+#define SLOG_DISPLAY_IF(FLAG, NEWLINE, ...) do { \
+    if (slog_is_enabled(FLAG)) slog_display(FLAG, NEWLINE, __VA_ARGS__); \
+    } while (0)
+
 #define slog(...) \
-    slog_display(SLOG_NOTAG, 1, __VA_ARGS__)
+    SLOG_DISPLAY_IF(SLOG_NOTAG, 1, __VA_ARGS__)
 
 #define slogwn(...) \
-    slog_display(SLOG_NOTAG, 0, __VA_ARGS__)
+    SLOG_DISPLAY_IF(SLOG_NOTAG, 0, __VA_ARGS__)
 
 #define slog_note(...) \
-    slog_display(SLOG_NOTE, 1, __VA_ARGS__)
+    SLOG_DISPLAY_IF(SLOG_NOTE, 1, __VA_ARGS__)
 
 #define slog_info(...) \
-    slog_display(SLOG_INFO, 1, __VA_ARGS__)
+    SLOG_DISPLAY_IF(SLOG_INFO, 1, __VA_ARGS__)
 
 #define slog_warn(...) \
-    slog_display(SLOG_WARN, 1, __VA_ARGS__)
+    SLOG_DISPLAY_IF(SLOG_WARN, 1, __VA_ARGS__)
 
 #define slog_debug(...) \
-    slog_display(SLOG_DEBUG, 1, __VA_ARGS__)
+    SLOG_DISPLAY_IF(SLOG_DEBUG, 1, __VA_ARGS__)
 
 #define slog_error(...) \
-    slog_display(SLOG_ERROR, 1, __VA_ARGS__)
+    SLOG_DISPLAY_IF(SLOG_ERROR, 1, __VA_ARGS__)
 
 #define slog_trace(...) \
-    slog_display(SLOG_TRACE, 1, SLOG_THROW_LOCATION __VA_ARGS__)
+    SLOG_DISPLAY_IF(SLOG_TRACE, 1, SLOG_THROW_LOCATION __VA_ARGS__)
 
 #define slog_fatal(...) \
-    slog_display(SLOG_FATAL, 1, SLOG_THROW_LOCATION __VA_ARGS__)
+    SLOG_DISPLAY_IF(SLOG_FATAL, 1, SLOG_THROW_LOCATION __VA_ARGS__)
 
 /* Short name definitions */
 #define slogn(...) slog_note(__VA_ARGS__)
@@ -161,7 +172,9 @@ typedef struct SLogConfig {
     uint8_t nUseHeap:1;                 // Use dynamic allocation
     uint8_t nToFile:1;                  // Enable file logging
     uint8_t nFlush:1;                   // Flush stdout after screen log
+    uint8_t nAsync:1;                   // Write log file from a writer thread
     uint16_t nFlags;                    // Allowed log level flags
+    uint32_t nHighWater;                // Queued file records before dropping
 
     char sSeparator[SLOG_NAME_MAX];     // Separator between info and log
     char sFileName[SLOG_NAME_MAX];      // Output file name for logs
@@ -179,8 +192,11 @@ void slog_enable(slog_flag_t eFlag);
 void slog_disable(slog_flag_t eFlag);
 
 void slog_init(const char* pName, uint16_t nFlags, uint8_t nTdSafe);
+uint8_t slog_is_enabled(slog_flag_t eFlag); // Level allowed and some output enabled
 void slog_display(slog_flag_t eFlag, uint8_t nNewLine, const char *pFormat, ...);
-void slog_destroy(); // Needed only if the slog_init() function argument nTdSafe > 0
+void slog_flush(); // Waits for the async writer to write every queued record
+uint64_t slog_get_dropped(); // File records dropped at the high water mark
+void slog_destroy(); // Needed only if the slog_init() function argument nTdSafe > 0 or nAsync is set
 
 #ifdef __cplusplus
 }
@@ -31,11 +31,15 @@ extern "C" {
 #include "profile.h"
 #include "subvec.h"
 #include "stim.h"
+#include "tmem.h"
+#include "resident.h"
+#include "perf.h"
 #include "prgm.h"
 #include "db.h"
 
 #include "board/helper.h"
 #include "board/dma.h"
+#include "board/dev.h"
 #include "board/i2c.h"
 #include "board/gpio.h"
 #include "board/subcore.h"
@@ -0,0 +1,320 @@
+/*
+ * Phase timing
+ *
+ * Copyright (c) 2015-2021 Gemini Complex Corporation. All rights reserved.
+ *
+ */
+
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <inttypes.h>
+
+#include "common.h"
+#include "perf.h"
+
+/*
+ * Per phase counters. Timers on any thread add to them with relaxed
+ * atomics, so recording never takes a lock. A snapshot taken while
+ * timers are running can be off by the few samples in flight.
+ *
+ */
+struct perf_phase {
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t min_ns;
+    uint64_t max_ns;
+    uint64_t buckets[PERF_NUM_BUCKETS];
+};
+
+bool _perf_is_enabled = false;
+
+static struct perf_phase perf_phases[PERF_NUM_PHASES];
+
+static const char *perf_phase_names[PERF_NUM_PHASES] = {
+    [PERF_PROFILE_PARSE] = "profile_parse",
+    [PERF_DOTS_PARSE] = "dots_parse",
+    [PERF_CHUNK_FILL] = "chunk_fill",
+    [PERF_COMPRESS] = "compress",
+    [PERF_DECOMPRESS] = "decompress",
+    [PERF_DMA_PREP] = "dma_prep",
+    [PERF_DMA_START] = "dma_start",
+    [PERF_SUBCORE_STATE] = "subcore_state",
+    [PERF_AGENT_POLL] = "agent_poll",
+    [PERF_TEST_RUN] = "test_run",
+    [PERF_DB_WRITE] = "db_write"
+};
+
+// periodic dump thread
+static pthread_mutex_t perf_dump_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t perf_dump_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t perf_dump_thread;
+static bool perf_is_dumping = false;
+static bool perf_stop_dumping = false;
+static char *perf_dump_path = NULL;
+static uint32_t perf_dump_interval_secs = 0;
+
+void perf_set_enabled(bool is_enabled){
+    __atomic_store_n(&_perf_is_enabled, is_enabled, __ATOMIC_RELAXED);
+    return;
+}
+
+bool perf_is_enabled(void){
+    return __atomic_load_n(&_perf_is_enabled, __ATOMIC_RELAXED);
+}
+
+/*
+ * Clears the timings of every phase.
+ *
+ */
+void perf_reset(void){
+    for(uint32_t i=0; i<PERF_NUM_PHASES; i++){
+        struct perf_phase *p = &perf_phases[i];
+        __atomic_store_n(&p->count, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&p->total_ns, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&p->min_ns, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&p->max_ns, 0, __ATOMIC_RELAXED);
+        for(uint32_t j=0; j<PERF_NUM_BUCKETS; j++){
+            __atomic_store_n(&p->buckets[j], 0, __ATOMIC_RELAXED);
+        }
+    }
+    return;
+}
+
+const char *perf_get_phase_name(enum perf_phases phase){
+    if(phase >= PERF_NUM_PHASES){
+        die("invalid perf phase %i", phase);
+    }
+    return perf_phase_names[phase];
+}
+
+static uint32_t perf_get_bucket(uint64_t duration_ns){
+    uint64_t us = duration_ns / 1000;
+    uint32_t bucket = 0;
+
+    if(us == 0){
+        return 0;
+    }
+    // index of the highest set bit plus one
+    bucket = 64 - (uint32_t)__builtin_clzll(us);
+    if(bucket >= PERF_NUM_BUCKETS){
+        bucket = PERF_NUM_BUCKETS-1;
+    }
+    return bucket;
+}
+
+/*
+ * Adds one duration to the phase. Use perf_begin/perf_end instead
+ * of calling this directly, they skip it when timing is disabled.
+ *
+ */
+void perf_record(enum perf_phases phase, uint64_t duration_ns){
+    struct perf_phase *p = NULL;
+    uint64_t cur = 0;
+
+    if(phase >= PERF_NUM_PHASES){
+        die("invalid perf phase %i", phase);
+    }
+    p = &perf_phases[phase];
+
+    // a min of 0 means no samples yet, so store at least 1ns
+    if(duration_ns == 0){
+        duration_ns = 1;
+    }
+
+    __atomic_fetch_add(&p->count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&p->total_ns, duration_ns, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&p->buckets[perf_get_bucket(duration_ns)], 1, __ATOMIC_RELAXED);
+
+    cur = __atomic_load_n(&p->min_ns, __ATOMIC_RELAXED);
+    while((cur == 0 || duration_ns < cur) &&
+            !__atomic_compare_exchange_n(&p->min_ns, &cur, duration_ns,
+                true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+    cur = __atomic_load_n(&p->max_ns, __ATOMIC_RELAXED);
+    while(duration_ns > cur &&
+            !__atomic_compare_exchange_n(&p->max_ns, &cur, duration_ns,
+                true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    return;
+}
+
+void perf_get_stats(enum perf_phases phase, struct perf_stats *stats){
+    struct perf_phase *p = NULL;
+
+    if(stats == NULL){
+        die("pointer is NULL");
+    }
+    if(phase >= PERF_NUM_PHASES){
+        die("invalid perf phase %i", phase);
+    }
+    p = &perf_phases[phase];
+
+    stats->name = perf_phase_names[phase];
+    stats->count = __atomic_load_n(&p->count, __ATOMIC_RELAXED);
+    stats->total_ns = __atomic_load_n(&p->total_ns, __ATOMIC_RELAXED);
+    stats->min_ns = __atomic_load_n(&p->min_ns, __ATOMIC_RELAXED);
+    stats->max_ns = __atomic_load_n(&p->max_ns, __ATOMIC_RELAXED);
+    for(uint32_t i=0; i<PERF_NUM_BUCKETS; i++){
+        stats->buckets[i] = __atomic_load_n(&p->buckets[i], __ATOMIC_RELAXED);
+    }
+    return;
+}
+
+/*
+ * Estimates a percentile, 0.0 to 100.0, from the histogram. Returns
+ * the upper bound of the bucket it falls in, capped at the max, so
+ * it's off by at most a factor of two.
+ *
+ */
+uint64_t perf_get_percentile_us(struct perf_stats *stats, double percentile){
+    uint64_t total = 0;
+    uint64_t rank = 0;
+    uint64_t seen = 0;
+    uint64_t max_us = 0;
+    uint64_t bound_us = 0;
+
+    if(stats == NULL){
+        die("pointer is NULL");
+    }
+
+    for(uint32_t i=0; i<PERF_NUM_BUCKETS; i++){
+        total += stats->buckets[i];
+    }
+    if(total == 0){
+        return 0;
+    }
+
+    if(percentile < 0.0){
+        percentile = 0.0;
+    } else if(percentile > 100.0){
+        percentile = 100.0;
+    }
+    rank = (uint64_t)((percentile / 100.0) * (double)total + 0.5);
+    if(rank == 0){
+        rank = 1;
+    }
+
+    max_us = stats->max_ns / 1000;
+    for(uint32_t i=0; i<PERF_NUM_BUCKETS; i++){
+        seen += stats->buckets[i];
+        if(seen >= rank){
+            bound_us = (i == PERF_NUM_BUCKETS-1) ? max_us : (1ULL << i);
+            return bound_us < max_us ? bound_us : max_us;
+        }
+    }
+    return max_us;
+}
+
+/*
+ * Prints a line per timed phase, times in us.
+ *
+ */
+void perf_print(FILE *fp){
+    struct perf_stats stats;
+
+    if(fp == NULL){
+        die("pointer is NULL");
+    }
+
+    fprintf(fp, "%-14s %10s %12s %10s %10s %10s %10s %10s\n", "phase",
+        "count", "total_us", "mean_us", "min_us", "p50_us", "p99_us", "max_us");
+    for(uint32_t i=0; i<PERF_NUM_PHASES; i++){
+        perf_get_stats((enum perf_phases)i, &stats);
+        if(stats.count == 0){
+            continue;
+        }
+        fprintf(fp, "%-14s %10" PRIu64 " %12" PRIu64 " %10" PRIu64 " %10" PRIu64
+            " %10" PRIu64 " %10" PRIu64 " %10" PRIu64 "\n",
+            stats.name, stats.count, stats.total_ns/1000,
+            (stats.total_ns/stats.count)/1000, stats.min_ns/1000,
+            perf_get_percentile_us(&stats, 50.0),
+            perf_get_percentile_us(&stats, 99.0), stats.max_ns/1000);
+    }
+    return;
+}
+
+static void *perf_dump_loop(void *arg){
+    struct timespec deadline;
+    FILE *fp = NULL;
+    time_t now;
+    char timestamp[32];
+
+    pthread_mutex_lock(&perf_dump_mutex);
+    while(!perf_stop_dumping){
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += perf_dump_interval_secs;
+        while(!perf_stop_dumping){
+            if(pthread_cond_timedwait(&perf_dump_cond, &perf_dump_mutex,
+                    &deadline) == ETIMEDOUT){
+                break;
+            }
+        }
+        if(perf_stop_dumping){
+            break;
+        }
+
+        if((fp = fopen(perf_dump_path, "a")) == NULL){
+            slog_warn("failed to open perf dump %s: %s",
+                perf_dump_path, strerror(errno));
+            continue;
+        }
+        now = time(NULL);
+        strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S",
+            localtime(&now));
+        fprintf(fp, "# %s\n", timestamp);
+        perf_print(fp);
+        fprintf(fp, "\n");
+        fclose(fp);
+    }
+    pthread_mutex_unlock(&perf_dump_mutex);
+    return NULL;
+}
+
+/*
+ * Appends the timings to path every interval_secs until perf_stop_dump
+ * is called. Restarts the dump if one is already running.
+ *
+ */
+void perf_start_dump(const char *path, uint32_t interval_secs){
+    if(path == NULL){
+        die("pointer is NULL");
+    }
+    if(interval_secs == 0){
+        die("perf dump interval must be at least one second");
+    }
+
+    perf_stop_dump();
+
+    pthread_mutex_lock(&perf_dump_mutex);
+    if((perf_dump_path = strdup(path)) == NULL){
+        die("failed to strdup perf dump path");
+    }
+    perf_dump_interval_secs = interval_secs;
+    perf_stop_dumping = false;
+    if(pthread_create(&perf_dump_thread, NULL, perf_dump_loop, NULL) != 0){
+        die("failed to create perf dump thread");
+    }
+    perf_is_dumping = true;
+    pthread_mutex_unlock(&perf_dump_mutex);
+    return;
+}
+
+void perf_stop_dump(void){
+    pthread_mutex_lock(&perf_dump_mutex);
+    if(!perf_is_dumping){
+        pthread_mutex_unlock(&perf_dump_mutex);
+        return;
+    }
+    perf_stop_dumping = true;
+    pthread_cond_signal(&perf_dump_cond);
+    pthread_mutex_unlock(&perf_dump_mutex);
+
+    pthread_join(perf_dump_thread, NULL);
+
+    pthread_mutex_lock(&perf_dump_mutex);
+    perf_is_dumping = false;
+    free(perf_dump_path);
+    perf_dump_path = NULL;
+    pthread_mutex_unlock(&perf_dump_mutex);
+    return;
+}
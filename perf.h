@@ -0,0 +1,113 @@
+/*
+ * Phase timing
+ *
+ * Copyright (c) 2015-2021 Gemini Complex Corporation. All rights reserved.
+ *
+ */
+
+#ifndef PERF_H
+#define PERF_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+// bucket 0 counts durations under 1us, bucket i counts durations from
+// 2^(i-1)us up to 2^i us and the last bucket everything above
+#define PERF_NUM_BUCKETS 32
+
+/*
+ * Phases of a load/run cycle that get timed.
+ *
+ */
+enum perf_phases {
+    PERF_PROFILE_PARSE,
+    PERF_DOTS_PARSE,
+    PERF_CHUNK_FILL,
+    PERF_COMPRESS,
+    PERF_DECOMPRESS,
+    PERF_DMA_PREP,
+    PERF_DMA_START,
+    PERF_SUBCORE_STATE,
+    PERF_AGENT_POLL,
+    PERF_TEST_RUN,
+    PERF_DB_WRITE,
+    PERF_NUM_PHASES
+};
+
+/*
+ * Copy of the timings of one phase.
+ *
+ * count    : Number of times the phase was timed.
+ * total_ns : Sum of all the durations.
+ * min_ns   : Shortest duration, 0 if count is 0.
+ * max_ns   : Longest duration.
+ * buckets  : Latency histogram, see PERF_NUM_BUCKETS.
+ *
+ */
+struct perf_stats {
+    const char *name;
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t min_ns;
+    uint64_t max_ns;
+    uint64_t buckets[PERF_NUM_BUCKETS];
+};
+
+// private, read by the inline timers
+extern bool _perf_is_enabled;
+
+void perf_set_enabled(bool is_enabled);
+bool perf_is_enabled(void);
+void perf_reset(void);
+const char *perf_get_phase_name(enum perf_phases phase);
+void perf_record(enum perf_phases phase, uint64_t duration_ns);
+void perf_get_stats(enum perf_phases phase, struct perf_stats *stats);
+uint64_t perf_get_percentile_us(struct perf_stats *stats, double percentile);
+void perf_print(FILE *fp);
+void perf_start_dump(const char *path, uint32_t interval_secs);
+void perf_stop_dump(void);
+
+static inline uint64_t perf_now_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec;
+}
+
+/*
+ * Time a phase with
+ *
+ *     uint64_t perf_start = perf_begin();
+ *     ...
+ *     perf_end(PERF_DMA_PREP, perf_start);
+ *
+ * When timing is disabled perf_begin returns 0 without reading the
+ * clock and perf_end returns right away, so the cost is one load and
+ * one branch on each side.
+ *
+ */
+static inline uint64_t perf_begin(void){
+    if(!__atomic_load_n(&_perf_is_enabled, __ATOMIC_RELAXED)){
+        return 0;
+    }
+    return perf_now_ns();
+}
+
+static inline void perf_end(enum perf_phases phase, uint64_t start_ns){
+    if(start_ns == 0){
+        return;
+    }
+    perf_record(phase, perf_now_ns() - start_ns);
+    return;
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif
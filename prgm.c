@@ -8,6 +8,8 @@
 #include "common.h"
 #include "util.h"
 #include "stim.h"
+#include "resident.h"
+#include "perf.h"
 #include "board/artix.h"
 #include "prgm.h"
 
@@ -29,14 +31,19 @@
 #include <inttypes.h>
 #include <ctype.h>
 #include <setjmp.h>
+#include <pthread.h>
 
 #define BUFFER_SIZE (4096)
 
+static pthread_mutex_t fe_data_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static void *fe_data_pool[FE_DATA_POOL_SIZE];
+static uint32_t fe_data_pool_count = 0;
+
 /*
  * Creates a prgm stim object to be added to the hashtable.
  *
  */
-struct prgm_stim *_create_prgm_stim(struct stim *stim, uint32_t a1_addr, uint32_t a2_addr){
+struct prgm_stim *_create_prgm_stim(struct stim *stim, uint64_t a1_addr, uint64_t a2_addr){
     struct prgm_stim *prgm_stim = NULL;
     if(stim == NULL){
         die("pointer is null");
@@ -48,10 +55,182 @@ struct prgm_stim *_create_prgm_stim(struct stim *stim, uint32_t a1_addr, uint32_
     prgm_stim->stim = stim;
     prgm_stim->a1_addr = a1_addr;
     prgm_stim->a2_addr = a2_addr;
+    prgm_stim->setup = artix_create_stim_setup(stim, a1_addr, a2_addr);
+    prgm_stim->num_site_setups = 0;
+    prgm_stim->site_setups = NULL;
+    prgm_stim->resident = NULL;
 
     return prgm_stim;
 }
 
+/*
+ * Frees the prgm stim along with its stim and setup.
+ *
+ */
+void _free_prgm_stim(struct prgm_stim *prgm_stim){
+    if(prgm_stim == NULL){
+        return;
+    }
+    artix_free_stim_setup(prgm_stim->setup);
+    for(uint32_t i=0; i<prgm_stim->num_site_setups; i++){
+        artix_free_stim_setup(prgm_stim->site_setups[i]);
+    }
+    if(prgm_stim->site_setups != NULL){
+        free(prgm_stim->site_setups);
+    }
+    free_stim(prgm_stim->stim);
+    free(prgm_stim);
+    return;
+}
+
+/*
+ * Rebuilds the setups of a prgm stim after it moved in tester memory.
+ * Site setups get rebuilt the next time the stim runs by site.
+ *
+ */
+static void _reset_prgm_stim_setups(struct prgm_stim *prgm_stim){
+    artix_free_stim_setup(prgm_stim->setup);
+    for(uint32_t i=0; i<prgm_stim->num_site_setups; i++){
+        artix_free_stim_setup(prgm_stim->site_setups[i]);
+    }
+    if(prgm_stim->site_setups != NULL){
+        free(prgm_stim->site_setups);
+    }
+    prgm_stim->num_site_setups = 0;
+    prgm_stim->site_setups = NULL;
+    prgm_stim->setup = artix_create_stim_setup(prgm_stim->stim, 
+        prgm_stim->a1_addr, prgm_stim->a2_addr);
+    return;
+}
+
+/*
+ * Loaded stims are kept per unit, keyed by the addr they're loaded at
+ * in that unit.
+ *
+ */
+static struct prgm_stim *_find_loaded_stim(struct prgm *prgm, 
+        enum artix_selects artix_select, uint64_t addr){
+    struct prgm_stim *prgm_stim = NULL;
+
+    if(artix_select == ARTIX_SELECT_A1){
+        HASH_FIND(hh, prgm->_a1_loaded_stims, &addr, sizeof(uint64_t), prgm_stim);
+    }else if(artix_select == ARTIX_SELECT_A2){
+        HASH_FIND(a2_hh, prgm->_a2_loaded_stims, &addr, sizeof(uint64_t), prgm_stim);
+    }else{
+        die("invalid artix unit selected");
+    }
+    return prgm_stim;
+}
+
+static void _add_loaded_stim(struct prgm *prgm, 
+        enum artix_selects artix_select, struct prgm_stim *prgm_stim){
+    if(artix_select == ARTIX_SELECT_A1){
+        HASH_ADD(hh, prgm->_a1_loaded_stims, a1_addr, sizeof(uint64_t), prgm_stim);
+        prgm->_num_a1_loaded_stims += 1;
+    }else if(artix_select == ARTIX_SELECT_A2){
+        HASH_ADD(a2_hh, prgm->_a2_loaded_stims, a2_addr, sizeof(uint64_t), prgm_stim);
+        prgm->_num_a2_loaded_stims += 1;
+    }else{
+        die("invalid artix unit selected");
+    }
+    return;
+}
+
+static void _del_loaded_stim(struct prgm *prgm, 
+        enum artix_selects artix_select, struct prgm_stim *prgm_stim){
+    if(artix_select == ARTIX_SELECT_A1){
+        HASH_DELETE(hh, prgm->_a1_loaded_stims, prgm_stim);
+        prgm->_num_a1_loaded_stims -= 1;
+    }else if(artix_select == ARTIX_SELECT_A2){
+        HASH_DELETE(a2_hh, prgm->_a2_loaded_stims, prgm_stim);
+        prgm->_num_a2_loaded_stims -= 1;
+    }else{
+        die("invalid artix unit selected");
+    }
+    return;
+}
+
+/*
+ * Follows a loaded stim moved by compacting tester memory, whichever
+ * prgm compacted it. Resident stims not loaded by this prgm are skipped,
+ * as are stims of ours that were overwritten and only share the addr.
+ *
+ */
+static void _move_loaded_stim(struct resident_stim *resident, 
+        enum artix_selects artix_select, uint64_t old_addr, uint64_t new_addr, 
+        void *data){
+    struct prgm *prgm = (struct prgm*)data;
+    struct prgm_stim *prgm_stim = NULL;
+
+    if((prgm_stim = _find_loaded_stim(prgm, artix_select, old_addr)) == NULL){
+        return;
+    }
+    if(prgm_stim->resident != resident){
+        return;
+    }
+
+    _del_loaded_stim(prgm, artix_select, prgm_stim);
+    if(artix_select == ARTIX_SELECT_A1){
+        prgm_stim->a1_addr = new_addr;
+    }else{
+        prgm_stim->a2_addr = new_addr;
+    }
+    _add_loaded_stim(prgm, artix_select, prgm_stim);
+    _reset_prgm_stim_setups(prgm_stim);
+    return;
+}
+
+/*
+ * Compacts a unit's tester memory, moving the resident stims down so the
+ * free memory is in one piece. Returns the number of stims moved.
+ *
+ */
+static uint32_t _compact_stim_mem(struct prgm *prgm, 
+        enum artix_selects artix_select){
+    return resident_compact(artix_select);
+}
+
+/*
+ * Takes the prgm stim out of the units it's loaded in, releases its
+ * resident stim and frees it. The stim stays in tester memory until
+ * it's evicted, so a later load of the same stim is free.
+ *
+ */
+static void _unload_prgm_stim(struct prgm *prgm, struct prgm_stim *prgm_stim){
+    if(_find_loaded_stim(prgm, ARTIX_SELECT_A1, prgm_stim->a1_addr) == prgm_stim){
+        _del_loaded_stim(prgm, ARTIX_SELECT_A1, prgm_stim);
+    }
+    if(_find_loaded_stim(prgm, ARTIX_SELECT_A2, prgm_stim->a2_addr) == prgm_stim){
+        _del_loaded_stim(prgm, ARTIX_SELECT_A2, prgm_stim);
+    }
+    if(prgm->_last_prgm_stim == prgm_stim){
+        prgm->_last_prgm_stim = NULL;
+    }
+    if(prgm_stim->resident != NULL){
+        resident_release_stim(prgm_stim->resident);
+    }
+    _free_prgm_stim(prgm_stim);
+    return;
+}
+
+/*
+ * Unloads our stim at addr if tester memory was overwritten under it,
+ * so a new stim can be loaded there.
+ *
+ */
+static void _unload_overwritten_stim(struct prgm *prgm, 
+        enum artix_selects artix_select, uint64_t addr){
+    struct prgm_stim *prgm_stim = NULL;
+
+    if((prgm_stim = _find_loaded_stim(prgm, artix_select, addr)) == NULL){
+        return;
+    }
+    if(prgm_stim->resident != NULL && !resident_is_valid(prgm_stim->resident)){
+        _unload_prgm_stim(prgm, prgm_stim);
+    }
+    return;
+}
+
 /*
  * Returns the nfs mount path if the prgm has a prgm_id and a mount_id set,
  * otherwise just return the path given.
@@ -99,12 +278,16 @@ enum load_types {
 /*
  * Helper function that loads a stim into tester memory.
  *
- * LOAD = loads from profile/stim path at next available memory address
- * LOADS = loads from a stim object at next available memory address
+ * LOAD = loads from profile/stim path at the best fitting free memory
+ * LOADS = loads from a stim object at the best fitting free memory
  * LOADA = loads from a stim object and uses load address given
  *
- * TODO: if LOADA, check to make sure it doesn't overwrite another pattern
- * TODO: check if loading a stim will go out of memory bounds
+ * LOAD and LOADS don't load a stim that's still resident from this or
+ * an earlier prgm, they just return its addrs. Stims not in use are
+ * evicted, least recently used first, to make room.
+ *
+ * Raises a fe error if the stim doesn't fit or, for LOADA, if it goes
+ * out of bounds or overlaps a stim in use.
  *
  */
 static void _load_stim(fe_Context *_fe_ctx, fe_Object *arg, enum load_types load_type, 
@@ -114,15 +297,15 @@ static void _load_stim(fe_Context *_fe_ctx, fe_Object *arg, enum load_types load
     struct prgm *prgm = NULL;
     fe_Object *fe_stim_path = NULL;
     fe_Object *fe_stim = NULL;
-    fe_Object *fe_prgm = NULL;
     fe_Object *fe_addr = NULL;
-    uint32_t a1_load_addr = 0;
-    uint32_t a2_load_addr = 0;
+    uint64_t a1_load_addr = 0;
+    uint64_t a2_load_addr = 0;
     struct prgm_stim *prgm_stim = NULL;
-    struct prgm_stim *s;
     // double buffer so it can fit max len of stim_path below
     char buffer[BUFFER_SIZE*2];
-    uint64_t num_loaded_bytes = 0;
+    struct resident_stim *resident = NULL;
+    bool use_a1 = false;
+    bool use_a2 = false;
     enum stim_modes stim_mode = STIM_MODE_NONE;
     UT_string *path = NULL;
 
@@ -134,9 +317,8 @@ static void _load_stim(fe_Context *_fe_ctx, fe_Object *arg, enum load_types load
         die("pointer is null");
     }
 
-    fe_prgm = fe_eval(_fe_ctx, fe_symbol(_fe_ctx, "prgm"));
-    if((prgm = (struct prgm*)fe_toptr(_fe_ctx, fe_prgm)) == NULL){
-        fe_error(_fe_ctx, "failed to get global prgm object");
+    if((prgm = (struct prgm*)fe_getudata(_fe_ctx)) == NULL){
+        fe_error(_fe_ctx, "failed to get prgm object from fe context");
     }
 
     if(load_type == LOAD){
@@ -167,10 +349,13 @@ static void _load_stim(fe_Context *_fe_ctx, fe_Object *arg, enum load_types load
         }
 
         fe_addr = fe_nextarg(_fe_ctx, &arg);
-        a1_load_addr = (uint32_t)fe_tonumber(_fe_ctx, fe_addr);
-        a2_load_addr = (uint32_t)fe_tonumber(_fe_ctx, fe_addr);
+        a1_load_addr = (uint64_t)fe_tointeger(_fe_ctx, fe_addr);
+        a2_load_addr = (uint64_t)fe_tointeger(_fe_ctx, fe_addr);
     }
 
+    // stims from reads are only built when first loaded
+    stim_load_lazy(stim);
+
     stim_mode = stim_get_mode(stim);
     if(stim_mode == STIM_MODE_NONE){
         // double buffer so it can fit max len of stim_path
@@ -178,69 +363,72 @@ static void _load_stim(fe_Context *_fe_ctx, fe_Object *arg, enum load_types load
         fe_error(_fe_ctx, buffer);
     }
 
-    if(load_type == LOAD || load_type == LOADS){
-        // use a1 addr for both a1 and a2 if dual mode
-        a1_load_addr = prgm->_cur_a1_stim_addr;
-        a2_load_addr = prgm->_cur_a2_stim_addr;
-    }
+    use_a1 = (stim_mode == STIM_MODE_DUAL || stim_mode == STIM_MODE_A1);
+    use_a2 = (stim_mode == STIM_MODE_DUAL || stim_mode == STIM_MODE_A2);
 
-    if((prgm_stim = _create_prgm_stim(stim, a1_load_addr, a2_load_addr)) == NULL){
-        die("failed to create prgm stim");
+    if(load_type == LOAD || load_type == LOADS){
+        resident = resident_acquire_stim(stim);
     }
 
-    if(stim_mode == STIM_MODE_DUAL){
-        HASH_FIND_INT(prgm->_a1_loaded_stims, &prgm_stim->a1_addr, s);
-        if (s == NULL) {
-            HASH_ADD_INT(prgm->_a1_loaded_stims, a1_addr, prgm_stim);
-        }else{
-            snprintf(buffer, BUFFER_SIZE, "stim already loaded at a1 address 0x%08X", a1_load_addr);
-            fe_error(_fe_ctx, buffer);
+    if(resident != NULL){
+        a1_load_addr = resident->a1_addr;
+        a2_load_addr = resident->a2_addr;
+        if(use_a1){
+            _unload_overwritten_stim(prgm, ARTIX_SELECT_A1, a1_load_addr);
         }
-
-        HASH_FIND_INT(prgm->_a2_loaded_stims, &prgm_stim->a2_addr, s);
-        if (s == NULL) {
-            HASH_ADD_INT(prgm->_a2_loaded_stims, a2_addr, prgm_stim);
-        }else{
-            snprintf(buffer, BUFFER_SIZE, "stim already loaded at a2 address 0x%08X", a2_load_addr);
-            fe_error(_fe_ctx, buffer);
+        if(use_a2){
+            _unload_overwritten_stim(prgm, ARTIX_SELECT_A2, a2_load_addr);
         }
 
-        num_loaded_bytes = artix_load_stim(stim, a1_load_addr, a2_load_addr);
-
-        if(load_type == LOAD || load_type == LOADS){
-            prgm->_cur_a1_stim_addr += num_loaded_bytes;
-            prgm->_cur_a2_stim_addr += num_loaded_bytes;
-        }
-        prgm->_num_a1_loaded_stims += 1;
-        prgm->_num_a2_loaded_stims += 1;
-    }else if(stim_mode == STIM_MODE_A1){
-        HASH_FIND_INT(prgm->_a1_loaded_stims, &prgm_stim->a1_addr, s);
-        if (s == NULL) {
-            HASH_ADD_INT(prgm->_a1_loaded_stims, a1_addr, prgm_stim);
+        // already loaded by this prgm, so there's nothing to do
+        if(use_a1){
+            prgm_stim = _find_loaded_stim(prgm, ARTIX_SELECT_A1, a1_load_addr);
         }else{
-            snprintf(buffer, BUFFER_SIZE, "stim already loaded at a1 address 0x%08X", a1_load_addr);
-            fe_error(_fe_ctx, buffer);
+            prgm_stim = _find_loaded_stim(prgm, ARTIX_SELECT_A2, a2_load_addr);
+        }
+        if(prgm_stim != NULL){
+            resident_release_stim(resident);
+            if(load_type == LOAD){
+                free_stim(stim);
+            }
+            *a1_addr = a1_load_addr;
+            *a2_addr = a2_load_addr;
+            *mode = stim_mode;
+            return;
         }
 
-        num_loaded_bytes = artix_load_stim(stim, a1_load_addr, a2_load_addr);
-        if(load_type == LOAD || load_type == LOADS){
-            prgm->_cur_a1_stim_addr += num_loaded_bytes;
+        slog_info("stim '%s' is already in tester memory", stim->path);
+    }else if(load_type == LOAD || load_type == LOADS){
+        if((resident = resident_load_stim(stim)) == NULL){
+            snprintf(buffer, BUFFER_SIZE*2, "not enough tester memory to load stim '%s'", stim->path);
+            fe_error(_fe_ctx, buffer);
         }
-        prgm->_num_a1_loaded_stims += 1;
-    }else if(stim_mode == STIM_MODE_A2){
-        HASH_FIND_INT(prgm->_a2_loaded_stims, &prgm_stim->a2_addr, s);
-        if (s == NULL) {
-            HASH_ADD_INT(prgm->_a2_loaded_stims, a2_addr, prgm_stim);
-        }else{
-            snprintf(buffer, BUFFER_SIZE, "stim already loaded at a2 address 0x%08X", a2_load_addr);
+        a1_load_addr = resident->a1_addr;
+        a2_load_addr = resident->a2_addr;
+    }else{
+        if((resident = resident_load_stim_at(stim, a1_load_addr, a2_load_addr)) == NULL){
+            snprintf(buffer, BUFFER_SIZE*2, "can't load stim at address 0x%08" PRIX64 " because it's unaligned, out of bounds or overlaps a stim in use", a1_load_addr);
             fe_error(_fe_ctx, buffer);
         }
+    }
 
-        num_loaded_bytes = artix_load_stim(stim, a1_load_addr, a2_load_addr);
-        if(load_type == LOAD || load_type == LOADS){
-            prgm->_cur_a2_stim_addr += num_loaded_bytes;
-        }
-        prgm->_num_a2_loaded_stims += 1;
+    if(use_a1){
+        _unload_overwritten_stim(prgm, ARTIX_SELECT_A1, a1_load_addr);
+    }
+    if(use_a2){
+        _unload_overwritten_stim(prgm, ARTIX_SELECT_A2, a2_load_addr);
+    }
+
+    if((prgm_stim = _create_prgm_stim(stim, a1_load_addr, a2_load_addr)) == NULL){
+        die("failed to create prgm stim");
+    }
+    prgm_stim->resident = resident;
+
+    if(use_a1){
+        _add_loaded_stim(prgm, ARTIX_SELECT_A1, prgm_stim);
+    }
+    if(use_a2){
+        _add_loaded_stim(prgm, ARTIX_SELECT_A2, prgm_stim);
     }
 
     *a1_addr = a1_load_addr;
@@ -250,165 +438,348 @@ static void _load_stim(fe_Context *_fe_ctx, fe_Object *arg, enum load_types load
     return;
 }
 
-static fe_Object * _run_stim(fe_Context *_fe_ctx, fe_Object *arg, bool run_continue){
-    struct prgm *prgm = NULL;
-    fe_Object *fe_addrs = NULL;
+/*
+ * Looks up the prgm stims to run for an (a1_addr . a2_addr) pair. Raises
+ * a fe error if the pair is invalid or nothing is loaded there.
+ *
+ * Returns the number of runs for the pair. A dual stim or a single solo
+ * stim is one run and is set in a1_run_stim. Two different solo stims, 
+ * a1 at a1_addr and a2 at a2_addr, are two runs started together.
+ *
+ */
+static uint32_t _get_run_prgm_stims(fe_Context *_fe_ctx, 
+        struct prgm *prgm, fe_Object *fe_addrs, 
+        struct prgm_stim **a1_run_stim, struct prgm_stim **a2_run_stim){
     fe_Object *fe_a1_addr = NULL;
     fe_Object *fe_a2_addr = NULL;
-    fe_Object *fe_prgm = NULL;
     uint64_t a1_addr = 0;
     uint64_t a2_addr = 0;
     struct prgm_stim *a1_prgm_stim = NULL;
     struct prgm_stim *a2_prgm_stim = NULL;
-    bool failed = false;
-    bool did_test_fail = false;
-    uint64_t test_cycle = 0;
-    uint32_t num_tests_ran = 0;
     char buffer[BUFFER_SIZE];
-    struct db_prgm *db_prgm = NULL;
-    int64_t db_stim_id = -1;
-    struct db_stim *db_stim = NULL;
 
-    fe_prgm = fe_eval(_fe_ctx, fe_symbol(_fe_ctx, "prgm"));
-    if((prgm = (struct prgm*)fe_toptr(_fe_ctx, fe_prgm)) == NULL){
-        fe_error(_fe_ctx, "failed to get global prgm object");
+    fe_a1_addr = fe_car(_fe_ctx, fe_addrs);
+    fe_a2_addr = fe_cdr(_fe_ctx, fe_addrs);
+
+    if(fe_type(_fe_ctx, fe_a2_addr) == FE_TPAIR){
+        fe_error(_fe_ctx, "failed to run because addrs given must be a cons pair not a list");
     }
 
-    if(prgm->_db_prgm_id >= 0 && prgm->_db != NULL){
-        if((db_prgm = db_get_prgm_by_id(prgm->_db, prgm->_db_prgm_id)) == NULL){
-            die("failed to get db_prgm by id %lli", prgm->_db_prgm_id);
+    if(fe_isnil(_fe_ctx, fe_a1_addr) && fe_isnil(_fe_ctx, fe_a2_addr)){
+        snprintf(buffer, BUFFER_SIZE, "failed to run stim because invalid address pair given");
+        fe_error(_fe_ctx, buffer);
+    }
+
+    if(!fe_isnil(_fe_ctx, fe_a1_addr)){
+        a1_addr = (uint64_t)fe_tointeger(_fe_ctx, fe_a1_addr);
+        if((a1_prgm_stim = _find_loaded_stim(prgm, ARTIX_SELECT_A1, a1_addr)) == NULL){
+            snprintf(buffer, BUFFER_SIZE, "no stim loaded at a1 address 0x%08" PRIX64 "", a1_addr);
+            fe_error(_fe_ctx, buffer);
         }
+    }
 
-        db_prgm->did_fail = 0;
-        db_prgm->failing_vec = -1;
+    if(!fe_isnil(_fe_ctx, fe_a2_addr)){
+        a2_addr = (uint64_t)fe_tointeger(_fe_ctx, fe_a2_addr);
+        if((a2_prgm_stim = _find_loaded_stim(prgm, ARTIX_SELECT_A2, a2_addr)) == NULL){
+            snprintf(buffer, BUFFER_SIZE, "no stim loaded at a2 address 0x%08" PRIX64 "", a2_addr);
+            fe_error(_fe_ctx, buffer);
+        }
     }
 
-    while(!fe_isnil(_fe_ctx, arg)){
-        a1_addr = 0;
-        a2_addr = 0;
-        a1_prgm_stim = NULL;
-        a2_prgm_stim = NULL;
+    if(a1_prgm_stim == NULL && a2_prgm_stim == NULL){
+        fe_error(_fe_ctx, "failed to run stim because no stim found at a1 addr or a2 addr");
+    }
 
-        fe_addrs = fe_nextarg(_fe_ctx, &arg);
-        fe_a1_addr = fe_car(_fe_ctx, fe_addrs);
-        fe_a2_addr = fe_cdr(_fe_ctx, fe_addrs);
+    // a mem test or config overwrote tester memory since the load
+    if((a1_prgm_stim != NULL && !resident_is_valid(a1_prgm_stim->resident)) 
+            || (a2_prgm_stim != NULL && !resident_is_valid(a2_prgm_stim->resident))){
+        fe_error(_fe_ctx, "failed to run stim because tester memory was overwritten since it was loaded, load it again");
+    }
 
-        if(fe_type(_fe_ctx, fe_a2_addr) == FE_TPAIR){
-            fe_error(_fe_ctx, "failed to run because addrs given must be a cons pair not a list");
-        }
+    (*a1_run_stim) = NULL;
+    (*a2_run_stim) = NULL;
 
-        if(fe_isnil(_fe_ctx, fe_a1_addr) && fe_isnil(_fe_ctx, fe_a2_addr)){
-            snprintf(buffer, BUFFER_SIZE, "failed to run stim because invalid address pair given");
+    // Either stim loaded into a1, a2 or both. If both then it's either a dual 
+    // pattern and the stim will be the same, or an a1 and an a2 solo pattern
+    // that get run at the same time.
+    if(a1_prgm_stim != NULL && a2_prgm_stim != NULL){
+        if(a1_prgm_stim == a2_prgm_stim && a1_prgm_stim->stim == a2_prgm_stim->stim){
+            (*a1_run_stim) = a1_prgm_stim;
+            return 1;
+        }
+        if(stim_get_mode(a1_prgm_stim->stim) != STIM_MODE_A1 
+                || stim_get_mode(a2_prgm_stim->stim) != STIM_MODE_A2){
+            snprintf(buffer, BUFFER_SIZE, "Failed to run because addr pair (0x%016" PRIX64 ", 0x%016" PRIX64 ") must be a dual stim loaded in both units or an a1 and an a2 solo stim.", a1_addr, a2_addr);
             fe_error(_fe_ctx, buffer);
         }
+        (*a1_run_stim) = a1_prgm_stim;
+        (*a2_run_stim) = a2_prgm_stim;
+        return 2;
+    }
 
-        if(!fe_isnil(_fe_ctx, fe_a1_addr)){
-            a1_addr = (uint32_t)fe_tonumber(_fe_ctx, fe_a1_addr);
-            HASH_FIND_INT(prgm->_a1_loaded_stims, &a1_addr, a1_prgm_stim);
-            if (a1_prgm_stim == NULL) {
-                snprintf(buffer, BUFFER_SIZE, "no stim loaded at a1 address 0x%08" PRIX64 "", a1_addr);
-                fe_error(_fe_ctx, buffer);
-            }
-        }
+    if(a1_prgm_stim != NULL){
+        (*a1_run_stim) = a1_prgm_stim;
+    }else{
+        (*a1_run_stim) = a2_prgm_stim;
+    }
+    return 1;
+}
+
+/*
+ * Db rows of a batch run. Each stim row is inserted STIM_PENDING when
+ * its run starts and set to STIM_DONE when the run ends, so the db
+ * follows the batch as it runs and a batch cut short keeps its rows.
+ *
+ */
+struct prgm_run_db {
+    struct prgm *prgm;
+    struct db_prgm *db_prgm;
+    struct artix_stim_run *runs;
+    int64_t *db_stim_ids;
+    // site runs log the site and keep the first fail in the prgm row,
+    // other runs log no site and the prgm row follows the last run
+    bool is_by_site;
+};
+
+static void _prgm_run_db_start(struct artix_stim_run *run, void *data){
+    struct prgm_run_db *run_db = (struct prgm_run_db*)data;
+    int32_t site = -1;
+
+    if(run_db->is_by_site){
+        site = run->setup->dut_id;
+    }
+    run_db->db_stim_ids[run - run_db->runs] = db_insert_stim(
+        run_db->prgm->_db, run_db->prgm->_db_prgm_id, run->stim->path, 
+        site, 0, -1, STIM_PENDING);
+    return;
+}
+
+static void _prgm_run_db_done(struct artix_stim_run *run, void *data){
+    struct prgm_run_db *run_db = (struct prgm_run_db*)data;
+    struct db_prgm *db_prgm = run_db->db_prgm;
+    struct db_stim *db_stim = NULL;
+    int64_t db_stim_id = run_db->db_stim_ids[run - run_db->runs];
+
+    if((db_stim = db_get_stim_by_id(run_db->prgm->_db, db_stim_id)) == NULL){
+        die("failed to get db_stim by id %lli", db_stim_id);
+    }
+    db_stim->did_fail = (int32_t)run->did_fail;
+    db_stim->failing_vec = (int64_t)run->test_cycle;
+    db_stim->state = STIM_DONE;
+    db_update_stim(run_db->prgm->_db, db_stim);
+    db_free_stim(db_stim);
 
-        if(!fe_isnil(_fe_ctx, fe_a2_addr)){
-            a2_addr = (uint32_t)fe_tonumber(_fe_ctx, fe_a2_addr);
-            HASH_FIND_INT(prgm->_a2_loaded_stims, &a2_addr, a2_prgm_stim);
-            if (a2_prgm_stim == NULL) {
-                snprintf(buffer, BUFFER_SIZE, "no stim loaded at a2 address 0x%08" PRIX64 "", a2_addr);
-                fe_error(_fe_ctx, buffer);
+    if(run->fail_pins != NULL){
+        for(uint32_t i=0; i<DUT_TOTAL_NUM_PINS; i++){
+            if(run->fail_pins[i]){
+                db_insert_fail_pin(run_db->prgm->_db, db_stim_id, (int64_t)i, 1);
             }
         }
+    }
 
-        
-        if(a1_prgm_stim == NULL && a2_prgm_stim == NULL){
-            fe_error(_fe_ctx, "failed to run stim because no stim found at a1 addr or a2 addr");
-        }
+    db_prgm->last_stim_id = db_stim_id;
+    if(!run_db->is_by_site){
+        db_prgm->did_fail = (int32_t)run->did_fail;
+        db_prgm->failing_vec = (int64_t)run->test_cycle;
+    }else if(run->did_fail && !db_prgm->did_fail){
+        db_prgm->did_fail = 1;
+        db_prgm->failing_vec = (int64_t)run->test_cycle;
+    }
+    db_update_prgm(run_db->prgm->_db, db_prgm);
+    return;
+}
 
-        if(prgm->_db_prgm_id >= 0 && prgm->_db != NULL){
-            if(a1_prgm_stim != NULL){
-                db_stim_id = db_insert_stim(prgm->_db, prgm->_db_prgm_id, 
-                        a1_prgm_stim->stim->path, 0, -1, STIM_PENDING);
-            }else if(a2_prgm_stim != NULL){
-                db_stim_id = db_insert_stim(prgm->_db, prgm->_db_prgm_id, 
-                        a2_prgm_stim->stim->path, 0, -1, STIM_PENDING);
-            }
+/*
+ * Sets up the db rows of a batch run if the prgm logs to a db. Returns
+ * false if it doesn't.
+ *
+ */
+static bool _prgm_run_db_init(struct prgm *prgm, struct prgm_run_db *run_db, 
+        struct artix_stim_run *runs, uint32_t num_runs, bool is_by_site){
+    if(prgm == NULL || run_db == NULL){
+        die("pointer is NULL");
+    }
+
+    memset(run_db, 0, sizeof(struct prgm_run_db));
+    if(prgm->_db_prgm_id < 0 || prgm->_db == NULL || num_runs == 0){
+        return false;
+    }
+
+    if((run_db->db_prgm = db_get_prgm_by_id(prgm->_db, prgm->_db_prgm_id)) == NULL){
+        die("failed to get db_prgm by id %lli", prgm->_db_prgm_id);
+    }
+    run_db->db_prgm->did_fail = 0;
+    run_db->db_prgm->failing_vec = -1;
+
+    if((run_db->db_stim_ids = (int64_t*)calloc(num_runs, sizeof(int64_t))) == NULL){
+        die("error: calloc failed");
+    }
+    run_db->prgm = prgm;
+    run_db->runs = runs;
+    run_db->is_by_site = is_by_site;
+
+    for(uint32_t i=0; i<num_runs; i++){
+        runs[i].start_cb = _prgm_run_db_start;
+        runs[i].done_cb = _prgm_run_db_done;
+        runs[i].cb_data = run_db;
+    }
+    return true;
+}
+
+static void _prgm_run_db_free(struct prgm_run_db *run_db){
+    if(run_db == NULL){
+        die("pointer is NULL");
+    }
+    if(run_db->db_prgm != NULL){
+        db_free_prgm(run_db->db_prgm);
+        run_db->db_prgm = NULL;
+    }
+    if(run_db->db_stim_ids != NULL){
+        free(run_db->db_stim_ids);
+        run_db->db_stim_ids = NULL;
+    }
+    return;
+}
+
+/*
+ * Unpins everything pushed on the gc stack since gc and pins only the
+ * result list being built, plus the sublist in progress if not NULL.
+ * Every fe_cons pins its result, so building a long result list without
+ * this overflows the gc stack on big batches, many sites or long logs.
+ *
+ */
+static void _fe_repin(fe_Context *_fe_ctx, int gc, fe_Object *list, 
+        fe_Object *sublist){
+    fe_restoregc(_fe_ctx, gc);
+    fe_pushgc(_fe_ctx, list);
+    if(sublist != NULL){
+        fe_pushgc(_fe_ctx, sublist);
+    }
+    return;
+}
+
+/*
+ * Runs every (a1_addr . a2_addr) pair given as one batch. All pairs are
+ * checked before anything runs. Returns 
+ * (num_tests_ran did_test_fail test_cycle results) where results holds
+ * a (did_fail . test_cycle) pair for each test ran. A pair with two solo
+ * stims counts as two tests.
+ *
+ */
+static fe_Object * _run_stim(fe_Context *_fe_ctx, fe_Object *arg, bool run_continue){
+    struct prgm *prgm = NULL;
+    fe_Object *fe_arg = NULL;
+    fe_Object *fe_results = NULL;
+    struct prgm_stim *a1_run_stim = NULL;
+    struct prgm_stim *a2_run_stim = NULL;
+    struct prgm_stim **prgm_stims = NULL;
+    struct artix_stim_run *runs = NULL;
+    uint32_t num_runs = 0;
+    uint32_t num_pair_runs = 0;
+    bool did_test_fail = false;
+    uint64_t test_cycle = 0;
+    uint32_t num_tests_ran = 0;
+    struct prgm_run_db run_db;
+    int gc = 0;
+
+    if((prgm = (struct prgm*)fe_getudata(_fe_ctx)) == NULL){
+        fe_error(_fe_ctx, "failed to get prgm object from fe context");
+    }
+
+    // check every pair first, fe_error doesn't return
+    fe_arg = arg;
+    while(!fe_isnil(_fe_ctx, fe_arg)){
+        num_runs += _get_run_prgm_stims(_fe_ctx, prgm, 
+            fe_nextarg(_fe_ctx, &fe_arg), &a1_run_stim, &a2_run_stim);
+    }
+
+    if(num_runs > 0){
+        if((runs = (struct artix_stim_run*)calloc(num_runs, sizeof(struct artix_stim_run))) == NULL){
+            die("error: calloc failed");
+        }
+        if((prgm_stims = (struct prgm_stim**)calloc(num_runs, sizeof(struct prgm_stim*))) == NULL){
+            die("error: calloc failed");
         }
+    }
 
-        // Either stim loaded into a1, a2 or both. If both then it's a dual pattern and
-        // the stim will be the same. It could be two solo patterns, but that's currently
-        // not supported.
-        // TODO: support running two loaded solo patterns.
-        if(a1_prgm_stim != NULL && a2_prgm_stim != NULL){
-            if((a1_prgm_stim != a2_prgm_stim) || (a1_prgm_stim->stim != a2_prgm_stim->stim)){
-                snprintf(buffer, BUFFER_SIZE, "Failed to run because addr pair (0x%016" PRIX64 ", 0x%016" PRIX64 ") must be a dual stim loaded in both units.", a1_addr, a2_addr);
-                fe_error(_fe_ctx, buffer);
-            }
+    for(uint32_t i=0; i<num_runs; i+=num_pair_runs){
+        num_pair_runs = _get_run_prgm_stims(_fe_ctx, prgm, 
+            fe_nextarg(_fe_ctx, &arg), &a1_run_stim, &a2_run_stim);
+
+        prgm_stims[i] = a1_run_stim;
+        if(num_pair_runs > 1){
+            prgm_stims[i+1] = a2_run_stim;
+            runs[i].run_with_next = true;
+        }
+        for(uint32_t j=i; j<i+num_pair_runs; j++){
+            runs[j].stim = prgm_stims[j]->stim;
+            runs[j].a1_addr = prgm_stims[j]->a1_addr;
+            runs[j].a2_addr = prgm_stims[j]->a2_addr;
+            runs[j].setup = prgm_stims[j]->setup;
+        }
+    }
 
-            failed = artix_run_stim(a1_prgm_stim->stim, &test_cycle, a1_addr, a2_addr);
-            prgm->_last_prgm_stim = a1_prgm_stim;
+    _prgm_run_db_init(prgm, &run_db, runs, num_runs, false);
+    num_tests_ran = artix_run_stims(runs, num_runs, run_continue);
+    _prgm_run_db_free(&run_db);
 
-        }else if(a1_prgm_stim != NULL){
-            failed  = artix_run_stim(a1_prgm_stim->stim, &test_cycle, a1_prgm_stim->a1_addr, a1_prgm_stim->a2_addr);
-            prgm->_last_prgm_stim = a1_prgm_stim;
-        }else if(a2_prgm_stim != NULL){
-            failed = artix_run_stim(a2_prgm_stim->stim, &test_cycle, a2_prgm_stim->a1_addr, a2_prgm_stim->a2_addr);
-            prgm->_last_prgm_stim = a2_prgm_stim;
+    gc = fe_savegc(_fe_ctx);
+    fe_results = fe_bool(_fe_ctx, false);
+    for(int64_t i=(int64_t)num_runs-1; i>=0; i--){
+        if(!runs[i].did_run){
+            continue;
         }
+        fe_results = fe_cons(_fe_ctx, fe_cons(_fe_ctx, 
+            fe_bool(_fe_ctx, runs[i].did_fail),
+            fe_integer(_fe_ctx, runs[i].test_cycle)), fe_results);
+        _fe_repin(_fe_ctx, gc, fe_results, NULL);
+    }
 
-        // save results to db
-        if(db_stim_id >= 0 && db_prgm != NULL){
-            if((db_stim = db_get_stim_by_id(prgm->_db, db_stim_id)) == NULL){
-                die("failed to get db_stim by id %lli", db_stim_id);
-            }
-            db_stim->did_fail = (int32_t)failed;
-            db_stim->failing_vec = (int64_t)test_cycle;
-            db_stim->state = STIM_DONE;
-            db_update_stim(prgm->_db, db_stim);
-
-            db_prgm->last_stim_id = db_stim_id;
-            db_prgm->did_fail = (int32_t)failed;
-            db_prgm->failing_vec = (int64_t)test_cycle;
-            db_update_prgm(prgm->_db, db_prgm);
+    for(uint32_t i=0; i<num_runs; i++){
+        if(!runs[i].did_run){
+            continue;
         }
 
-        num_tests_ran += 1;
+        prgm->_last_prgm_stim = prgm_stims[i];
+        test_cycle = runs[i].test_cycle;
 
         if(did_test_fail == false){
-            did_test_fail = failed;
+            did_test_fail = runs[i].did_fail;
         }
+    }
 
-        if(run_continue == false){
-            if(did_test_fail == true){
-                break;
-            }
-        }
+    if(runs != NULL){
+        free(runs);
+    }
+    if(prgm_stims != NULL){
+        free(prgm_stims);
     }
 
-    fe_Object *ret[3];
-    ret[0] = fe_number(_fe_ctx, num_tests_ran);
+    fe_Object *ret[4];
+    ret[0] = fe_integer(_fe_ctx, num_tests_ran);
     ret[1] = fe_bool(_fe_ctx, did_test_fail);
-    ret[2] = fe_number(_fe_ctx, test_cycle);
-    return fe_list(_fe_ctx, ret, 3);
+    ret[2] = fe_integer(_fe_ctx, test_cycle);
+    ret[3] = fe_results;
+    return fe_list(_fe_ctx, ret, 4);
 }
 
 /*
  * (reads <stim_path:str>) -> <stim_object:ptr>
  *
- * Reads a stim file from disk and returns a stim object.
+ * Reads a stim file from disk and returns a stim object. Only the file
+ * header is read here. The file is mapped and the stim built the first
+ * time it's loaded or written.
  *
  */
 static fe_Object* f_reads(fe_Context *_fe_ctx, fe_Object *arg){
     char stim_path[BUFFER_SIZE];
     struct stim *stim = NULL;
     struct prgm *prgm = NULL;
-    fe_Object *fe_prgm = NULL;
     fe_Object *fe_stim_path = NULL;
     UT_string *path = NULL;
 
-    fe_prgm = fe_eval(_fe_ctx, fe_symbol(_fe_ctx, "prgm"));
-    if((prgm = (struct prgm*)fe_toptr(_fe_ctx, fe_prgm)) == NULL){
-        fe_error(_fe_ctx, "failed to get global prgm object");
+    if((prgm = (struct prgm*)fe_getudata(_fe_ctx)) == NULL){
+        fe_error(_fe_ctx, "failed to get prgm object from fe context");
     }
 
     if(prgm->_profile == NULL){
@@ -422,7 +793,7 @@ static fe_Object* f_reads(fe_Context *_fe_ctx, fe_Object *arg){
         die("error: pointer is NULL");
     }
 
-    if((stim = get_stim_by_path(prgm->_profile, utstring_body(path))) == NULL){
+    if((stim = get_lazy_stim_by_path(prgm->_profile, utstring_body(path))) == NULL){
         fe_error(_fe_ctx, "Failed to load stim.");
     }
 
@@ -443,12 +814,10 @@ static fe_Object* f_writes(fe_Context *_fe_ctx, fe_Object *arg){
     fe_Object *fe_stim = NULL;
     fe_Object *fe_stim_path = NULL;
     struct prgm *prgm = NULL;
-    fe_Object *fe_prgm = NULL;
     UT_string *path = NULL;
 
-    fe_prgm = fe_eval(_fe_ctx, fe_symbol(_fe_ctx, "prgm"));
-    if((prgm = (struct prgm*)fe_toptr(_fe_ctx, fe_prgm)) == NULL){
-        fe_error(_fe_ctx, "failed to get global prgm object");
+    if((prgm = (struct prgm*)fe_getudata(_fe_ctx)) == NULL){
+        fe_error(_fe_ctx, "failed to get prgm object from fe context");
     }
 
     fe_stim = fe_nextarg(_fe_ctx, &arg);
@@ -472,9 +841,8 @@ static fe_Object* f_writes(fe_Context *_fe_ctx, fe_Object *arg){
 /*
  * (load <stim_path:str>) -> (<a1_addr:num>, <a2_addr:num>)
  *
- * Sequentially loads the test pattern stim into tester memory after the
- * previously loaded test pattern. Returns the address in tester memory
- * where the stim was loaded.
+ * Loads the test pattern stim into the best fitting free tester memory.
+ * Returns the address in tester memory where the stim was loaded.
  *
  */
 static fe_Object* f_load(fe_Context *_fe_ctx, fe_Object *arg){
@@ -486,11 +854,11 @@ static fe_Object* f_load(fe_Context *_fe_ctx, fe_Object *arg){
     if(stim_mode == STIM_MODE_NONE){
         die("stim mode is none");
     }else if(stim_mode == STIM_MODE_DUAL){
-        return fe_cons(_fe_ctx, fe_number(_fe_ctx, a1_load_addr), fe_number(_fe_ctx, a2_load_addr));
+        return fe_cons(_fe_ctx, fe_integer(_fe_ctx, a1_load_addr), fe_integer(_fe_ctx, a2_load_addr));
     }else if(stim_mode == STIM_MODE_A1){
-        return fe_cons(_fe_ctx, fe_number(_fe_ctx, a1_load_addr), fe_bool(_fe_ctx, false));
+        return fe_cons(_fe_ctx, fe_integer(_fe_ctx, a1_load_addr), fe_bool(_fe_ctx, false));
     }else if(stim_mode == STIM_MODE_A2){
-        return fe_cons(_fe_ctx, fe_bool(_fe_ctx, false), fe_number(_fe_ctx, a2_load_addr));
+        return fe_cons(_fe_ctx, fe_bool(_fe_ctx, false), fe_integer(_fe_ctx, a2_load_addr));
     }else{
         die("invalid stim mode");
     }
@@ -499,9 +867,9 @@ static fe_Object* f_load(fe_Context *_fe_ctx, fe_Object *arg){
 /*
  * (loads <stim_object>) -> (<a1_addr>, <a2_addr>)
  *
- * Sequentially loads the test pattern stim into tester memory after the
- * previously loaded test pattern given a stim object. Returns the address in
- * tester memory where the stim was loaded.
+ * Loads the test pattern stim into the best fitting free tester memory
+ * given a stim object. Returns the address in tester memory where the stim
+ * was loaded.
  *
  */
 static fe_Object* f_loads(fe_Context *_fe_ctx, fe_Object *arg){
@@ -513,11 +881,11 @@ static fe_Object* f_loads(fe_Context *_fe_ctx, fe_Object *arg){
     if(stim_mode == STIM_MODE_NONE){
         die("stim mode is none");
     }else if(stim_mode == STIM_MODE_DUAL){
-        return fe_cons(_fe_ctx, fe_number(_fe_ctx, a1_load_addr), fe_number(_fe_ctx, a2_load_addr));
+        return fe_cons(_fe_ctx, fe_integer(_fe_ctx, a1_load_addr), fe_integer(_fe_ctx, a2_load_addr));
     }else if(stim_mode == STIM_MODE_A1){
-        return fe_cons(_fe_ctx, fe_number(_fe_ctx, a1_load_addr), fe_bool(_fe_ctx, false));
+        return fe_cons(_fe_ctx, fe_integer(_fe_ctx, a1_load_addr), fe_bool(_fe_ctx, false));
     }else if(stim_mode == STIM_MODE_A2){
-        return fe_cons(_fe_ctx, fe_bool(_fe_ctx, false), fe_number(_fe_ctx, a2_load_addr));
+        return fe_cons(_fe_ctx, fe_bool(_fe_ctx, false), fe_integer(_fe_ctx, a2_load_addr));
     }else{
         die("invalid stim mode");
     }
@@ -527,9 +895,8 @@ static fe_Object* f_loads(fe_Context *_fe_ctx, fe_Object *arg){
  * (loada <stim_object> (<a1_addr>, <a2_addr>)) -> (<a1_addr>, <a2_addr>)
  *
  * Loads the stim object given to the tester memory at the address given.
- * Returns the address in tester memory where the stim was loaded.
- *
- * DANGER: this can and will overwrite tester memory
+ * Returns the address in tester memory where the stim was loaded. Fails
+ * if the stim would overlap a loaded stim or go out of bounds.
  *
  */
 static fe_Object* f_loada(fe_Context *_fe_ctx, fe_Object *arg){
@@ -541,11 +908,11 @@ static fe_Object* f_loada(fe_Context *_fe_ctx, fe_Object *arg){
     if(stim_mode == STIM_MODE_NONE){
         die("stim mode is none");
     }else if(stim_mode == STIM_MODE_DUAL){
-        return fe_cons(_fe_ctx, fe_number(_fe_ctx, a1_load_addr), fe_number(_fe_ctx, a2_load_addr));
+        return fe_cons(_fe_ctx, fe_integer(_fe_ctx, a1_load_addr), fe_integer(_fe_ctx, a2_load_addr));
     }else if(stim_mode == STIM_MODE_A1){
-        return fe_cons(_fe_ctx, fe_number(_fe_ctx, a1_load_addr), fe_bool(_fe_ctx, false));
+        return fe_cons(_fe_ctx, fe_integer(_fe_ctx, a1_load_addr), fe_bool(_fe_ctx, false));
     }else if(stim_mode == STIM_MODE_A2){
-        return fe_cons(_fe_ctx, fe_bool(_fe_ctx, false), fe_number(_fe_ctx, a2_load_addr));
+        return fe_cons(_fe_ctx, fe_bool(_fe_ctx, false), fe_integer(_fe_ctx, a2_load_addr));
     }else{
         die("invalid stim mode");
     }
@@ -554,7 +921,8 @@ static fe_Object* f_loada(fe_Context *_fe_ctx, fe_Object *arg){
 /*
  * (unload (<a1_addr>, <a2_addr)) -> nil
  *
- * Unloads a stim at the address pair given.
+ * Unloads a stim at the address pair given and frees its tester memory.
+ * A dual stim is unloaded from both units.
  *
  */
 static fe_Object* f_unload(fe_Context *_fe_ctx, fe_Object *arg){
@@ -562,16 +930,14 @@ static fe_Object* f_unload(fe_Context *_fe_ctx, fe_Object *arg){
     fe_Object *fe_addrs = NULL;
     fe_Object *fe_a1_addr = NULL;
     fe_Object *fe_a2_addr = NULL;
-    fe_Object *fe_prgm = NULL;
-    uint32_t a1_addr = 0;
-    uint32_t a2_addr = 0;
+    uint64_t a1_addr = 0;
+    uint64_t a2_addr = 0;
     struct prgm_stim *a1_prgm_stim = NULL;
     struct prgm_stim *a2_prgm_stim = NULL;
     char buffer[BUFFER_SIZE];
 
-    fe_prgm = fe_eval(_fe_ctx, fe_symbol(_fe_ctx, "prgm"));
-    if((prgm = (struct prgm*)fe_toptr(_fe_ctx, fe_prgm)) == NULL){
-        fe_error(_fe_ctx, "failed to get global prgm object");
+    if((prgm = (struct prgm*)fe_getudata(_fe_ctx)) == NULL){
+        fe_error(_fe_ctx, "failed to get prgm object from fe context");
     }
 
     fe_addrs = fe_nextarg(_fe_ctx, &arg);
@@ -584,148 +950,504 @@ static fe_Object* f_unload(fe_Context *_fe_ctx, fe_Object *arg){
     }
 
     if(!fe_isnil(_fe_ctx, fe_a1_addr)){
-        a1_addr = (uint32_t)fe_tonumber(_fe_ctx, fe_a1_addr);
-        HASH_FIND_INT(prgm->_a1_loaded_stims, &a1_addr, a1_prgm_stim);
-        if (a1_prgm_stim == NULL) {
-            snprintf(buffer, BUFFER_SIZE, "no stim loaded at a1 address 0x%08X", a1_addr);
+        a1_addr = (uint64_t)fe_tointeger(_fe_ctx, fe_a1_addr);
+        if((a1_prgm_stim = _find_loaded_stim(prgm, ARTIX_SELECT_A1, a1_addr)) == NULL){
+            snprintf(buffer, BUFFER_SIZE, "no stim loaded at a1 address 0x%08" PRIX64 "", a1_addr);
             fe_error(_fe_ctx, buffer);
         }
-        prgm->_num_a1_loaded_stims -= 1;
-        HASH_DEL(prgm->_a1_loaded_stims, a1_prgm_stim);
     }
 
-    if(!fe_isnil(_fe_ctx, fe_a2_addr)){
-        a2_addr = (uint32_t)fe_tonumber(_fe_ctx, fe_a2_addr);
-        HASH_FIND_INT(prgm->_a2_loaded_stims, &a2_addr, a2_prgm_stim);
-        if (a2_prgm_stim == NULL) {
-            snprintf(buffer, BUFFER_SIZE, "no stim loaded at a2 address 0x%08X", a2_addr);
-            fe_error(_fe_ctx, buffer);
-        }
-        prgm->_num_a2_loaded_stims -= 1;
-        HASH_DEL(prgm->_a2_loaded_stims, a2_prgm_stim);
+    if(!fe_isnil(_fe_ctx, fe_a2_addr)){
+        a2_addr = (uint64_t)fe_tointeger(_fe_ctx, fe_a2_addr);
+        if((a2_prgm_stim = _find_loaded_stim(prgm, ARTIX_SELECT_A2, a2_addr)) == NULL){
+            snprintf(buffer, BUFFER_SIZE, "no stim loaded at a2 address 0x%08" PRIX64 "", a2_addr);
+            fe_error(_fe_ctx, buffer);
+        }
+    }
+
+    if(a1_prgm_stim != NULL){
+        _unload_prgm_stim(prgm, a1_prgm_stim);
+    }
+    if(a2_prgm_stim != NULL && a2_prgm_stim != a1_prgm_stim){
+        _unload_prgm_stim(prgm, a2_prgm_stim);
+    }
+
+    return fe_bool(_fe_ctx, false); 
+}
+
+/*
+ * (unload-all) -> (<num_a1_unloaded_stims>, <num_a2_unloaded_stims>)
+ *
+ * Unloads all stims and returns num stims that were unloaded. Returns the
+ * number of stims that were unloaded.
+ *
+ *
+ */
+static fe_Object* f_unload_all(fe_Context *_fe_ctx, fe_Object *arg){
+    struct prgm *prgm = NULL;
+    struct prgm_stim *prgm_stim = NULL;
+    struct prgm_stim *prgm_stim_tmp = NULL;
+    uint64_t num_a1_unloaded_stims = 0;
+    uint64_t num_a2_unloaded_stims = 0;
+
+    if((prgm = (struct prgm*)fe_getudata(_fe_ctx)) == NULL){
+        fe_error(_fe_ctx, "failed to get prgm object from fe context");
+    }
+
+    num_a1_unloaded_stims = prgm->_num_a1_loaded_stims;
+    num_a2_unloaded_stims = prgm->_num_a2_loaded_stims;
+
+    // dual stims come out of both tables on the first pass
+    HASH_ITER(hh, prgm->_a1_loaded_stims, prgm_stim, prgm_stim_tmp) {
+        _unload_prgm_stim(prgm, prgm_stim);
+    }
+    HASH_ITER(a2_hh, prgm->_a2_loaded_stims, prgm_stim, prgm_stim_tmp) {
+        _unload_prgm_stim(prgm, prgm_stim);
+    }
+
+    return fe_cons(_fe_ctx, fe_integer(_fe_ctx, num_a1_unloaded_stims), fe_integer(_fe_ctx, num_a2_unloaded_stims));
+}
+
+/*
+ * (compact) -> (<num_a1_moved_stims>, <num_a2_moved_stims>)
+ *
+ * Moves the loaded stims down in tester memory so the free memory in 
+ * each unit is in one piece. Moved stims get new addresses, look them 
+ * up again before running them. Stims loaded by other prgms in the 
+ * process move too. Loads compact on their own when memory
+ * is too fragmented to fit a stim.
+ *
+ */
+static fe_Object* f_compact(fe_Context *_fe_ctx, fe_Object *arg){
+    struct prgm *prgm = NULL;
+    uint32_t num_a1_moved_stims = 0;
+    uint32_t num_a2_moved_stims = 0;
+
+    if((prgm = (struct prgm*)fe_getudata(_fe_ctx)) == NULL){
+        fe_error(_fe_ctx, "failed to get prgm object from fe context");
+    }
+
+    num_a1_moved_stims = _compact_stim_mem(prgm, ARTIX_SELECT_A1);
+    num_a2_moved_stims = _compact_stim_mem(prgm, ARTIX_SELECT_A2);
+
+    return fe_cons(_fe_ctx, fe_integer(_fe_ctx, num_a1_moved_stims), fe_integer(_fe_ctx, num_a2_moved_stims));
+}
+
+/*
+ * (run <addr1> <addr2> ...) -> (<num_tests_ran>, <did_test_fail>, <fail_test_cycle>, <results>)
+ *
+ * Executes loaded stims at the tester memory addresses given. Stops at the
+ * first failing pattern. If a pair addresses an a1 solo stim and an a2
+ * solo stim, both are run at the same time with separate results.
+ *
+ */
+static fe_Object* f_run(fe_Context *_fe_ctx, fe_Object *arg){
+    bool run_continue = false;
+    return _run_stim(_fe_ctx, arg, run_continue);
+}
+
+/*
+ * (runc <addr1> <addr2> ...) -> (<num_tests_ran>, <did_test_fail>, <fail_test_cycle>, <results>)
+ *
+ * Executes loaded stims at the tester memory addresses given. Will execute all
+ * stims without stopping if it fails.
+ *
+ */
+static fe_Object* f_runc(fe_Context *_fe_ctx, fe_Object *arg){
+    bool run_continue = true;
+    return _run_stim(_fe_ctx, arg, run_continue);
+}
+
+/*
+ * Builds the per dut site setups of a prgm stim if they don't exist yet.
+ *
+ */
+static void _prgm_stim_build_site_setups(struct prgm_stim *prgm_stim){
+    struct profile *profile = NULL;
+
+    if(prgm_stim->site_setups != NULL){
+        return;
+    }
+
+    if((profile = prgm_stim->stim->profile) == NULL){
+        die("no profile set for stim");
+    }
+
+    prgm_stim->num_site_setups = profile->num_duts;
+    if(prgm_stim->num_site_setups == 0){
+        return;
+    }
+
+    if((prgm_stim->site_setups = (struct artix_stim_setup**)calloc(
+            prgm_stim->num_site_setups, sizeof(struct artix_stim_setup*))) == NULL){
+        die("error: calloc failed");
+    }
+
+    for(uint32_t i=0; i<prgm_stim->num_site_setups; i++){
+        prgm_stim->site_setups[i] = artix_create_stim_site_setup(prgm_stim->stim, 
+            prgm_stim->a1_addr, prgm_stim->a2_addr, (int32_t)i);
+    }
+
+    return;
+}
+
+/*
+ * (run-sites <addr>) -> ((<site>, <did_fail>, <fail_test_cycle>, (<fail_pin_name>, ...)), ...)
+ *
+ * Runs the loaded stim at the address pair given once for each dut in
+ * the profile that it has pins on. Each site only enables its own pins.
+ * A site on only a1 runs at the same time as a site on only a2. Every
+ * site runs even if another fails, and gets its own result and failing
+ * pins.
+ *
+ */
+static fe_Object* f_run_sites(fe_Context *_fe_ctx, fe_Object *arg){
+    struct prgm *prgm = NULL;
+    fe_Object *fe_results = NULL;
+    fe_Object *fe_fail_pins = NULL;
+    fe_Object *fe_result[4];
+    struct prgm_stim *prgm_stim = NULL;
+    struct prgm_stim *a2_run_stim = NULL;
+    struct artix_stim_setup *setup = NULL;
+    struct artix_stim_setup **a1_setups = NULL;
+    struct artix_stim_setup **a2_setups = NULL;
+    struct artix_stim_setup **both_setups = NULL;
+    uint32_t num_a1_setups = 0;
+    uint32_t num_a2_setups = 0;
+    uint32_t num_both_setups = 0;
+    struct artix_stim_run *runs = NULL;
+    uint32_t num_runs = 0;
+    uint8_t *fail_pins = NULL;
+    struct profile_pin *pin = NULL;
+    struct stim *stim = NULL;
+    struct prgm_run_db run_db;
+    int gc = 0;
+
+    if((prgm = (struct prgm*)fe_getudata(_fe_ctx)) == NULL){
+        fe_error(_fe_ctx, "failed to get prgm object from fe context");
+    }
+
+    if(_get_run_prgm_stims(_fe_ctx, prgm, fe_nextarg(_fe_ctx, &arg), 
+            &prgm_stim, &a2_run_stim) != 1){
+        fe_error(_fe_ctx, "failed to run sites because addr pair must be one stim");
+    }
+    stim = prgm_stim->stim;
+
+    _prgm_stim_build_site_setups(prgm_stim);
+
+    if(prgm_stim->num_site_setups > 0){
+        if((a1_setups = (struct artix_stim_setup**)calloc(prgm_stim->num_site_setups, sizeof(struct artix_stim_setup*))) == NULL){
+            die("error: calloc failed");
+        }
+        if((a2_setups = (struct artix_stim_setup**)calloc(prgm_stim->num_site_setups, sizeof(struct artix_stim_setup*))) == NULL){
+            die("error: calloc failed");
+        }
+        if((both_setups = (struct artix_stim_setup**)calloc(prgm_stim->num_site_setups, sizeof(struct artix_stim_setup*))) == NULL){
+            die("error: calloc failed");
+        }
+        if((runs = (struct artix_stim_run*)calloc(prgm_stim->num_site_setups, sizeof(struct artix_stim_run))) == NULL){
+            die("error: calloc failed");
+        }
+        if((fail_pins = (uint8_t*)calloc(prgm_stim->num_site_setups*DUT_TOTAL_NUM_PINS, sizeof(uint8_t))) == NULL){
+            die("error: calloc failed");
+        }
+    }
+
+    // sort sites by the units they use
+    for(uint32_t i=0; i<prgm_stim->num_site_setups; i++){
+        if((setup = prgm_stim->site_setups[i]) == NULL){
+            continue;
+        }
+        if(setup->a1_enable_pins != NULL && setup->a2_enable_pins != NULL){
+            both_setups[num_both_setups++] = setup;
+        }else if(setup->a1_enable_pins != NULL){
+            a1_setups[num_a1_setups++] = setup;
+        }else{
+            a2_setups[num_a2_setups++] = setup;
+        }
+    }
+
+    // pair up a1 only and a2 only sites so they run at the same time
+    for(uint32_t i=0; i<num_a1_setups || i<num_a2_setups; i++){
+        if(i < num_a1_setups){
+            runs[num_runs].setup = a1_setups[i];
+            runs[num_runs].run_with_next = (i < num_a2_setups);
+            num_runs++;
+        }
+        if(i < num_a2_setups){
+            runs[num_runs].setup = a2_setups[i];
+            num_runs++;
+        }
+    }
+    for(uint32_t i=0; i<num_both_setups; i++){
+        runs[num_runs].setup = both_setups[i];
+        num_runs++;
+    }
+
+    for(uint32_t i=0; i<num_runs; i++){
+        runs[i].stim = stim;
+        runs[i].a1_addr = prgm_stim->a1_addr;
+        runs[i].a2_addr = prgm_stim->a2_addr;
+        runs[i].fail_pins = &fail_pins[i*DUT_TOTAL_NUM_PINS];
+    }
+
+    if(num_runs > 0){
+        _prgm_run_db_init(prgm, &run_db, runs, num_runs, true);
+        artix_run_stims(runs, num_runs, true);
+        _prgm_run_db_free(&run_db);
+    }
+    prgm->_last_prgm_stim = prgm_stim;
+
+    gc = fe_savegc(_fe_ctx);
+    fe_results = fe_bool(_fe_ctx, false);
+    for(int64_t i=(int64_t)num_runs-1; i>=0; i--){
+        fe_fail_pins = fe_bool(_fe_ctx, false);
+        for(int32_t j=(int32_t)stim->num_pins-1; j>=0; j--){
+            pin = stim->pins[j];
+            if(pin->dut_io_id < 0 || pin->dut_io_id >= DUT_TOTAL_NUM_PINS){
+                continue;
+            }
+            if(runs[i].fail_pins[pin->dut_io_id]){
+                fe_fail_pins = fe_cons(_fe_ctx, fe_string(_fe_ctx, pin->net_name), fe_fail_pins);
+                _fe_repin(_fe_ctx, gc, fe_results, fe_fail_pins);
+            }
+        }
+        fe_result[0] = fe_integer(_fe_ctx, runs[i].setup->dut_id);
+        fe_result[1] = fe_bool(_fe_ctx, runs[i].did_fail);
+        fe_result[2] = fe_integer(_fe_ctx, runs[i].test_cycle);
+        fe_result[3] = fe_fail_pins;
+        fe_results = fe_cons(_fe_ctx, fe_list(_fe_ctx, fe_result, 4), fe_results);
+        _fe_repin(_fe_ctx, gc, fe_results, NULL);
+    }
+
+    if(a1_setups != NULL){
+        free(a1_setups);
+    }
+    if(a2_setups != NULL){
+        free(a2_setups);
+    }
+    if(both_setups != NULL){
+        free(both_setups);
+    }
+    if(runs != NULL){
+        free(runs);
+    }
+    if(fail_pins != NULL){
+        free(fail_pins);
+    }
+
+    return fe_results;
+}
+
+/*
+ * (capture-fails <addr> <max_records:num>) -> (<did_fail>, <is_complete>, ((<fail_test_cycle>, (<fail_pin_name>, ...)), ...))
+ *
+ * Captures a fail log for the loaded stim at the address pair given in
+ * one call. The stim is rerun with failing pins masked off, so each 
+ * record is a cycle and the pins that first failed at it; later fails 
+ * of the same pins aren't logged. Each record is one more run of the 
+ * stim, up to one per pin. max_records is optional and defaults to no 
+ * limit. is_complete is false if the capture stopped before every pin 
+ * was checked to the end.
+ *
+ */
+static fe_Object* f_capture_fails(fe_Context *_fe_ctx, fe_Object *arg){
+    struct prgm *prgm = NULL;
+    fe_Object *fe_addrs = NULL;
+    fe_Object *fe_records = NULL;
+    fe_Object *fe_fail_pins = NULL;
+    fe_Object *fe_record[2];
+    fe_Object *ret[3];
+    struct prgm_stim *prgm_stim = NULL;
+    struct prgm_stim *a2_run_stim = NULL;
+    struct artix_stim_run run;
+    struct artix_fail_log *fail_log = NULL;
+    struct artix_fail_record *record = NULL;
+    struct profile_pin *pin = NULL;
+    uint8_t fail_pins[DUT_TOTAL_NUM_PINS];
+    uint32_t max_records = 0;
+    struct db_prgm *db_prgm = NULL;
+    int64_t db_stim_id = -1;
+    int gc = 0;
+
+    if((prgm = (struct prgm*)fe_getudata(_fe_ctx)) == NULL){
+        fe_error(_fe_ctx, "failed to get prgm object from fe context");
+    }
+
+    fe_addrs = fe_nextarg(_fe_ctx, &arg);
+    if(!fe_isnil(_fe_ctx, arg)){
+        max_records = (uint32_t)fe_tointeger(_fe_ctx, fe_nextarg(_fe_ctx, &arg));
+    }
+
+    if(_get_run_prgm_stims(_fe_ctx, prgm, fe_addrs, &prgm_stim, &a2_run_stim) != 1){
+        fe_error(_fe_ctx, "failed to capture fails because addr pair must be one stim");
     }
 
-    if(a1_prgm_stim != NULL && a2_prgm_stim != NULL){
-        if(a1_prgm_stim == a2_prgm_stim){
-            free_stim(a1_prgm_stim->stim);
-            free(a1_prgm_stim);
-        }else{
-            if(a1_prgm_stim != NULL){
-                free_stim(a1_prgm_stim->stim);
-                free(a1_prgm_stim);
+    memset(&run, 0, sizeof(struct artix_stim_run));
+    run.stim = prgm_stim->stim;
+    run.a1_addr = prgm_stim->a1_addr;
+    run.a2_addr = prgm_stim->a2_addr;
+    run.setup = prgm_stim->setup;
+
+    fail_log = artix_capture_stim_fails(&run, max_records);
+    prgm->_last_prgm_stim = prgm_stim;
+
+    gc = fe_savegc(_fe_ctx);
+    fe_records = fe_bool(_fe_ctx, false);
+    for(int64_t i=(int64_t)fail_log->num_records-1; i>=0; i--){
+        record = &fail_log->records[i];
+        memset(fail_pins, 0, DUT_TOTAL_NUM_PINS*sizeof(uint8_t));
+        for(uint32_t j=0; j<record->num_pins; j++){
+            fail_pins[record->dut_io_ids[j]] = 1;
+        }
+        fe_fail_pins = fe_bool(_fe_ctx, false);
+        for(int32_t j=(int32_t)run.stim->num_pins-1; j>=0; j--){
+            pin = run.stim->pins[j];
+            if(pin->dut_io_id < 0 || pin->dut_io_id >= DUT_TOTAL_NUM_PINS){
+                continue;
             }
-            if(a2_prgm_stim != NULL){
-                free_stim(a2_prgm_stim->stim);
-                free(a2_prgm_stim);
+            if(!fail_pins[pin->dut_io_id]){
+                continue;
             }
+            fe_fail_pins = fe_cons(_fe_ctx, fe_string(_fe_ctx, pin->net_name), fe_fail_pins);
+            _fe_repin(_fe_ctx, gc, fe_records, fe_fail_pins);
         }
-    }else{
-        if(a1_prgm_stim != NULL){
-            free_stim(a1_prgm_stim->stim);
-            free(a1_prgm_stim);
+        fe_record[0] = fe_integer(_fe_ctx, record->test_cycle);
+        fe_record[1] = fe_fail_pins;
+        fe_records = fe_cons(_fe_ctx, fe_list(_fe_ctx, fe_record, 2), fe_records);
+        _fe_repin(_fe_ctx, gc, fe_records, NULL);
+    }
+
+    // save the log to db
+    if(prgm->_db_prgm_id >= 0 && prgm->_db != NULL){
+        if((db_prgm = db_get_prgm_by_id(prgm->_db, prgm->_db_prgm_id)) == NULL){
+            die("failed to get db_prgm by id %lli", prgm->_db_prgm_id);
         }
-        if(a2_prgm_stim != NULL){
-            free_stim(a2_prgm_stim->stim);
-            free(a2_prgm_stim);
+
+        db_stim_id = db_insert_stim(prgm->_db, prgm->_db_prgm_id, 
+            run.stim->path, -1, (int32_t)run.did_fail, 
+            (int64_t)run.test_cycle, STIM_DONE);
+        for(uint32_t i=0; i<fail_log->num_records; i++){
+            record = &fail_log->records[i];
+            for(uint32_t j=0; j<record->num_pins; j++){
+                db_insert_fail_log(prgm->_db, db_stim_id, 
+                    (int64_t)record->test_cycle, (int64_t)record->dut_io_ids[j]);
+            }
         }
+
+        db_prgm->last_stim_id = db_stim_id;
+        db_prgm->did_fail = (int32_t)run.did_fail;
+        db_prgm->failing_vec = (int64_t)run.test_cycle;
+        db_update_prgm(prgm->_db, db_prgm);
+        db_free_prgm(db_prgm);
     }
 
-    return fe_bool(_fe_ctx, false); 
+    ret[0] = fe_bool(_fe_ctx, fail_log->did_fail);
+    ret[1] = fe_bool(_fe_ctx, fail_log->is_complete);
+    ret[2] = fe_records;
+
+    artix_free_fail_log(fail_log);
+
+    return fe_list(_fe_ctx, ret, 3);
 }
 
 /*
- * (unload-all) -> (<num_a1_unloaded_stims>, <num_a2_unloaded_stims>)
- *
- * Unloads all stims and returns num stims that were unloaded. Returns the
- * number of stims that were unloaded.
+ * (locate-fail <addr>) -> (<did_fail>, <fail_vec_id>, <fail_test_cycle>, (<fail_pin_name>, ...))
  *
+ * Runs the loaded stim at the address pair given and if it fails, 
+ * bisects truncated runs of it to find the first failing vec in tester
+ * memory, the first failing unrolled cycle and the pins that failed
+ * there. Returns nil for the vec, cycle and pins if it passed. Raises
+ * an error if the fail doesn't repeat, so it can't be located.
  *
  */
-static fe_Object* f_unload_all(fe_Context *_fe_ctx, fe_Object *arg){
-    fe_Object *fe_prgm = NULL;
+static fe_Object* f_locate_fail(fe_Context *_fe_ctx, fe_Object *arg){
     struct prgm *prgm = NULL;
+    fe_Object *fe_fail_pins = NULL;
+    fe_Object *ret[4];
     struct prgm_stim *prgm_stim = NULL;
-    struct prgm_stim *prgm_stim_tmp = NULL;
-    uint64_t num_a1_unloaded_stims = 0;
-    uint64_t num_a2_unloaded_stims = 0;
+    struct prgm_stim *a2_run_stim = NULL;
+    struct artix_stim_run run;
+    struct artix_first_fail first_fail;
+    struct profile_pin *pin = NULL;
+    struct db_prgm *db_prgm = NULL;
+    int64_t db_stim_id = -1;
+    int gc = 0;
 
-    struct del_prgm_stims {
-        struct prgm_stim *prgm_stim;
-        UT_hash_handle hh;
-    };
-    struct del_prgm_stims *del_prgm_stims = NULL;
-    struct del_prgm_stims *del_prgm_stim = NULL;
-    struct del_prgm_stims *del_prgm_stim_tmp = NULL;
+    if((prgm = (struct prgm*)fe_getudata(_fe_ctx)) == NULL){
+        fe_error(_fe_ctx, "failed to get prgm object from fe context");
+    }
 
-    fe_prgm = fe_eval(_fe_ctx, fe_symbol(_fe_ctx, "prgm"));
-    if((prgm = (struct prgm*)fe_toptr(_fe_ctx, fe_prgm)) == NULL){
-        fe_error(_fe_ctx, "failed to get global prgm object");
+    if(_get_run_prgm_stims(_fe_ctx, prgm, fe_nextarg(_fe_ctx, &arg), 
+            &prgm_stim, &a2_run_stim) != 1){
+        fe_error(_fe_ctx, "failed to locate fail because addr pair must be one stim");
     }
 
-    HASH_ITER(hh, prgm->_a1_loaded_stims, prgm_stim, prgm_stim_tmp) {
-        HASH_DEL(prgm->_a1_loaded_stims, prgm_stim);
-        prgm->_num_a1_loaded_stims -= 1;
-        num_a1_unloaded_stims += 1;
+    memset(&run, 0, sizeof(struct artix_stim_run));
+    run.stim = prgm_stim->stim;
+    run.a1_addr = prgm_stim->a1_addr;
+    run.a2_addr = prgm_stim->a2_addr;
+    run.setup = prgm_stim->setup;
 
-        HASH_FIND_INT(del_prgm_stims, &prgm_stim, del_prgm_stim);
-        if(del_prgm_stim == NULL){
-            if((del_prgm_stim = (struct del_prgm_stims*)malloc(sizeof(struct del_prgm_stims))) == NULL){
-                die("malloc failed");
-            }
-            del_prgm_stim->prgm_stim = prgm_stim;
-            HASH_ADD_INT(del_prgm_stims, prgm_stim, del_prgm_stim);
-        }
-    }
-    prgm->_cur_a1_stim_addr = 0;
+    artix_locate_stim_first_fail(&run, &first_fail);
+    prgm->_last_prgm_stim = prgm_stim;
 
-    HASH_ITER(hh, prgm->_a2_loaded_stims, prgm_stim, prgm_stim_tmp) {
-        HASH_DEL(prgm->_a2_loaded_stims, prgm_stim);
-        prgm->_num_a2_loaded_stims -= 1;
-        num_a2_unloaded_stims += 1;
+    // save results to db
+    if(prgm->_db_prgm_id >= 0 && prgm->_db != NULL){
+        if((db_prgm = db_get_prgm_by_id(prgm->_db, prgm->_db_prgm_id)) == NULL){
+            die("failed to get db_prgm by id %lli", prgm->_db_prgm_id);
+        }
 
-        HASH_FIND_INT(del_prgm_stims, &prgm_stim, del_prgm_stim);
-        if(del_prgm_stim == NULL){
-            if((del_prgm_stim = (struct del_prgm_stims*)malloc(sizeof(struct del_prgm_stims))) == NULL){
-                die("malloc failed");
+        db_stim_id = db_insert_stim(prgm->_db, prgm->_db_prgm_id, 
+            run.stim->path, -1, (int32_t)run.did_fail, 
+            first_fail.did_fail ? (int64_t)first_fail.test_cycle : (int64_t)run.test_cycle, 
+            STIM_DONE);
+        for(uint32_t i=0; i<DUT_TOTAL_NUM_PINS; i++){
+            if(first_fail.fail_pins[i]){
+                db_insert_fail_pin(prgm->_db, db_stim_id, (int64_t)i, 1);
             }
-            del_prgm_stim->prgm_stim = prgm_stim;
-            HASH_ADD_INT(del_prgm_stims, prgm_stim, del_prgm_stim);
         }
+
+        db_prgm->last_stim_id = db_stim_id;
+        db_prgm->did_fail = (int32_t)run.did_fail;
+        db_prgm->failing_vec = -1;
+        if(run.did_fail){
+            db_prgm->failing_vec = first_fail.did_fail ? (int64_t)first_fail.test_cycle : (int64_t)run.test_cycle;
+        }
+        db_update_prgm(prgm->_db, db_prgm);
+        db_free_prgm(db_prgm);
     }
-    prgm->_cur_a2_stim_addr = 0;
 
-    // only free prgm_stims once
-    HASH_ITER(hh, del_prgm_stims, del_prgm_stim, del_prgm_stim_tmp) {
-        free_stim(del_prgm_stim->prgm_stim->stim);
-        free(del_prgm_stim->prgm_stim);
-        free(del_prgm_stim);
+    if(first_fail.is_flaky){
+        fe_error(_fe_ctx, "failed to locate fail because the stim fails inconsistently");
     }
 
-    return fe_cons(_fe_ctx, fe_number(_fe_ctx, num_a1_unloaded_stims), fe_number(_fe_ctx, num_a2_unloaded_stims));
-}
+    if(!first_fail.did_fail){
+        ret[0] = fe_bool(_fe_ctx, false);
+        ret[1] = fe_bool(_fe_ctx, false);
+        ret[2] = fe_bool(_fe_ctx, false);
+        ret[3] = fe_bool(_fe_ctx, false);
+        return fe_list(_fe_ctx, ret, 4);
+    }
 
-/*
- * (run <addr1> <addr2> ...) -> (<num_tests_ran>, <did_test_fail>, <fail_test_cycle>)
- *
- * Executes loaded stims at the tester memory addresses given. Stops at the
- * first failing pattern.
- *
- */
-static fe_Object* f_run(fe_Context *_fe_ctx, fe_Object *arg){
-    bool run_continue = false;
-    return _run_stim(_fe_ctx, arg, run_continue);
-}
+    gc = fe_savegc(_fe_ctx);
+    fe_fail_pins = fe_bool(_fe_ctx, false);
+    for(int32_t i=(int32_t)run.stim->num_pins-1; i>=0; i--){
+        pin = run.stim->pins[i];
+        if(pin->dut_io_id < 0 || pin->dut_io_id >= DUT_TOTAL_NUM_PINS){
+            continue;
+        }
+        if(first_fail.fail_pins[pin->dut_io_id]){
+            fe_fail_pins = fe_cons(_fe_ctx, fe_string(_fe_ctx, pin->net_name), fe_fail_pins);
+            _fe_repin(_fe_ctx, gc, fe_fail_pins, NULL);
+        }
+    }
 
-/*
- * (runc <addr1> <addr2> ...) -> (<num_tests_ran>, <did_test_fail>, <fail_test_cycle>)
- *
- * Executes loaded stims at the tester memory addresses given. Will execute all
- * stims without stopping if it fails.
- *
- */
-static fe_Object* f_runc(fe_Context *_fe_ctx, fe_Object *arg){
-    bool run_continue = true;
-    return _run_stim(_fe_ctx, arg, run_continue);
+    ret[0] = fe_bool(_fe_ctx, true);
+    ret[1] = fe_integer(_fe_ctx, first_fail.vec_id);
+    ret[2] = fe_integer(_fe_ctx, first_fail.test_cycle);
+    ret[3] = fe_fail_pins;
+    return fe_list(_fe_ctx, ret, 4);
 }
 
 /*
@@ -736,15 +1458,13 @@ static fe_Object* f_runc(fe_Context *_fe_ctx, fe_Object *arg){
  *
  */
 static fe_Object* f_set_profile(fe_Context *_fe_ctx, fe_Object *arg){
-    fe_Object *fe_prgm = NULL;
     fe_Object *fe_profile_path = NULL;
     char profile_path[4096];
     struct prgm *prgm = NULL;
     UT_string *path = NULL;
 
-    fe_prgm = fe_eval(_fe_ctx, fe_symbol(_fe_ctx, "prgm"));
-    if((prgm = (struct prgm*)fe_toptr(_fe_ctx, fe_prgm)) == NULL){
-        fe_error(_fe_ctx, "failed to get global prgm object");
+    if((prgm = (struct prgm*)fe_getudata(_fe_ctx)) == NULL){
+        fe_error(_fe_ctx, "failed to get prgm object from fe context");
     }
 
     fe_profile_path = fe_nextarg(_fe_ctx, &arg);
@@ -758,6 +1478,11 @@ static fe_Object* f_set_profile(fe_Context *_fe_ctx, fe_Object *arg){
         die("error: pointer is NULL");
     }
 
+    // stims still loaded keep their own reference to the old profile
+    if(prgm->_profile != NULL){
+        prgm->_profile = free_profile(prgm->_profile);
+    }
+
     if((prgm->_profile = get_profile_by_path(utstring_body(path))) == NULL){
         die("error: pointer is NULL");
     }
@@ -781,12 +1506,10 @@ static fe_Object* f_get_pin_names(fe_Context *_fe_ctx, fe_Object *arg){
     uint8_t *fail_pins = NULL;
     struct prgm *prgm = NULL;
     struct stim *stim = NULL;
-    fe_Object *fe_prgm = NULL;
     struct profile_pin *pin = NULL;
 
-    fe_prgm = fe_eval(_fe_ctx, fe_symbol(_fe_ctx, "prgm"));
-    if((prgm = (struct prgm*)fe_toptr(_fe_ctx, fe_prgm)) == NULL){
-        fe_error(_fe_ctx, "failed to get global prgm object");
+    if((prgm = (struct prgm*)fe_getudata(_fe_ctx)) == NULL){
+        fe_error(_fe_ctx, "failed to get prgm object from fe context");
     }
 
     if(prgm->_last_prgm_stim == NULL){
@@ -830,12 +1553,10 @@ static fe_Object* f_get_fail_pins(fe_Context *_fe_ctx, fe_Object *arg){
     uint8_t *fail_pins = NULL;
     struct prgm *prgm = NULL;
     struct stim *stim = NULL;
-    fe_Object *fe_prgm = NULL;
     struct profile_pin *pin = NULL;
 
-    fe_prgm = fe_eval(_fe_ctx, fe_symbol(_fe_ctx, "prgm"));
-    if((prgm = (struct prgm*)fe_toptr(_fe_ctx, fe_prgm)) == NULL){
-        fe_error(_fe_ctx, "failed to get global prgm object");
+    if((prgm = (struct prgm*)fe_getudata(_fe_ctx)) == NULL){
+        fe_error(_fe_ctx, "failed to get prgm object from fe context");
     }
 
     if(prgm->_last_prgm_stim == NULL){
@@ -867,6 +1588,100 @@ static fe_Object* f_get_fail_pins(fe_Context *_fe_ctx, fe_Object *arg){
     return fe_list(_fe_ctx, ret, stim->num_pins);
 }
 
+/*
+ * (perf-enable <is_enabled:bool>) -> nil
+ *
+ * Turns phase timing on or off. Timings already taken are kept, use
+ * perf-reset to clear them.
+ *
+ */
+static fe_Object* f_perf_enable(fe_Context *_fe_ctx, fe_Object *arg){
+    fe_Object *fe_is_enabled = NULL;
+
+    fe_is_enabled = fe_nextarg(_fe_ctx, &arg);
+    perf_set_enabled(!fe_isnil(_fe_ctx, fe_is_enabled));
+
+    return fe_bool(_fe_ctx, false);
+}
+
+/*
+ * (perf-reset) -> nil
+ *
+ * Clears the timings of every phase.
+ *
+ */
+static fe_Object* f_perf_reset(fe_Context *_fe_ctx, fe_Object *arg){
+    perf_reset();
+    return fe_bool(_fe_ctx, false);
+}
+
+/*
+ * (perf-stats) -> ((<phase:str>, <count>, <mean_us>, <p50_us>, <p99_us>, <max_us>), ...)
+ *
+ * Returns the timings of each phase timed at least once since the last
+ * reset. Percentiles come from the histogram buckets and are rounded up
+ * to the next power of two.
+ *
+ */
+static fe_Object* f_perf_stats(fe_Context *_fe_ctx, fe_Object *arg){
+    struct perf_stats stats;
+    fe_Object *fe_results = NULL;
+    fe_Object *fe_result[6];
+    int gc = 0;
+
+    gc = fe_savegc(_fe_ctx);
+    fe_results = fe_bool(_fe_ctx, false);
+    for(int32_t i=PERF_NUM_PHASES-1; i>=0; i--){
+        perf_get_stats((enum perf_phases)i, &stats);
+        if(stats.count == 0){
+            continue;
+        }
+        fe_result[0] = fe_string(_fe_ctx, stats.name);
+        fe_result[1] = fe_integer(_fe_ctx, stats.count);
+        fe_result[2] = fe_integer(_fe_ctx, (stats.total_ns/stats.count)/1000);
+        fe_result[3] = fe_integer(_fe_ctx, perf_get_percentile_us(&stats, 50.0));
+        fe_result[4] = fe_integer(_fe_ctx, perf_get_percentile_us(&stats, 99.0));
+        fe_result[5] = fe_integer(_fe_ctx, stats.max_ns/1000);
+        fe_results = fe_cons(_fe_ctx, fe_list(_fe_ctx, fe_result, 6), fe_results);
+        _fe_repin(_fe_ctx, gc, fe_results, NULL);
+    }
+
+    return fe_results;
+}
+
+/*
+ * (perf-dump <path:str> <interval_secs:num>) -> nil
+ *
+ * Appends the timings to path every interval_secs. Stops dumping if
+ * path is nil.
+ *
+ */
+static fe_Object* f_perf_dump(fe_Context *_fe_ctx, fe_Object *arg){
+    char dump_path[BUFFER_SIZE];
+    fe_Object *fe_dump_path = NULL;
+    fe_Object *fe_interval_secs = NULL;
+    fe_Integer interval_secs = 0;
+
+    fe_dump_path = fe_nextarg(_fe_ctx, &arg);
+    if(fe_isnil(_fe_ctx, fe_dump_path)){
+        perf_stop_dump();
+        return fe_bool(_fe_ctx, false);
+    }
+    fe_tostring(_fe_ctx, fe_dump_path, dump_path, sizeof(dump_path));
+
+    fe_interval_secs = fe_nextarg(_fe_ctx, &arg);
+    if(fe_isnil(_fe_ctx, fe_interval_secs)){
+        fe_error(_fe_ctx, "must give a perf dump interval in seconds");
+    }
+    if((interval_secs = fe_tointeger(_fe_ctx, fe_interval_secs)) < 1){
+        fe_error(_fe_ctx, "perf dump interval must be at least one second");
+    }
+
+    perf_start_dump(dump_path, (uint32_t)interval_secs);
+
+    return fe_bool(_fe_ctx, false);
+}
+
 /*
  * (exit <code:num>) -> nil
  *
@@ -877,18 +1692,16 @@ static fe_Object* f_exit(fe_Context *_fe_ctx, fe_Object *arg){
     fe_Object *fe_ret = NULL;
     uint32_t ret = 0;
     struct prgm *prgm = NULL;
-    fe_Object *fe_prgm = NULL;
 
-    fe_prgm = fe_eval(_fe_ctx, fe_symbol(_fe_ctx, "prgm"));
-    if((prgm = (struct prgm*)fe_toptr(_fe_ctx, fe_prgm)) == NULL){
-        fe_error(_fe_ctx, "failed to get global prgm object");
+    if((prgm = (struct prgm*)fe_getudata(_fe_ctx)) == NULL){
+        fe_error(_fe_ctx, "failed to get prgm object from fe context");
     }
 
     fe_ret = fe_nextarg(_fe_ctx, &arg);
     if(fe_isnil(_fe_ctx, fe_ret)){
         fe_error(_fe_ctx, "must give an exit code number");
     }
-    ret = (uint32_t)fe_tonumber(_fe_ctx, fe_ret);
+    ret = (uint32_t)fe_tointeger(_fe_ctx, fe_ret);
 
     prgm_close(prgm);
 
@@ -912,18 +1725,67 @@ void _add_fe_gemini_funcs(fe_Context *_fe_ctx){
     fe_set(_fe_ctx, fe_symbol(_fe_ctx, "loada"), fe_cfunc(_fe_ctx, f_loada)); 
     fe_set(_fe_ctx, fe_symbol(_fe_ctx, "unload"), fe_cfunc(_fe_ctx, f_unload)); 
     fe_set(_fe_ctx, fe_symbol(_fe_ctx, "unload-all"), fe_cfunc(_fe_ctx, f_unload_all)); 
+    fe_set(_fe_ctx, fe_symbol(_fe_ctx, "compact"), fe_cfunc(_fe_ctx, f_compact)); 
     fe_set(_fe_ctx, fe_symbol(_fe_ctx, "run"), fe_cfunc(_fe_ctx, f_run)); 
     fe_set(_fe_ctx, fe_symbol(_fe_ctx, "runc"), fe_cfunc(_fe_ctx, f_runc)); 
+    fe_set(_fe_ctx, fe_symbol(_fe_ctx, "run-sites"), fe_cfunc(_fe_ctx, f_run_sites)); 
+    fe_set(_fe_ctx, fe_symbol(_fe_ctx, "capture-fails"), fe_cfunc(_fe_ctx, f_capture_fails)); 
+    fe_set(_fe_ctx, fe_symbol(_fe_ctx, "locate-fail"), fe_cfunc(_fe_ctx, f_locate_fail)); 
     fe_set(_fe_ctx, fe_symbol(_fe_ctx, "set-profile"), fe_cfunc(_fe_ctx, f_set_profile)); 
     fe_set(_fe_ctx, fe_symbol(_fe_ctx, "get-pin-names"), fe_cfunc(_fe_ctx, f_get_pin_names)); 
     fe_set(_fe_ctx, fe_symbol(_fe_ctx, "get-fail-pins"), fe_cfunc(_fe_ctx, f_get_fail_pins)); 
+    fe_set(_fe_ctx, fe_symbol(_fe_ctx, "perf-enable"), fe_cfunc(_fe_ctx, f_perf_enable)); 
+    fe_set(_fe_ctx, fe_symbol(_fe_ctx, "perf-reset"), fe_cfunc(_fe_ctx, f_perf_reset)); 
+    fe_set(_fe_ctx, fe_symbol(_fe_ctx, "perf-stats"), fe_cfunc(_fe_ctx, f_perf_stats)); 
+    fe_set(_fe_ctx, fe_symbol(_fe_ctx, "perf-dump"), fe_cfunc(_fe_ctx, f_perf_dump)); 
     fe_set(_fe_ctx, fe_symbol(_fe_ctx, "exit"), fe_cfunc(_fe_ctx, f_exit)); 
 }
 
 
 /*
- * Creates a new fe context and sets the global 'prgm' symbol to the prgm
- * pointer.
+ * Gets an fe arena from the pool, or a new one if the pool is empty.
+ * Reusing the arena of a freed prgm saves faulting in FE_DATA_SIZE of
+ * fresh pages for every prgm.
+ *
+ */
+static void *_prgm_alloc_fe_data(){
+    void *data = NULL;
+
+    pthread_mutex_lock(&fe_data_pool_lock);
+    if(fe_data_pool_count > 0){
+        data = fe_data_pool[--fe_data_pool_count];
+    }
+    pthread_mutex_unlock(&fe_data_pool_lock);
+
+    if(data == NULL){
+        if((data = malloc(FE_DATA_SIZE)) == NULL){
+            die("failed to malloc fe data");
+        }
+    }
+    return data;
+}
+
+static void _prgm_release_fe_data(void *data){
+    if(data == NULL){
+        die("pointer is NULL");
+    }
+
+    pthread_mutex_lock(&fe_data_pool_lock);
+    if(fe_data_pool_count < FE_DATA_POOL_SIZE){
+        fe_data_pool[fe_data_pool_count++] = data;
+        data = NULL;
+    }
+    pthread_mutex_unlock(&fe_data_pool_lock);
+
+    if(data != NULL){
+        free(data);
+    }
+    return;
+}
+
+/*
+ * Creates a new fe context and sets its udata and the global 'prgm'
+ * symbol to the prgm pointer.
  *
  */
 void _prgm_create_fe_ctx(struct prgm *prgm){
@@ -936,15 +1798,14 @@ void _prgm_create_fe_ctx(struct prgm *prgm){
     }
     
     prgm->_fe_data_size = FE_DATA_SIZE;
-
-    if((prgm->_fe_data = malloc(prgm->_fe_data_size)) == NULL){
-        die("failed to malloc fe data");
-    }
+    prgm->_fe_data = _prgm_alloc_fe_data();
 
     if((prgm->_fe_ctx = fe_open(prgm->_fe_data, prgm->_fe_data_size)) == NULL){
         die("failed to create fe context");
     }
 
+    // builtins get the prgm from the context, the global is for scripts
+    fe_setudata(prgm->_fe_ctx, (void *)prgm);
     fe_set(prgm->_fe_ctx, fe_symbol(prgm->_fe_ctx, "prgm"), fe_ptr(prgm->_fe_ctx, (void *)prgm)); 
 
     return;
@@ -968,8 +1829,16 @@ void _prgm_free_fe_ctx(struct prgm *prgm){
         prgm->_fe_ctx = NULL;
     }
 
+    // compiled forms lived in the context
+    if(prgm->_fe_form_array != NULL){
+        free(prgm->_fe_form_array);
+        prgm->_fe_form_array = NULL;
+    }
+    prgm->_fe_forms = NULL;
+    prgm->_num_fe_forms = 0;
+
     if(prgm->_fe_data != NULL){
-        free(prgm->_fe_data);
+        _prgm_release_fe_data(prgm->_fe_data);
         prgm->_fe_data = NULL;
     }
 
@@ -985,16 +1854,26 @@ struct prgm *prgm_create(){
         die("failed to malloc prgm");
     }
 
+    prgm->path = NULL;
+    prgm->is_path_open = false;
+
     prgm->_path_fd = 0;
     prgm->_path_fp = NULL;
     prgm->_path_size = 0;
     prgm->_db_prgm_id = -1;
 
+    prgm->_db_path = NULL;
     prgm->_db = NULL;
 
     prgm->_fe_data_size = 0;
     prgm->_fe_data = NULL;
     prgm->_fe_ctx = NULL;
+    prgm->_fe_jmp_buf = NULL;
+    prgm->_fe_fp_err = NULL;
+    prgm->_fe_forms = NULL;
+    prgm->_fe_form_array = NULL;
+    prgm->_num_fe_forms = 0;
+    prgm->_fe_forms_gc = 0;
 
     _prgm_create_fe_ctx(prgm);
     _add_fe_gemini_funcs(prgm->_fe_ctx);
@@ -1002,12 +1881,13 @@ struct prgm *prgm_create(){
     prgm->_profile = NULL;
     prgm->_num_a1_loaded_stims = 0;
     prgm->_num_a2_loaded_stims = 0;
-    prgm->_cur_a1_stim_addr = 0;
-    prgm->_cur_a2_stim_addr = 0;
     prgm->_a1_loaded_stims = NULL;
     prgm->_a2_loaded_stims = NULL;
     prgm->_last_prgm_stim = NULL;
 
+    // follow our stims when any prgm compacts tester memory
+    resident_add_move_cb(_move_loaded_stim, prgm);
+
     return prgm;
 }
 
@@ -1017,6 +1897,30 @@ struct prgm *prgm_create(){
  * be set to -1 and db_path set to NULL;
  *
  */
+/*
+ * Drops the forms read by prgm_compile, unpinning them so they get
+ * collected.
+ *
+ */
+static void _prgm_drop_compiled(struct prgm *prgm){
+    if(prgm == NULL){
+        die("pointer is NULL");
+    }
+    if(prgm->_fe_forms == NULL){
+        return;
+    }
+
+    fe_restoregc(prgm->_fe_ctx, prgm->_fe_forms_gc);
+    if(prgm->_fe_form_array != NULL){
+        free(prgm->_fe_form_array);
+        prgm->_fe_form_array = NULL;
+    }
+    prgm->_fe_forms = NULL;
+    prgm->_num_fe_forms = 0;
+    prgm->_fe_forms_gc = 0;
+    return;
+}
+
 void prgm_open(struct prgm *prgm, const char *path, int64_t db_prgm_id, const char *db_path){
     char *real_path = NULL;
 
@@ -1032,6 +1936,10 @@ void prgm_open(struct prgm *prgm, const char *path, int64_t db_prgm_id, const ch
         die("prgm path '%s' already open", path);
     }
 
+    if(prgm->_fe_forms != NULL){
+        die("prgm is still compiled from another path");
+    }
+
     if((real_path = realpath(path, NULL)) == NULL){
         die("invalid prgm path '%s' because %s", path, strerror(errno));
     }
@@ -1069,6 +1977,9 @@ void prgm_open(struct prgm *prgm, const char *path, int64_t db_prgm_id, const ch
 }
 
 void prgm_close(struct prgm *prgm){
+    // the compiled forms belong to the file being closed
+    _prgm_drop_compiled(prgm);
+
     if(prgm->is_path_open){
         fclose(prgm->_path_fp);
         close(prgm->_path_fd);
@@ -1082,6 +1993,9 @@ void prgm_close(struct prgm *prgm){
 }
 
 void prgm_free(struct prgm *prgm){
+    struct prgm_stim *prgm_stim = NULL;
+    struct prgm_stim *prgm_stim_tmp = NULL;
+
     if(prgm == NULL){
         die("pointer is NULL");
     }
@@ -1102,18 +2016,62 @@ void prgm_free(struct prgm *prgm){
 
     _prgm_free_fe_ctx(prgm);
 
+    HASH_ITER(hh, prgm->_a1_loaded_stims, prgm_stim, prgm_stim_tmp) {
+        _unload_prgm_stim(prgm, prgm_stim);
+    }
+    HASH_ITER(a2_hh, prgm->_a2_loaded_stims, prgm_stim, prgm_stim_tmp) {
+        _unload_prgm_stim(prgm, prgm_stim);
+    }
+    resident_remove_move_cb(_move_loaded_stim, prgm);
+
     if(prgm->_profile != NULL){
         free_profile(prgm->_profile);
     }
 
-    // TODO: free loaded stims
-
     free(prgm);
     return;
 }
 
 
-int prgm_run(struct prgm *prgm){
+/*
+ * Jumps back to the prgm_repl running the context. The error state is
+ * kept in the prgm rather than in statics, so one prgm's error doesn't
+ * jump into another prgm's repl.
+ *
+ */
+static void _fe_onerror(fe_Context *ctx, const char *msg, fe_Object *cl) {
+    struct prgm *prgm = NULL;
+    FILE *fp_err = stderr;
+
+    // no prgm_repl to go back to, let fe print the trace and exit
+    if((prgm = (struct prgm*)fe_getudata(ctx)) == NULL){
+        return;
+    }
+    if(prgm->_fe_jmp_buf == NULL){
+        return;
+    }
+    if(prgm->_fe_fp_err != NULL){
+        fp_err = prgm->_fe_fp_err;
+    }
+    fprintf(fp_err, "error: %s\n", msg);
+    longjmp(*prgm->_fe_jmp_buf, -1);
+}
+
+/*
+ * Reads the prgm file into the fe context once. After this prgm_run
+ * evaluates the read forms instead of re-reading the file, until the
+ * prgm is closed. Returns EXIT_FAILURE if the file doesn't parse.
+ *
+ */
+int prgm_compile(struct prgm *prgm){
+    int gc;
+    fe_Object *obj = NULL;
+    fe_Object *forms = NULL;
+    uint32_t num_forms = 0;
+    jmp_buf jmp;
+    jmp_buf *volatile prev_jmp = NULL;
+    FILE *volatile prev_fp_err = NULL;
+
     if(prgm == NULL){
         die("pointer is NULL");
     }
@@ -1122,30 +2080,149 @@ int prgm_run(struct prgm *prgm){
         die("prgm is not open");
     }
 
-    int ret = prgm_repl(prgm, prgm->_path_fp, stdout, stderr);
+    if(prgm->_fe_forms != NULL){
+        die("prgm already compiled");
+    }
 
-    // rewind prgm path if we want to re-run
+    prev_jmp = prgm->_fe_jmp_buf;
+    prev_fp_err = prgm->_fe_fp_err;
+    prgm->_fe_fp_err = stderr;
+
+    fe_handlers(prgm->_fe_ctx)->error = _fe_onerror;
+
+    gc = fe_savegc(prgm->_fe_ctx);
+    if(setjmp(jmp) == -1){
+        fe_restoregc(prgm->_fe_ctx, gc);
+        fseek(prgm->_path_fp, 0, SEEK_SET);
+        prgm->_fe_jmp_buf = prev_jmp;
+        prgm->_fe_fp_err = prev_fp_err;
+        return EXIT_FAILURE;
+    }
+    prgm->_fe_jmp_buf = &jmp;
+
+    // read every form, the list ends up newest first
+    forms = fe_bool(prgm->_fe_ctx, false);
+    for(;;){
+        if((obj = fe_readfp(prgm->_fe_ctx, prgm->_path_fp)) == NULL){
+            break;
+        }
+        forms = fe_cons(prgm->_fe_ctx, obj, forms);
+        fe_restoregc(prgm->_fe_ctx, gc);
+        fe_pushgc(prgm->_fe_ctx, forms);
+        num_forms++;
+    }
+
+    prgm->_fe_jmp_buf = prev_jmp;
+    prgm->_fe_fp_err = prev_fp_err;
+
+    // rewind prgm path in case it's also run by prgm_repl
     fseek(prgm->_path_fp, 0, SEEK_SET);
 
-    return ret;
+    if(num_forms > 0){
+        if((prgm->_fe_form_array = (fe_Object **)calloc(num_forms,
+                sizeof(fe_Object *))) == NULL){
+            die("failed to calloc fe form array");
+        }
+    }
+    obj = forms;
+    for(uint32_t i=num_forms; i>0; i--){
+        prgm->_fe_form_array[i-1] = fe_car(prgm->_fe_ctx, obj);
+        obj = fe_cdr(prgm->_fe_ctx, obj);
+    }
+
+    // forms stays pinned on the gc stack until the prgm is closed
+    prgm->_fe_forms = forms;
+    prgm->_num_fe_forms = num_forms;
+    prgm->_fe_forms_gc = gc;
+
+    // every run starts with the globals as they are now
+    fe_saveglobals(prgm->_fe_ctx);
+
+    return EXIT_SUCCESS;
 }
 
-static jmp_buf fe_jmp_buf;
-static FILE *fe_fp_err = NULL;
+/*
+ * Evaluates the compiled forms with the globals put back to what they
+ * were when the prgm was compiled.
+ *
+ */
+static int _prgm_run_compiled(struct prgm *prgm, FILE *fp_err){
+    int gc;
+    jmp_buf jmp;
+    jmp_buf *volatile prev_jmp = NULL;
+    FILE *volatile prev_fp_err = NULL;
+
+    if(prgm == NULL){
+        die("pointer is NULL");
+    }
+
+    prev_jmp = prgm->_fe_jmp_buf;
+    prev_fp_err = prgm->_fe_fp_err;
 
-static void _fe_onerror(fe_Context *ctx, const char *msg, fe_Object *cl) {
-    //unused(ctx), unused(cl);
-    FILE *fp_err = stderr;
-    if(fe_fp_err != NULL){
-        fp_err = fe_fp_err;
+    if(fp_err != NULL){
+        prgm->_fe_fp_err = fp_err;
+    }else{
+        prgm->_fe_fp_err = stderr;
     }
-    fprintf(fp_err, "error: %s\n", msg);
-    longjmp(fe_jmp_buf, -1);
+
+    fe_handlers(prgm->_fe_ctx)->error = _fe_onerror;
+    fe_restoreglobals(prgm->_fe_ctx);
+
+    gc = fe_savegc(prgm->_fe_ctx);
+    if(setjmp(jmp) == -1){
+        fe_restoregc(prgm->_fe_ctx, gc);
+        prgm->_fe_jmp_buf = prev_jmp;
+        prgm->_fe_fp_err = prev_fp_err;
+        return EXIT_FAILURE;
+    }
+    prgm->_fe_jmp_buf = &jmp;
+
+    for(uint32_t i=0; i<prgm->_num_fe_forms; i++){
+        fe_eval(prgm->_fe_ctx, prgm->_fe_form_array[i]);
+        fe_restoregc(prgm->_fe_ctx, gc);
+    }
+
+    prgm->_fe_jmp_buf = prev_jmp;
+    prgm->_fe_fp_err = prev_fp_err;
+
+    return EXIT_SUCCESS;
+}
+
+int prgm_run(struct prgm *prgm){
+    if(prgm == NULL){
+        die("pointer is NULL");
+    }
+
+    if(prgm->is_path_open == false){
+        die("prgm is not open");
+    }
+
+    if(prgm->_fe_forms != NULL){
+        return _prgm_run_compiled(prgm, stderr);
+    }
+
+    int ret = prgm_repl(prgm, prgm->_path_fp, stdout, stderr);
+
+    // rewind prgm path if we want to re-run
+    fseek(prgm->_path_fp, 0, SEEK_SET);
+
+    return ret;
 }
 
+/*
+ * Reads and evaluates the program from fp_in until EOF. Returns
+ * EXIT_FAILURE on a script error, leaving the prgm usable for another
+ * run. Each prgm has its own fe context and error state and board
+ * calls take the board lock, so each thread can run its own prgm. A
+ * prgm itself isn't safe to share between threads.
+ *
+ */
 int prgm_repl(struct prgm *prgm, FILE *fp_in, FILE *fp_out, FILE *fp_err){
     int gc;
     fe_Object *obj;
+    jmp_buf jmp;
+    jmp_buf *volatile prev_jmp = NULL;
+    FILE *volatile prev_fp_err = NULL;
 
     if(prgm == NULL){
         die("pointer is NULL");
@@ -1162,22 +2239,28 @@ int prgm_repl(struct prgm *prgm, FILE *fp_in, FILE *fp_out, FILE *fp_err){
         _fp_out = fp_out;
     }
 
+    // a builtin can run a nested repl, put back the outer one when done
+    prev_jmp = prgm->_fe_jmp_buf;
+    prev_fp_err = prgm->_fe_fp_err;
+
     if(fp_err != NULL){
-        fe_fp_err = fp_err;
+        prgm->_fe_fp_err = fp_err;
     }else{
-        fe_fp_err = stderr;
+        prgm->_fe_fp_err = stderr;
     }
 
-    if(_fp_in == stdin){ 
-        fe_handlers(prgm->_fe_ctx)->error = _fe_onerror;
-    }
+    fe_handlers(prgm->_fe_ctx)->error = _fe_onerror;
 
     gc = fe_savegc(prgm->_fe_ctx);
-    int jmp_ret = setjmp(fe_jmp_buf);
+    int jmp_ret = setjmp(jmp);
 
     if(jmp_ret == -1){
+        fe_restoregc(prgm->_fe_ctx, gc);
+        prgm->_fe_jmp_buf = prev_jmp;
+        prgm->_fe_fp_err = prev_fp_err;
         return EXIT_FAILURE;
     }
+    prgm->_fe_jmp_buf = &jmp;
 
     // bust out the repl
     for(;;){
@@ -1199,6 +2282,9 @@ int prgm_repl(struct prgm *prgm, FILE *fp_in, FILE *fp_out, FILE *fp_err){
 
     }
 
+    prgm->_fe_jmp_buf = prev_jmp;
+    prgm->_fe_fp_err = prev_fp_err;
+
     return EXIT_SUCCESS;
 }
 
@@ -11,12 +11,17 @@
 extern "C" {
 #endif
 
+#include <setjmp.h>
+
 #include "lib/uthash/uthash.h"
 #include "lib/fe/fe.h"
 #include "db.h"
+#include "resident.h"
 
 // 32 MB fe data scratch pad
 #define FE_DATA_SIZE (1024*1024*3)
+// fe arenas of freed prgms kept for the next prgm_create
+#define FE_DATA_POOL_SIZE (4)
 
 
 /*
@@ -26,7 +31,17 @@ struct prgm_stim {
     uint64_t a1_addr;
     uint64_t a2_addr;
     struct stim *stim;
+    // prepared when loaded so runs can skip rebuilding it
+    struct artix_stim_setup *setup;
+    // one per profile dut, built the first time the stim runs by site.
+    // NULL if the stim has no pins on that dut.
+    uint32_t num_site_setups;
+    struct artix_stim_setup **site_setups;
+    // where the stim sits in tester memory, shared with other prgms
+    struct resident_stim *resident;
+    // a dual stim is in both the a1 and a2 loaded stims tables
     UT_hash_handle hh;
+    UT_hash_handle a2_hh;
 };
 
 
@@ -59,13 +74,21 @@ struct prgm {
     uint32_t _fe_data_size;
     void *_fe_data;
     fe_Context *_fe_ctx;
+    // error recovery of the innermost prgm_repl, NULL outside of one
+    jmp_buf *_fe_jmp_buf;
+    FILE *_fe_fp_err;
+    // forms read once by prgm_compile, NULL if not compiled. The list
+    // keeps them from being collected, the array is in file order.
+    fe_Object *_fe_forms;
+    fe_Object **_fe_form_array;
+    uint32_t _num_fe_forms;
+    // gc stack index the forms are pinned at
+    int _fe_forms_gc;
 
     // stim
     struct profile *_profile;
     uint64_t _num_a1_loaded_stims;
     uint64_t _num_a2_loaded_stims;
-    uint64_t _cur_a1_stim_addr;
-    uint64_t _cur_a2_stim_addr;
     struct prgm_stim *_a1_loaded_stims;
     struct prgm_stim *_a2_loaded_stims;
     struct prgm_stim *_last_prgm_stim;
@@ -77,6 +100,7 @@ struct prgm *prgm_create();
 void prgm_open(struct prgm *prgm, const char *path, int64_t db_prgm_id, const char *db_path);
 void prgm_close(struct prgm *prgm);
 void prgm_free(struct prgm *prgm);
+int prgm_compile(struct prgm *prgm);
 int prgm_run(struct prgm *prgm);
 int prgm_repl(struct prgm *prgm, FILE *fp_in, FILE *fp_out, FILE *fp_err);
 
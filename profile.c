@@ -19,12 +19,16 @@
 #include <stdbool.h>
 #include <fcntl.h>
 #include <inttypes.h>
+#include <sys/mman.h>
 
 #include "lib/jsmn/jsmn.h"
-#include "lib/avl/avl.h"
+#include "lib/sha2/sha-256.h"
+#include "lib/capnp/capnp_c.h"
+#include "serialize/stim_serdes.capnp.h"
 
 #include "profile.h"
 #include "util.h"
+#include "perf.h"
 
 
 
@@ -49,6 +53,8 @@ struct profile_pin *create_profile_pin(uint32_t num_dests){
     profile_pin->num_dests = num_dests;
     profile_pin->dest_dut_ids = NULL;
     profile_pin->dest_pin_names = NULL;
+    profile_pin->_refs = 1;
+    profile_pin->_profile = NULL;
 
     if(profile_pin->num_dests > 0){
         if((profile_pin->dest_dut_ids = (uint32_t *)calloc(profile_pin->num_dests, sizeof(uint32_t))) == NULL){
@@ -63,7 +69,9 @@ struct profile_pin *create_profile_pin(uint32_t num_dests){
 }
 
 /*
- * Allocate a new profile pin object.
+ * Allocate a new profile pin object with a deep copy of copy_pin. The
+ * copy isn't owned by any profile. Prefer retain_profile_pin unless 
+ * you really need a pin you can modify.
  *
  */
 struct profile_pin *create_profile_pin_from_pin(struct profile_pin *copy_pin){
@@ -126,9 +134,52 @@ struct profile *create_profile(){
     profile->pins = create_profile_pins(PROFILE_MAX_PINS);
     profile->num_pins = 0;
     profile->num_duts = 0;
+    profile->_refs = 1;
+
+    profile->_map = NULL;
+    profile->_map_size = 0;
+
+    profile->_pins_by_name = NULL;
+    profile->_pins_by_net = NULL;
+    profile->_pins_by_alias = NULL;
+    profile->_pins_by_dest = NULL;
+    profile->_pins_by_dut_io_id = NULL;
+    profile->_pins_by_tag = NULL;
     return profile;
 }
 
+/*
+ * Adds a reference to a pin. If the pin belongs to a profile, the
+ * profile is retained too.
+ *
+ */
+struct profile_pin *retain_profile_pin(struct profile_pin *pin){
+    if(pin == NULL){
+        die("pointer is NULL");
+    }
+    __atomic_add_fetch(&pin->_refs, 1, __ATOMIC_RELAXED);
+    if(pin->_profile != NULL){
+        retain_profile(pin->_profile);
+    }
+    return pin;
+}
+
+/*
+ * Adds a reference to a profile.
+ *
+ */
+struct profile *retain_profile(struct profile *profile){
+    if(profile == NULL){
+        die("pointer is NULL");
+    }
+    __atomic_add_fetch(&profile->_refs, 1, __ATOMIC_RELAXED);
+    return profile;
+}
+
+/*
+ * Drops a reference to each pin and frees the array.
+ *
+ */
 struct profile_pin **free_profile_pins(struct profile_pin **pins, uint32_t num_pins){
     if(pins == NULL){
         die("pointer is NULL");
@@ -145,84 +196,130 @@ struct profile_pin **free_profile_pins(struct profile_pin **pins, uint32_t num_p
 }
 
 /*
- * Deallocate the profile_pin struct and all internal members.
+ * Deallocate the profile_pin struct and all internal members. If 
+ * is_mapped, the strings point into a profile cache map and are not
+ * freed.
  *
  */
-struct profile_pin *free_profile_pin(struct profile_pin *pin){
-    if(pin == NULL){
-        return NULL;
-    }
-    if(pin->pin_name != NULL){
+static void destroy_profile_pin(struct profile_pin *pin, bool is_mapped){
+    if(!is_mapped){
         free(pin->pin_name);
-        pin->pin_name = NULL;
-    }
-    if(pin->comp_name != NULL){
         free(pin->comp_name);
-        pin->comp_name = NULL;
-    }
-    if(pin->net_name != NULL){
         free(pin->net_name);
-        pin->net_name = NULL;
-    }
-    if(pin->net_alias != NULL){
         free(pin->net_alias);
-        pin->net_alias = NULL;
-    }
-    pin->tag = PROFILE_TAG_NONE;
-    pin->dut_io_id = -1;
-
-    if(pin->dest_dut_ids != NULL){
-        free(pin->dest_dut_ids);
-    }
-    pin->dest_dut_ids = 0;
-
-    for(uint32_t i=0; i<pin->num_dests; i++){
         if(pin->dest_pin_names != NULL){
-            free(pin->dest_pin_names[i]);
-            pin->dest_pin_names[i] = NULL;
+            for(uint32_t i=0; i<pin->num_dests; i++){
+                free(pin->dest_pin_names[i]);
+            }
         }
     }
+    free(pin->dest_dut_ids);
+    free(pin->dest_pin_names);
+    free(pin);
+    return;
+}
 
-    if(pin->dest_pin_names != NULL){
-        free(pin->dest_pin_names);
-        pin->dest_pin_names = NULL;
-    }
+/*
+ * Drops a reference to the pin. Pins owned by a profile drop the
+ * profile reference taken by retain_profile_pin and are freed with
+ * the profile. Other pins are freed when the last reference drops.
+ *
+ */
+struct profile_pin *free_profile_pin(struct profile_pin *pin){
+    uint32_t refs = 0;
 
-    pin->num_dests = 0;
-    free(pin);
+    if(pin == NULL){
+        return NULL;
+    }
+    if((refs = __atomic_fetch_sub(&pin->_refs, 1, __ATOMIC_ACQ_REL)) == 0){
+        die("profile pin '%s' freed too many times", pin->pin_name);
+    }
+    if(pin->_profile != NULL){
+        free_profile(pin->_profile);
+    }else if(refs == 1){
+        destroy_profile_pin(pin, false);
+    }
     return NULL;
 }
 
 /*
- * Deallocate the profile struct and all internal members.
+ * Deallocate a profile index and its entries. The pins are owned by
+ * the profile and not freed here.
+ *
+ */
+static void free_profile_index(struct profile_index **index){
+    struct profile_index *entry = NULL;
+    struct profile_index *tmp = NULL;
+
+    HASH_ITER(hh, (*index), entry, tmp){
+        HASH_DEL((*index), entry);
+        free(entry->key);
+        free(entry->pins);
+        free(entry);
+    }
+    (*index) = NULL;
+    return;
+}
+
+/*
+ * Drops a reference to the profile and deallocates it, its pins and
+ * all internal members when the last reference drops.
  *
  */
 struct profile *free_profile(struct profile *profile){
+    uint32_t refs = 0;
+
     if(profile == NULL){
         return NULL;
     }
+    if((refs = __atomic_fetch_sub(&profile->_refs, 1, __ATOMIC_ACQ_REL)) == 0){
+        die("profile freed too many times");
+    }
+    if(refs > 1){
+        return NULL;
+    }
+    free_profile_index(&profile->_pins_by_name);
+    free_profile_index(&profile->_pins_by_net);
+    free_profile_index(&profile->_pins_by_alias);
+    free_profile_index(&profile->_pins_by_dest);
+    free_profile_index(&profile->_pins_by_dut_io_id);
+    free_profile_index(&profile->_pins_by_tag);
     if(profile->path != NULL){
         free(profile->path);
         profile->path = NULL;
     }
-    if(profile->board_name != NULL){
-        free(profile->board_name);
-        profile->board_name = NULL;
-    }
-    if(profile->description != NULL){
-        free(profile->description);
-        profile->description = NULL;
+    if(profile->_map == NULL){
+        if(profile->board_name != NULL){
+            free(profile->board_name);
+        }
+        if(profile->description != NULL){
+            free(profile->description);
+        }
     }
+    profile->board_name = NULL;
+    profile->description = NULL;
     profile->revision = 0;
     if(profile->pins != NULL){
+        // every outside pin reference holds a profile reference, so
+        // only the profile's own reference is left here
         for(uint32_t i=0; i<profile->num_pins; i++){
-            profile->pins[i] = free_profile_pin(profile->pins[i]);
+            if(profile->pins[i] != NULL){
+                destroy_profile_pin(profile->pins[i], (profile->_map != NULL));
+                profile->pins[i] = NULL;
+            }
         }
         free(profile->pins);
         profile->pins = NULL;
     }
     profile->num_pins = 0;
     profile->num_duts = 0;
+    if(profile->_map != NULL){
+        if(munmap(profile->_map, profile->_map_size) == -1){
+            die("failed to munmap profile cache");
+        }
+        profile->_map = NULL;
+        profile->_map_size = 0;
+    }
     free(profile);
     return NULL;
 }
@@ -387,66 +484,382 @@ void print_profile_pin(struct profile_pin *pin){
     return;
 }
 
-static inline int avl_comp(const void *key1, const void *key2){
-    struct profile_pin *pin1 = (struct profile_pin *)key1;
-    struct profile_pin *pin2 = (struct profile_pin *)key2;
+/*
+ * Convert c string to capn_text. A NULL string is written as a null
+ * pointer so it reads back as NULL.
+ *
+ */
+static capn_text chars_to_text(const char *chars) {
+  return (capn_text) {
+    .len = (chars == NULL) ? 0 : (int) strlen(chars),
+    .str = chars,
+    .seg = NULL,
+  };
+}
 
-    if(pin1 == NULL || pin2 == NULL){
-        die("error: avl_comp failed, pointer is NULL");
+static char *text_to_chars(capn_text text){
+    if(text.seg == NULL){
+        return NULL;
     }
-    return strcmp(pin1->pin_name, pin2->pin_name);
+    return (char*)text.str;
+}
+
+static ssize_t write_profile_cache_fd(int fd, const void *p, size_t count){
+    return write(fd, p, count);
+}
+
+static inline int64_t get_profile_mtime(struct stat *st){
+    return util_get_mtime_ns(st);
+}
+
+static char *get_profile_cache_path(const char *path){
+    size_t len = strlen(path) + strlen(PROFILE_CACHE_EXT) + 1;
+    char *cache_path = NULL;
+    if((cache_path = (char*)malloc(len)) == NULL){
+        die("malloc failed");
+    }
+    snprintf(cache_path, len, "%s%s", path, PROFILE_CACHE_EXT);
+    return cache_path;
 }
 
 /*
- * Returns a profile given a board name.
+ * Reads the whole json file into a NULL terminated buffer.
  *
  */
-struct profile *get_profile_by_path(const char *path){
+static char *read_profile_json(const char *path, size_t *size){
     int fd;
     FILE *fp = NULL;
     off_t file_size;
+    char *data = NULL;
+
+    if(util_fopen(path, &fd, &fp, &file_size) != 0){
+        die("fopen failed");
+    }
+
+    if((data = (char*)calloc((size_t)file_size+1, sizeof(char))) == NULL){
+        die("error: failed to malloc data.");
+    }
+
+    if(fread(data, sizeof(uint8_t), (size_t)file_size, fp) != (size_t)file_size){
+        die("error: failed to read profile '%s'", path);
+    }
+
+    fclose(fp);
+    close(fd);
+
+    (*size) = (size_t)file_size;
+    return data;
+}
+
+/*
+ * Initializes a capn session whose segments point straight into the
+ * mapped file instead of copying it like capn_init_mem does. The
+ * returned segments must be freed after the session is done.
+ *
+ */
+static struct capn_segment *init_profile_capn_map(struct capn *c, 
+        const uint8_t *map, size_t map_size){
+    struct capn_segment *segs = NULL;
+    const uint32_t *hdr = (const uint32_t*)map;
+    uint32_t num_segs = 0;
+    size_t offset = 0;
+
+    if(map_size < 8){
+        return NULL;
+    }
+
+    num_segs = capn_flip32(hdr[0]) + 1;
+    if(num_segs > 1024){
+        return NULL;
+    }
+
+    // header is padded to a word boundary
+    offset = 4 * (((2 + num_segs) / 2) * 2);
+    if(offset > map_size){
+        return NULL;
+    }
+
+    if((segs = (struct capn_segment*)calloc(num_segs, sizeof(struct capn_segment))) == NULL){
+        die("malloc failed");
+    }
+
+    memset(c, 0, sizeof(struct capn));
+    for(uint32_t i=0; i<num_segs; i++){
+        size_t seg_size = (size_t)capn_flip32(hdr[1+i]) * 8;
+        if(offset + seg_size > map_size){
+            free(segs);
+            return NULL;
+        }
+        segs[i].data = (char*)(map + offset);
+        segs[i].len = seg_size;
+        segs[i].cap = seg_size;
+        capn_append_segment(c, &segs[i]);
+        offset += seg_size;
+    }
+
+    return segs;
+}
+
+/*
+ * Returns the profile from the compiled cache if it's still valid for
+ * the json at path, otherwise NULL. The cache is valid if the json 
+ * mtime and size are unchanged, or if its contents hash the same.
+ *
+ */
+static struct profile *load_profile_cache(const char *path, struct stat *json_st){
     struct profile *profile = NULL;
-    jsmn_parser json_parser;
-    jsmntok_t t[2048*2];
-    int32_t num_tokens;
-    char *data;
-    char *real_path = NULL;
+    struct capn_segment *segs = NULL;
+    struct capn capn;
+    struct stat st;
+    uint8_t *map = NULL;
+    size_t map_size = 0;
+    char *cache_path = NULL;
+    bool is_valid = false;
+    int fd = -1;
+
+    cache_path = get_profile_cache_path(path);
+    fd = open(cache_path, O_RDONLY);
+    free(cache_path);
+
+    if(fd == -1){
+        return NULL;
+    }
 
-    if(path == NULL){
-        die("error: failed to get profile by path, pointer is NULL");
+    if(fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0){
+        close(fd);
+        return NULL;
     }
 
-    if(strlen(path) == 0){
-        die("error: profile path is empty");
+    map_size = (size_t)st.st_size;
+    map = (uint8_t*)mmap(NULL, map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if(map == MAP_FAILED){
+        return NULL;
     }
 
-    if(strcmp(util_get_file_ext_by_path(path), "json") != 0){
-        die("profile path '%s' does not have a .json extension", path);
+    if((segs = init_profile_capn_map(&capn, map, map_size)) == NULL){
+        slog_warn("invalid profile cache for '%s'", path);
+        munmap(map, map_size);
+        return NULL;
+    }
+
+    SerialProfile_ptr serialProfile_ptr;
+    struct SerialProfile serialProfile;
+
+    serialProfile_ptr.p = capn_getp(capn_root(&capn), 0 /* off */, 1 /* resolve */);
+    read_SerialProfile(&serialProfile, serialProfile_ptr);
+
+    if(serialProfile.sourceMtime == get_profile_mtime(json_st) && 
+            serialProfile.sourceSize == (uint64_t)json_st->st_size){
+        is_valid = true;
+    }else if(serialProfile.sourceSize == (uint64_t)json_st->st_size && 
+            serialProfile.sourceHash.p.len == SIZE_OF_SHA_256_HASH){
+        // touched but maybe not changed
+        uint8_t hash[SIZE_OF_SHA_256_HASH];
+        size_t data_size = 0;
+        char *data = read_profile_json(path, &data_size);
+        calc_sha_256(hash, data, data_size);
+        free(data);
+        is_valid = (memcmp(hash, serialProfile.sourceHash.p.data, SIZE_OF_SHA_256_HASH) == 0);
+    }
+
+    if(!is_valid || serialProfile.numPins > PROFILE_MAX_PINS ||
+            capn_len(serialProfile.pins) != (int)serialProfile.numPins){
+        capn_free(&capn);
+        free(segs);
+        munmap(map, map_size);
+        return NULL;
     }
 
     if((profile = create_profile()) == NULL){
         die("pointer is NULL");
     }
 
-    if((real_path = realpath(path, NULL)) == NULL){
-        die("invalid profile path '%s'", path);
+    profile->_map = map;
+    profile->_map_size = map_size;
+    profile->path = strdup(path);
+    profile->board_name = text_to_chars(serialProfile.boardName);
+    profile->description = text_to_chars(serialProfile.description);
+    profile->revision = serialProfile.revision;
+    profile->num_duts = serialProfile.numDuts;
+
+    for(uint32_t i=0; i<serialProfile.numPins; i++){
+        struct ProfilePin profilePin;
+        get_ProfilePin(&profilePin, serialProfile.pins, i);
+
+        struct profile_pin *pin = create_profile_pin(profilePin.numDests);
+
+        pin->pin_name = text_to_chars(profilePin.pinName);
+        pin->comp_name = text_to_chars(profilePin.compName);
+        pin->net_name = text_to_chars(profilePin.netName);
+        pin->net_alias = text_to_chars(profilePin.netAlias);
+        pin->tag = (enum profile_tags)profilePin.tag;
+        pin->tag_data = profilePin.tagData;
+        pin->dut_io_id = profilePin.dutIoId;
+
+        for(uint32_t j=0; j<pin->num_dests; j++){
+            pin->dest_dut_ids[j] = capn_get32(profilePin.destDutIds, j);
+            struct String string;
+            get_String(&string, profilePin.destPinNames, j);
+            pin->dest_pin_names[j] = text_to_chars(string.string);
+        }
+
+        profile->pins[profile->num_pins++] = pin;
     }
 
-    profile->path = strdup(real_path);
-    free(real_path);
+    // segments only index into the map, which the profile now owns
+    capn_free(&capn);
+    free(segs);
 
-    if(util_fopen(profile->path, &fd, &fp, &file_size) != 0){
-        die("fopen failed");
+    return profile;
+}
+
+/*
+ * Writes the compiled cache for a profile parsed from json. Failing to
+ * write isn't fatal; the json will just be parsed again next time.
+ *
+ */
+static void write_profile_cache(struct profile *profile, struct stat *json_st, 
+        uint8_t hash[SIZE_OF_SHA_256_HASH]){
+    char *cache_path = NULL;
+    char *tmp_path = NULL;
+    size_t tmp_path_len = 0;
+    int fd = -1;
+
+    cache_path = get_profile_cache_path(profile->path);
+    tmp_path_len = strlen(cache_path) + 8;
+    if((tmp_path = (char*)malloc(tmp_path_len)) == NULL){
+        die("malloc failed");
     }
 
-    if((data = (char*)calloc((size_t)file_size, sizeof(char))) == NULL){
-        die("error: failed to malloc data.");
+    // unique temp file next to the cache so the rename stays on one fs
+    snprintf(tmp_path, tmp_path_len, "%s.XXXXXX", cache_path);
+    fd = mkstemp(tmp_path);
+    if(fd != -1 && fchmod(fd, 0644) != 0){
+        close(fd);
+        unlink(tmp_path);
+        fd = -1;
+    }
+    if(fd == -1){
+        slog_warn("failed to write profile cache '%s'", cache_path);
+        free(tmp_path);
+        free(cache_path);
+        return;
+    }
+
+    struct capn c;
+    capn_init_malloc(&c);
+    capn_ptr cr = capn_root(&c);
+    struct capn_segment *cs = cr.seg;
+
+    capn_list8 hash_list = capn_new_list8(cs, SIZE_OF_SHA_256_HASH);
+    capn_setv8(hash_list, 0, hash, SIZE_OF_SHA_256_HASH);
+
+    struct SerialProfile serialProfile = {
+        .sourceMtime = get_profile_mtime(json_st),
+        .sourceSize = (uint64_t)json_st->st_size,
+        .sourceHash = { .p = hash_list.p },
+        .boardName = chars_to_text(profile->board_name),
+        .description = chars_to_text(profile->description),
+        .revision = profile->revision,
+        .numDuts = profile->num_duts,
+        .numPins = profile->num_pins,
+    };
+
+    serialProfile.pins = new_ProfilePin_list(cs, profile->num_pins);
+
+    for(uint32_t i=0; i<profile->num_pins; i++){
+        struct profile_pin *pin = profile->pins[i];
+        struct ProfilePin profilePin = {
+            .dutId = -1,
+            .pinName = chars_to_text(pin->pin_name),
+            .compName = chars_to_text(pin->comp_name),
+            .netName = chars_to_text(pin->net_name),
+            .netAlias = chars_to_text(pin->net_alias),
+            .tag = (enum ProfilePin_ProfileTags)pin->tag,
+            .tagData = pin->tag_data,
+            .dutIoId = pin->dut_io_id,
+            .numDests = pin->num_dests,
+        };
+
+        profilePin.destDutIds = capn_new_list32(cs, pin->num_dests);
+        profilePin.destPinNames = new_String_list(cs, pin->num_dests);
+
+        for(uint32_t j=0; j<pin->num_dests; j++){
+            capn_set32(profilePin.destDutIds, j, pin->dest_dut_ids[j]);
+            struct String string = {
+                .string = chars_to_text(pin->dest_pin_names[j]),
+            };
+            set_String(&string, profilePin.destPinNames, j);
+        }
+
+        set_ProfilePin(&profilePin, serialProfile.pins, i);
     }
 
-    fread(data, sizeof(uint8_t), (size_t)file_size, fp);
+    SerialProfile_ptr serialProfilePtr = new_SerialProfile(cs);
+    write_SerialProfile(&serialProfile, serialProfilePtr);
+    if(capn_setp(capn_root(&c), 0, serialProfilePtr.p) != 0){
+        die("capn setp failed");
+    }
+
+    if(capn_write_fd(&c, &write_profile_cache_fd, fd, 0 /* packed */) < 0){
+        slog_warn("failed to write profile cache '%s'", cache_path);
+        close(fd);
+        unlink(tmp_path);
+    }else{
+        close(fd);
+        // rename is atomic, so readers never see a partial cache
+        if(rename(tmp_path, cache_path) != 0){
+            slog_warn("failed to write profile cache '%s'", cache_path);
+            unlink(tmp_path);
+        }
+    }
+    capn_free(&c);
+
+    free(tmp_path);
+    free(cache_path);
+    return;
+}
+
+static char *json_strndup(const char *data, jsmntok_t *tok){
+    return strndup(data+tok->start, tok->end-tok->start);
+}
+
+static int32_t json_atoi(const char *data, jsmntok_t *tok){
+    char *s = json_strndup(data, tok);
+    int32_t i = atoi(s);
+    free(s);
+    return i;
+}
+
+/*
+ * Parses the json profile data into profile.
+ *
+ */
+static void parse_profile_json(struct profile *profile, const char *data, size_t size){
+    jsmn_parser json_parser;
+    jsmntok_t *t = NULL;
+    int32_t num_tokens;
+    char *s = NULL;
+
+    // count the tokens first so large profiles never hit a limit
+    jsmn_init(&json_parser);
+    num_tokens = jsmn_parse(&json_parser, data, size, NULL, 0);
+    if(num_tokens < 0){
+        die("error: failed to parse json file: num_tokens (%d)", num_tokens);
+    }
+
+    if(num_tokens < 1){
+        die("error: profile is not a valid json file");
+    }
+
+    if((t = (jsmntok_t*)calloc(num_tokens, sizeof(jsmntok_t))) == NULL){
+        die("malloc failed");
+    }
 
     jsmn_init(&json_parser);
-    num_tokens = jsmn_parse(&json_parser, data, strlen(data), t, sizeof(t)/sizeof(t[0]));
+    num_tokens = jsmn_parse(&json_parser, data, size, t, num_tokens);
     if(num_tokens < 0){
         die("error: failed to parse json file: num_tokens (%d)", num_tokens);
     }
@@ -457,16 +870,16 @@ struct profile *get_profile_by_path(const char *path){
 
     for(int i=1; i<num_tokens; i++){
         if(util_jsmn_eq(data, &t[i], "board_name") == 0){
-            profile->board_name = strndup(data+t[i+1].start, t[i+1].end-t[i+1].start); 
+            profile->board_name = json_strndup(data, &t[i+1]);
             i++;
         }else if(util_jsmn_eq(data, &t[i], "description") == 0){
-            profile->description = strndup(data+t[i+1].start, t[i+1].end-t[i+1].start); 
+            profile->description = json_strndup(data, &t[i+1]);
             i++;
         }else if(util_jsmn_eq(data, &t[i], "revision") == 0){
-            profile->revision = atoi(strndup(data+t[i+1].start, t[i+1].end-t[i+1].start)); 
+            profile->revision = json_atoi(data, &t[i+1]);
             i++;
         }else if(util_jsmn_eq(data, &t[i], "num_duts") == 0){
-            profile->num_duts = atoi(strndup(data+t[i+1].start, t[i+1].end-t[i+1].start)); 
+            profile->num_duts = json_atoi(data, &t[i+1]);
             i++;
         }else if(util_jsmn_eq(data, &t[i], "pins") == 0){
             if(t[i+1].type != JSMN_ARRAY) {
@@ -477,29 +890,35 @@ struct profile *get_profile_by_path(const char *path){
                 if (pins->type != JSMN_OBJECT) {
                     continue;
                 }
+                if(profile->num_pins >= PROFILE_MAX_PINS){
+                    die("error: profile has more than %i pins", PROFILE_MAX_PINS);
+                }
                 // don't allocate dests since we don't know yet
                 struct profile_pin *pin = create_profile_pin(0);
                 for(int k=1; k < (pins->size*2)+1; k=k+2){
                     jsmntok_t *key = &pins[k+0];
                     jsmntok_t *v = &pins[k+1];
                     if(util_jsmn_eq(data, key, "pin_name") == 0){
-                        pin->pin_name = strndup(data+v->start, v->end-v->start);
+                        pin->pin_name = json_strndup(data, v);
                     }else if (util_jsmn_eq(data, key, "comp_name") == 0){
-                        pin->comp_name = strndup(data+v->start, v->end-v->start);
+                        pin->comp_name = json_strndup(data, v);
                     }else if (util_jsmn_eq(data, key, "net_name") == 0){
-                        pin->net_name = strndup(data+v->start, v->end-v->start);
+                        pin->net_name = json_strndup(data, v);
                     }else if (util_jsmn_eq(data, key, "net_alias") == 0){
-                        pin->net_alias = strndup(data+v->start, v->end-v->start);
+                        pin->net_alias = json_strndup(data, v);
                     }else if (util_jsmn_eq(data, key, "tag_name") == 0){
-                        pin->tag = get_tag_by_name(strndup(data+v->start, v->end-v->start));
+                        s = json_strndup(data, v);
+                        pin->tag = get_tag_by_name(s);
+                        free(s);
                     }else if (util_jsmn_eq(data, key, "tag_data") == 0){
-                        pin->tag_data = atoi(strndup(data+v->start, v->end-v->start));
+                        pin->tag_data = json_atoi(data, v);
                     }else if (util_jsmn_eq(data, key, "dut_io_id") == 0){
-                        pin->dut_io_id = atoi(strndup(data+v->start, v->end-v->start));
+                        pin->dut_io_id = json_atoi(data, v);
                     }else if (util_jsmn_eq(data, key, "dest_dut_ids") == 0){
                         char **dest_dut_ids = NULL;
-                        pin->num_dests = util_str_split(strndup(data+v->start, v->end-v->start), 
-                                ',', &(dest_dut_ids));
+                        s = json_strndup(data, v);
+                        pin->num_dests = util_str_split(s, ',', &(dest_dut_ids));
+                        free(s);
                         if((pin->dest_dut_ids = (uint32_t *)calloc(pin->num_dests, sizeof(uint32_t))) == NULL){
                             die("error: failed to malloc struct.");
                         }
@@ -510,8 +929,9 @@ struct profile *get_profile_by_path(const char *path){
                         free(dest_dut_ids);
                         // TODO: check if num_dests same as for pin_names
                     }else if (util_jsmn_eq(data, key, "dest_pin_names") == 0){
-                        pin->num_dests = util_str_split(strndup(data+v->start, v->end-v->start), 
-                                ',', &(pin->dest_pin_names));
+                        s = json_strndup(data, v);
+                        pin->num_dests = util_str_split(s, ',', &(pin->dest_pin_names));
+                        free(s);
                     }
                 }
                 profile->pins[profile->num_pins] = pin;
@@ -522,24 +942,73 @@ struct profile *get_profile_by_path(const char *path){
         }
     }
 
-    AVLTree *tree = CreateAVL(&avl_comp);
+    free(t);
+    return;
+}
 
-    // check for duplicate pins
-    for(int i=0; i<profile->num_pins; i++){
-        if(FindAVL(tree, (const void *)profile->pins[i]) == NULL){
-            InsertAVL(tree, (const void *)profile->pins[i], NULL);
-        } else {
-            die("error: dupliate profile pin found %s.", profile->pins[i]->pin_name);
-        }
+/*
+ * Returns a profile given a board name. Loads the compiled cache next
+ * to the json if it's valid, otherwise parses the json and writes a 
+ * new cache.
+ *
+ */
+struct profile *get_profile_by_path(const char *path){
+    struct profile *profile = NULL;
+    struct stat json_st;
+    uint8_t hash[SIZE_OF_SHA_256_HASH];
+    char *real_path = NULL;
+    char *data = NULL;
+    size_t data_size = 0;
+    uint64_t perf_start = perf_begin();
+
+    if(path == NULL){
+        die("error: failed to get profile by path, pointer is NULL");
+    }
+
+    if(strlen(path) == 0){
+        die("error: profile path is empty");
+    }
+
+    if(strcmp(util_get_file_ext_by_path(path), "json") != 0){
+        die("profile path '%s' does not have a .json extension", path);
     }
-    DestroyAVL(tree);
+
+    if((real_path = realpath(path, NULL)) == NULL){
+        die("invalid profile path '%s'", path);
+    }
+
+    if(stat(real_path, &json_st) != 0){
+        die("failed to stat profile path '%s'", real_path);
+    }
+
+    if((profile = load_profile_cache(real_path, &json_st)) != NULL){
+        free(real_path);
+        // also checks for duplicate pins
+        index_profile(profile);
+        perf_end(PERF_PROFILE_PARSE, perf_start);
+        return profile;
+    }
+
+    if((profile = create_profile()) == NULL){
+        die("pointer is NULL");
+    }
+
+    profile->path = strdup(real_path);
+    free(real_path);
+
+    data = read_profile_json(profile->path, &data_size);
+    parse_profile_json(profile, data, data_size);
+
+    // also checks for duplicate pins
+    index_profile(profile);
+
+    calc_sha_256(hash, data, data_size);
+    write_profile_cache(profile, &json_st, hash);
 
     free(data);
     data = NULL;
 
-    fclose(fp);
-    close(fd);
-
+    perf_end(PERF_PROFILE_PARSE, perf_start);
     return profile;
 }
 
@@ -596,71 +1065,182 @@ struct profile_pin **sort_profile_pins_by_tag_data(struct profile_pin **pins, ui
 }
 
 /*
- * Returns an array of found pins by given tag. You can optionally pass
- * a dut_id to filter by dut or pass -1 to filter by all pins.
+ * Append pin to the index entry for a string key, creating the entry
+ * if needed. A pin is only added once per key.
  *
  */
-struct profile_pin **get_profile_pins_by_tag(struct profile *profile, 
-        int32_t dut_id, enum profile_tags tag, uint32_t *found_num_pins){
-    struct profile_pin ** pins = NULL;
-    (*found_num_pins) = 0;
+static void add_profile_index_pin(struct profile_index **index, 
+        const char *key, int32_t id, struct profile_pin *pin){
+    struct profile_index *entry = NULL;
+
+    if(key != NULL){
+        HASH_FIND_STR((*index), key, entry);
+    }else{
+        HASH_FIND_INT((*index), &id, entry);
+    }
+
+    if(entry == NULL){
+        if((entry = (struct profile_index*)calloc(1, sizeof(struct profile_index))) == NULL){
+            die("error: failed to calloc struct.");
+        }
+        entry->id = id;
+        if(key != NULL){
+            entry->key = strdup(key);
+            HASH_ADD_KEYPTR(hh, (*index), entry->key, strlen(entry->key), entry);
+        }else{
+            HASH_ADD_INT((*index), id, entry);
+        }
+    }else if(entry->pins[entry->num_pins-1] == pin){
+        return;
+    }
+
+    if((entry->pins = (struct profile_pin**)realloc(entry->pins, 
+            (entry->num_pins+1)*sizeof(struct profile_pin*))) == NULL){
+        die("error: failed to realloc pins.");
+    }
+    entry->pins[entry->num_pins++] = pin;
+    return;
+}
+
+/*
+ * Alias and dest pin names are only unique within a dut, so they're
+ * keyed by dut and name. A dut_id of -1 is the key used to search
+ * across all duts.
+ *
+ */
+static char *get_profile_dut_key(int32_t dut_id, const char *name){
+    size_t len = strlen(name) + 16;
+    char *key = NULL;
+    if((key = (char*)malloc(len)) == NULL){
+        die("malloc failed");
+    }
+    snprintf(key, len, "%i:%s", dut_id, name);
+    return key;
+}
+
+static inline int32_t get_profile_tag_key(int32_t dut_id, enum profile_tags tag){
+    return ((dut_id+1) << 8) | (int32_t)tag;
+}
+
+/*
+ * Builds the lookup indexes over profile->pins. Must be called after
+ * all pins are added. Dies on duplicate pin names.
+ *
+ */
+void index_profile(struct profile *profile){
+    struct profile_pin *pin = NULL;
+    struct profile_index *entry = NULL;
+    char *key = NULL;
 
     if(profile == NULL){
         die("pointer is NULL");
     }
 
+    free_profile_index(&profile->_pins_by_name);
+    free_profile_index(&profile->_pins_by_net);
+    free_profile_index(&profile->_pins_by_alias);
+    free_profile_index(&profile->_pins_by_dest);
+    free_profile_index(&profile->_pins_by_dut_io_id);
+    free_profile_index(&profile->_pins_by_tag);
+
+    for(uint32_t i=0; i<profile->num_pins; i++){
+        if((pin = profile->pins[i]) == NULL){
+            die("pointer is NULL");
+        }
+
+        // the profile owns its pins from here on
+        pin->_profile = profile;
+
+        if(pin->pin_name != NULL){
+            HASH_FIND_STR(profile->_pins_by_name, pin->pin_name, entry);
+            if(entry != NULL){
+                die("error: dupliate profile pin found %s.", pin->pin_name);
+            }
+            add_profile_index_pin(&profile->_pins_by_name, pin->pin_name, 0, pin);
+        }
+
+        if(pin->net_name != NULL){
+            add_profile_index_pin(&profile->_pins_by_net, pin->net_name, 0, pin);
+        }
+
+        if(pin->dut_io_id >= 0){
+            add_profile_index_pin(&profile->_pins_by_dut_io_id, NULL, pin->dut_io_id, pin);
+        }
+
+        if(pin->net_alias != NULL){
+            key = get_profile_dut_key(-1, pin->net_alias);
+            add_profile_index_pin(&profile->_pins_by_alias, key, 0, pin);
+            free(key);
+        }
+
+        add_profile_index_pin(&profile->_pins_by_tag, NULL, 
+            get_profile_tag_key(-1, pin->tag), pin);
+
+        for(uint32_t j=0; j<pin->num_dests; j++){
+            int32_t dut_id = (int32_t)pin->dest_dut_ids[j];
+
+            if(pin->dest_pin_names != NULL && pin->dest_pin_names[j] != NULL){
+                key = get_profile_dut_key(-1, pin->dest_pin_names[j]);
+                add_profile_index_pin(&profile->_pins_by_dest, key, 0, pin);
+                free(key);
+                key = get_profile_dut_key(dut_id, pin->dest_pin_names[j]);
+                add_profile_index_pin(&profile->_pins_by_dest, key, 0, pin);
+                free(key);
+            }
+
+            if(pin->net_alias != NULL){
+                key = get_profile_dut_key(dut_id, pin->net_alias);
+                add_profile_index_pin(&profile->_pins_by_alias, key, 0, pin);
+                free(key);
+            }
+
+            add_profile_index_pin(&profile->_pins_by_tag, NULL, 
+                get_profile_tag_key(dut_id, pin->tag), pin);
+        }
+    }
+    return;
+}
+
+static void check_profile_dut_id(struct profile *profile, int32_t dut_id){
     if(dut_id < -1){
         die("invalid dut_id given %i; less than -1", dut_id);
     }else if(dut_id >= 0 && (dut_id+1) > profile->num_duts){
         die("invalid dut_id given %i; greater than num duts %i", dut_id, profile->num_duts);
     }
+    return;
+}
 
-    for(int i=0; i<profile->num_pins; i++){
-        if(profile->pins[i]->tag == tag){
-            if(dut_id >= 0){
-                bool found = false;
-                for(int j=0; j<profile->pins[i]->num_dests; j++){
-                    if(profile->pins[i]->dest_dut_ids[j] == dut_id){
-                        found = true;
-                        break;
-                    }
-                }
-                if(!found){
-                    continue;
-                }
-            }
-            (*found_num_pins)++;
-        }
+/*
+ * Returns a borrowed array of pins by given tag. You can optionally pass
+ * a dut_id to filter by dut or pass -1 to filter by all pins. DATA pins
+ * are returned sorted by tag_data. Returns NULL if no pins are found.
+ *
+ */
+struct profile_pin **find_profile_pins_by_tag(struct profile *profile, 
+        int32_t dut_id, enum profile_tags tag, uint32_t *found_num_pins){
+    struct profile_index *entry = NULL;
+    struct profile_pin **pins = NULL;
+    int32_t id = 0;
+
+    if(profile == NULL){
+        die("pointer is NULL");
     }
 
-    if((pins = create_profile_pins((*found_num_pins))) == NULL){
-        die("error: failed to allocate pins by tag");
+    if(found_num_pins == NULL){
+        die("pointer is NULL");
     }
 
-    int j = 0;
-    for(int i=0; i<profile->num_pins; i++){
-        if(profile->pins[i]->tag == tag){
-            if(j+1 > (*found_num_pins)){
-                die("error: failed to get pins by tag, incorrect num_pins calculated");
-            } else {
-                if(dut_id >= 0){
-                    bool found = false;
-                    for(int k=0; k<profile->pins[i]->num_dests; k++){
-                        if(profile->pins[i]->dest_dut_ids[k] == dut_id){
-                            found = true;
-                            break;
-                        }
-                    }
-                    if(!found){
-                        continue;
-                    }
-                }
-                pins[j] = create_profile_pin_from_pin(profile->pins[i]);
-                j++;
-            }
-        }
+    check_profile_dut_id(profile, dut_id);
+
+    id = get_profile_tag_key(dut_id, tag);
+    HASH_FIND_INT(profile->_pins_by_tag, &id, entry);
+
+    (*found_num_pins) = 0;
+    if(entry != NULL){
+        pins = entry->pins;
+        (*found_num_pins) = entry->num_pins;
     }
-    
+
     // check if correct number of pins are returned for each tag type.
     switch(tag){
         case PROFILE_TAG_NONE:
@@ -682,6 +1262,7 @@ struct profile_pin **get_profile_pins_by_tag(struct profile *profile,
                 die("error: failed to get pins by tag, did not find 32"
                     "%s pins, only %i", get_name_by_tag(tag), (*found_num_pins));
             }
+            // sorts in place, so only the first lookup reorders
             pins = sort_profile_pins_by_tag_data(pins, (*found_num_pins));
         case PROFILE_TAG_GPIO:
             break;
@@ -693,35 +1274,60 @@ struct profile_pin **get_profile_pins_by_tag(struct profile *profile,
 }
 
 /*
- * Return a profile pin given a dut_io id.
+ * Returns an array of retained pins by given tag. Release them with 
+ * free_profile_pins. You can optionally pass a dut_id to filter by dut 
+ * or pass -1 to filter by all pins.
  *
  */
-struct profile_pin *get_profile_pin_by_dut_io_id(struct profile *profile, 
+struct profile_pin **get_profile_pins_by_tag(struct profile *profile, 
+        int32_t dut_id, enum profile_tags tag, uint32_t *found_num_pins){
+    struct profile_pin **found_pins = NULL;
+    struct profile_pin **pins = NULL;
+
+    found_pins = find_profile_pins_by_tag(profile, dut_id, tag, found_num_pins);
+
+    if((pins = create_profile_pins((*found_num_pins))) == NULL){
+        die("error: failed to allocate pins by tag");
+    }
+
+    for(uint32_t i=0; i<(*found_num_pins); i++){
+        pins[i] = retain_profile_pin(found_pins[i]);
+    }
+
+    return pins;
+}
+
+/*
+ * Return a borrowed profile pin given a dut_io id.
+ *
+ */
+struct profile_pin *find_profile_pin_by_dut_io_id(struct profile *profile, 
         uint32_t dut_io_id){
-    struct profile_pin *found_pin = NULL;
+    struct profile_index *entry = NULL;
+    int32_t id = (int32_t)dut_io_id;
 
     if(profile == NULL){
         die("pointer is NULL");
     }
 
-    for(int i=0; i<profile->num_pins; i++){
-        if(profile->pins[i]->dut_io_id == dut_io_id){
-            if(found_pin != NULL){
-                die("found multiple pins for dut_io_id '%d'", dut_io_id);
-            }else{
-                found_pin = create_profile_pin_from_pin(profile->pins[i]);
-            }
-        }
+    HASH_FIND_INT(profile->_pins_by_dut_io_id, &id, entry);
+    if(entry == NULL){
+        return NULL;
     }
-    return found_pin;
+    if(entry->num_pins > 1){
+        die("found multiple pins for dut_io_id '%d'", dut_io_id);
+    }
+    return entry->pins[0];
 }
 
 /*
- * Return a profile pin with a given pin name. Pin names are always unique.
+ * Return a borrowed profile pin with a given pin name. Pin names are 
+ * always unique.
  *
  */
-struct profile_pin *get_profile_pin_by_pin_name(struct profile *profile, char *pin_name){
-    struct profile_pin *found_pin = NULL;
+struct profile_pin *find_profile_pin_by_pin_name(struct profile *profile, 
+        const char *pin_name){
+    struct profile_index *entry = NULL;
 
     if(profile == NULL){
         die("pointer is NULL");
@@ -731,27 +1337,25 @@ struct profile_pin *get_profile_pin_by_pin_name(struct profile *profile, char *p
         die("pointer is NULL");
     }
 
-    for(int i=0; i<profile->num_pins; i++){
-        if(strcmp(profile->pins[i]->pin_name, pin_name) == 0){
-            if(found_pin != NULL){
-                die("found multiple pins for pin_name '%s'", pin_name);
-            }else{
-                found_pin = create_profile_pin_from_pin(profile->pins[i]);
-            }
-        }
+    HASH_FIND_STR(profile->_pins_by_name, pin_name, entry);
+    if(entry == NULL){
+        return NULL;
     }
-    return found_pin;
+    return entry->pins[0];
 }
 
 /*
- * Return a profile pin that connects to a given vendor specific dest pin name.
- * Note that one profile pin can connect to many dest pin names. For example,
- * if we supported 'shorted pin' groups. You can optionally pass a dut_id to 
- * filter by dut or pass -1 to filter by all pins.
+ * Return a borrowed profile pin that connects to a given vendor specific 
+ * dest pin name. Note that one profile pin can connect to many dest pin 
+ * names. For example, if we supported 'shorted pin' groups. You can 
+ * optionally pass a dut_id to filter by dut or pass -1 to filter by all 
+ * pins.
  *
  */
-struct profile_pin *get_profile_pin_by_dest_pin_name(struct profile *profile, int32_t dut_id, char *dest_pin_name){
-    struct profile_pin *found_pin = NULL;
+struct profile_pin *find_profile_pin_by_dest_pin_name(struct profile *profile, 
+        int32_t dut_id, const char *dest_pin_name){
+    struct profile_index *entry = NULL;
+    char *key = NULL;
 
     if(profile == NULL){
         die("pointer is NULL");
@@ -761,39 +1365,31 @@ struct profile_pin *get_profile_pin_by_dest_pin_name(struct profile *profile, in
         die("pointer is NULL");
     }
 
-    if(dut_id < -1){
-        die("invalid dut_id given %i; less than -1", dut_id);
-    }else if(dut_id >= 0 && (dut_id+1) > profile->num_duts){
-        die("invalid dut_id given %i; greater than num duts %i", dut_id, profile->num_duts);
-    }
+    check_profile_dut_id(profile, dut_id);
 
-    for(int i=0; i<profile->num_pins; i++){
-        for(int j=0; j<profile->pins[i]->num_dests; j++){
-            if(dut_id >= 0 && profile->pins[i]->dest_dut_ids[j] != dut_id){
-                continue;
-            }
-            if(strcmp(dest_pin_name, profile->pins[i]->dest_pin_names[j]) == 0){
-                if(found_pin != NULL){
-                    die("dest_pin_name '%s' is driven by multiple pins for profile '%s'", 
-                            dest_pin_name, profile->path);
-                }else{
-                    found_pin = create_profile_pin_from_pin(profile->pins[i]);
-                }
-            }
-        }
+    key = get_profile_dut_key(dut_id, dest_pin_name);
+    HASH_FIND_STR(profile->_pins_by_dest, key, entry);
+    free(key);
+
+    if(entry == NULL){
+        return NULL;
+    }
+    if(entry->num_pins > 1){
+        die("dest_pin_name '%s' is driven by multiple pins for profile '%s'", 
+                dest_pin_name, profile->path);
     }
-    return found_pin;
+    return entry->pins[0];
 }
 
-
 /*
- * Return the profile pin given an ARTIX1/ARTIX2 DUT IO net name.
- * There can only be on profile pin for a dut io name. That pin
- * of course can fanout to multiple dest_dut_pins.
+ * Return the borrowed profile pin given an ARTIX1/ARTIX2 DUT IO net name.
+ * There can only be on profile pin for a dut io name. That pin of course
+ * can fanout to multiple dest_dut_pins.
  *
  */
-struct profile_pin *get_profile_pin_by_net_name(struct profile *profile, char *net_name){
-    struct profile_pin *found_pin = NULL;
+struct profile_pin *find_profile_pin_by_net_name(struct profile *profile, 
+        const char *net_name){
+    struct profile_index *entry = NULL;
 
     if(profile == NULL){
         die("pointer is NULL");
@@ -803,30 +1399,29 @@ struct profile_pin *get_profile_pin_by_net_name(struct profile *profile, char *n
         die("pointer is NULL");
     }
 
-    for(int i=0; i<profile->num_pins; i++){
-        if(strcmp(net_name, profile->pins[i]->net_name) == 0){
-            if(found_pin != NULL){
-                die("multiple net_name '%s' found for profile '%s'", 
-                    net_name, profile->path);
-            }else{
-                found_pin = create_profile_pin_from_pin(profile->pins[i]);
-            }
-        }
+    HASH_FIND_STR(profile->_pins_by_net, net_name, entry);
+    if(entry == NULL){
+        return NULL;
+    }
+    if(entry->num_pins > 1){
+        die("multiple net_name '%s' found for profile '%s'", 
+            net_name, profile->path);
     }
-    return found_pin;
+    return entry->pins[0];
 }
 
-
 /*
- * Get a profile pin by the net alias name. Note that the net alias is unique
- * for a given dut. The net alias name can be used across duts if you have
- * more than one, but again, never more than once within a dut. Pass a -1
- * to search all duts, however, it will error out if it finds more than one
- * dut with the name. 
+ * Get a borrowed profile pin by the net alias name. Note that the net 
+ * alias is unique for a given dut. The net alias name can be used across 
+ * duts if you have more than one, but again, never more than once within 
+ * a dut. Pass a -1 to search all duts, however, it will error out if it 
+ * finds more than one dut with the name. 
  *
  */
-struct profile_pin *get_profile_pin_by_net_alias(struct profile *profile, int32_t dut_id, char *net_alias){
-    struct profile_pin *found_pin = NULL;
+struct profile_pin *find_profile_pin_by_net_alias(struct profile *profile, 
+        int32_t dut_id, const char *net_alias){
+    struct profile_index *entry = NULL;
+    char *key = NULL;
 
     if(profile == NULL){
         die("pointer is NULL");
@@ -836,32 +1431,79 @@ struct profile_pin *get_profile_pin_by_net_alias(struct profile *profile, int32_
         die("pointer is NULL");
     }
 
-    if(dut_id < -1){
-        die("invalid dut_id given %i; less than -1", dut_id);
-    }else if(dut_id >= 0 && (dut_id+1) > profile->num_duts){
-        die("invalid dut_id given %i; greater than num duts %i", dut_id, profile->num_duts);
-    }
+    check_profile_dut_id(profile, dut_id);
 
-    for(int i=0; i<profile->num_pins; i++){
-        if(dut_id >= 0 && profile->pins[i]->dut_io_id != dut_id){
-            continue;
+    key = get_profile_dut_key(dut_id, net_alias);
+    HASH_FIND_STR(profile->_pins_by_alias, key, entry);
+    free(key);
+
+    if(entry == NULL){
+        return NULL;
+    }
+    if(entry->num_pins > 1){
+        if(dut_id == -1){
+            die("Multiple net_alias '%s' found when searching all duts for profile '%s'.\
+                    Pass a dut_id to filter by dut.", 
+                    net_alias, profile->path);
+        }else{
+            die("multiple net_alias '%s' found for dut id '%d' for profile '%s'", 
+                net_alias, dut_id, profile->path);
         }
-        if(strcmp(net_alias, profile->pins[i]->net_alias) == 0){
-            if(found_pin != NULL){
-                if(dut_id == -1){
-                    die("Multiple net_alias '%s' found when searching all duts for profile '%s'.\
-                            Pass a dut_id to filter by dut.", 
-                            net_alias, profile->path);
-                }else{
-                    die("multiple net_alias '%s' found for dut id '%d' for profile '%s'", 
-                        net_alias, dut_id, profile->path);
-                }
-            }else{
-                found_pin = create_profile_pin_from_pin(profile->pins[i]);
-            }
+    }
+    return entry->pins[0];
+}
+
+/*
+ * The get_ variants below return a retained reference to the found pin
+ * which the caller must drop with free_profile_pin.
+ *
+ */
+static inline struct profile_pin *retain_found_profile_pin(struct profile_pin *pin){
+    if(pin == NULL){
+        return NULL;
+    }
+    return retain_profile_pin(pin);
+}
+
+struct profile_pin *get_profile_pin_by_dut_io_id(struct profile *profile, 
+        uint32_t dut_io_id){
+    return retain_found_profile_pin(find_profile_pin_by_dut_io_id(profile, dut_io_id));
+}
+
+struct profile_pin *get_profile_pin_by_pin_name(struct profile *profile, char *pin_name){
+    return retain_found_profile_pin(find_profile_pin_by_pin_name(profile, pin_name));
+}
+
+struct profile_pin *get_profile_pin_by_dest_pin_name(struct profile *profile, int32_t dut_id, char *dest_pin_name){
+    return retain_found_profile_pin(find_profile_pin_by_dest_pin_name(profile, dut_id, dest_pin_name));
+}
+
+struct profile_pin *get_profile_pin_by_net_name(struct profile *profile, char *net_name){
+    return retain_found_profile_pin(find_profile_pin_by_net_name(profile, net_name));
+}
+
+struct profile_pin *get_profile_pin_by_net_alias(struct profile *profile, int32_t dut_id, char *net_alias){
+    return retain_found_profile_pin(find_profile_pin_by_net_alias(profile, dut_id, net_alias));
+}
+
+/*
+ * Returns true if one of the pin's dests is on the dut. A dut_id of -1
+ * matches any dut.
+ *
+ */
+bool is_profile_pin_on_dut(struct profile_pin *pin, int32_t dut_id){
+    if(pin == NULL){
+        die("pointer is null");
+    }
+    if(dut_id < 0){
+        return true;
+    }
+    for(uint32_t i=0; i<pin->num_dests; i++){
+        if(pin->dest_dut_ids[i] == (uint32_t)dut_id){
+            return true;
         }
     }
-    return found_pin;
+    return false;
 }
 
 /*
@@ -17,6 +17,7 @@ extern "C" {
 
 #include "common.h"
 #include "board/driver.h"
+#include "lib/uthash/uthash.h"
 
 // number if xilinx config data pins
 #define PROFILE_NUM_DATA_PINS 32
@@ -24,6 +25,9 @@ extern "C" {
 // max pins from a1 and a2 connectors
 #define PROFILE_MAX_PINS (400)
 
+// compiled profile cache is written next to the json as <path>.cache
+#define PROFILE_CACHE_EXT ".cache"
+
 /*
  * Profile tags are classes that a pin can belong to. 
  *
@@ -63,10 +67,14 @@ enum profile_tags {
  *                  A pin can have many destination loads, if for example 
  *                  it's a 'shorted pin'. 
  *
- *
+ * Pins are reference counted and must be treated as immutable once 
+ * created. Share a pin with retain_profile_pin and drop it with 
+ * free_profile_pin. Retaining a pin owned by a profile also retains 
+ * the profile, so the pin can never outlive it.
  *
  */
 struct profile_pin {
+    // public
     char *pin_name;
     char *comp_name;
     char *net_name;
@@ -77,6 +85,24 @@ struct profile_pin {
     uint32_t num_dests;
     uint32_t *dest_dut_ids;
     char **dest_pin_names;
+
+    // private, changed with atomics since prgms share pins across threads
+    uint32_t _refs;
+    struct profile *_profile;
+};
+
+/*
+ * Lookup index into profile->pins. String indexes are keyed by key and
+ * int indexes by id. More than one pin under a key means the key is
+ * ambiguous, which the getters report.
+ *
+ */
+struct profile_index {
+    char *key;
+    int32_t id;
+    uint32_t num_pins;
+    struct profile_pin **pins;
+    UT_hash_handle hh;
 };
 
 /*
@@ -84,8 +110,12 @@ struct profile_pin {
  * profile represents a connection from each connector pin to one
  * fpga device-under-test. 
  *
+ * Profiles are reference counted. Share one with retain_profile and
+ * drop it with free_profile.
+ *
  */
 struct profile {
+    // public
     char *path;
     char *board_name;
     char *description;
@@ -93,6 +123,22 @@ struct profile {
     struct profile_pin **pins;
     uint32_t num_pins;
     uint32_t num_duts;
+
+    // private, changed with atomics since prgms share pins across threads
+    uint32_t _refs;
+
+    // private, set if loaded from the compiled cache. Pin strings 
+    // point into the map.
+    uint8_t *_map;
+    size_t _map_size;
+
+    // private, built by index_profile
+    struct profile_index *_pins_by_name;
+    struct profile_index *_pins_by_net;
+    struct profile_index *_pins_by_alias;
+    struct profile_index *_pins_by_dest;
+    struct profile_index *_pins_by_dut_io_id;
+    struct profile_index *_pins_by_tag;
 };
 
 /*
@@ -103,6 +149,8 @@ struct profile_pin *create_profile_pin(uint32_t num_dests);
 struct profile_pin *create_profile_pin_from_pin(struct profile_pin *copy_pin);
 struct profile_pin **create_profile_pins(uint32_t num_pins);
 struct profile *create_profile(void);
+struct profile_pin *retain_profile_pin(struct profile_pin *pin);
+struct profile *retain_profile(struct profile *profile);
 struct profile_pin *free_profile_pin(struct profile_pin *pin);
 struct profile_pin **free_profile_pins(
         struct profile_pin **pins, uint32_t num_pins);
@@ -112,6 +160,7 @@ const char *get_name_by_tag(enum profile_tags tag);
 void print_profile(struct profile *profile);
 void print_profile_pin(struct profile_pin *pin);
 struct profile *get_profile_by_path(const char *path);
+void index_profile(struct profile *profile);
 struct profile_pin **sort_profile_pins_by_tag_data(
         struct profile_pin **pins, uint32_t num_pins);
 struct profile_pin **get_profile_pins_by_tag(struct profile *profile, 
@@ -126,6 +175,26 @@ struct profile_pin *get_profile_pin_by_dest_pin_name(struct profile *profile,
         int32_t dut_id, char *dest_pin_name);
 struct profile_pin *get_profile_pin_by_net_alias(struct profile *profile, 
         int32_t dut_id, char *net_alias);
+
+/*
+ * The find_ funcs return pins borrowed from the profile. Don't free
+ * them and don't use them after the profile is freed.
+ *
+ */
+struct profile_pin **find_profile_pins_by_tag(struct profile *profile, 
+        int32_t dut_id, enum profile_tags tag, uint32_t *found_num_pins);
+struct profile_pin *find_profile_pin_by_dut_io_id(struct profile *profile, 
+        uint32_t dut_io_id);
+struct profile_pin *find_profile_pin_by_pin_name(struct profile *profile, 
+        const char *pin_name);
+struct profile_pin *find_profile_pin_by_net_name(struct profile *profile, 
+        const char *net_name);
+struct profile_pin *find_profile_pin_by_dest_pin_name(struct profile *profile, 
+        int32_t dut_id, const char *dest_pin_name);
+struct profile_pin *find_profile_pin_by_net_alias(struct profile *profile, 
+        int32_t dut_id, const char *net_alias);
+
+bool is_profile_pin_on_dut(struct profile_pin *pin, int32_t dut_id);
 enum artix_selects get_artix_select_by_profile_pin(struct profile_pin *pin);
 enum artix_selects get_artix_select_by_profile_pins(
         struct profile_pin **pins, uint32_t num_pins);
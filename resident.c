@@ -0,0 +1,741 @@
+/*
+ * Resident stims
+ *
+ * Copyright (c) 2015-2021 Gemini Complex Corporation. All rights reserved.
+ *
+ */
+
+#include "common.h"
+#include "stim.h"
+#include "tmem.h"
+#include "resident.h"
+#include "util.h"
+#include "board/artix.h"
+#include "board/dev.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+
+#define RESIDENT_READ_SIZE (1024*1024)
+
+/*
+ * Hash of a stim file, memoized so a stim that's loaded again is only
+ * read again if its size or mtime changed.
+ *
+ */
+struct resident_file {
+    char *path;
+    off_t size;
+    int64_t mtime;
+    uint8_t hash[SIZE_OF_SHA_256_HASH];
+    UT_hash_handle hh;
+};
+
+/*
+ * A registered move callback.
+ *
+ */
+struct resident_move_listener {
+    resident_move_cb move_cb;
+    void *move_data;
+    struct resident_move_listener *next;
+};
+
+// taken after the board lock by anything that can touch tester memory
+static pthread_mutex_t resident_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct tmem *resident_a1_mem = NULL;
+static struct tmem *resident_a2_mem = NULL;
+// iterates from least to most recently used
+static struct resident_stim *resident_stims = NULL;
+static struct resident_file *resident_files = NULL;
+static uint64_t resident_num_private_stims = 0;
+static struct resident_move_listener *resident_move_listeners = NULL;
+
+static inline int64_t get_resident_mtime(struct stat *st){
+    return util_get_mtime_ns(st);
+}
+
+static enum artix_selects get_resident_select(struct stim *stim){
+    switch(stim_get_mode(stim)){
+        case STIM_MODE_A1:
+            return ARTIX_SELECT_A1;
+        case STIM_MODE_A2:
+            return ARTIX_SELECT_A2;
+        case STIM_MODE_DUAL:
+            return ARTIX_SELECT_BOTH;
+        default:
+            break;
+    }
+    return ARTIX_SELECT_NONE;
+}
+
+static struct tmem *get_resident_tmem(enum artix_selects artix_select){
+    if(artix_select == ARTIX_SELECT_A1){
+        if(resident_a1_mem == NULL){
+            resident_a1_mem = create_tmem(ARTIX_MEM_ADDR_LIMIT);
+        }
+        return resident_a1_mem;
+    }else if(artix_select == ARTIX_SELECT_A2){
+        if(resident_a2_mem == NULL){
+            resident_a2_mem = create_tmem(ARTIX_MEM_ADDR_LIMIT);
+        }
+        return resident_a2_mem;
+    }
+    die("invalid artix unit selected");
+    return NULL;
+}
+
+static uint64_t get_resident_addr(struct resident_stim *resident,
+        enum artix_selects artix_select){
+    return artix_select == ARTIX_SELECT_A1 ? resident->a1_addr : resident->a2_addr;
+}
+
+/*
+ * Hashes the stim file at path. Returns false if it can't be read.
+ *
+ */
+static bool get_resident_file_hash(const char *path,
+        uint8_t hash[SIZE_OF_SHA_256_HASH]){
+    struct resident_file *file = NULL;
+    struct Sha_256 sha_256;
+    struct stat st;
+    uint8_t *buffer = NULL;
+    ssize_t num_read = 0;
+    int fd = -1;
+
+    if(stat(path, &st) != 0){
+        return false;
+    }
+
+    HASH_FIND_STR(resident_files, path, file);
+    if(file != NULL && file->size == st.st_size &&
+            file->mtime == get_resident_mtime(&st)){
+        memcpy(hash, file->hash, SIZE_OF_SHA_256_HASH);
+        return true;
+    }
+
+    if((fd = open(path, O_RDONLY)) == -1){
+        return false;
+    }
+    if((buffer = (uint8_t*)malloc(RESIDENT_READ_SIZE)) == NULL){
+        die("error: malloc failed");
+    }
+
+    sha_256_init(&sha_256, hash);
+    while((num_read = read(fd, buffer, RESIDENT_READ_SIZE)) != 0){
+        if(num_read < 0){
+            if(errno == EINTR){
+                continue;
+            }
+            free(buffer);
+            close(fd);
+            return false;
+        }
+        sha_256_write(&sha_256, buffer, (size_t)num_read);
+    }
+    sha_256_close(&sha_256);
+    free(buffer);
+    close(fd);
+
+    if(file == NULL){
+        if((file = (struct resident_file*)calloc(1, sizeof(struct resident_file))) == NULL){
+            die("error: calloc failed");
+        }
+        if((file->path = strdup(path)) == NULL){
+            die("error: strdup failed");
+        }
+        HASH_ADD_KEYPTR(hh, resident_files, file->path, strlen(file->path), file);
+    }
+    file->size = st.st_size;
+    file->mtime = get_resident_mtime(&st);
+    memcpy(file->hash, hash, SIZE_OF_SHA_256_HASH);
+
+    return true;
+}
+
+/*
+ * The vectors a stim puts in tester memory depend on its file and on
+ * which dut io each of its pins maps to in the profile, so both go into
+ * the hash. Returns false if the stim has no file to hash.
+ *
+ */
+static bool get_resident_stim_hash(struct stim *stim,
+        uint8_t hash[SIZE_OF_SHA_256_HASH]){
+    uint8_t file_hash[SIZE_OF_SHA_256_HASH];
+    struct Sha_256 sha_256;
+    struct profile_pin *pin = NULL;
+    int32_t type = 0;
+
+    if(stim->path == NULL || stim->dots != NULL){
+        return false;
+    }
+    stim_load_lazy(stim);
+    if(!get_resident_file_hash(stim->path, file_hash)){
+        return false;
+    }
+
+    type = (int32_t)stim->type;
+
+    sha_256_init(&sha_256, hash);
+    sha_256_write(&sha_256, file_hash, SIZE_OF_SHA_256_HASH);
+    sha_256_write(&sha_256, &type, sizeof(int32_t));
+    sha_256_write(&sha_256, &stim->num_vecs, sizeof(uint32_t));
+    sha_256_write(&sha_256, &stim->num_unrolled_vecs, sizeof(uint64_t));
+    for(uint16_t i=0; i<stim->num_pins; i++){
+        pin = stim->pins[i];
+        sha_256_write(&sha_256, &pin->dut_io_id, sizeof(int32_t));
+        if(pin->net_name != NULL){
+            sha_256_write(&sha_256, pin->net_name, strlen(pin->net_name)+1);
+        }
+    }
+    sha_256_close(&sha_256);
+
+    return true;
+}
+
+/*
+ * Moves the resident stim to the most recently used end.
+ *
+ */
+static void touch_resident_stim(struct resident_stim *resident){
+    HASH_DELETE(hh, resident_stims, resident);
+    HASH_ADD(hh, resident_stims, hash, SIZE_OF_SHA_256_HASH, resident);
+    return;
+}
+
+static void free_resident_stim(struct resident_stim *resident){
+    if(resident->path != NULL){
+        free(resident->path);
+    }
+    free(resident);
+    return;
+}
+
+/*
+ * Gives back the stim's tester memory and takes it out of the resident
+ * stims.
+ *
+ */
+static void drop_resident_stim(struct resident_stim *resident){
+    if(resident->artix_select & ARTIX_SELECT_A1){
+        if(!tmem_release(get_resident_tmem(ARTIX_SELECT_A1), resident->a1_addr)){
+            die("no tester memory allocated at a1 address 0x%08" PRIX64 "", resident->a1_addr);
+        }
+    }
+    if(resident->artix_select & ARTIX_SELECT_A2){
+        if(!tmem_release(get_resident_tmem(ARTIX_SELECT_A2), resident->a2_addr)){
+            die("no tester memory allocated at a2 address 0x%08" PRIX64 "", resident->a2_addr);
+        }
+    }
+
+    HASH_DELETE(hh, resident_stims, resident);
+    return;
+}
+
+static void evict_resident_stim(struct resident_stim *resident){
+    if(resident->_refs > 0){
+        die("can't evict resident stim '%s' because it's in use", resident->path);
+    }
+
+    slog_debug("evicting resident stim '%s'", resident->path);
+
+    drop_resident_stim(resident);
+    free_resident_stim(resident);
+    return;
+}
+
+/*
+ * Returns the least recently used stim not in use that's loaded in the
+ * unit, or NULL if there's none.
+ *
+ */
+static struct resident_stim *get_lru_resident_stim(enum artix_selects artix_select){
+    struct resident_stim *resident = NULL;
+    struct resident_stim *tmp = NULL;
+
+    HASH_ITER(hh, resident_stims, resident, tmp){
+        if(resident->_refs == 0 && (resident->artix_select & artix_select)){
+            return resident;
+        }
+    }
+    return NULL;
+}
+
+static uint32_t compact_resident_mem(enum artix_selects artix_select){
+    struct resident_move_listener *listener = NULL;
+    struct tmem_move *moves = NULL;
+    struct resident_stim *resident = NULL;
+    struct resident_stim *tmp = NULL;
+    struct resident_stim *moved = NULL;
+    uint32_t num_moves = 0;
+
+    num_moves = tmem_compact(get_resident_tmem(artix_select), &moves);
+
+    for(uint32_t i=0; i<num_moves; i++){
+        moved = NULL;
+        HASH_ITER(hh, resident_stims, resident, tmp){
+            if((resident->artix_select & artix_select) &&
+                    get_resident_addr(resident, artix_select) == moves[i].old_addr){
+                moved = resident;
+                break;
+            }
+        }
+        if(moved == NULL){
+            die("no resident stim at moved addr 0x%016" PRIX64 "", moves[i].old_addr);
+        }
+
+        artix_mem_copy(artix_select, moves[i].new_addr, moves[i].old_addr, moves[i].size);
+
+        if(artix_select == ARTIX_SELECT_A1){
+            moved->a1_addr = moves[i].new_addr;
+        }else{
+            moved->a2_addr = moves[i].new_addr;
+        }
+        for(listener=resident_move_listeners; listener!=NULL; listener=listener->next){
+            listener->move_cb(moved, artix_select, moves[i].old_addr, 
+                moves[i].new_addr, listener->move_data);
+        }
+    }
+
+    if(moves != NULL){
+        free(moves);
+    }
+    return num_moves;
+}
+
+/*
+ * Allocates tester memory in a unit. If no free extent is big enough
+ * but the unit has enough free bytes it's compacted, otherwise the
+ * least recently used stim not in use is evicted and it tries again.
+ *
+ */
+static bool alloc_resident_mem(enum artix_selects artix_select, uint64_t size,
+        uint64_t *addr){
+    struct tmem *tmem = get_resident_tmem(artix_select);
+    struct resident_stim *lru = NULL;
+
+    while(true){
+        if(tmem_alloc(tmem, size, addr)){
+            return true;
+        }
+
+        if(tmem->num_free_bytes >= tmem_get_alloc_size(size)){
+            slog_info("tester memory is fragmented, compacting...");
+            compact_resident_mem(artix_select);
+            return tmem_alloc(tmem, size, addr);
+        }
+
+        if((lru = get_lru_resident_stim(artix_select)) == NULL){
+            return false;
+        }
+        evict_resident_stim(lru);
+    }
+    return false;
+}
+
+/*
+ * Allocates tester memory in a unit at addr, evicting the stims not in
+ * use that overlap it.
+ *
+ */
+static bool reserve_resident_mem(enum artix_selects artix_select,
+        uint64_t addr, uint64_t size){
+    struct resident_stim *resident = NULL;
+    struct resident_stim *tmp = NULL;
+    uint64_t end_addr = addr + tmem_get_alloc_size(size);
+    uint64_t resident_addr = 0;
+
+    HASH_ITER(hh, resident_stims, resident, tmp){
+        if(!(resident->artix_select & artix_select)){
+            continue;
+        }
+        resident_addr = get_resident_addr(resident, artix_select);
+        if(resident_addr >= end_addr || resident_addr + resident->size <= addr){
+            continue;
+        }
+        if(resident->_refs > 0){
+            return false;
+        }
+        evict_resident_stim(resident);
+    }
+
+    return tmem_reserve(get_resident_tmem(artix_select), addr, size);
+}
+
+/*
+ * Records the stim loaded at the given addrs as resident. Stims that
+ * can't be hashed, or have the same content as a stim already resident,
+ * get a private key and are never shared.
+ *
+ */
+static struct resident_stim *add_resident_stim(struct stim *stim,
+        enum artix_selects artix_select, uint64_t a1_addr, uint64_t a2_addr){
+    struct resident_stim *resident = NULL;
+    struct resident_stim *found = NULL;
+
+    if((resident = (struct resident_stim*)calloc(1, sizeof(struct resident_stim))) == NULL){
+        die("error: calloc failed");
+    }
+
+    resident->_is_shared = get_resident_stim_hash(stim, resident->hash);
+    if(resident->_is_shared){
+        HASH_FIND(hh, resident_stims, resident->hash, SIZE_OF_SHA_256_HASH, found);
+        resident->_is_shared = (found == NULL);
+    }
+    if(!resident->_is_shared){
+        memset(resident->hash, 0, SIZE_OF_SHA_256_HASH);
+        resident_num_private_stims += 1;
+        memcpy(resident->hash, &resident_num_private_stims, sizeof(uint64_t));
+    }
+
+    if(stim->path != NULL){
+        if((resident->path = strdup(stim->path)) == NULL){
+            die("error: strdup failed");
+        }
+    }
+    resident->artix_select = artix_select;
+    resident->a1_addr = a1_addr;
+    resident->a2_addr = a2_addr;
+    resident->size = resident_get_stim_size(stim);
+    resident->_refs = 1;
+
+    HASH_ADD(hh, resident_stims, hash, SIZE_OF_SHA_256_HASH, resident);
+
+    return resident;
+}
+
+/*
+ * Bytes of tester memory the stim takes in each unit it's loaded in.
+ *
+ */
+uint64_t resident_get_stim_size(struct stim *stim){
+    if(stim == NULL){
+        die("pointer is NULL");
+    }
+    return ((uint64_t)stim->num_vecs+(uint64_t)stim->num_padding_vecs)*(uint64_t)STIM_VEC_SIZE;
+}
+
+/*
+ * Returns the board's tester memory allocator for the unit.
+ *
+ */
+struct tmem *resident_get_tmem(enum artix_selects artix_select){
+    struct tmem *tmem = NULL;
+
+    pthread_mutex_lock(&resident_lock);
+    tmem = get_resident_tmem(artix_select);
+    pthread_mutex_unlock(&resident_lock);
+
+    return tmem;
+}
+
+/*
+ * Registers a callback called for every resident stim moved by any
+ * compaction. Stims in use can be moved, so everything that keeps the
+ * addr of a resident stim must register one.
+ *
+ */
+void resident_add_move_cb(resident_move_cb move_cb, void *move_data){
+    struct resident_move_listener *listener = NULL;
+
+    if(move_cb == NULL){
+        die("pointer is NULL");
+    }
+    if((listener = (struct resident_move_listener*)calloc(1, sizeof(struct resident_move_listener))) == NULL){
+        die("error: calloc failed");
+    }
+    listener->move_cb = move_cb;
+    listener->move_data = move_data;
+
+    pthread_mutex_lock(&resident_lock);
+    listener->next = resident_move_listeners;
+    resident_move_listeners = listener;
+    pthread_mutex_unlock(&resident_lock);
+    return;
+}
+
+void resident_remove_move_cb(resident_move_cb move_cb, void *move_data){
+    struct resident_move_listener **listener = NULL;
+    struct resident_move_listener *found = NULL;
+
+    pthread_mutex_lock(&resident_lock);
+    for(listener=&resident_move_listeners; (*listener)!=NULL; listener=&(*listener)->next){
+        if((*listener)->move_cb == move_cb && (*listener)->move_data == move_data){
+            found = (*listener);
+            (*listener) = found->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&resident_lock);
+
+    if(found == NULL){
+        die("move callback isn't registered");
+    }
+    free(found);
+    return;
+}
+
+/*
+ * Looks for a resident stim with the same content as the stim. If one
+ * is found it's marked as used and retained, and the stim doesn't need
+ * to be loaded again.
+ *
+ */
+struct resident_stim *resident_acquire_stim(struct stim *stim){
+    uint8_t hash[SIZE_OF_SHA_256_HASH];
+    struct resident_stim *resident = NULL;
+
+    if(stim == NULL){
+        die("pointer is NULL");
+    }
+
+    pthread_mutex_lock(&resident_lock);
+    if(get_resident_stim_hash(stim, hash)){
+        HASH_FIND(hh, resident_stims, hash, SIZE_OF_SHA_256_HASH, resident);
+    }
+    if(resident != NULL && resident->_is_shared &&
+            resident->artix_select == get_resident_select(stim)){
+        resident->_refs += 1;
+        touch_resident_stim(resident);
+    }else{
+        resident = NULL;
+    }
+    pthread_mutex_unlock(&resident_lock);
+
+    return resident;
+}
+
+/*
+ * Drops a reference to the resident stim. It stays in tester memory
+ * until it's evicted.
+ *
+ */
+void resident_release_stim(struct resident_stim *resident){
+    if(resident == NULL){
+        die("pointer is NULL");
+    }
+
+    pthread_mutex_lock(&resident_lock);
+    if(resident->_refs == 0){
+        die("resident stim '%s' released too many times", resident->path);
+    }
+    resident->_refs -= 1;
+    if(resident->_refs == 0 && resident->_is_overwritten){
+        free_resident_stim(resident);
+    }else if(resident->_refs == 0 && !resident->_is_shared){
+        evict_resident_stim(resident);
+    }
+    pthread_mutex_unlock(&resident_lock);
+    return;
+}
+
+/*
+ * Returns false if tester memory was overwritten since the stim was
+ * loaded, see resident_evict_all.
+ *
+ */
+bool resident_is_valid(struct resident_stim *resident){
+    bool is_valid = false;
+
+    if(resident == NULL){
+        die("pointer is NULL");
+    }
+
+    pthread_mutex_lock(&resident_lock);
+    is_valid = !resident->_is_overwritten;
+    pthread_mutex_unlock(&resident_lock);
+
+    return is_valid;
+}
+
+/*
+ * Allocates tester memory for the stim in the units it uses and loads
+ * it. Stims not in use are evicted, least recently used first, until
+ * it fits. If a unit has to be compacted the registered move callbacks
+ * are called for every resident stim moved.
+ *
+ */
+struct resident_stim *resident_load_stim(struct stim *stim){
+    struct resident_stim *resident = NULL;
+    enum artix_selects artix_select = ARTIX_SELECT_NONE;
+    uint64_t a1_addr = 0;
+    uint64_t a2_addr = 0;
+    uint64_t size = 0;
+
+    if(stim == NULL){
+        die("pointer is NULL");
+    }
+    if((artix_select = get_resident_select(stim)) == ARTIX_SELECT_NONE){
+        die("can't load empty stim");
+    }
+    size = resident_get_stim_size(stim);
+
+    gcore_dev_lock();
+    pthread_mutex_lock(&resident_lock);
+
+    if(artix_select & ARTIX_SELECT_A1){
+        if(!alloc_resident_mem(ARTIX_SELECT_A1, size, &a1_addr)){
+            pthread_mutex_unlock(&resident_lock);
+            gcore_dev_unlock();
+            return NULL;
+        }
+    }
+    if(artix_select & ARTIX_SELECT_A2){
+        if(!alloc_resident_mem(ARTIX_SELECT_A2, size, &a2_addr)){
+            if(artix_select & ARTIX_SELECT_A1){
+                tmem_release(get_resident_tmem(ARTIX_SELECT_A1), a1_addr);
+            }
+            pthread_mutex_unlock(&resident_lock);
+            gcore_dev_unlock();
+            return NULL;
+        }
+    }
+
+    artix_load_stim(stim, a1_addr, a2_addr);
+    resident = add_resident_stim(stim, artix_select, a1_addr, a2_addr);
+
+    pthread_mutex_unlock(&resident_lock);
+    gcore_dev_unlock();
+
+    return resident;
+}
+
+/*
+ * Loads the stim at the given addrs, evicting the stims not in use it
+ * overlaps.
+ *
+ */
+struct resident_stim *resident_load_stim_at(struct stim *stim,
+        uint64_t a1_addr, uint64_t a2_addr){
+    struct resident_stim *resident = NULL;
+    enum artix_selects artix_select = ARTIX_SELECT_NONE;
+    uint64_t size = 0;
+
+    if(stim == NULL){
+        die("pointer is NULL");
+    }
+    if((artix_select = get_resident_select(stim)) == ARTIX_SELECT_NONE){
+        die("can't load empty stim");
+    }
+    size = resident_get_stim_size(stim);
+
+    gcore_dev_lock();
+    pthread_mutex_lock(&resident_lock);
+
+    if(artix_select & ARTIX_SELECT_A1){
+        if(!reserve_resident_mem(ARTIX_SELECT_A1, a1_addr, size)){
+            pthread_mutex_unlock(&resident_lock);
+            gcore_dev_unlock();
+            return NULL;
+        }
+    }
+    if(artix_select & ARTIX_SELECT_A2){
+        if(!reserve_resident_mem(ARTIX_SELECT_A2, a2_addr, size)){
+            if(artix_select & ARTIX_SELECT_A1){
+                tmem_release(get_resident_tmem(ARTIX_SELECT_A1), a1_addr);
+            }
+            pthread_mutex_unlock(&resident_lock);
+            gcore_dev_unlock();
+            return NULL;
+        }
+    }
+
+    artix_load_stim(stim, a1_addr, a2_addr);
+    resident = add_resident_stim(stim, artix_select, a1_addr, a2_addr);
+
+    pthread_mutex_unlock(&resident_lock);
+    gcore_dev_unlock();
+
+    return resident;
+}
+
+/*
+ * Compacts a unit's tester memory, moving the resident stims down so
+ * the free memory is in one piece. The registered move callbacks are
+ * called for every stim moved. Returns the number of stims moved.
+ *
+ */
+uint32_t resident_compact(enum artix_selects artix_select){
+    uint32_t num_moves = 0;
+
+    gcore_dev_lock();
+    pthread_mutex_lock(&resident_lock);
+    num_moves = compact_resident_mem(artix_select);
+    pthread_mutex_unlock(&resident_lock);
+    gcore_dev_unlock();
+
+    return num_moves;
+}
+
+/*
+ * Drops every resident stim before tester memory gets overwritten.
+ * Stims in use are marked overwritten, so their holders fail cleanly
+ * when they run them instead of running whatever is there now. Returns
+ * the number of stims dropped.
+ *
+ */
+uint32_t resident_evict_all(void){
+    struct resident_stim *resident = NULL;
+    struct resident_stim *tmp = NULL;
+    uint32_t num_evicted = 0;
+
+    pthread_mutex_lock(&resident_lock);
+    HASH_ITER(hh, resident_stims, resident, tmp){
+        if(resident->_refs == 0){
+            evict_resident_stim(resident);
+        }else{
+            slog_warn("resident stim '%s' is in use and will be overwritten, "
+                "it must be loaded again", resident->path);
+            drop_resident_stim(resident);
+            resident->_is_overwritten = true;
+        }
+        num_evicted += 1;
+    }
+    pthread_mutex_unlock(&resident_lock);
+
+    return num_evicted;
+}
+
+/*
+ * Returns the number of resident stims held by a prgm.
+ *
+ */
+uint32_t resident_get_num_in_use(void){
+    struct resident_stim *resident = NULL;
+    struct resident_stim *tmp = NULL;
+    uint32_t num_in_use = 0;
+
+    pthread_mutex_lock(&resident_lock);
+    HASH_ITER(hh, resident_stims, resident, tmp){
+        if(resident->_refs > 0){
+            num_in_use += 1;
+        }
+    }
+    pthread_mutex_unlock(&resident_lock);
+
+    return num_in_use;
+}
+
+void resident_print(void){
+    struct resident_stim *resident = NULL;
+    struct resident_stim *tmp = NULL;
+
+    pthread_mutex_lock(&resident_lock);
+    printf("resident stims: %u\n", HASH_COUNT(resident_stims));
+    HASH_ITER(hh, resident_stims, resident, tmp){
+        printf("  a1 0x%08" PRIX64 " a2 0x%08" PRIX64 " %12" PRIu64 " refs %u %s\n",
+            resident->a1_addr, resident->a2_addr, resident->size, resident->_refs,
+            resident->path == NULL ? "(none)" : resident->path);
+    }
+    pthread_mutex_unlock(&resident_lock);
+    return;
+}
@@ -0,0 +1,108 @@
+/*
+ * Resident stims
+ *
+ * Copyright (c) 2015-2021 Gemini Complex Corporation. All rights reserved.
+ *
+ */
+
+#ifndef RESIDENT_H
+#define RESIDENT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "common.h"
+#include "stim.h"
+#include "tmem.h"
+#include "board/driver.h"
+#include "lib/sha2/sha-256.h"
+#include "lib/uthash/uthash.h"
+
+/*
+ * A stim sitting in tester memory. Resident stims belong to the board,
+ * not to a prgm, so a stim loaded by one prgm is still there for the
+ * next prgm run by the process.
+ *
+ * hash         : Content hash of the stim file and the profile pins it
+ *                was built with. Two stims with the same hash have the
+ *                same vectors in tester memory.
+ * path         : Path the stim was loaded from, for logging.
+ * artix_select : Units the stim is loaded in.
+ * size         : Bytes of tester memory it takes in each unit.
+ *
+ * A resident stim is in use while a prgm has it loaded. Once every prgm
+ * released it, it stays in tester memory until it's evicted to make
+ * room for another stim, least recently used first.
+ *
+ */
+struct resident_stim {
+    // public
+    uint8_t hash[SIZE_OF_SHA_256_HASH];
+    char *path;
+    enum artix_selects artix_select;
+    uint64_t a1_addr;
+    uint64_t a2_addr;
+    uint64_t size;
+
+    // private
+    uint32_t _refs;
+    // false if the stim has no file to hash. It's never shared and is
+    // evicted as soon as it's released.
+    bool _is_shared;
+    // set when tester memory was overwritten while the stim was in use.
+    // It's no longer resident and is freed when the last holder
+    // releases it.
+    bool _is_overwritten;
+    UT_hash_handle hh;
+};
+
+/*
+ * Called for every resident stim moved by compaction, so a holder can
+ * follow its own records of the addr. Every registered callback is
+ * called for every move, whoever started the compaction.
+ *
+ */
+typedef void (*resident_move_cb)(struct resident_stim *resident,
+    enum artix_selects artix_select, uint64_t old_addr, uint64_t new_addr,
+    void *data);
+
+uint64_t resident_get_stim_size(struct stim *stim);
+struct tmem *resident_get_tmem(enum artix_selects artix_select);
+
+// holders of resident stims register a move callback before loading
+void resident_add_move_cb(resident_move_cb move_cb, void *move_data);
+void resident_remove_move_cb(resident_move_cb move_cb, void *move_data);
+
+// returns the resident stim with the same content retained, or NULL
+// if there's none
+struct resident_stim *resident_acquire_stim(struct stim *stim);
+void resident_release_stim(struct resident_stim *resident);
+
+// loads the stim into tester memory and returns it retained, NULL if it
+// doesn't fit even after evicting every stim not in use
+struct resident_stim *resident_load_stim(struct stim *stim);
+// same but at the given addrs, NULL if unaligned, out of bounds or
+// overlapping a stim in use
+struct resident_stim *resident_load_stim_at(struct stim *stim,
+    uint64_t a1_addr, uint64_t a2_addr);
+
+// false if tester memory was overwritten since the stim was loaded
+bool resident_is_valid(struct resident_stim *resident);
+
+uint32_t resident_compact(enum artix_selects artix_select);
+// drops every stim, for when tester memory gets overwritten. Stims in
+// use are marked overwritten and can't be run until loaded again.
+uint32_t resident_evict_all(void);
+uint32_t resident_get_num_in_use(void);
+void resident_print(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
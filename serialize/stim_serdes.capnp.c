@@ -165,3 +165,48 @@ void set_SerialStim(const struct SerialStim *s, SerialStim_list l, int i) {
     p.p = capn_getp(l.p, i, 0);
     write_SerialStim(s, p);
 }
+
+SerialProfile_ptr new_SerialProfile(struct capn_segment *s) {
+    SerialProfile_ptr p;
+    p.p = capn_new_struct(s, 32, 4);
+    return p;
+}
+SerialProfile_list new_SerialProfile_list(struct capn_segment *s, int len) {
+    SerialProfile_list p;
+    p.p = capn_new_list(s, len, 32, 4);
+    return p;
+}
+void read_SerialProfile(struct SerialProfile *s, SerialProfile_ptr p) {
+    capn_resolve(&p.p);
+    s->sourceMtime = (int64_t) capn_read64(p.p, 0);
+    s->sourceSize = capn_read64(p.p, 8);
+    s->sourceHash = capn_get_data(p.p, 0);
+    s->boardName = capn_get_text(p.p, 1, capn_val0);
+    s->description = capn_get_text(p.p, 2, capn_val0);
+    s->revision = capn_read32(p.p, 16);
+    s->numDuts = capn_read32(p.p, 20);
+    s->numPins = capn_read32(p.p, 24);
+    s->pins.p = capn_getp(p.p, 3, 0);
+}
+void write_SerialProfile(const struct SerialProfile *s, SerialProfile_ptr p) {
+    capn_resolve(&p.p);
+    capn_write64(p.p, 0, (uint64_t) s->sourceMtime);
+    capn_write64(p.p, 8, s->sourceSize);
+    capn_setp(p.p, 0, s->sourceHash.p);
+    capn_set_text(p.p, 1, s->boardName);
+    capn_set_text(p.p, 2, s->description);
+    capn_write32(p.p, 16, s->revision);
+    capn_write32(p.p, 20, s->numDuts);
+    capn_write32(p.p, 24, s->numPins);
+    capn_setp(p.p, 3, s->pins.p);
+}
+void get_SerialProfile(struct SerialProfile *s, SerialProfile_list l, int i) {
+    SerialProfile_ptr p;
+    p.p = capn_getp(l.p, i, 0);
+    read_SerialProfile(s, p);
+}
+void set_SerialProfile(const struct SerialProfile *s, SerialProfile_list l, int i) {
+    SerialProfile_ptr p;
+    p.p = capn_getp(l.p, i, 0);
+    write_SerialProfile(s, p);
+}
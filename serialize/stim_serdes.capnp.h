@@ -16,16 +16,19 @@ struct String;
 struct ProfilePin;
 struct VecChunk;
 struct SerialStim;
+struct SerialProfile;
 
 typedef struct {capn_ptr p;} String_ptr;
 typedef struct {capn_ptr p;} ProfilePin_ptr;
 typedef struct {capn_ptr p;} VecChunk_ptr;
 typedef struct {capn_ptr p;} SerialStim_ptr;
+typedef struct {capn_ptr p;} SerialProfile_ptr;
 
 typedef struct {capn_ptr p;} String_list;
 typedef struct {capn_ptr p;} ProfilePin_list;
 typedef struct {capn_ptr p;} VecChunk_list;
 typedef struct {capn_ptr p;} SerialStim_list;
+typedef struct {capn_ptr p;} SerialProfile_list;
 
 enum ProfilePin_ProfileTags {
     ProfilePin_ProfileTags_profileTagNone = 0,
@@ -95,35 +98,53 @@ struct SerialStim {
     VecChunk_list a2VecChunks;
 };
 
+struct SerialProfile {
+    int64_t sourceMtime;
+    uint64_t sourceSize;
+    capn_data sourceHash;
+    capn_text boardName;
+    capn_text description;
+    uint32_t revision;
+    uint32_t numDuts;
+    uint32_t numPins;
+    ProfilePin_list pins;
+};
+
 String_ptr new_String(struct capn_segment*);
 ProfilePin_ptr new_ProfilePin(struct capn_segment*);
 VecChunk_ptr new_VecChunk(struct capn_segment*);
 SerialStim_ptr new_SerialStim(struct capn_segment*);
+SerialProfile_ptr new_SerialProfile(struct capn_segment*);
 
 String_list new_String_list(struct capn_segment*, int len);
 ProfilePin_list new_ProfilePin_list(struct capn_segment*, int len);
 VecChunk_list new_VecChunk_list(struct capn_segment*, int len);
 SerialStim_list new_SerialStim_list(struct capn_segment*, int len);
+SerialProfile_list new_SerialProfile_list(struct capn_segment*, int len);
 
 void read_String(struct String*, String_ptr);
 void read_ProfilePin(struct ProfilePin*, ProfilePin_ptr);
 void read_VecChunk(struct VecChunk*, VecChunk_ptr);
 void read_SerialStim(struct SerialStim*, SerialStim_ptr);
+void read_SerialProfile(struct SerialProfile*, SerialProfile_ptr);
 
 void write_String(const struct String*, String_ptr);
 void write_ProfilePin(const struct ProfilePin*, ProfilePin_ptr);
 void write_VecChunk(const struct VecChunk*, VecChunk_ptr);
 void write_SerialStim(const struct SerialStim*, SerialStim_ptr);
+void write_SerialProfile(const struct SerialProfile*, SerialProfile_ptr);
 
 void get_String(struct String*, String_list, int i);
 void get_ProfilePin(struct ProfilePin*, ProfilePin_list, int i);
 void get_VecChunk(struct VecChunk*, VecChunk_list, int i);
 void get_SerialStim(struct SerialStim*, SerialStim_list, int i);
+void get_SerialProfile(struct SerialProfile*, SerialProfile_list, int i);
 
 void set_String(const struct String*, String_list, int i);
 void set_ProfilePin(const struct ProfilePin*, ProfilePin_list, int i);
 void set_VecChunk(const struct VecChunk*, VecChunk_list, int i);
 void set_SerialStim(const struct SerialStim*, SerialStim_list, int i);
+void set_SerialProfile(const struct SerialProfile*, SerialProfile_list, int i);
 
 #ifdef __cplusplus
 }
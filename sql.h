@@ -76,7 +76,8 @@ const char *DB_SQL = ""
     "       path TEXT,\n"
     "       did_fail INTEGER,\n"
     "       failing_vec INTEGER,\n"
-    "       state INTEGER\n"
+    "       state INTEGER,\n"
+    "       site INTEGER DEFAULT -1\n"
     "   );\n"
     "   CREATE TABLE IF NOT EXISTS fail_pins (\n"
     "       id INTEGER PRIMARY KEY,\n"
@@ -84,6 +85,12 @@ const char *DB_SQL = ""
     "       dut_io_id INTEGER,\n"
     "       did_fail INTEGER\n"
     "   );\n"
+    "   CREATE TABLE IF NOT EXISTS fail_logs (\n"
+    "       id INTEGER PRIMARY KEY,\n"
+    "       stim_id INTEGER,\n"
+    "       test_cycle INTEGER,\n"
+    "       dut_io_id INTEGER\n"
+    "   );\n"
     "   CREATE TABLE IF NOT EXISTS mounts (\n"
     "       id INTEGER PRIMARY KEY,\n"
     "       date_created DATETIME CURRENT_TIMESTAMP,\n"
@@ -93,9 +100,58 @@ const char *DB_SQL = ""
     "       local_point TEXT,\n"
     "       message TEXT,\n"
     "       state INTEGER\n"
-    "   );\n";
+    "   );\n"
+    "   CREATE TABLE IF NOT EXISTS events (\n"
+    "       id INTEGER PRIMARY KEY AUTOINCREMENT,\n"
+    "       date_created DATETIME CURRENT_TIMESTAMP,\n"
+    "       table_name TEXT,\n"
+    "       row_id INTEGER,\n"
+    "       old_state INTEGER,\n"
+    "       new_state INTEGER\n"
+    "   );\n"
+    "   CREATE TRIGGER IF NOT EXISTS jobs_insert_event AFTER INSERT ON jobs\n"
+    "   BEGIN\n"
+    "       INSERT INTO events(date_created, table_name, row_id, old_state, new_state)\n"
+    "       VALUES(datetime('now'), 'jobs', NEW.id, 0, NEW.state);\n"
+    "   END;\n"
+    "   CREATE TRIGGER IF NOT EXISTS jobs_state_event AFTER UPDATE OF state ON jobs\n"
+    "   WHEN OLD.state IS NOT NEW.state\n"
+    "   BEGIN\n"
+    "       INSERT INTO events(date_created, table_name, row_id, old_state, new_state)\n"
+    "       VALUES(datetime('now'), 'jobs', NEW.id, OLD.state, NEW.state);\n"
+    "   END;\n"
+    "   CREATE TRIGGER IF NOT EXISTS prgms_insert_event AFTER INSERT ON prgms\n"
+    "   BEGIN\n"
+    "       INSERT INTO events(date_created, table_name, row_id, old_state, new_state)\n"
+    "       VALUES(datetime('now'), 'prgms', NEW.id, 0, NEW.state);\n"
+    "   END;\n"
+    "   CREATE TRIGGER IF NOT EXISTS prgms_state_event AFTER UPDATE OF state ON prgms\n"
+    "   WHEN OLD.state IS NOT NEW.state\n"
+    "   BEGIN\n"
+    "       INSERT INTO events(date_created, table_name, row_id, old_state, new_state)\n"
+    "       VALUES(datetime('now'), 'prgms', NEW.id, OLD.state, NEW.state);\n"
+    "   END;\n"
+    "   CREATE TRIGGER IF NOT EXISTS stims_insert_event AFTER INSERT ON stims\n"
+    "   BEGIN\n"
+    "       INSERT INTO events(date_created, table_name, row_id, old_state, new_state)\n"
+    "       VALUES(datetime('now'), 'stims', NEW.id, 0, NEW.state);\n"
+    "   END;\n"
+    "   CREATE TRIGGER IF NOT EXISTS stims_state_event AFTER UPDATE OF state ON stims\n"
+    "   WHEN OLD.state IS NOT NEW.state\n"
+    "   BEGIN\n"
+    "       INSERT INTO events(date_created, table_name, row_id, old_state, new_state)\n"
+    "       VALUES(datetime('now'), 'stims', NEW.id, OLD.state, NEW.state);\n"
+    "   END;\n";
+
 
 
+/*
+ * Columns added after a table was first created. Each is only applied if
+ * the check select fails on an existing db.
+ *
+ */
+const char *DB_SQL_STIMS_SITE_CHECK = "SELECT site FROM stims LIMIT 0";
+const char *DB_SQL_STIMS_SITE_ADD = "ALTER TABLE stims ADD COLUMN site INTEGER DEFAULT -1";
 
 #ifdef __cplusplus
 }
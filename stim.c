@@ -26,6 +26,7 @@
 #include "dots.h"
 #include "profile.h"
 #include "config.h"
+#include "perf.h"
 #include "serialize/stim_serdes.capnp.h"
 #include "lib/capnp/capnp_c.h"
 #include "lib/lz4/lz4.h"
@@ -341,6 +342,35 @@ struct vec_chunk *create_vec_chunk(uint8_t vec_chunk_id,
     return chunk;
 }
 
+/*
+ * Number of chunks a unit needs for num_vecs plus padding. Sets
+ * last_chunk_partial if the last chunk isn't full.
+ *
+ */
+uint32_t calc_num_vec_chunks(uint32_t num_vecs, bool *last_chunk_partial){
+    uint64_t vecs_size = 0;
+    uint32_t num_vec_chunks = 0;
+    bool is_partial = false;
+
+    vecs_size = ((uint64_t)num_vecs+(uint64_t)calc_num_padding_vecs(num_vecs))*(uint64_t)STIM_VEC_SIZE;
+
+    if(vecs_size > STIM_CHUNK_SIZE){
+        num_vec_chunks = (uint32_t)(vecs_size / STIM_CHUNK_SIZE);
+        if(vecs_size % STIM_CHUNK_SIZE != 0){
+            num_vec_chunks++;
+            is_partial = true;
+        }
+    }else if (vecs_size <= STIM_CHUNK_SIZE){
+        num_vec_chunks = 1;
+        is_partial = true;
+    }
+
+    if(last_chunk_partial != NULL){
+        *last_chunk_partial = is_partial;
+    }
+    return num_vec_chunks;
+}
+
 /*
  * Allocate a new stim object. Note that it is not initialized yet.
  *
@@ -386,6 +416,10 @@ struct stim *create_stim(){
     // will get set there.  
     // 
     stim->dots = NULL;
+    stim->owns_dots = false;
+
+    // set by get_lazy_stim_by_path until stim_load_lazy
+    stim->is_lazy = false;
 
     return stim;
 }
@@ -450,10 +484,10 @@ struct stim *init_stim(struct stim *stim, struct profile_pin **pins, uint32_t nu
         die("error: failed to calloc profile pins");
     }
 
-    // Copy pins to stim. Freeing the pins passed in is not our responsibility.
+    // Retain pins for the stim. Releasing the pins passed in is not our responsibility.
     for(uint32_t i=0, j=0; i<stim->num_pins; i++){
         if(pins[i]->dut_io_id >= 0){
-            stim->pins[j++] = create_profile_pin_from_pin(pins[i]);
+            stim->pins[j++] = retain_profile_pin(pins[i]);
         }else{
             die("error: failed to init stim, pin '%s' doesn't"
                 "have a valid dut_io_id", pins[i]->net_name);
@@ -471,17 +505,7 @@ struct stim *init_stim(struct stim *stim, struct profile_pin **pins, uint32_t nu
     uint64_t vecs_size = ((uint64_t)stim->num_vecs+(uint64_t)stim->num_padding_vecs)*(uint64_t)STIM_VEC_SIZE;
 
     // calculate the number of chunks needed based on vecs_size
-    uint32_t num_vec_chunks = 0;
-    if(vecs_size > STIM_CHUNK_SIZE){
-        num_vec_chunks = (uint32_t)(vecs_size / STIM_CHUNK_SIZE);
-        if(vecs_size % STIM_CHUNK_SIZE != 0){
-            num_vec_chunks++;
-            last_chunk_partial = true;
-        }
-    }else if (vecs_size <= STIM_CHUNK_SIZE){
-        num_vec_chunks = 1;
-        last_chunk_partial = true;
-    }
+    uint32_t num_vec_chunks = calc_num_vec_chunks(stim->num_vecs, &last_chunk_partial);
 
     // if stim is for both a1 and a2 then when need to double the number
     if(artix_select == ARTIX_SELECT_A1){
@@ -563,6 +587,8 @@ struct vec_chunk *stim_load_next_chunk(struct stim *stim, enum artix_selects art
     if(stim == NULL){
         die("error: failed to load vec chunk, pointer is NULL");
     }
+
+    stim_load_lazy(stim);
     
     if(stim->type == STIM_TYPE_NONE){
         die("error: failed to load vec chunk, stim type is none");
@@ -702,6 +728,7 @@ struct vec_chunk *stim_fill_chunk(struct stim *stim, struct vec_chunk *chunk){
     bool is_first_chunk = false;
     bool is_last_chunk = false;
     char a1_or_a2_str[5] = "none";
+    uint64_t perf_start = perf_begin();
 
     if(stim == NULL){
         die("pointer is NULL");
@@ -820,6 +847,7 @@ struct vec_chunk *stim_fill_chunk(struct stim *stim, struct vec_chunk *chunk){
         die("invalid stim type");
     }
 
+    perf_end(PERF_CHUNK_FILL, perf_start);
     return chunk;
 }
 
@@ -1039,89 +1067,63 @@ enum stim_types get_stim_type_by_path(const char *path){
 
 
 /*
- * Creates a new stim object, mmap the file, and save handles to stim.
- * Path can be a dots, rbt, bin, bit or a raw stim file. Calculates
- * number of vectors and chunks needed based on the file type given.
- *
+ * Opens and mmaps the stim's file and saves the handles to the stim.
  *
  */
-struct stim *get_stim_by_path(struct profile *profile, const char *path){
-    struct stim * stim = NULL;
+static void stim_open_file(struct stim *stim){
     int fd;
     FILE *fp = NULL;
     off_t file_size = 0;
-    off_t bitstream_size = 0;
-    uint32_t num_pins = 0;
-    struct profile_pin **pins = NULL;
-    uint32_t num_vecs = 0;
-    uint64_t num_unrolled_vecs = 0;
-    char buffer[BUFFER_LENGTH];
-    char *real_path = NULL;
-    struct dots *dots = NULL;
-
-    if(profile == NULL){
-        die("pointer is NULL");
-    }
 
-    if(path == NULL){
-        die("pointer is NULL");
+    if(util_fopen(stim->path, &fd, &fp, &file_size)){
+        die("error: failed to open file '%s'", stim->path);
     }
 
-    enum stim_types stim_type = get_stim_type_by_path(path); 
+    // Save file handle data to stim so we can load chunks as needed.
+    // The cur_map_byte is where we are currently reading from. The
+    // start_map_byte is the location after some header is read where
+    // we can reset to and restart reading from without initializing.
+    stim->is_open = true;
+    stim->fd = fd;
+    stim->fp = fp;
+    stim->file_size = file_size;
+    stim->map = (uint8_t*)mmap(NULL, (size_t)file_size, PROT_READ, MAP_SHARED, fd, 0); 
+    stim->cur_map_byte = 0;
+    stim->start_map_byte = 0;
 
-    if(stim_type == STIM_TYPE_NONE){
-        const char *file_ext = util_get_file_ext_by_path(path);
-        die("error: invalid file type given '%s'", file_ext);
+    if(stim->map == MAP_FAILED){
+        close(stim->fd);
+        die("error: failed to map file");
     }
+    return;
+}
 
-    // only create a stim if not dots, since for dots the parser
-    // returns a dots which we use to create a stim
-    if(stim_type == STIM_TYPE_RBT || stim_type == STIM_TYPE_BIN 
-            || stim_type == STIM_TYPE_BIT || stim_type == STIM_TYPE_RAW){
-        if((stim = create_stim()) == NULL){
-            die("error: pointer is NULL");
-        }
-
-        stim->type = stim_type;
-        stim->profile = profile;
-
-        if(util_fopen(path, &fd, &fp, &file_size)){
-            die("error: failed to open file '%s'", path);
-        }
-
-        if((real_path = realpath(path, NULL)) == NULL){
-            die("invalid stim path '%s'", path);
-        }
-
-        // legit path so save it
-        stim->path = strdup(real_path);
-
-        // Save file handle data to stim so we can load chunks as needed.
-        // The cur_map_byte is where we are currently reading from. The
-        // start_map_byte is the location after some header is read where
-        // we can reset to and restart reading from without initializing.
-        stim->is_open = true;
-        stim->fd = fd;
-        stim->fp = fp;
-        stim->file_size = file_size;
-        stim->map = (uint8_t*)mmap(NULL, (size_t)file_size, PROT_READ, MAP_SHARED, fd, 0); 
-        stim->cur_map_byte = 0;
-        stim->start_map_byte = 0;
-
-        if(stim->map == MAP_FAILED){
-            close(stim->fd);
-            die("error: failed to map file");
+static void stim_close_file(struct stim *stim){
+    if(stim->is_open == true){
+        if(munmap(stim->map, (size_t)(stim->file_size)) == -1){
+            die("error: failed to munmap file");
         }
-    }else if(stim_type == STIM_TYPE_DOTS){
-        dots = parse_dots(profile, (char *)path);
-        stim = get_stim_by_dots(profile, dots);
-
-        stim->path = strdup(path);
+        fclose(stim->fp);
+        close(stim->fd);
     }
+    stim->is_open = false;
+    stim->fd = 0;
+    stim->fp = NULL;
+    stim->map = NULL;
+    stim->cur_map_byte = 0;
+    stim->start_map_byte = 0;
+    return;
+}
 
-    if(stim == NULL){
-        die("pointer is null");
-    }
+/*
+ * Finds the endianness of a bitstream and reads its header. Leaves the
+ * map at the start of the bitstream and returns its size in bytes, or 
+ * zero if the stim isn't a bitstream.
+ *
+ */
+static off_t stim_read_header(struct stim *stim){
+    off_t bitstream_size = 0;
+    char buffer[BUFFER_LENGTH];
 
     // Find the endianness of the bitstream
     if(stim->type == STIM_TYPE_RBT){
@@ -1145,7 +1147,7 @@ struct stim *get_stim_by_path(struct profile *profile, const char *path){
             }
         }
         if(!found){
-            die("invalid bitstream '%s'; failed to find sync word", path);
+            die("invalid bitstream '%s'; failed to find sync word", stim->path);
         }else{
             stim->cur_map_byte = 0;
             stim->start_map_byte = 0;
@@ -1157,7 +1159,7 @@ struct stim *get_stim_by_path(struct profile *profile, const char *path){
         int32_t c = 0;
         uint32_t line = 0;
         uint32_t count = 0;
-        while(stim->cur_map_byte < file_size){
+        while(stim->cur_map_byte < stim->file_size){
             if(stim->map[stim->cur_map_byte+count] == '\n'){
                 if(count > BUFFER_LENGTH){
                     die("buffer overflow; gross");
@@ -1189,7 +1191,7 @@ struct stim *get_stim_by_path(struct profile *profile, const char *path){
 
     // bin bitstream size is exactly the file size since no header
     }else if(stim->type == STIM_TYPE_BIN){
-        bitstream_size = file_size;
+        bitstream_size = stim->file_size;
     // read bit header and get number of bits
     } else if(stim->type == STIM_TYPE_BIT){
         uint8_t byte = 0;
@@ -1254,12 +1256,89 @@ struct stim *get_stim_by_path(struct profile *profile, const char *path){
         stim->start_map_byte = stim->cur_map_byte;
     }
 
-    // initialize
+    return bitstream_size;
+}
+
+/*
+ * Returns the config pins a bitstream stim is run on, along with the
+ * number of vecs and unrolled vecs it takes to configure with it.
+ *
+ */
+static struct profile_pin **get_bitstream_stim_pins(struct stim *stim, 
+        off_t bitstream_size, uint32_t *num_pins, uint32_t *num_vecs, 
+        uint64_t *num_unrolled_vecs){
+    struct profile_pin **pins = NULL;
     int32_t dut_id = -1;
     uint32_t num_file_vecs = 0;
     uint32_t num_body_vecs = 0;
     uint64_t num_unrolled_body_vecs = 0;
 
+    if(bitstream_size == 0){
+        die("failed to get bitstream size; size is zero");
+    }
+
+    // TODO: dut_id = -1 filters by all duts. Which only works if there is one dut.
+    //       Pass the correct dut_id when supported multiple-duts.
+    dut_id = -1;
+    if((pins = get_config_profile_pins(stim->profile, dut_id, num_pins)) == NULL){
+        die("error: failed to get profile config pins");
+    }
+
+    // Check if the config vecs exceeds the size of a chunk since the code is not
+    // designed to handle that. We control the size of these in config.c but add
+    // a check just in case.
+    if((get_config_num_vecs_by_type(CONFIG_TYPE_HEADER)*STIM_VEC_SIZE) > STIM_CHUNK_SIZE){
+        die("config header size cannot exceed a chunk size %i", STIM_CHUNK_SIZE);
+    }
+
+    if((get_config_num_vecs_by_type(CONFIG_TYPE_BODY)*STIM_VEC_SIZE) > STIM_CHUNK_SIZE){
+        die("config body size cannot exceed a chunk size %i", STIM_CHUNK_SIZE);
+    }
+
+    if((get_config_num_vecs_by_type(CONFIG_TYPE_FOOTER)*STIM_VEC_SIZE) > STIM_CHUNK_SIZE){
+        die("config footer size cannot exceed a chunk size %i", STIM_CHUNK_SIZE);
+    }
+    
+    // need to prep fpga for rbt and need to do post config checks
+    *num_vecs = 0;
+    *num_vecs += get_config_num_vecs_by_type(CONFIG_TYPE_HEADER);
+    *num_vecs += get_config_num_vecs_by_type(CONFIG_TYPE_FOOTER);
+
+    // get num taking into account repeat value and clocking (double)
+    *num_unrolled_vecs = 0;
+    *num_unrolled_vecs += get_config_unrolled_num_vecs_by_type(CONFIG_TYPE_HEADER);
+    *num_unrolled_vecs += get_config_unrolled_num_vecs_by_type(CONFIG_TYPE_FOOTER);
+
+    // bin files have no header, it's just raw words ready to use.
+    num_file_vecs = (uint32_t)(bitstream_size/sizeof(uint32_t));
+    if(bitstream_size % sizeof(uint32_t) != 0){
+        die("error: bitstream given '%s' is not 32 bit word aligned", stim->path);
+    }
+    num_body_vecs = num_file_vecs*get_config_num_vecs_by_type(CONFIG_TYPE_BODY);
+    *num_vecs += num_body_vecs; 
+
+    num_unrolled_body_vecs = ((uint64_t)num_file_vecs)*get_config_unrolled_num_vecs_by_type(CONFIG_TYPE_BODY);
+    *num_unrolled_vecs += num_unrolled_body_vecs;
+
+    // must get the profile pins from the particular file we're loading
+    if(pins == NULL || *num_pins == 0){
+        die("failed to get_stim_by_path; no pins were set");
+    }
+
+    return pins;
+}
+
+/*
+ * Builds the pins and chunks of a stim whose file is open and whose
+ * header has been read.
+ *
+ */
+static struct stim *stim_build(struct stim *stim, off_t bitstream_size){
+    uint32_t num_pins = 0;
+    struct profile_pin **pins = NULL;
+    uint32_t num_vecs = 0;
+    uint64_t num_unrolled_vecs = 0;
+
     // get the pins, num_pins and num_vecs for each file type
     switch(stim->type){
         case STIM_TYPE_NONE:
@@ -1268,60 +1347,14 @@ struct stim *get_stim_by_path(struct profile *profile, const char *path){
         case STIM_TYPE_RBT:
         case STIM_TYPE_BIN:
         case STIM_TYPE_BIT:
-            if(bitstream_size == 0){
-                die("failed to get bitstream size; size is zero");
-            }
-
-            // TODO: dut_id = -1 filters by all duts. Which only works if there is one dut.
-            //       Pass the correct dut_id when supported multiple-duts.
-            dut_id = -1;
-            if((pins = get_config_profile_pins(stim->profile, dut_id, &num_pins)) == NULL){
-                die("error: failed to get profile config pins");
-            }
-
-            // Check if the config vecs exceeds the size of a chunk since the code is not
-            // designed to handle that. We control the size of these in config.c but add
-            // a check just in case.
-            if((get_config_num_vecs_by_type(CONFIG_TYPE_HEADER)*STIM_VEC_SIZE) > STIM_CHUNK_SIZE){
-                die("config header size cannot exceed a chunk size %i", STIM_CHUNK_SIZE);
-            }
-
-            if((get_config_num_vecs_by_type(CONFIG_TYPE_BODY)*STIM_VEC_SIZE) > STIM_CHUNK_SIZE){
-                die("config body size cannot exceed a chunk size %i", STIM_CHUNK_SIZE);
-            }
-
-            if((get_config_num_vecs_by_type(CONFIG_TYPE_FOOTER)*STIM_VEC_SIZE) > STIM_CHUNK_SIZE){
-                die("config footer size cannot exceed a chunk size %i", STIM_CHUNK_SIZE);
-            }
-            
-            // need to prep fpga for rbt and need to do post config checks
-            num_vecs += get_config_num_vecs_by_type(CONFIG_TYPE_HEADER);
-            num_vecs += get_config_num_vecs_by_type(CONFIG_TYPE_FOOTER);
-
-            // get num taking into account repeat value and clocking (double)
-            num_unrolled_vecs += get_config_unrolled_num_vecs_by_type(CONFIG_TYPE_HEADER);
-            num_unrolled_vecs += get_config_unrolled_num_vecs_by_type(CONFIG_TYPE_FOOTER);
-
-            // bin files have no header, it's just raw words ready to use.
-            num_file_vecs = (uint32_t)(bitstream_size/sizeof(uint32_t));
-            if(bitstream_size % sizeof(uint32_t) != 0){
-                die("error: bitstream given '%s' is not 32 bit word aligned", path);
-            }
-            num_body_vecs = num_file_vecs*get_config_num_vecs_by_type(CONFIG_TYPE_BODY);
-            num_vecs += num_body_vecs; 
-
-            num_unrolled_body_vecs = ((uint64_t)num_file_vecs)*get_config_unrolled_num_vecs_by_type(CONFIG_TYPE_BODY);
-            num_unrolled_vecs += num_unrolled_body_vecs;
-
-            // must get the profile pins from the particular file we're loading
-            if(pins == NULL || num_pins == 0){
-                die("failed to get_stim_by_path; no pins were set");
-            }
+            pins = get_bitstream_stim_pins(stim, bitstream_size, 
+                &num_pins, &num_vecs, &num_unrolled_vecs);
 
             // initialize the stim with the pins and vec from the parsed file
             if((stim = init_stim(stim, pins, num_pins, num_vecs, num_unrolled_vecs)) == NULL){
                 die("error: pointer is NULL");
             }
+            pins = free_profile_pins(pins, num_pins);
             break;
         case STIM_TYPE_RAW:
             if((stim = stim_deserialize(stim)) == NULL){
@@ -1338,6 +1371,208 @@ struct stim *get_stim_by_path(struct profile *profile, const char *path){
     return stim;
 }
 
+/*
+ * Creates a stim for a rbt, bin, bit or raw stim file without opening 
+ * it yet.
+ *
+ */
+static struct stim *create_stim_by_path(struct profile *profile, 
+        const char *path, enum stim_types stim_type){
+    struct stim *stim = NULL;
+    char *real_path = NULL;
+
+    if((stim = create_stim()) == NULL){
+        die("error: pointer is NULL");
+    }
+
+    stim->type = stim_type;
+    stim->profile = retain_profile(profile);
+
+    if((real_path = realpath(path, NULL)) == NULL){
+        die("invalid stim path '%s'", path);
+    }
+
+    // legit path so save it
+    stim->path = strdup(real_path);
+    free(real_path);
+
+    return stim;
+}
+
+/*
+ * Creates a new stim object, mmap the file, and save handles to stim.
+ * Path can be a dots, rbt, bin, bit or a raw stim file. Calculates
+ * number of vectors and chunks needed based on the file type given.
+ *
+ *
+ */
+struct stim *get_stim_by_path(struct profile *profile, const char *path){
+    struct stim * stim = NULL;
+    off_t bitstream_size = 0;
+    struct dots *dots = NULL;
+
+    if(profile == NULL){
+        die("pointer is NULL");
+    }
+
+    if(path == NULL){
+        die("pointer is NULL");
+    }
+
+    enum stim_types stim_type = get_stim_type_by_path(path); 
+
+    if(stim_type == STIM_TYPE_NONE){
+        const char *file_ext = util_get_file_ext_by_path(path);
+        die("error: invalid file type given '%s'", file_ext);
+    }
+
+    // only create a stim if not dots, since for dots the parser
+    // returns a dots which we use to create a stim
+    if(stim_type == STIM_TYPE_RBT || stim_type == STIM_TYPE_BIN 
+            || stim_type == STIM_TYPE_BIT || stim_type == STIM_TYPE_RAW){
+        stim = create_stim_by_path(profile, path, stim_type);
+        stim_open_file(stim);
+        bitstream_size = stim_read_header(stim);
+    }else if(stim_type == STIM_TYPE_DOTS){
+        dots = parse_dots(profile, (char *)path);
+        stim = get_stim_by_dots(profile, dots);
+
+        // parsed here, so the stim must free it
+        stim->owns_dots = true;
+        stim->path = strdup(path);
+    }
+
+    if(stim == NULL){
+        die("pointer is null");
+    }
+
+    return stim_build(stim, bitstream_size);
+}
+
+/*
+ * Reads only the counts from a raw stim's root struct. The pins and
+ * chunks it points to aren't touched.
+ *
+ */
+static void stim_read_serial_header(struct stim *stim){
+    struct capn capn;
+    SerialStim_ptr serialStim_ptr; 
+    struct SerialStim serialStim;
+
+    if(capn_init_mem(&capn, stim->map, stim->file_size, 0 /* packed */) != 0){
+        die("cap init mem failed");
+    }
+
+    serialStim_ptr.p = capn_getp(capn_root(&capn), 
+            0 /* off */, 1 /* resolve */);
+    read_SerialStim(&serialStim, serialStim_ptr);
+
+    stim->num_pins = serialStim.numPins;
+    stim->num_vecs = serialStim.numVecs;
+    stim->num_unrolled_vecs = serialStim.numUnrolledVecs;
+    stim->num_padding_vecs = serialStim.numPaddingVecs;
+    stim->num_a1_vec_chunks = serialStim.numA1VecChunks;
+    stim->num_a2_vec_chunks = serialStim.numA2VecChunks;
+
+    capn_free(&capn);
+    return;
+}
+
+/*
+ * Same as get_stim_by_path but only reads the header of the file. The
+ * stim has its path, type, pin, vec and chunk counts, so its mode is
+ * known, but no pins or chunks and no open file until stim_load_lazy
+ * is called. The stim funcs that need them call it for you.
+ *
+ * Dots files have to be parsed to know anything, so they're loaded
+ * right away.
+ *
+ */
+struct stim *get_lazy_stim_by_path(struct profile *profile, const char *path){
+    struct stim * stim = NULL;
+    off_t bitstream_size = 0;
+    enum stim_types stim_type = STIM_TYPE_NONE;
+    enum artix_selects artix_select = ARTIX_SELECT_NONE;
+    struct profile_pin **pins = NULL;
+    uint32_t num_pins = 0;
+    uint32_t num_vecs = 0;
+    uint64_t num_unrolled_vecs = 0;
+    uint32_t num_vec_chunks = 0;
+
+    if(profile == NULL){
+        die("pointer is NULL");
+    }
+
+    if(path == NULL){
+        die("pointer is NULL");
+    }
+
+    stim_type = get_stim_type_by_path(path); 
+    if(stim_type != STIM_TYPE_RBT && stim_type != STIM_TYPE_BIN 
+            && stim_type != STIM_TYPE_BIT && stim_type != STIM_TYPE_RAW){
+        return get_stim_by_path(profile, path);
+    }
+
+    stim = create_stim_by_path(profile, path, stim_type);
+    stim_open_file(stim);
+    bitstream_size = stim_read_header(stim);
+
+    if(stim_type == STIM_TYPE_RAW){
+        stim_read_serial_header(stim);
+    }else{
+        pins = get_bitstream_stim_pins(stim, bitstream_size, 
+            &num_pins, &num_vecs, &num_unrolled_vecs);
+        artix_select = get_artix_select_by_profile_pins(pins, num_pins);
+        pins = free_profile_pins(pins, num_pins);
+
+        stim->num_pins = num_pins;
+        stim->num_vecs = num_vecs;
+        stim->num_unrolled_vecs = num_unrolled_vecs;
+        stim->num_padding_vecs = calc_num_padding_vecs(num_vecs);
+        num_vec_chunks = calc_num_vec_chunks(num_vecs, NULL);
+        if(artix_select & ARTIX_SELECT_A1){
+            stim->num_a1_vec_chunks = num_vec_chunks;
+        }
+        if(artix_select & ARTIX_SELECT_A2){
+            stim->num_a2_vec_chunks = num_vec_chunks;
+        }
+    }
+
+    stim_close_file(stim);
+    stim->is_lazy = true;
+
+    return stim;
+}
+
+/*
+ * Maps the file of a stim from get_lazy_stim_by_path and builds its 
+ * pins and chunks. Does nothing if the stim is already loaded.
+ *
+ */
+struct stim *stim_load_lazy(struct stim *stim){
+    off_t bitstream_size = 0;
+
+    if(stim == NULL){
+        die("pointer is NULL");
+    }
+
+    if(!stim->is_lazy){
+        return stim;
+    }
+
+    slog_debug("loading lazy stim '%s'", stim->path);
+
+    // init_stim and stim_deserialize fill these in again
+    stim->num_a1_vec_chunks = 0;
+    stim->num_a2_vec_chunks = 0;
+
+    stim_open_file(stim);
+    bitstream_size = stim_read_header(stim);
+    stim->is_lazy = false;
+
+    return stim_build(stim, bitstream_size);
+}
+
 /*
  * Returns a stim from a dots object.
  *
@@ -1385,7 +1620,7 @@ struct stim *get_stim_by_dots(struct profile *profile, struct dots *dots){
         die("pointer is NULL");
     }
 
-    stim->profile = profile;
+    stim->profile = retain_profile(profile);
     stim->type = STIM_TYPE_DOTS;
     stim->dots = dots;
 
@@ -1444,27 +1679,34 @@ struct stim *free_stim(struct stim *stim){
         die("pointer is NULL");
     }
 
-    if(stim->pins == NULL){
-        die("pointer is NULL");
-    }
+    // a lazy stim only has counts, the pins and chunks were never built
+    if(stim->is_lazy){
+        stim->num_pins = 0;
+        stim->num_a1_vec_chunks = 0;
+        stim->num_a2_vec_chunks = 0;
+    }else{
+        if(stim->pins == NULL){
+            die("pointer is NULL");
+        }
 
-    if(stim->num_a1_vec_chunks > 0 && stim->a1_vec_chunks == NULL){
-        die("num_a1_vec_chunks is %i but a1_vec_chunks is NULL", stim->num_a1_vec_chunks);
-    }
+        if(stim->num_a1_vec_chunks > 0 && stim->a1_vec_chunks == NULL){
+            die("num_a1_vec_chunks is %i but a1_vec_chunks is NULL", stim->num_a1_vec_chunks);
+        }
 
-    if(stim->num_a2_vec_chunks > 0 && stim->a2_vec_chunks == NULL){
-        die("num_a2_vec_chunks is %i but a2_vec_chunks is NULL", stim->num_a2_vec_chunks);
-    }
+        if(stim->num_a2_vec_chunks > 0 && stim->a2_vec_chunks == NULL){
+            die("num_a2_vec_chunks is %i but a2_vec_chunks is NULL", stim->num_a2_vec_chunks);
+        }
 
-    if(stim->num_pins > 0 && stim->pins == NULL){
-        die("num_pins is %i but pins is NULL", stim->num_pins);
+        if(stim->num_pins > 0 && stim->pins == NULL){
+            die("num_pins is %i but pins is NULL", stim->num_pins);
+        }
     }
 
     if(stim->path != NULL){
         free(stim->path);
     }
 
-    // free pins
+    // release pins
     for(uint32_t i=0; i<stim->num_pins; i++){
         stim->pins[i] = free_profile_pin(stim->pins[i]);
     }
@@ -1506,12 +1748,16 @@ struct stim *free_stim(struct stim *stim){
     stim->start_map_byte = 0;
     stim->is_little_endian = true;
 
-    // Don't free dots here. It was passed externally by get_stim_by_dots so
-    // it's not our responsibility.
+    // Only free dots parsed by get_stim_by_path. Dots passed to
+    // get_stim_by_dots are not our responsibility.
+    if(stim->owns_dots && stim->dots != NULL){
+        stim->dots = free_dots(stim->dots);
+    }
     stim->dots = NULL;
+    stim->owns_dots = false;
 
-    free_profile(stim->profile);
-    stim->profile = NULL;
+    // drops the reference taken when the stim was created
+    stim->profile = free_profile(stim->profile);
 
     free(stim);
     return NULL;
@@ -1553,6 +1799,7 @@ static size_t stim_serialize_chunk(struct stim *stim, enum artix_selects artix_s
             .vecDataSize = (uint32_t)chunk->vec_data_size,
         };
 
+        uint64_t perf_start = perf_begin();
         int max_dst_size = LZ4_compressBound(chunk->vec_data_size);
         if((compressed_data = (uint8_t*)malloc(max_dst_size)) == NULL){
             die("failed to malloc");
@@ -1567,6 +1814,7 @@ static size_t stim_serialize_chunk(struct stim *stim, enum artix_selects artix_s
                 compressed_data_size)) == NULL){
             die("re-alloc failed");
         }
+        perf_end(PERF_COMPRESS, perf_start);
 
         if(artix_select == ARTIX_SELECT_A1){
             slog_info("compressed a1 chunk %i by %zu bytes", chunk->id, 
@@ -1612,6 +1860,8 @@ void stim_serialize_to_path(struct stim *stim, const char *path){
         die("pointer is NULL");
     }
 
+    stim_load_lazy(stim);
+
     int fd = 0;
     struct capn c;
     capn_init_malloc(&c);
@@ -1907,8 +2157,10 @@ struct vec_chunk *stim_decompress_vec_chunk(struct vec_chunk *chunk){
         die("failed to decompress chunk; compress size is 0");
     }
 
+    uint64_t perf_start = perf_begin();
     int decompressed_size = LZ4_decompress_safe((char*)chunk->vec_data_compressed,
             (char*)chunk->vec_data, chunk->vec_data_compressed_size, chunk->vec_data_size);
+    perf_end(PERF_DECOMPRESS, perf_start);
 
     slog_info("decompressed chunk %i (%zu bytes -> %zu bytes)", chunk->id, 
             chunk->vec_data_compressed_size, chunk->vec_data_size);
@@ -1927,6 +2179,18 @@ struct vec_chunk *stim_decompress_vec_chunk(struct vec_chunk *chunk){
  *
  */
 uint8_t *stim_get_enable_pins_data(struct stim *stim, enum artix_selects artix_select){
+    return stim_get_dut_enable_pins_data(stim, artix_select, -1, NULL);
+}
+
+/*
+ * Same as stim_get_enable_pins_data but only enables the pins wired to
+ * dut_id, or all pins if dut_id is -1. If num_enabled_pins is given it's
+ * set to the number of pins enabled in the burst.
+ *
+ */
+uint8_t *stim_get_dut_enable_pins_data(struct stim *stim, 
+        enum artix_selects artix_select, int32_t dut_id, 
+        uint32_t *num_enabled_pins){
     uint32_t range_low = 0;
     uint32_t range_high = 0;
     struct profile_pin *pin = NULL;
@@ -1935,6 +2199,12 @@ uint8_t *stim_get_enable_pins_data(struct stim *stim, enum artix_selects artix_s
         die("pointer is NULL");
     }
 
+    stim_load_lazy(stim);
+
+    if(num_enabled_pins != NULL){
+        (*num_enabled_pins) = 0;
+    }
+
     if(artix_select == ARTIX_SELECT_NONE){
         die("no artix unit selected");
     }
@@ -1970,15 +2240,21 @@ uint8_t *stim_get_enable_pins_data(struct stim *stim, enum artix_selects artix_s
             continue;
         }
 
+        // skip past pins that don't go to the dut
+        if(!is_profile_pin_on_dut(pin, dut_id)){
+            continue;
+        }
+
         // clamp the id from 0 to 200 since we're only writing to one
         // dut at a time and so packed_subvecs will always be len of 200
         uint8_t dut_io_id = (uint8_t)(pin->dut_io_id % DUT_NUM_PINS);
 
         enable_pins[dut_io_id] = 0x00;
+        if(num_enabled_pins != NULL){
+            (*num_enabled_pins) += 1;
+        }
 
-#ifdef GEM_DEBUG
         slog_debug( "%s : %i", pin->net_alias, dut_io_id);
-#endif
     }
 
     // Note: no need to swap the endianess of enable_pins because of the
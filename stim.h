@@ -156,6 +156,8 @@ struct stim {
     bool is_little_endian;
     struct profile *profile;
     struct dots *dots;
+    bool owns_dots;
+    bool is_lazy;
 };
 
 
@@ -169,6 +171,11 @@ struct stim {
 // load an rbt, bin, bit or raw stim. Actual dots file not supported yet.
 struct stim *get_stim_by_path(struct profile *profile, const char *path);
 
+// Same but only reads the file header. Pins and chunks are built by
+// stim_load_lazy, which the funcs needing them call on first use.
+struct stim *get_lazy_stim_by_path(struct profile *profile, const char *path);
+struct stim *stim_load_lazy(struct stim *stim);
+
 // Load a dots object. Must be fully populated with vectors but not expanded. 
 struct stim *get_stim_by_dots(struct profile *profile, struct dots *dots);
 
@@ -181,6 +188,10 @@ void stim_serialize_to_path(struct stim *stim, const char *path);
 
 // get enable_pins array for gvpu TEST_SETUP
 uint8_t *stim_get_enable_pins_data(struct stim *stim, enum artix_selects artix_select);
+// get enable_pins array with only the pins of one dut, -1 for all duts
+uint8_t *stim_get_dut_enable_pins_data(struct stim *stim, 
+    enum artix_selects artix_select, int32_t dut_id, 
+    uint32_t *num_enabled_pins);
 
 // none is empty stim, A1 or A2 is solo mode, dual is running on both units
 enum stim_modes stim_get_mode(struct stim *stim);
@@ -206,6 +217,7 @@ enum subvecs *convert_bitstream_word_to_subvecs(uint32_t *word,
     uint32_t *num_subvecs);
 uint32_t stim_get_next_bitstream_word(struct stim *stim);
 uint32_t calc_num_padding_vecs(uint32_t num_vecs);
+uint32_t calc_num_vec_chunks(uint32_t num_vecs, bool *last_chunk_partial);
 
 struct stim *create_stim(void);
 struct vec_chunk **create_vec_chunks(uint32_t num_vec_chunks);
@@ -124,5 +124,27 @@ enum subvecs get_subvec_by_pin_id(uint8_t *packed_subvecs, uint32_t pin_id){
     return subvec;
 }
 
+/*
+ * Given a vector, returns the opcode and sets operand from the packed
+ * subvecs. Inverse of pack_subvecs_with_opcode_and_operand.
+ *
+ */
+enum subvec_opcode get_opcode_and_operand_by_subvecs(uint8_t *packed_subvecs, 
+        uint64_t *operand){
+    if(packed_subvecs == NULL){
+        die("error: pointer is null");
+    }
+    if(operand == NULL){
+        die("error: pointer is null");
+    }
+
+    // operand is at 100 stored as little endian
+    (*operand) = 0;
+    for(int i=7; i>=0; i--){
+        (*operand) = ((*operand) << 8) | packed_subvecs[100+i];
+    }
 
+    // opcode is at 127
+    return (enum subvec_opcode)packed_subvecs[STIM_VEC_SIZE-1];
+}
 
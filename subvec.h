@@ -54,6 +54,8 @@ void pack_subvecs_by_dut_io_id(uint8_t *packed_subvecs,
     uint32_t dut_io_id, enum subvecs subvec);
 void pack_subvecs_with_opcode_and_operand(uint8_t *packed_subvecs, 
     enum subvec_opcode opcode, uint64_t operand);
+enum subvec_opcode get_opcode_and_operand_by_subvecs(uint8_t *packed_subvecs, 
+    uint64_t *operand);
 
 
 #ifdef __cplusplus
@@ -0,0 +1,188 @@
+/*
+ * Runs prgms on many threads at once against a fake register backend.
+ *
+ * Each thread creates its own prgms and runs scripts that wait on the
+ * fake registers, some of which end in a script error. Every prgm must
+ * finish with its own result, and the board lock must keep the backend
+ * reads from overlapping.
+ *
+ * Copyright (c) 2015-2021 Gemini Complex Corporation. All rights reserved.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "libgcore.h"
+
+#define NUM_THREADS (8)
+#define NUM_PRGMS (25)
+#define NUM_WAITS (50)
+#define WAIT_TIMEOUT_US (1000000)
+
+// the fake unit status bit flips on every read
+#define FAKE_DONE_BIT (0x1)
+
+struct fake_regs {
+    uint64_t num_reads;
+    uint32_t num_in_read;
+    uint32_t num_overlaps;
+};
+
+struct worker {
+    pthread_t thread;
+    uint32_t num_waits;
+    uint32_t num_errors;
+};
+
+static struct fake_regs fake;
+static __thread struct worker *cur_worker = NULL;
+static uint32_t is_done = 0;
+
+/*
+ * Fake register backend. num_reads is written without atomics, so
+ * ThreadSanitizer also catches reads the board lock let through together.
+ *
+ */
+static void fake_read_regs(struct gcore_registers *regs, void *data){
+    struct fake_regs *fake_regs = (struct fake_regs*)data;
+
+    if(__atomic_add_fetch(&fake_regs->num_in_read, 1, __ATOMIC_ACQ_REL) != 1){
+        __atomic_add_fetch(&fake_regs->num_overlaps, 1, __ATOMIC_RELAXED);
+    }
+
+    // give another thread's read the chance to land in the middle
+    sched_yield();
+    fake_regs->num_reads++;
+    memset(regs, 0, sizeof(struct gcore_registers));
+    regs->a1_status = (u32)(fake_regs->num_reads & FAKE_DONE_BIT);
+    regs->a2_status = (u32)(~fake_regs->num_reads & FAKE_DONE_BIT);
+
+    __atomic_sub_fetch(&fake_regs->num_in_read, 1, __ATOMIC_ACQ_REL);
+    return;
+}
+
+static struct subcore_regs_backend fake_backend = {
+    .read_regs = fake_read_regs,
+    .data = &fake
+};
+
+static fe_Object* f_wait_regs(fe_Context *ctx, fe_Object *arg){
+    if(!subcore_wait_for_state(ARTIX_SELECT_A1, FAKE_DONE_BIT,
+            FAKE_DONE_BIT, WAIT_TIMEOUT_US)){
+        fe_error(ctx, "timed out waiting for a1");
+    }
+    if(!subcore_wait_for_state_change(ARTIX_SELECT_A2, FAKE_DONE_BIT,
+            FAKE_DONE_BIT, WAIT_TIMEOUT_US)){
+        fe_error(ctx, "timed out waiting for a2");
+    }
+    cur_worker->num_waits++;
+    return fe_bool(ctx, true);
+}
+
+static int run_script(struct prgm *prgm, const char *script, FILE *fp_err){
+    FILE *fp_in = NULL;
+    int ret = 0;
+
+    if((fp_in = fmemopen((void*)script, strlen(script), "r")) == NULL){
+        fprintf(stderr, "error: fmemopen failed\n");
+        exit(EXIT_FAILURE);
+    }
+    ret = prgm_repl(prgm, fp_in, fp_err, fp_err);
+    fclose(fp_in);
+    return ret;
+}
+
+static void *run_worker(void *data){
+    struct worker *worker = (struct worker*)data;
+    struct prgm *prgm = NULL;
+    FILE *fp_err = NULL;
+    char script[128];
+
+    cur_worker = worker;
+    if((fp_err = fopen("/dev/null", "w")) == NULL){
+        fprintf(stderr, "error: failed to open /dev/null\n");
+        exit(EXIT_FAILURE);
+    }
+
+    snprintf(script, sizeof(script),
+        "(= i 0) (while (< i %u) (wait-regs) (= i (+ i 1)))", NUM_WAITS);
+
+    for(uint32_t i=0; i<NUM_PRGMS; i++){
+        prgm = prgm_create();
+        fe_set(prgm->_fe_ctx, fe_symbol(prgm->_fe_ctx, "wait-regs"),
+            fe_cfunc(prgm->_fe_ctx, f_wait_regs));
+
+        if(run_script(prgm, script, fp_err) != EXIT_SUCCESS){
+            worker->num_errors++;
+        }
+        // the error only unwinds this prgm's repl and it can run again
+        if(run_script(prgm, "(wait-regs) (car 5) (wait-regs)", fp_err) != EXIT_FAILURE){
+            worker->num_errors++;
+        }
+        if(run_script(prgm, "(wait-regs)", fp_err) != EXIT_SUCCESS){
+            worker->num_errors++;
+        }
+        prgm_free(prgm);
+    }
+
+    fclose(fp_err);
+    return NULL;
+}
+
+/*
+ * Flips register coalescing while the prgms run, which drops the shared
+ * snapshot under them.
+ *
+ */
+static void *run_coalescer(void *data){
+    uint64_t window_ns = 0;
+
+    while(!__atomic_load_n(&is_done, __ATOMIC_ACQUIRE)){
+        window_ns = (window_ns == 0) ? 1000 : 0;
+        subcore_set_regs_coalesce_ns(window_ns);
+    }
+    subcore_set_regs_coalesce_ns(0);
+    return NULL;
+}
+
+int main(int argc, char *argv[]){
+    struct worker workers[NUM_THREADS];
+    pthread_t coalescer;
+    uint32_t num_waits = 0;
+    uint32_t num_errors = 0;
+    uint32_t expected_waits = NUM_THREADS*NUM_PRGMS*(NUM_WAITS+2);
+
+    memset(&fake, 0, sizeof(struct fake_regs));
+    memset(workers, 0, sizeof(workers));
+    subcore_set_regs_backend(&fake_backend);
+
+    pthread_create(&coalescer, NULL, run_coalescer, NULL);
+    for(uint32_t i=0; i<NUM_THREADS; i++){
+        pthread_create(&workers[i].thread, NULL, run_worker, &workers[i]);
+    }
+    for(uint32_t i=0; i<NUM_THREADS; i++){
+        pthread_join(workers[i].thread, NULL);
+        num_waits += workers[i].num_waits;
+        num_errors += workers[i].num_errors;
+    }
+    __atomic_store_n(&is_done, 1, __ATOMIC_RELEASE);
+    pthread_join(coalescer, NULL);
+
+    subcore_set_regs_backend(NULL);
+
+    printf("%u threads, %u prgms, %u waits, %u errors, %u overlapping reads\n",
+        NUM_THREADS, NUM_THREADS*NUM_PRGMS, num_waits, num_errors, fake.num_overlaps);
+
+    if(num_errors != 0 || num_waits != expected_waits || fake.num_overlaps != 0){
+        printf("FAIL\n");
+        return EXIT_FAILURE;
+    }
+    printf("PASS\n");
+    return EXIT_SUCCESS;
+}
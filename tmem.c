@@ -0,0 +1,390 @@
+/*
+ * Tester memory allocator
+ *
+ * Copyright (c) 2015-2021 Gemini Complex Corporation. All rights reserved.
+ *
+ */
+
+#include "common.h"
+#include "tmem.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <inttypes.h>
+
+
+static struct tmem_extent *create_tmem_extent(uint64_t addr, uint64_t size, 
+        bool is_free){
+    struct tmem_extent *extent = NULL;
+
+    if((extent = (struct tmem_extent*)calloc(1, sizeof(struct tmem_extent))) == NULL){
+        die("error: calloc failed");
+    }
+    extent->addr = addr;
+    extent->size = size;
+    extent->is_free = is_free;
+    extent->prev = NULL;
+    extent->next = NULL;
+
+    return extent;
+}
+
+static void free_tmem_extents(struct tmem_extent *extent){
+    struct tmem_extent *next = NULL;
+
+    while(extent != NULL){
+        next = extent->next;
+        free(extent);
+        extent = next;
+    }
+    return;
+}
+
+/*
+ * Tracks allocations in size bytes of tester memory starting at addr 0.
+ * Size must be burst aligned.
+ *
+ */
+struct tmem *create_tmem(uint64_t size){
+    struct tmem *tmem = NULL;
+
+    if(size == 0 || size % BURST_BYTES != 0){
+        die("tester memory size %" PRIu64 " must be burst aligned", size);
+    }
+
+    if((tmem = (struct tmem*)calloc(1, sizeof(struct tmem))) == NULL){
+        die("error: calloc failed");
+    }
+
+    tmem->size = size;
+    tmem->num_free_bytes = size;
+    tmem->num_allocs = 0;
+    tmem->_extents = create_tmem_extent(0, size, true);
+
+    return tmem;
+}
+
+struct tmem *free_tmem(struct tmem *tmem){
+    if(tmem == NULL){
+        return NULL;
+    }
+    free_tmem_extents(tmem->_extents);
+    free(tmem);
+    return NULL;
+}
+
+/*
+ * Size actually taken by an allocation of size bytes.
+ *
+ */
+uint64_t tmem_get_alloc_size(uint64_t size){
+    if(size % BURST_BYTES != 0){
+        size += BURST_BYTES-(size % BURST_BYTES);
+    }
+    return size;
+}
+
+/*
+ * Splits the free extent so the allocated part is [addr, addr+size).
+ *
+ */
+static void tmem_take(struct tmem *tmem, struct tmem_extent *extent, 
+        uint64_t addr, uint64_t size){
+    struct tmem_extent *head = NULL;
+    struct tmem_extent *tail = NULL;
+
+    if(!extent->is_free || addr < extent->addr 
+            || addr+size > extent->addr+extent->size){
+        die("tester memory extent can't fit allocation");
+    }
+
+    // free part before addr
+    if(addr > extent->addr){
+        head = create_tmem_extent(extent->addr, addr-extent->addr, true);
+        head->prev = extent->prev;
+        head->next = extent;
+        if(extent->prev != NULL){
+            extent->prev->next = head;
+        }else{
+            tmem->_extents = head;
+        }
+        extent->prev = head;
+    }
+
+    // free part after addr+size
+    if(addr+size < extent->addr+extent->size){
+        tail = create_tmem_extent(addr+size, (extent->addr+extent->size)-(addr+size), true);
+        tail->prev = extent;
+        tail->next = extent->next;
+        if(extent->next != NULL){
+            extent->next->prev = tail;
+        }
+        extent->next = tail;
+    }
+
+    extent->addr = addr;
+    extent->size = size;
+    extent->is_free = false;
+
+    tmem->num_free_bytes -= size;
+    tmem->num_allocs += 1;
+
+    return;
+}
+
+/*
+ * Allocates size bytes, rounded up to a burst, from the smallest free
+ * extent that fits. Returns false if none does. Memory may still have
+ * enough free bytes in total, see tmem_compact.
+ *
+ */
+bool tmem_alloc(struct tmem *tmem, uint64_t size, uint64_t *addr){
+    struct tmem_extent *extent = NULL;
+    struct tmem_extent *best = NULL;
+
+    if(tmem == NULL || addr == NULL){
+        die("pointer is NULL");
+    }
+    if(size == 0){
+        die("can't allocate zero bytes of tester memory");
+    }
+
+    size = tmem_get_alloc_size(size);
+
+    for(extent=tmem->_extents; extent!=NULL; extent=extent->next){
+        if(!extent->is_free || extent->size < size){
+            continue;
+        }
+        if(best == NULL || extent->size < best->size){
+            best = extent;
+        }
+    }
+
+    if(best == NULL){
+        return false;
+    }
+
+    (*addr) = best->addr;
+    tmem_take(tmem, best, best->addr, size);
+
+    return true;
+}
+
+/*
+ * Allocates size bytes, rounded up to a burst, at addr. Returns false 
+ * if addr isn't burst aligned, the allocation goes out of bounds or it
+ * overlaps another allocation.
+ *
+ */
+bool tmem_reserve(struct tmem *tmem, uint64_t addr, uint64_t size){
+    struct tmem_extent *extent = NULL;
+
+    if(tmem == NULL){
+        die("pointer is NULL");
+    }
+    if(size == 0){
+        die("can't allocate zero bytes of tester memory");
+    }
+
+    size = tmem_get_alloc_size(size);
+
+    if(addr % BURST_BYTES != 0){
+        return false;
+    }
+    if(addr >= tmem->size || size > tmem->size-addr){
+        return false;
+    }
+
+    for(extent=tmem->_extents; extent!=NULL; extent=extent->next){
+        if(addr >= extent->addr && addr < extent->addr+extent->size){
+            break;
+        }
+    }
+
+    if(extent == NULL || !extent->is_free 
+            || addr+size > extent->addr+extent->size){
+        return false;
+    }
+
+    tmem_take(tmem, extent, addr, size);
+
+    return true;
+}
+
+/*
+ * Frees the allocation starting at addr and coalesces it with free 
+ * neighbors. Returns false if no allocation starts at addr.
+ *
+ */
+bool tmem_release(struct tmem *tmem, uint64_t addr){
+    struct tmem_extent *extent = NULL;
+    struct tmem_extent *next = NULL;
+
+    if(tmem == NULL){
+        die("pointer is NULL");
+    }
+
+    for(extent=tmem->_extents; extent!=NULL; extent=extent->next){
+        if(extent->addr == addr){
+            break;
+        }
+        if(extent->addr > addr){
+            return false;
+        }
+    }
+
+    if(extent == NULL || extent->is_free){
+        return false;
+    }
+
+    extent->is_free = true;
+    tmem->num_free_bytes += extent->size;
+    tmem->num_allocs -= 1;
+
+    // merge into the previous free extent
+    if(extent->prev != NULL && extent->prev->is_free){
+        next = extent;
+        extent = extent->prev;
+        extent->size += next->size;
+        extent->next = next->next;
+        if(next->next != NULL){
+            next->next->prev = extent;
+        }
+        free(next);
+    }
+
+    // merge the next free extent in
+    if(extent->next != NULL && extent->next->is_free){
+        next = extent->next;
+        extent->size += next->size;
+        extent->next = next->next;
+        if(next->next != NULL){
+            next->next->prev = extent;
+        }
+        free(next);
+    }
+
+    return true;
+}
+
+/*
+ * Frees every allocation.
+ *
+ */
+void tmem_reset(struct tmem *tmem){
+    if(tmem == NULL){
+        die("pointer is NULL");
+    }
+    free_tmem_extents(tmem->_extents);
+    tmem->_extents = create_tmem_extent(0, tmem->size, true);
+    tmem->num_free_bytes = tmem->size;
+    tmem->num_allocs = 0;
+    return;
+}
+
+uint64_t tmem_get_largest_free(struct tmem *tmem){
+    struct tmem_extent *extent = NULL;
+    uint64_t largest = 0;
+
+    if(tmem == NULL){
+        die("pointer is NULL");
+    }
+
+    for(extent=tmem->_extents; extent!=NULL; extent=extent->next){
+        if(extent->is_free && extent->size > largest){
+            largest = extent->size;
+        }
+    }
+    return largest;
+}
+
+/*
+ * Slides every allocation down to the lowest free addr, keeping their 
+ * order, so all free memory ends up in one extent at the end. Only the
+ * bookkeeping changes, the caller has to move the data for each move 
+ * in the order given. Every move is to a lower addr so copying each
+ * one front to back is safe.
+ *
+ * Returns the number of moves. Free moves with free().
+ *
+ */
+uint32_t tmem_compact(struct tmem *tmem, struct tmem_move **moves){
+    struct tmem_extent *extent = NULL;
+    struct tmem_extent *next = NULL;
+    struct tmem_extent *last = NULL;
+    uint64_t next_addr = 0;
+    uint32_t num_moves = 0;
+
+    if(tmem == NULL || moves == NULL){
+        die("pointer is NULL");
+    }
+
+    (*moves) = NULL;
+    if(tmem->num_allocs > 0){
+        if(((*moves) = (struct tmem_move*)calloc(tmem->num_allocs, sizeof(struct tmem_move))) == NULL){
+            die("error: calloc failed");
+        }
+    }
+
+    // drop the free extents and pack the allocations down
+    extent = tmem->_extents;
+    tmem->_extents = NULL;
+    while(extent != NULL){
+        next = extent->next;
+        if(extent->is_free){
+            free(extent);
+            extent = next;
+            continue;
+        }
+
+        if(extent->addr != next_addr){
+            (*moves)[num_moves].old_addr = extent->addr;
+            (*moves)[num_moves].new_addr = next_addr;
+            (*moves)[num_moves].size = extent->size;
+            num_moves++;
+            extent->addr = next_addr;
+        }
+        next_addr += extent->size;
+
+        extent->prev = last;
+        extent->next = NULL;
+        if(last != NULL){
+            last->next = extent;
+        }else{
+            tmem->_extents = extent;
+        }
+        last = extent;
+        extent = next;
+    }
+
+    if(next_addr < tmem->size){
+        extent = create_tmem_extent(next_addr, tmem->size-next_addr, true);
+        extent->prev = last;
+        if(last != NULL){
+            last->next = extent;
+        }else{
+            tmem->_extents = extent;
+        }
+    }
+
+    return num_moves;
+}
+
+void tmem_print(struct tmem *tmem){
+    struct tmem_extent *extent = NULL;
+
+    if(tmem == NULL){
+        die("pointer is NULL");
+    }
+
+    printf("tester memory: %" PRIu64 " of %" PRIu64 " bytes free in %u allocations\n", 
+        tmem->num_free_bytes, tmem->size, tmem->num_allocs);
+    for(extent=tmem->_extents; extent!=NULL; extent=extent->next){
+        printf("  0x%016" PRIX64 " %12" PRIu64 " %s\n", 
+            extent->addr, extent->size, extent->is_free ? "free" : "used");
+    }
+    return;
+}
+
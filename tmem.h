@@ -0,0 +1,76 @@
+/*
+ * Tester memory allocator
+ *
+ * Copyright (c) 2015-2021 Gemini Complex Corporation. All rights reserved.
+ *
+ */
+
+#ifndef TMEM_H
+#define TMEM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * A run of tester memory, either free or holding one stim. Extents are
+ * burst aligned, kept in addr order and cover the whole memory with no
+ * gaps. Neighboring free extents are always coalesced.
+ *
+ */
+struct tmem_extent {
+    uint64_t addr;
+    uint64_t size;
+    bool is_free;
+    struct tmem_extent *prev;
+    struct tmem_extent *next;
+};
+
+/*
+ * Allocated extent that tmem_compact moved from old_addr to new_addr.
+ *
+ */
+struct tmem_move {
+    uint64_t old_addr;
+    uint64_t new_addr;
+    uint64_t size;
+};
+
+/*
+ * Tester memory of one artix unit.
+ *
+ */
+struct tmem {
+    // public
+    uint64_t size;
+    uint64_t num_free_bytes;
+    uint32_t num_allocs;
+
+    // private
+    struct tmem_extent *_extents;
+};
+
+struct tmem *create_tmem(uint64_t size);
+struct tmem *free_tmem(struct tmem *tmem);
+uint64_t tmem_get_alloc_size(uint64_t size);
+// best fit, returns false if no free extent is big enough
+bool tmem_alloc(struct tmem *tmem, uint64_t size, uint64_t *addr);
+// allocates at addr, returns false if out of bounds or it overlaps
+bool tmem_reserve(struct tmem *tmem, uint64_t addr, uint64_t size);
+// returns false if nothing is allocated at addr
+bool tmem_release(struct tmem *tmem, uint64_t addr);
+void tmem_reset(struct tmem *tmem);
+uint64_t tmem_get_largest_free(struct tmem *tmem);
+uint32_t tmem_compact(struct tmem *tmem, struct tmem_move **moves);
+void tmem_print(struct tmem *tmem);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
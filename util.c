@@ -89,6 +89,19 @@ error:
     return s;
 }
 
+/*
+ * Modification time of a stat in nanoseconds. Darwin names the field
+ * st_mtimespec.
+ *
+ */
+int64_t util_get_mtime_ns(struct stat *st){
+#if defined(__APPLE__)
+    return ((int64_t)st->st_mtimespec.tv_sec * 1000000000LL) + (int64_t)st->st_mtimespec.tv_nsec;
+#else
+    return ((int64_t)st->st_mtim.tv_sec * 1000000000LL) + (int64_t)st->st_mtim.tv_nsec;
+#endif
+}
+
 /*
  * Returns a malloced array of 64 bit values with size num_bytes.
  *
@@ -18,8 +18,10 @@ extern "C" {
 #include <stdio.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <sys/stat.h>
 
 int util_fopen(const char *file_path, int *fd, FILE **fp, off_t *file_size);
+int64_t util_get_mtime_ns(struct stat *st);
 uint64_t* util_get_rand_data(size_t num_bytes, uint32_t seed);
 uint64_t* util_get_static_data(size_t num_bytes, bool include_xor_data, bool clear_xor_results);
 uint64_t* util_get_inc_data(size_t num_bytes);